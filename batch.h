@@ -0,0 +1,254 @@
+// batch.h
+// Batch URL mode for the curl based tools.
+//
+// Reads a URL list (one per line, '#' comments allowed) from a file or
+// stdin and drives it through a single curl_multi handle with epoll socket
+// callbacks. At most max_in_flight transfers run at once; each finished
+// transfer is handed to the tool's view as its own record, and a failing
+// URL only affects its own record.
+#pragma once
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <curl/curl.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "dive.h"
+#include "results_store.h"
+
+struct BatchOptions {
+    std::string source = "-";    // URL list file, "-" for stdin
+    size_t max_in_flight = 256;  // concurrent transfers
+    ResultsWriter* results = nullptr;  // also append every result here
+};
+
+// Recognise "--batch <file|->" and "--parallel <n>" on the command line.
+// Returns true when batch mode was requested.
+inline bool parse_batch_args(int argc, char* argv[], BatchOptions& options) {
+    bool batch = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--batch") {
+            batch = true;
+            if (i + 1 < argc) options.source = argv[++i];
+        } else if (arg == "--parallel" && i + 1 < argc) {
+            long n = std::strtol(argv[++i], nullptr, 10);
+            if (n > 0) options.max_in_flight = static_cast<size_t>(n);
+        }
+    }
+    return batch;
+}
+
+inline void print_batch_usage(const char* tool) {
+    std::cerr << "       " << tool << " --batch <file|-> [--parallel N] [--results <file>] [--incremental <file>]\n";
+}
+
+// Record header printed before each URL's view output
+inline void print_batch_record(const DiveResult& r, std::ostream& out = std::cout) {
+    out << "[Batch] " << r.url << " -> ";
+    if (r.ok()) {
+        out << r.response_code;
+    } else {
+        out << "error: " << r.error();
+    }
+    out << " (" << std::fixed << std::setprecision(3) << r.total_time_us / 1e6 << "s)\n";
+    out.unsetf(std::ios::fixed);
+}
+
+class BatchRunner {
+public:
+    using ResultFn = std::function<void(const DiveResult&)>;
+
+    BatchRunner(const BatchOptions& options, const DiveOptions& dive_options, ResultFn on_result)
+        : options_(options), dive_options_(dive_options), on_result_(std::move(on_result)) {
+        // A blocking lookup would stall the whole event loop, so batch
+        // transfers only take addresses the shared cache already has
+        dive_options_.resolve_cache_only = true;
+    }
+
+    // Run the whole list. Returns the number of URLs that failed.
+    size_t run() {
+        raise_fd_limit();
+
+        std::ifstream file;
+        std::istream* in = &std::cin;
+        if (options_.source != "-") {
+            file.open(options_.source);
+            if (!file) {
+                std::cerr << "Failed to open URL list: " << options_.source << "\n";
+                return 0;
+            }
+            in = &file;
+        }
+        input_ = in;
+
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        multi_ = curl_multi_init();
+        curl_multi_setopt(multi_, CURLMOPT_SOCKETFUNCTION, socket_callback);
+        curl_multi_setopt(multi_, CURLMOPT_SOCKETDATA, this);
+        curl_multi_setopt(multi_, CURLMOPT_TIMERFUNCTION, timer_callback);
+        curl_multi_setopt(multi_, CURLMOPT_TIMERDATA, this);
+        curl_multi_setopt(multi_, CURLMOPT_MAXCONNECTS, static_cast<long>(options_.max_in_flight));
+
+        auto start = std::chrono::steady_clock::now();
+        fill();
+
+        const int max_events = 256;
+        epoll_event events[max_events];
+        while (in_flight_ > 0) {
+            int n = epoll_wait(epoll_fd_, events, max_events, wait_ms());
+            if (n < 0 && errno != EINTR) break;
+
+            int running = 0;
+            for (int i = 0; i < n; i++) {
+                int flags = 0;
+                if (events[i].events & EPOLLIN) flags |= CURL_CSELECT_IN;
+                if (events[i].events & EPOLLOUT) flags |= CURL_CSELECT_OUT;
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) flags |= CURL_CSELECT_ERR;
+                curl_multi_socket_action(multi_, events[i].data.fd, flags, &running);
+            }
+
+            // Timers are checked after socket events so a busy loop cannot starve them
+            if (timer_armed_ && std::chrono::steady_clock::now() >= deadline_) {
+                timer_armed_ = false;
+                curl_multi_socket_action(multi_, CURL_SOCKET_TIMEOUT, 0, &running);
+            }
+
+            collect();
+            fill();
+        }
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cerr << "[Batch] " << done_ << " URLs, " << failed_ << " failed, "
+                  << std::fixed << std::setprecision(2) << elapsed << "s\n";
+        print_dns_cache_stats();
+
+        curl_multi_cleanup(multi_);
+        close(epoll_fd_);
+        return failed_;
+    }
+
+private:
+    // Thousands of concurrent transfers need more than the default 1024 fds
+    static void raise_fd_limit() {
+        rlimit limit{};
+        if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+            limit.rlim_cur = limit.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &limit);
+        }
+    }
+
+    bool next_url(std::string& url) {
+        std::string line;
+        while (std::getline(*input_, line)) {
+            size_t start = line.find_first_not_of(" \t\r");
+            if (start == std::string::npos || line[start] == '#') continue;
+            size_t end = line.find_last_not_of(" \t\r");
+            url = line.substr(start, end - start + 1);
+            return true;
+        }
+        return false;
+    }
+
+    // Top up the multi handle to the in-flight limit
+    void fill() {
+        std::string url;
+        while (in_flight_ < options_.max_in_flight && next_url(url)) {
+            DiveTransfer* transfer = new DiveTransfer(url, dive_options_);
+            transfer->result.started = std::chrono::system_clock::now();
+            if (!transfer->handle() || curl_multi_add_handle(multi_, transfer->handle()) != CURLM_OK) {
+                transfer->result.code = CURLE_FAILED_INIT;
+                report(transfer);
+                continue;
+            }
+            in_flight_++;
+        }
+    }
+
+    // Hand finished transfers to the view and free them
+    void collect() {
+        int pending = 0;
+        while (CURLMsg* msg = curl_multi_info_read(multi_, &pending)) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            DiveTransfer* transfer = nullptr;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &transfer);
+            CURLcode code = msg->data.result;
+            curl_multi_remove_handle(multi_, msg->easy_handle);
+            if (transfer->next_hop(code) && curl_multi_add_handle(multi_, transfer->handle()) == CURLM_OK) continue;
+            in_flight_--;
+            transfer->finish(code);
+            report(transfer);
+        }
+    }
+
+    void report(DiveTransfer* transfer) {
+        std::unique_ptr<DiveTransfer> owned(transfer);
+        done_++;
+        if (!transfer->result.ok()) failed_++;
+        on_result_(transfer->result);
+    }
+
+    static int socket_callback(CURL*, curl_socket_t s, int what, void* userp, void*) {
+        BatchRunner* self = static_cast<BatchRunner*>(userp);
+        if (what == CURL_POLL_REMOVE) {
+            epoll_ctl(self->epoll_fd_, EPOLL_CTL_DEL, s, nullptr);
+            return 0;
+        }
+
+        epoll_event ev{};
+        ev.data.fd = s;
+        if (what & CURL_POLL_IN) ev.events |= EPOLLIN;
+        if (what & CURL_POLL_OUT) ev.events |= EPOLLOUT;
+        if (epoll_ctl(self->epoll_fd_, EPOLL_CTL_MOD, s, &ev) != 0 && errno == ENOENT) {
+            epoll_ctl(self->epoll_fd_, EPOLL_CTL_ADD, s, &ev);
+        }
+        return 0;
+    }
+
+    static int timer_callback(CURLM*, long timeout_ms, void* userp) {
+        BatchRunner* self = static_cast<BatchRunner*>(userp);
+        self->timer_armed_ = timeout_ms >= 0;
+        self->deadline_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        return 0;
+    }
+
+    int wait_ms() const {
+        if (!timer_armed_) return -1;
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline_ - std::chrono::steady_clock::now()).count();
+        return left > 0 ? static_cast<int>(left) : 0;
+    }
+
+    BatchOptions options_;
+    DiveOptions dive_options_;
+    ResultFn on_result_;
+
+    std::istream* input_ = nullptr;
+    CURLM* multi_ = nullptr;
+    int epoll_fd_ = -1;
+    bool timer_armed_ = false;
+    std::chrono::steady_clock::time_point deadline_;
+    size_t in_flight_ = 0;
+    size_t done_ = 0;
+    size_t failed_ = 0;
+};
+
+// Run a batch and print one record per URL using the given view
+inline size_t run_batch(const BatchOptions& options, const DiveOptions& dive_options,
+                        const std::function<void(const DiveResult&)>& view) {
+    BatchRunner runner(options, dive_options, [&](const DiveResult& r) {
+        if (options.results) options.results->append(r);
+        print_batch_record(r);
+        if (r.ok()) view(r);
+        std::cout << "\n";
+    });
+    return runner.run();
+}
@@ -0,0 +1,576 @@
+// bench.cpp
+// Benchmarks for the hot paths shared by the tools.
+//
+// headers: feed a typical response header block through the header
+// parsing used by the header callback, line by line as curl delivers it,
+// and report time and heap allocations per line. The old way (a
+// std::string per line plus a lowercased copy to test the field name) runs
+// alongside for comparison.
+//
+// tools: run each tool's probe (its DiveOptions, callbacks and view) over
+// and over against the loopback fixture server in bench_server.h, and
+// report throughput, latency percentiles, allocations per request and
+// peak RSS. Offline; --export and --compare keep the numbers comparable
+// between commits.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include "header_parse.h"
+#include "bench_server.h"
+#include "event_log.h"
+#include "repeat.h"
+
+// Every heap allocation in this process goes through here. The fixture
+// server's threads are not counted.
+static std::atomic<uint64_t> g_allocations{0};
+static std::atomic<uint64_t> g_curl_allocations{0};
+static thread_local bool t_untracked = false;
+
+void* operator new(size_t size) {
+    if (!t_untracked) g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+// Out of line, or GCC sees free() on memory from operator new once inlined
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept { free(p); }
+
+static const char* kResponse[] = {
+    "HTTP/1.1 200 OK\r\n",
+    "Date: Sat, 17 Oct 2026 06:45:35 GMT\r\n",
+    "Content-Type: text/html; charset=utf-8\r\n",
+    "Transfer-Encoding: chunked\r\n",
+    "Connection: keep-alive\r\n",
+    "Server: cloudflare\r\n",
+    "Cache-Control: private, max-age=0, no-store, no-cache, must-revalidate\r\n",
+    "Vary: Accept-Encoding\r\n",
+    "Set-Cookie: __cf_bm=Jr2kq5tx7.ZbW1yPQ0c9gTqv0L3xYgZt4m8; path=/; expires=Sat, 17-Oct-26 07:15:35 GMT; "
+    "domain=.example.com; HttpOnly; Secure; SameSite=None\r\n",
+    "Set-Cookie: session=8f14e45fceea167a5a36dedd4bea2543; Path=/; Secure; HttpOnly\r\n",
+    "Strict-Transport-Security: max-age=31536000; includeSubDomains; preload\r\n",
+    "X-Content-Type-Options: nosniff\r\n",
+    "X-Frame-Options: SAMEORIGIN\r\n",
+    "Content-Security-Policy: default-src 'self'; script-src 'self' https://cdn.example.com\r\n",
+    "Alt-Svc: h3=\":443\"; ma=86400\r\n",
+    "CF-RAY: 8c2b4e9f1a2b3c4d-FRA\r\n",
+    "Location: https://www.example.com/landing?utm_source=bench\r\n",
+    "\r\n",
+};
+static const size_t kLines = sizeof(kResponse) / sizeof(kResponse[0]);
+
+struct BenchResult {
+    double ns_per_line;
+    double allocations_per_line;
+    size_t checksum;  // keeps the work from being optimised away
+};
+
+// What the tools did before header_parse.h
+static BenchResult bench_legacy(const std::vector<std::string_view>& lines, long rounds) {
+    std::vector<std::string> kept;
+    size_t checksum = 0;
+    uint64_t before = g_allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    for (long r = 0; r < rounds; r++) {
+        kept.clear();
+        for (std::string_view raw : lines) {
+            std::string line(raw.data(), raw.size());
+            std::string lower = line;
+            std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+            if (lower.compare(0, 11, "set-cookie:") == 0 || lower.compare(0, 9, "location:") == 0) {
+                checksum += line.size();
+            }
+            kept.push_back(std::move(line));
+        }
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    uint64_t allocations = g_allocations.load() - before;
+    double total = double(rounds) * double(lines.size());
+    return BenchResult{ns / total, double(allocations) / total, checksum + kept.size()};
+}
+
+// The header callback's path: parse in place, dispatch on the id, append to
+// the transfer's DiveHeaders (cleared between rounds, as reset_result() does)
+static BenchResult bench_parser(const std::vector<std::string_view>& lines, long rounds) {
+    DiveHeaders headers;
+    size_t checksum = 0;
+    // One warm-up round lets the buffers reach their working size
+    for (std::string_view raw : lines) headers.add(raw, parse_header_line(raw));
+
+    uint64_t before = g_allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    for (long r = 0; r < rounds; r++) {
+        headers.clear();
+        for (std::string_view raw : lines) {
+            HeaderLine line = parse_header_line(raw);
+            if (line.id == HEADER_SET_COOKIE || line.id == HEADER_LOCATION) checksum += line.value.size();
+            headers.add(raw, line);
+        }
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    uint64_t allocations = g_allocations.load() - before;
+    double total = double(rounds) * double(lines.size());
+    return BenchResult{ns / total, double(allocations) / total, checksum + headers.size()};
+}
+
+static void print_result(const char* name, const BenchResult& r) {
+    printf("[Bench] %-8s %8.1f ns/line %8.3f allocations/line  (checksum %zu)\n", name, r.ns_per_line,
+           r.allocations_per_line, r.checksum);
+}
+
+// ---------------------------------------------------------------------------
+// tools
+
+// libcurl's own allocations, counted through curl_global_init_mem
+static void* curl_counted_malloc(size_t size) {
+    if (!t_untracked) g_curl_allocations.fetch_add(1, std::memory_order_relaxed);
+    return malloc(size);
+}
+static void* curl_counted_calloc(size_t n, size_t size) {
+    if (!t_untracked) g_curl_allocations.fetch_add(1, std::memory_order_relaxed);
+    return calloc(n, size);
+}
+static void* curl_counted_realloc(void* p, size_t size) {
+    if (!t_untracked) g_curl_allocations.fetch_add(1, std::memory_order_relaxed);
+    return realloc(p, size);
+}
+static char* curl_counted_strdup(const char* s) {
+    if (!t_untracked) g_curl_allocations.fetch_add(1, std::memory_order_relaxed);
+    return strdup(s);
+}
+
+// Formats everything it is given and keeps none of it, so the views do
+// their full work without the terminal in the measurement
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+// Peak RSS since the last reset, in KB. Resetting needs /proc/self/clear_refs
+// (Linux 4.0+); without it this is the peak of the whole run.
+static void reset_peak_rss() {
+    if (FILE* f = fopen("/proc/self/clear_refs", "w")) {
+        fputs("5", f);
+        fclose(f);
+    }
+}
+
+static long peak_rss_kb() {
+    if (FILE* f = fopen("/proc/self/status", "r")) {
+        char line[256];
+        long kb = -1;
+        while (fgets(line, sizeof(line), f)) {
+            if (strncmp(line, "VmHWM:", 6) == 0) kb = strtol(line + 6, nullptr, 10);
+        }
+        fclose(f);
+        if (kb >= 0) return kb;
+    }
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+struct ToolBenchConfig {
+    long requests = 300;
+    int rounds = 3;  // each tool is measured this many times and its fastest round kept
+    BenchResponse response;
+    int redirects = 3;  // chain length for the redirect tool
+    bool tls = true;
+    std::string only;
+    std::string export_path;
+    std::string compare_path;
+    double threshold = 10;  // percent, for --compare
+};
+
+// One tool's probe: its options and its view, as in its main()
+struct ToolBench {
+    const char* name;
+    DiveOptions options;
+    BenchResponse response;
+    bool fresh = false;  // a new handle (and connection) per request, like a separate run
+    std::function<void(const DiveResult&, std::ostream&)> view;
+    std::function<bool(const DiveResult&)> check = nullptr;  // the probe did its job; a request that fails it counts as failed
+};
+
+struct ToolBenchResult {
+    std::string name;
+    uint64_t requests = 0;
+    uint64_t failed = 0;
+    double seconds = 0;
+    uint64_t bytes = 0;
+    uint64_t allocations = 0;
+    uint64_t curl_allocations = 0;
+    long peak_rss_kb = 0;
+    LatencyHistogram latency;  // microseconds
+
+    // The numbers --export writes and --compare reads
+    std::vector<std::pair<const char*, double>> metrics() const {
+        double n = requests ? double(requests) : 1;
+        return {
+            {"requests_per_sec", seconds > 0 ? double(requests) / seconds : 0},
+            {"mb_per_sec", seconds > 0 ? double(bytes) / seconds / (1024.0 * 1024.0) : 0},
+            {"p50_us", double(latency.percentile(50))},
+            {"p90_us", double(latency.percentile(90))},
+            {"p99_us", double(latency.percentile(99))},
+            {"max_us", double(latency.max())},
+            {"allocations_per_request", double(allocations) / n},
+            {"curl_allocations_per_request", double(curl_allocations) / n},
+            {"peak_rss_kb", double(peak_rss_kb)},
+        };
+    }
+};
+
+static bool higher_is_better(const std::string& metric) {
+    return metric == "requests_per_sec" || metric == "mb_per_sec";
+}
+
+// Tail latencies swing too much between loopback runs to gate on
+static bool informational(const std::string& metric) { return metric == "p99_us" || metric == "max_us"; }
+
+static ToolBenchResult run_tool_bench(const BenchServer& server, const ToolBenchConfig& config, ToolBench& bench) {
+    NullBuffer null_buffer;
+    std::ostream null(&null_buffer);
+    std::string url = server.url(config.tls, bench.response);
+    ToolBenchResult out;
+    out.name = bench.name;
+
+    // One untimed request opens the connection and warms the buffers
+    std::unique_ptr<DiveTransfer> transfer(new DiveTransfer(url, bench.options));
+    transfer->perform();
+    bench.view(transfer->result, null);
+
+    reset_peak_rss();
+    uint64_t allocations = g_allocations.load();
+    uint64_t curl_allocations = g_curl_allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < config.requests; i++) {
+        auto t0 = std::chrono::steady_clock::now();
+        if (bench.fresh) {
+            transfer.reset(new DiveTransfer(url, bench.options));
+        } else {
+            transfer->reset_result();
+        }
+        transfer->perform();
+        bench.view(transfer->result, null);
+        out.latency.record(
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count());
+        out.requests++;
+        out.bytes += uint64_t(transfer->result.download_bytes);
+        if (!transfer->result.ok() || (bench.check && !bench.check(transfer->result))) out.failed++;
+    }
+    out.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    out.allocations = g_allocations.load() - allocations;
+    out.curl_allocations = g_curl_allocations.load() - curl_allocations;
+    out.peak_rss_kb = peak_rss_kb();
+    return out;
+}
+
+static void print_tool_result(const ToolBenchResult& r) {
+    double n = r.requests ? double(r.requests) : 1;
+    printf("[Bench] %-9s %7.0f req/s %8.2f MB/s  p50 %7.1f p90 %7.1f p99 %7.1f max %8.1f us  %7.1f allocs/req"
+           "  %7.1f curl allocs/req  peak RSS %6ld KB%s\n",
+           r.name.c_str(), r.seconds > 0 ? double(r.requests) / r.seconds : 0,
+           r.seconds > 0 ? double(r.bytes) / r.seconds / (1024.0 * 1024.0) : 0, double(r.latency.percentile(50)),
+           double(r.latency.percentile(90)), double(r.latency.percentile(99)), double(r.latency.max()),
+           double(r.allocations) / n, double(r.curl_allocations) / n, r.peak_rss_kb,
+           r.failed ? (" (" + std::to_string(r.failed) + " failed)").c_str() : "");
+}
+
+// Same layout as the --repeat export: one value per line, so two reports
+// can also be compared with diff
+static bool export_tool_results(const std::string& path, const ToolBenchConfig& config,
+                                const std::vector<ToolBenchResult>& results) {
+    std::ofstream file;
+    std::ostream* out = &std::cout;
+    if (path != "-") {
+        file.open(path);
+        if (!file) return false;
+        out = &file;
+    }
+    *out << "{\n  \"config\": {\n";
+    *out << "    \"requests\": " << config.requests << ",\n";
+    *out << "    \"rounds\": " << config.rounds << ",\n";
+    *out << "    \"tls\": " << (config.tls ? 1 : 0) << ",\n";
+    *out << "    \"size\": " << config.response.size << ",\n";
+    *out << "    \"headers\": " << config.response.headers << ",\n";
+    *out << "    \"cookies\": " << config.response.cookies << ",\n";
+    *out << "    \"redirects\": " << config.redirects << ",\n";
+    *out << "    \"delay_ms\": " << config.response.delay_ms << "\n  },\n";
+    *out << "  \"tools\": {";
+    for (size_t i = 0; i < results.size(); i++) {
+        *out << (i ? ",\n" : "\n") << "    \"" << results[i].name << "\": {\n";
+        *out << "      \"failed\": " << results[i].failed;
+        for (const auto& m : results[i].metrics()) *out << ",\n      \"" << m.first << "\": " << m.second;
+        *out << "\n    }";
+    }
+    *out << "\n  }\n}\n";
+    return bool(*out);
+}
+
+// Reads back what export_tool_results wrote: section -> key -> value
+static bool load_tool_results(const std::string& path, std::map<std::string, std::map<std::string, double>>& out) {
+    std::ifstream file(path);
+    if (!file) return false;
+    std::string line;
+    std::string section;
+    while (std::getline(file, line)) {
+        size_t q1 = line.find('"');
+        size_t q2 = q1 == std::string::npos ? q1 : line.find('"', q1 + 1);
+        if (q2 == std::string::npos) continue;
+        std::string key = line.substr(q1 + 1, q2 - q1 - 1);
+        size_t colon = line.find(':', q2);
+        if (colon == std::string::npos) continue;
+        std::string rest = line.substr(colon + 1);
+        if (rest.find('{') != std::string::npos) {
+            section = key;
+        } else {
+            out[section][key] = strtod(rest.c_str(), nullptr);
+        }
+    }
+    return true;
+}
+
+// Old against new, metric by metric. Returns the number of regressions
+// beyond the threshold.
+static int compare_tool_results(const std::string& path, const ToolBenchConfig& config,
+                                const std::vector<ToolBenchResult>& results) {
+    std::map<std::string, std::map<std::string, double>> old;
+    if (!load_tool_results(path, old)) {
+        std::cerr << "Cannot read " << path << "\n";
+        return -1;
+    }
+    const auto& c = old["config"];
+    auto differs = [&](const char* key, double now) { return c.count(key) && c.at(key) != now; };
+    if (differs("requests", double(config.requests)) || differs("rounds", config.rounds) || differs("tls", config.tls ? 1 : 0) ||
+        differs("size", double(config.response.size)) || differs("headers", config.response.headers) ||
+        differs("cookies", config.response.cookies) || differs("redirects", config.redirects) ||
+        differs("delay_ms", config.response.delay_ms)) {
+        printf("[Compare] %s was run with other settings; the numbers are not comparable\n", path.c_str());
+    }
+
+    int regressions = 0;
+    for (const ToolBenchResult& r : results) {
+        auto it = old.find(r.name);
+        if (it == old.end()) {
+            printf("[Compare] %-9s not in %s\n", r.name.c_str(), path.c_str());
+            continue;
+        }
+        for (const auto& m : r.metrics()) {
+            auto before = it->second.find(m.first);
+            if (before == it->second.end()) continue;
+            double was = before->second;
+            double change = was != 0 ? (m.second - was) / was * 100.0 : 0;
+            bool worse = higher_is_better(m.first) ? change < -config.threshold : change > config.threshold;
+            // Below one allocation per request or 10 us the percentages are noise
+            bool tiny = std::max(was, m.second) < (std::string(m.first).find("_us") != std::string::npos ? 10 : 1);
+            bool regression = worse && !tiny && !informational(m.first);
+            if (regression) regressions++;
+            printf("[Compare] %-9s %-28s %12.1f -> %12.1f  %+7.1f%%%s\n", r.name.c_str(), m.first, was, m.second,
+                   change, regression ? "  REGRESSION" : "");
+        }
+    }
+    printf("[Compare] %d regressions beyond %.0f%% against %s\n", regressions, config.threshold, path.c_str());
+    return regressions;
+}
+
+static void tools_usage(const char* tool) {
+    std::cerr << "Usage: " << tool << " tools [--requests n] [--rounds n] [--size bytes] [--headers n] [--cookies n]"
+              << " [--redirects n] [--delay ms]\n"
+              << "            [--http] [--only tool] [--export <file.json|->] [--compare <file.json>]"
+              << " [--threshold percent]\n";
+}
+
+static int run_tools(int argc, char* argv[]) {
+    ToolBenchConfig config;
+    config.response.size = 16 * 1024;
+    config.response.headers = 8;
+    config.response.cookies = 4;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--requests" && has_value) {
+            config.requests = std::max(1L, strtol(argv[++i], nullptr, 10));
+        } else if (arg == "--rounds" && has_value) {
+            config.rounds = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--size" && has_value) {
+            config.response.size = size_t(std::max(0L, strtol(argv[++i], nullptr, 10)));
+        } else if (arg == "--headers" && has_value) {
+            config.response.headers = std::max(0, atoi(argv[++i]));
+        } else if (arg == "--cookies" && has_value) {
+            config.response.cookies = std::max(0, atoi(argv[++i]));
+        } else if (arg == "--redirects" && has_value) {
+            config.redirects = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--delay" && has_value) {
+            config.response.delay_ms = std::max(0, atoi(argv[++i]));
+        } else if (arg == "--http") {
+            config.tls = false;
+        } else if (arg == "--only" && has_value) {
+            config.only = argv[++i];
+        } else if (arg == "--export" && has_value) {
+            config.export_path = argv[++i];
+        } else if (arg == "--compare" && has_value) {
+            config.compare_path = argv[++i];
+        } else if (arg == "--threshold" && has_value) {
+            config.threshold = std::max(0.0, strtod(argv[++i], nullptr));
+        } else {
+            tools_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    curl_global_init_mem(CURL_GLOBAL_DEFAULT, curl_counted_malloc, free, curl_counted_realloc, curl_counted_strdup,
+                         curl_counted_calloc);
+    BenchServer server([] { t_untracked = true; });
+    if (!server.start()) {
+        std::cerr << "Fixture server failed: " << server.error() << "\n";
+        return 1;
+    }
+
+    DiveOptions quiet;
+    quiet.ca_file = server.ca_file();
+    quiet.follow_redirects = false;
+    quiet.keep_body = false;
+    quiet.debug_events = false;
+    quiet.tls_info = false;
+    quiet.certinfo = false;
+
+    CookieJar jar;
+    TlsSessionCache sessions("off");
+    uint64_t events = 0;
+    EventLog log;
+    log.start([&events](const LoggedEvent&) { events++; });
+
+    std::vector<ToolBench> benches;
+    {
+        ToolBench b{"header", quiet, config.response, false, [](const DiveResult& r, std::ostream& o) { print_headers(r, o); }};
+        b.options.nobody = true;
+        benches.push_back(b);
+    }
+    {
+        ToolBench b{"cookies", quiet, config.response, false, [](const DiveResult& r, std::ostream& o) {
+                        print_cookies(r, o);
+                        print_cookies_sent(r, o);
+                    }};
+        b.options.cookie_jar = &jar;
+        // Every request after the warm-up one sends back what the jar stored
+        int cookies = config.response.cookies;
+        b.check = [cookies](const DiveResult& r) { return r.cookies_sent == size_t(cookies); };
+        benches.push_back(b);
+    }
+    {
+        ToolBench b{"redirect", quiet, config.response, false,
+                    [](const DiveResult& r, std::ostream& o) { print_redirects(r, o); }};
+        b.options.walk_redirects = true;
+        b.options.follow_redirects = true;
+        b.response.redirects = config.redirects;
+        benches.push_back(b);
+    }
+    {
+        ToolBench b{"html_body", quiet, config.response, false, [](const DiveResult& r, std::ostream& o) { print_body(r, o); }};
+        b.options.keep_body = true;
+        benches.push_back(b);
+    }
+    {
+        ToolBench b{"packets", quiet, config.response, false, [](const DiveResult&, std::ostream&) {}};
+        b.options.debug_events = true;
+        b.options.on_debug_data = [&log](curl_infotype type, const char* data, size_t size) {
+            log.record(type, data, size);
+        };
+        benches.push_back(b);
+    }
+    if (config.tls) {
+        ToolBench b{"tls", quiet, config.response, true, [](const DiveResult& r, std::ostream& o) {
+                        print_tls(r, o);
+                        print_tls_handshake(r, o);
+                    }};
+        b.options.tls_info = true;
+        b.options.tls_sessions = &sessions;
+        benches.push_back(b);
+        ToolBench c{"certchain", quiet, config.response, true,
+                    [](const DiveResult& r, std::ostream& o) { print_certchain(r, o); }};
+        c.options.tls_info = true;
+        c.options.certinfo = true;
+        c.options.nobody = true;
+        benches.push_back(c);
+    }
+    {
+        ToolBench b{"dive", DiveOptions(), config.response, false, [](const DiveResult& r, std::ostream& o) {
+                        print_dns(r, o);
+                        if (r.tls.available) print_tls(r, o);
+                        print_headers(r, o);
+                        print_cookies(r, o);
+                        print_body(r, o);
+                        print_redirects(r, o);
+                        print_packets(r, o);
+                    }};
+        b.options.ca_file = server.ca_file();
+        benches.push_back(b);
+    }
+
+    printf("[Bench] tools: best of %d rounds of %ld requests each over %s to the loopback fixture, %zu-byte bodies, %d headers, %d cookies,"
+           " %d-hop redirects, %d ms delay\n",
+           config.rounds, config.requests, config.tls ? "HTTPS" : "HTTP", config.response.size, config.response.headers,
+           config.response.cookies, config.redirects, config.response.delay_ms);
+    fflush(stdout);
+
+    std::vector<ToolBenchResult> results;
+    bool failed = false;
+    for (ToolBench& bench : benches) {
+        if (!config.only.empty() && config.only != bench.name) continue;
+        // Loopback timings swing with whatever else the machine is doing;
+        // the fastest of a few rounds is the most repeatable figure
+        ToolBenchResult best = run_tool_bench(server, config, bench);
+        for (int round = 1; round < config.rounds; round++) {
+            ToolBenchResult next = run_tool_bench(server, config, bench);
+            if (next.seconds < best.seconds) best = next;
+        }
+        results.push_back(best);
+        print_tool_result(results.back());
+        fflush(stdout);
+        failed = failed || results.back().failed > 0;
+    }
+    log.stop();
+    server.stop();
+    if (results.empty()) {
+        std::cerr << "No tool named " << config.only << "\n";
+        return 1;
+    }
+
+    if (!config.export_path.empty() && !export_tool_results(config.export_path, config, results)) {
+        std::cerr << "Failed to write " << config.export_path << "\n";
+        return 1;
+    }
+    int regressions = config.compare_path.empty() ? 0 : compare_tool_results(config.compare_path, config, results);
+    curl_global_cleanup();
+    return failed || regressions != 0 ? 1 : 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "tools") == 0) return run_tools(argc, argv);
+    if (argc < 2 || strcmp(argv[1], "headers") != 0) {
+        std::cerr << "Usage: " << argv[0] << " headers [rounds]\n";
+        tools_usage(argv[0]);
+        return 1;
+    }
+    long rounds = argc > 2 ? std::max(1L, strtol(argv[2], nullptr, 10)) : 200000;
+
+    std::vector<std::string_view> lines;
+    for (size_t i = 0; i < kLines; i++) lines.emplace_back(kResponse[i]);
+
+    printf("[Bench] headers: %zu lines x %ld rounds\n", lines.size(), rounds);
+    BenchResult legacy = bench_legacy(lines, rounds);
+    BenchResult parser = bench_parser(lines, rounds);
+    print_result("string", legacy);
+    print_result("parser", parser);
+    return parser.allocations_per_line == 0 ? 0 : 1;
+}
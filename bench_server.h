@@ -0,0 +1,385 @@
+// bench_server.h
+// Loopback fixture server for the tool benchmarks.
+//
+// Plain HTTP and HTTPS on 127.0.0.1, on ports picked by the kernel. The
+// HTTPS side presents a leaf certificate for 127.0.0.1/localhost signed by
+// a CA made in memory at startup, and the CA is written to a temporary PEM
+// file for CURLOPT_CAINFO, so the benchmarks verify the peer as the tools
+// do and still need no network.
+//
+// Every response is described by the request's query string, so one server
+// serves every shape:
+//
+//   /bench?size=N        N body bytes of HTML, a link in every 64
+//         &headers=N     N extra X-Bench-<i> header lines
+//         &cookies=N     N Set-Cookie lines
+//         &redirects=N   N 302 hops back to the same URL with redirects=N-1
+//         &delay=MS      wait this long before answering
+//
+// Connections are kept alive, each on its own thread; threads of closed
+// connections are joined as new ones are accepted.
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Shape of one fixture response
+struct BenchResponse {
+    size_t size = 0;
+    int headers = 0;
+    int cookies = 0;
+    int redirects = 0;
+    int delay_ms = 0;
+};
+
+inline std::string bench_target(const BenchResponse& r) {
+    return "/bench?size=" + std::to_string(r.size) + "&headers=" + std::to_string(r.headers) +
+           "&cookies=" + std::to_string(r.cookies) + "&redirects=" + std::to_string(r.redirects) +
+           "&delay=" + std::to_string(r.delay_ms);
+}
+
+inline BenchResponse bench_parse_target(std::string_view target) {
+    BenchResponse r;
+    size_t q = target.find('?');
+    while (q != std::string_view::npos && q + 1 < target.size()) {
+        size_t amp = target.find('&', q + 1);
+        std::string_view pair = target.substr(q + 1, amp == std::string_view::npos ? amp : amp - q - 1);
+        size_t eq = pair.find('=');
+        if (eq != std::string_view::npos) {
+            std::string_view key = pair.substr(0, eq);
+            long value = std::strtol(std::string(pair.substr(eq + 1)).c_str(), nullptr, 10);
+            if (value < 0) value = 0;
+            if (key == "size") r.size = size_t(value);
+            if (key == "headers") r.headers = int(value);
+            if (key == "cookies") r.cookies = int(value);
+            if (key == "redirects") r.redirects = int(value);
+            if (key == "delay") r.delay_ms = int(value);
+        }
+        q = amp;
+    }
+    return r;
+}
+
+class BenchServer {
+public:
+    // on_thread runs first on every server thread, e.g. to keep its
+    // allocations out of the benchmark's counts
+    explicit BenchServer(std::function<void()> on_thread = nullptr) : on_thread_(std::move(on_thread)) {
+        // 64 bytes of HTML per line, repeated for any body size
+        std::string line = "<p>bench <a href=\"/bench?size=0\">link</a></p>";
+        line.resize(63, ' ');
+        line += '\n';
+        while (pattern_.size() < kPatternSize) pattern_ += line;
+    }
+
+    ~BenchServer() { stop(); }
+
+    BenchServer(const BenchServer&) = delete;
+    BenchServer& operator=(const BenchServer&) = delete;
+
+    bool start() {
+        if (!make_certificates() || !listen_on(http_fd_, http_port_) || !listen_on(https_fd_, https_port_)) {
+            stop();
+            return false;
+        }
+        running_ = true;
+        accept_threads_.emplace_back([this] { accept_loop(http_fd_, false); });
+        accept_threads_.emplace_back([this] { accept_loop(https_fd_, true); });
+        return true;
+    }
+
+    void stop() {
+        if (running_.exchange(false)) {
+            shutdown(http_fd_, SHUT_RDWR);
+            shutdown(https_fd_, SHUT_RDWR);
+            for (std::thread& t : accept_threads_) t.join();
+            accept_threads_.clear();
+            std::vector<std::thread> connections;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                for (int fd : open_fds_) shutdown(fd, SHUT_RDWR);
+                connections.swap(connection_threads_);
+            }
+            for (std::thread& t : connections) t.join();
+        }
+        if (http_fd_ >= 0) close(http_fd_);
+        if (https_fd_ >= 0) close(https_fd_);
+        http_fd_ = https_fd_ = -1;
+        if (ctx_) SSL_CTX_free(ctx_);
+        ctx_ = nullptr;
+        if (!ca_file_.empty()) unlink(ca_file_.c_str());
+        ca_file_.clear();
+    }
+
+    const std::string& error() const { return error_; }
+    const std::string& ca_file() const { return ca_file_; }
+
+    std::string url(bool tls, const BenchResponse& response) const {
+        return std::string(tls ? "https" : "http") + "://127.0.0.1:" + std::to_string(tls ? https_port_ : http_port_) +
+               bench_target(response);
+    }
+
+    uint64_t requests() const { return requests_.load(); }
+
+private:
+    static constexpr size_t kPatternSize = 64 * 1024;
+
+    bool fail(const std::string& what) {
+        error_ = what;
+        unsigned long e = ERR_get_error();
+        if (e) error_ += std::string(": ") + ERR_error_string(e, nullptr);
+        return false;
+    }
+
+    static bool add_extension(X509* cert, X509* issuer, int nid, const char* value) {
+        X509V3_CTX ctx;
+        X509V3_set_ctx(&ctx, issuer, cert, nullptr, nullptr, 0);
+        X509_EXTENSION* ext = X509V3_EXT_conf_nid(nullptr, &ctx, nid, value);
+        if (!ext) return false;
+        bool ok = X509_add_ext(cert, ext, -1) == 1;
+        X509_EXTENSION_free(ext);
+        return ok;
+    }
+
+    static X509* new_certificate(EVP_PKEY* key, long serial, const char* cn) {
+        X509* cert = X509_new();
+        X509_set_version(cert, 2);
+        ASN1_INTEGER_set(X509_get_serialNumber(cert), serial);
+        X509_gmtime_adj(X509_getm_notBefore(cert), -3600);
+        X509_gmtime_adj(X509_getm_notAfter(cert), 7 * 86400);
+        X509_set_pubkey(cert, key);
+        X509_NAME_add_entry_by_txt(X509_get_subject_name(cert), "CN", MBSTRING_ASC,
+                                   reinterpret_cast<const unsigned char*>(cn), -1, -1, 0);
+        return cert;
+    }
+
+    // A CA and a leaf signed by it, both P-256
+    bool make_certificates() {
+        EVP_PKEY* ca_key = EVP_EC_gen("P-256");
+        EVP_PKEY* leaf_key = EVP_EC_gen("P-256");
+        if (!ca_key || !leaf_key) {
+            EVP_PKEY_free(ca_key);
+            EVP_PKEY_free(leaf_key);
+            return fail("key generation failed");
+        }
+
+        X509* ca = new_certificate(ca_key, 1, "Web-Dive bench CA");
+        X509_set_issuer_name(ca, X509_get_subject_name(ca));
+        bool ok = add_extension(ca, ca, NID_basic_constraints, "critical,CA:TRUE") &&
+                  add_extension(ca, ca, NID_key_usage, "critical,keyCertSign,cRLSign") &&
+                  add_extension(ca, ca, NID_subject_key_identifier, "hash") &&
+                  X509_sign(ca, ca_key, EVP_sha256()) > 0;
+
+        X509* leaf = new_certificate(leaf_key, 2, "127.0.0.1");
+        X509_set_issuer_name(leaf, X509_get_subject_name(ca));
+        ok = ok && add_extension(leaf, ca, NID_basic_constraints, "critical,CA:FALSE") &&
+             add_extension(leaf, ca, NID_ext_key_usage, "serverAuth") &&
+             add_extension(leaf, ca, NID_subject_alt_name, "IP:127.0.0.1,DNS:localhost") &&
+             add_extension(leaf, ca, NID_authority_key_identifier, "keyid") &&
+             X509_sign(leaf, ca_key, EVP_sha256()) > 0;
+
+        if (ok) {
+            ctx_ = SSL_CTX_new(TLS_server_method());
+            ok = ctx_ && SSL_CTX_use_certificate(ctx_, leaf) == 1 && SSL_CTX_use_PrivateKey(ctx_, leaf_key) == 1 &&
+                 SSL_CTX_add1_chain_cert(ctx_, ca) == 1;
+        }
+        if (ok) {
+            char path[] = "/tmp/webdive-bench-ca-XXXXXX";
+            int fd = mkstemp(path);
+            FILE* f = fd >= 0 ? fdopen(fd, "w") : nullptr;
+            ok = f && PEM_write_X509(f, ca) == 1;
+            if (f) fclose(f);
+            if (fd >= 0) ca_file_ = path;
+        }
+        X509_free(ca);
+        X509_free(leaf);
+        EVP_PKEY_free(ca_key);
+        EVP_PKEY_free(leaf_key);
+        return ok || fail("certificate setup failed");
+    }
+
+    bool listen_on(int& fd, uint16_t& port) {
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        if (fd < 0 || bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 1024) != 0 ||
+            getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+            return fail(std::string("listen failed: ") + strerror(errno));
+        }
+        port = ntohs(addr.sin_port);
+        return true;
+    }
+
+    void accept_loop(int listen_fd, bool tls) {
+        if (on_thread_) on_thread_();
+        while (running_) {
+            int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR) continue;
+                return;
+            }
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            std::lock_guard<std::mutex> lock(mutex_);
+            reap_finished();
+            open_fds_.push_back(fd);
+            connection_threads_.emplace_back([this, fd, tls] { serve(fd, tls); });
+        }
+    }
+
+    // One connection: requests are answered in order until the client
+    // closes it or the server stops
+    void serve(int fd, bool tls) {
+        if (on_thread_) on_thread_();
+        SSL* ssl = nullptr;
+        if (tls) {
+            ssl = SSL_new(ctx_);
+            SSL_set_fd(ssl, fd);
+            if (SSL_accept(ssl) != 1) {
+                SSL_free(ssl);
+                finish(fd);
+                return;
+            }
+        }
+
+        std::string in;
+        std::string out;
+        char buf[16 * 1024];
+        while (running_) {
+            size_t end;
+            while ((end = in.find("\r\n\r\n")) == std::string::npos) {
+                int n = ssl ? SSL_read(ssl, buf, sizeof(buf)) : int(read(fd, buf, sizeof(buf)));
+                if (n <= 0) goto done;
+                in.append(buf, size_t(n));
+            }
+            {
+                std::string_view request(in.data(), end);
+                size_t sp1 = request.find(' ');
+                size_t sp2 = request.find(' ', sp1 + 1);
+                if (sp1 == std::string_view::npos || sp2 == std::string_view::npos) break;
+                bool head = request.substr(0, sp1) == "HEAD";
+                std::string target(request.substr(sp1 + 1, sp2 - sp1 - 1));
+                in.erase(0, end + 4);
+                requests_++;
+                if (!respond(fd, ssl, target, head, out)) break;
+            }
+        }
+    done:
+        if (ssl) {
+            SSL_shutdown(ssl);
+            SSL_free(ssl);
+        }
+        finish(fd);
+    }
+
+    bool respond(int fd, SSL* ssl, const std::string& target, bool head, std::string& out) {
+        BenchResponse r = bench_parse_target(target);
+        if (r.delay_ms > 0) std::this_thread::sleep_for(std::chrono::milliseconds(r.delay_ms));
+
+        out.clear();
+        if (r.redirects > 0) {
+            BenchResponse next = r;
+            next.redirects--;
+            out += "HTTP/1.1 302 Found\r\nLocation: " + bench_target(next) + "\r\nContent-Length: 0\r\n";
+        } else {
+            out += "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\nContent-Length: " +
+                   std::to_string(r.size) + "\r\n";
+        }
+        out += "Server: webdive-bench\r\nCache-Control: no-store\r\n";
+        for (int i = 0; i < r.headers; i++) {
+            out += "X-Bench-" + std::to_string(i) + ": value-" + std::to_string(i) + "-0123456789abcdef\r\n";
+        }
+        for (int i = 0; i < r.cookies; i++) {
+            out += "Set-Cookie: bench" + std::to_string(i) + "=" + std::to_string(requests_.load()) +
+                   "; Path=/; Max-Age=3600; HttpOnly\r\n";
+        }
+        out += "\r\n";
+        if (!send_all(fd, ssl, out.data(), out.size())) return false;
+        if (head || r.redirects > 0) return true;
+
+        size_t left = r.size;
+        while (left > 0) {
+            size_t n = std::min(left, pattern_.size());
+            if (!send_all(fd, ssl, pattern_.data(), n)) return false;
+            left -= n;
+        }
+        return true;
+    }
+
+    static bool send_all(int fd, SSL* ssl, const char* data, size_t size) {
+        while (size > 0) {
+            int n = ssl ? SSL_write(ssl, data, int(std::min<size_t>(size, 1 << 30)))
+                        : int(send(fd, data, size, MSG_NOSIGNAL));
+            if (n < 0 && !ssl && errno == EINTR) continue;
+            if (n <= 0) return false;
+            data += n;
+            size -= size_t(n);
+        }
+        return true;
+    }
+
+    void finish(int fd) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < open_fds_.size(); i++) {
+            if (open_fds_[i] == fd) {
+                open_fds_.erase(open_fds_.begin() + long(i));
+                break;
+            }
+        }
+        close(fd);
+        finished_.push_back(std::this_thread::get_id());
+    }
+
+    // Join the connection threads that have finished (caller holds mutex_),
+    // so benches opening a connection per request do not keep a thread, and
+    // its stack, per request alive until stop()
+    void reap_finished() {
+        for (std::thread::id id : finished_) {
+            for (size_t i = 0; i < connection_threads_.size(); i++) {
+                if (connection_threads_[i].get_id() != id) continue;
+                connection_threads_[i].join();
+                connection_threads_[i] = std::move(connection_threads_.back());
+                connection_threads_.pop_back();
+                break;
+            }
+        }
+        finished_.clear();
+    }
+
+    std::function<void()> on_thread_;
+    std::string pattern_;
+    SSL_CTX* ctx_ = nullptr;
+    std::string ca_file_;
+    std::string error_;
+    int http_fd_ = -1;
+    int https_fd_ = -1;
+    uint16_t http_port_ = 0;
+    uint16_t https_port_ = 0;
+    std::atomic<bool> running_{false};
+    std::atomic<uint64_t> requests_{0};
+    std::vector<std::thread> accept_threads_;
+    std::mutex mutex_;
+    std::vector<int> open_fds_;
+    std::vector<std::thread> connection_threads_;
+    std::vector<std::thread::id> finished_;  // connection threads done serving, not yet joined
+};
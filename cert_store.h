@@ -0,0 +1,373 @@
+// cert_store.h
+// Deduplicated certificate corpus for large chain scans.
+//
+// Scanning many hosts sees the same intermediates and roots over and over,
+// so each certificate is stored once, keyed by its SHA-256 fingerprint,
+// and a host only keeps a list of references into the certificate table.
+// Fields are kept column by column (fingerprints, subject and issuer ids
+// into one interned string pool, validity, flags), which is also how the
+// file is laid out: memory and file size grow with the number of distinct
+// certificates and hosts, not hosts x chain length.
+//
+// File: "WDCERTS1", then u32 counts for strings, certs, hosts and chain
+// references, then each column in turn. Written to a temporary file and
+// renamed.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <unistd.h>
+#include "dive.h"
+
+using CertFingerprint = std::array<uint8_t, 32>;
+
+struct CertFingerprintHash {
+    size_t operator()(const CertFingerprint& fp) const {
+        size_t h;
+        memcpy(&h, fp.data(), sizeof(h));  // already uniformly distributed
+        return h;
+    }
+};
+
+// "AB:CD:..." as printed by print_certificate, to raw bytes
+inline bool cert_fingerprint_parse(const std::string& hex, CertFingerprint& out) {
+    size_t n = 0;
+    for (size_t i = 0; i + 1 < hex.size() && n < out.size();) {
+        if (hex[i] == ':') {
+            i++;
+            continue;
+        }
+        unsigned value;
+        if (sscanf(hex.c_str() + i, "%2x", &value) != 1) return false;
+        out[n++] = uint8_t(value);
+        i += 2;
+    }
+    return n == out.size();
+}
+
+inline std::string cert_fingerprint_hex(const CertFingerprint& fp, size_t bytes = 32) {
+    static const char digits[] = "0123456789ABCDEF";
+    std::string out;
+    for (size_t i = 0; i < bytes && i < fp.size(); i++) {
+        if (i) out += ':';
+        out += digits[fp[i] >> 4];
+        out += digits[fp[i] & 15];
+    }
+    return out;
+}
+
+class CertStore {
+public:
+    enum : uint8_t {
+        CERT_CA = 1,    // basicConstraints CA
+        CERT_LEAF = 2,  // seen first in some chain
+    };
+
+    // Read a store written by save(). A missing file is an empty store; a
+    // truncated or corrupt one is rejected and leaves the store empty.
+    bool load(const std::string& path) {
+        FILE* f = fopen(path.c_str(), "rb");
+        if (!f) return true;
+        uint64_t file_size = 0;
+        if (fseek(f, 0, SEEK_END) == 0) {
+            long end = ftell(f);
+            if (end > 0) file_size = uint64_t(end);
+        }
+        rewind(f);
+        char magic[8];
+        uint32_t counts[4];
+        bool ok = fread(magic, sizeof(magic), 1, f) == 1 && memcmp(magic, kMagic, 8) == 0 &&
+                  fread(counts, sizeof(counts), 1, f) == 1;
+        if (ok) {
+            std::vector<uint32_t> string_offsets;
+            uint32_t pool_size = 0;
+            ok = read_column(f, file_size, string_offsets, counts[0]) &&
+                 fread(&pool_size, sizeof(pool_size), 1, f) == 1 && read_column(f, file_size, pool_, pool_size) &&
+                 read_column(f, file_size, fingerprints_, counts[1]) &&
+                 read_column(f, file_size, subjects_, counts[1]) && read_column(f, file_size, issuers_, counts[1]) &&
+                 read_column(f, file_size, not_before_, counts[1]) &&
+                 read_column(f, file_size, not_after_, counts[1]) && read_column(f, file_size, flags_, counts[1]) &&
+                 read_column(f, file_size, host_names_, counts[2]) &&
+                 read_column(f, file_size, chain_begin_, counts[2]) &&
+                 read_column(f, file_size, chain_length_, counts[2]) &&
+                 read_column(f, file_size, chain_refs_, counts[3]);
+            string_offsets_ = std::move(string_offsets);
+        }
+        fclose(f);
+        if (!ok || !consistent()) {
+            *this = CertStore();
+            return false;
+        }
+        for (uint32_t i = 0; i < string_offsets_.size(); i++) string_ids_.emplace(string_at(i), i);
+        for (uint32_t i = 0; i < fingerprints_.size(); i++) by_fingerprint_.emplace(fingerprints_[i], i);
+        for (uint32_t i = 0; i < host_names_.size(); i++) by_host_.emplace(host_names_[i], i);
+        return true;
+    }
+
+    bool save(const std::string& path) {
+        compact();
+        std::string tmp = path + ".tmp." + std::to_string(getpid());
+        FILE* f = fopen(tmp.c_str(), "wb");
+        if (!f) return false;
+        uint32_t counts[4] = {uint32_t(string_offsets_.size()), uint32_t(fingerprints_.size()),
+                              uint32_t(host_names_.size()), uint32_t(chain_refs_.size())};
+        uint32_t pool_size = uint32_t(pool_.size());
+        fwrite(kMagic, 8, 1, f);
+        fwrite(counts, sizeof(counts), 1, f);
+        write_column(f, string_offsets_);
+        fwrite(&pool_size, sizeof(pool_size), 1, f);
+        write_column(f, pool_);
+        write_column(f, fingerprints_);
+        write_column(f, subjects_);
+        write_column(f, issuers_);
+        write_column(f, not_before_);
+        write_column(f, not_after_);
+        write_column(f, flags_);
+        write_column(f, host_names_);
+        write_column(f, chain_begin_);
+        write_column(f, chain_length_);
+        write_column(f, chain_refs_);
+        bool ok = fclose(f) == 0 && rename(tmp.c_str(), path.c_str()) == 0;
+        if (!ok) unlink(tmp.c_str());
+        return ok;
+    }
+
+    // Record a host's chain, leaf first. Returns the ids of the chain's
+    // certificates, with `added` set for each one not seen before.
+    std::vector<uint32_t> add_chain(const std::string& host, const std::vector<DiveCert>& chain,
+                                    std::vector<bool>* added = nullptr) {
+        std::vector<uint32_t> ids;
+        if (added) added->clear();
+        for (size_t i = 0; i < chain.size(); i++) {
+            bool fresh = false;
+            uint32_t id = add_cert(chain[i], fresh);
+            if (id == kNone) continue;
+            if (i == 0) flags_[id] |= CERT_LEAF;
+            ids.push_back(id);
+            if (added) added->push_back(fresh);
+        }
+        if (ids.empty()) return ids;
+
+        // A rescanned host points at a new run of references; the old run
+        // is dropped by compact()
+        uint32_t name = intern(host);
+        auto it = by_host_.find(name);
+        uint32_t row;
+        if (it == by_host_.end()) {
+            row = uint32_t(host_names_.size());
+            host_names_.push_back(name);
+            chain_begin_.push_back(0);
+            chain_length_.push_back(0);
+            by_host_.emplace(name, row);
+        } else {
+            row = it->second;
+            garbage_ += chain_length_[row];
+        }
+        chain_begin_[row] = uint32_t(chain_refs_.size());
+        chain_length_[row] = uint16_t(ids.size());
+        chain_refs_.insert(chain_refs_.end(), ids.begin(), ids.end());
+        return ids;
+    }
+
+    size_t cert_count() const { return fingerprints_.size(); }
+    size_t host_count() const { return host_names_.size(); }
+    size_t reference_count() const { return chain_refs_.size() - garbage_; }
+    size_t string_bytes() const { return pool_.size(); }
+
+    const CertFingerprint& fingerprint(uint32_t id) const { return fingerprints_[id]; }
+    std::string subject(uint32_t id) const { return string_at(subjects_[id]); }
+    std::string issuer(uint32_t id) const { return string_at(issuers_[id]); }
+    int64_t not_before(uint32_t id) const { return not_before_[id]; }
+    int64_t not_after(uint32_t id) const { return not_after_[id]; }
+    uint8_t flags(uint32_t id) const { return flags_[id]; }
+    std::string host(uint32_t row) const { return string_at(host_names_[row]); }
+
+    // Certificates matching a fingerprint prefix ("AB:CD" or "abcd") or,
+    // failing that, a subject substring
+    std::vector<uint32_t> find(const std::string& needle) const {
+        std::vector<uint32_t> out;
+        std::string hex;
+        for (char c : needle) {
+            if (isxdigit(static_cast<unsigned char>(c))) hex += char(toupper(static_cast<unsigned char>(c)));
+            else if (c != ':') {
+                hex.clear();
+                break;
+            }
+        }
+        if (hex.size() >= 4) {
+            for (uint32_t id = 0; id < fingerprints_.size(); id++) {
+                std::string full = cert_fingerprint_hex(fingerprints_[id]);
+                full.erase(std::remove(full.begin(), full.end(), ':'), full.end());
+                if (full.compare(0, hex.size(), hex) == 0) out.push_back(id);
+            }
+            if (!out.empty()) return out;
+        }
+        // Match each distinct subject string once, then map back to certs
+        std::vector<bool> matches(string_offsets_.size());
+        for (uint32_t s = 0; s < string_offsets_.size(); s++) {
+            matches[s] = string_at(s).find(needle) != std::string::npos;
+        }
+        for (uint32_t id = 0; id < subjects_.size(); id++) {
+            if (matches[subjects_[id]]) out.push_back(id);
+        }
+        return out;
+    }
+
+    // Hosts whose current chain contains any of the given certificates
+    std::vector<uint32_t> hosts_with(const std::vector<uint32_t>& certs) const {
+        std::vector<bool> wanted(fingerprints_.size());
+        for (uint32_t id : certs) wanted[id] = true;
+        std::vector<uint32_t> out;
+        for (uint32_t row = 0; row < host_names_.size(); row++) {
+            for (uint32_t i = 0; i < chain_length_[row]; i++) {
+                if (wanted[chain_refs_[chain_begin_[row] + i]]) {
+                    out.push_back(row);
+                    break;
+                }
+            }
+        }
+        return out;
+    }
+
+    // Leaf certificates whose notAfter is before the given time
+    std::vector<uint32_t> leaves_expiring_before(int64_t when) const {
+        std::vector<uint32_t> out;
+        for (uint32_t id = 0; id < not_after_.size(); id++) {
+            if ((flags_[id] & CERT_LEAF) && not_after_[id] < when) out.push_back(id);
+        }
+        return out;
+    }
+
+private:
+    static constexpr char kMagic[8] = {'W', 'D', 'C', 'E', 'R', 'T', 'S', '1'};
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    uint32_t add_cert(const DiveCert& cert, bool& fresh) {
+        CertFingerprint fp;
+        if (!cert_fingerprint_parse(cert.sha256, fp)) return kNone;
+        auto it = by_fingerprint_.find(fp);
+        if (it != by_fingerprint_.end()) return it->second;
+
+        uint32_t id = uint32_t(fingerprints_.size());
+        fingerprints_.push_back(fp);
+        subjects_.push_back(intern(cert.subject));
+        issuers_.push_back(intern(cert.issuer));
+        not_before_.push_back(cert.not_before);
+        not_after_.push_back(cert.not_after);
+        flags_.push_back(cert.is_ca ? CERT_CA : 0);
+        by_fingerprint_.emplace(fp, id);
+        fresh = true;
+        return id;
+    }
+
+    uint32_t intern(const std::string& s) {
+        auto it = string_ids_.find(s);
+        if (it != string_ids_.end()) return it->second;
+        uint32_t id = uint32_t(string_offsets_.size());
+        string_offsets_.push_back(uint32_t(pool_.size()));
+        pool_.insert(pool_.end(), s.begin(), s.end());
+        pool_.push_back('\0');
+        string_ids_.emplace(s, id);
+        return id;
+    }
+
+    // Every id and offset read from disk points inside the loaded tables,
+    // and every pooled string ends inside the pool
+    bool consistent() const {
+        if (!string_offsets_.empty() && (pool_.empty() || pool_.back() != '\0')) return false;
+        for (uint32_t offset : string_offsets_) {
+            if (offset >= pool_.size()) return false;
+        }
+        uint32_t strings = uint32_t(string_offsets_.size());
+        for (size_t id = 0; id < fingerprints_.size(); id++) {
+            if (subjects_[id] >= strings || issuers_[id] >= strings) return false;
+        }
+        for (size_t row = 0; row < host_names_.size(); row++) {
+            if (host_names_[row] >= strings) return false;
+            if (uint64_t(chain_begin_[row]) + chain_length_[row] > chain_refs_.size()) return false;
+        }
+        for (uint32_t id : chain_refs_) {
+            if (id >= fingerprints_.size()) return false;
+        }
+        return true;
+    }
+
+    std::string string_at(uint32_t id) const { return std::string(&pool_[string_offsets_[id]]); }
+
+    // Drop reference runs left behind by rescanned hosts
+    void compact() {
+        if (garbage_ == 0) return;
+        std::vector<uint32_t> refs;
+        refs.reserve(chain_refs_.size() - garbage_);
+        for (uint32_t row = 0; row < host_names_.size(); row++) {
+            uint32_t begin = uint32_t(refs.size());
+            refs.insert(refs.end(), chain_refs_.begin() + chain_begin_[row],
+                        chain_refs_.begin() + chain_begin_[row] + chain_length_[row]);
+            chain_begin_[row] = begin;
+        }
+        chain_refs_ = std::move(refs);
+        garbage_ = 0;
+    }
+
+    template <typename T>
+    static void write_column(FILE* f, const std::vector<T>& column) {
+        if (!column.empty()) fwrite(column.data(), sizeof(T), column.size(), f);
+    }
+
+    // A count larger than what is left of the file fails before allocating
+    template <typename T>
+    static bool read_column(FILE* f, uint64_t file_size, std::vector<T>& column, uint32_t count) {
+        long at = ftell(f);
+        if (at < 0 || uint64_t(count) * sizeof(T) > file_size - std::min(file_size, uint64_t(at))) return false;
+        column.resize(count);
+        return count == 0 || fread(column.data(), sizeof(T), count, f) == count;
+    }
+
+    // Interned strings: subjects, issuers and host names
+    std::vector<char> pool_;
+    std::vector<uint32_t> string_offsets_;
+    std::unordered_map<std::string, uint32_t> string_ids_;
+
+    // One row per distinct certificate
+    std::vector<CertFingerprint> fingerprints_;
+    std::vector<uint32_t> subjects_;
+    std::vector<uint32_t> issuers_;
+    std::vector<int64_t> not_before_;
+    std::vector<int64_t> not_after_;
+    std::vector<uint8_t> flags_;
+    std::unordered_map<CertFingerprint, uint32_t, CertFingerprintHash> by_fingerprint_;
+
+    // One row per host: a run of certificate ids in chain_refs_
+    std::vector<uint32_t> host_names_;
+    std::vector<uint32_t> chain_begin_;
+    std::vector<uint16_t> chain_length_;
+    std::vector<uint32_t> chain_refs_;
+    std::unordered_map<uint32_t, uint32_t> by_host_;
+    size_t garbage_ = 0;
+};
+
+inline std::string cert_date(int64_t when) {
+    std::time_t t = std::time_t(when);
+    std::tm tm{};
+    gmtime_r(&t, &tm);
+    char buf[32];
+    strftime(buf, sizeof(buf), "%Y-%m-%d", &tm);
+    return buf;
+}
+
+// One "[Cert]" line for a newly stored certificate
+inline void print_stored_cert(const CertStore& store, uint32_t id, std::ostream& out = std::cout) {
+    uint8_t flags = store.flags(id);
+    out << "[Cert] " << cert_fingerprint_hex(store.fingerprint(id), 8) << " " << store.subject(id) << " | issuer "
+        << store.issuer(id) << " | " << cert_date(store.not_before(id)) << " .. " << cert_date(store.not_after(id))
+        << ((flags & CertStore::CERT_CA) ? " | CA" : "") << "\n";
+}
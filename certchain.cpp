@@ -1,55 +1,179 @@
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
 #include <iostream>
 #include <string>
 #include <curl/curl.h>
+#include "dive.h"
+#include "batch.h"
+#include "cert_store.h"
 
-void printChain(CURL* curl) {
-    struct curl_certinfo* certinfo = nullptr;
-    CURLcode res = curl_easy_getinfo(curl, CURLINFO_CERTINFO, &certinfo);
+// "host:port" for the store's host rows
+static std::string store_host(const DiveResult& r) {
+    return r.host + ":" + std::to_string(r.port);
+}
 
-    if (res != CURLE_OK || !certinfo) {
-        std::cout << "No SSL certificate information available." << std::endl;
+// Add a host's chain to the store: one "[Chain]" line with short
+// fingerprints, and a "[Cert]" line only for certificates not seen before
+static void store_chain(CertStore& store, const DiveResult& r) {
+    if (r.tls.chain.empty()) {
+        std::cout << "[Chain] " << store_host(r) << " -> (no certificates, not stored)\n";
         return;
     }
+    std::vector<bool> added;
+    std::vector<uint32_t> ids = store.add_chain(store_host(r), r.tls.chain, &added);
+    std::cout << "[Chain] " << store_host(r) << " ->";
+    for (uint32_t id : ids) std::cout << " " << cert_fingerprint_hex(store.fingerprint(id), 4);
+    std::cout << "\n";
+    for (size_t i = 0; i < ids.size(); i++) {
+        if (added[i]) print_stored_cert(store, ids[i]);
+    }
+}
 
-    std::cout << "--- Certificate Chain ---" << std::endl;
+static void print_hosts(const CertStore& store, const std::vector<uint32_t>& certs) {
+    for (uint32_t row : store.hosts_with(certs)) std::cout << "  " << store.host(row) << "\n";
+}
 
-    for (int i = 0; i < certinfo->num_of_certs; ++i) {
-        std::cout << "\nCertificate " << (i + 1) << ":" << std::endl;
-        struct curl_slist* slist = certinfo->certinfo[i];
-        while (slist) {
-            std::cout << "  " << slist->data << std::endl;
-            slist = slist->next;
+// --query stats | expiring <days> | chains-to <fingerprint prefix|subject>
+static int run_query(const CertStore& store, int argc, char* argv[], int at) {
+    std::string query = argv[at];
+    if (query == "stats") {
+        std::cout << "[Store] " << store.host_count() << " hosts, " << store.cert_count() << " distinct certificates, "
+                  << store.reference_count() << " chain references, " << store.string_bytes()
+                  << " bytes of names\n";
+    } else if (query == "expiring" && at + 1 < argc) {
+        long days = std::strtol(argv[at + 1], nullptr, 10);
+        int64_t now = int64_t(std::time(nullptr));
+        std::vector<uint32_t> leaves = store.leaves_expiring_before(now + int64_t(days) * 86400);
+        std::cout << "[Store] " << leaves.size() << " leaf certificates expiring within " << days << " days\n";
+        for (uint32_t id : leaves) {
+            print_stored_cert(store, id);
+            print_hosts(store, {id});
         }
+    } else if (query == "chains-to" && at + 1 < argc) {
+        std::vector<uint32_t> certs = store.find(argv[at + 1]);
+        std::cout << "[Store] " << certs.size() << " certificates match \"" << argv[at + 1] << "\"\n";
+        for (uint32_t id : certs) print_stored_cert(store, id);
+        std::vector<uint32_t> hosts = store.hosts_with(certs);
+        std::cout << "[Store] " << hosts.size() << " hosts chain to them\n";
+        print_hosts(store, certs);
+    } else {
+        std::cerr << "Unknown query: " << query << std::endl;
+        return 1;
     }
+    return 0;
 }
 
 int main(int argc, char* argv[]) {
     if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <url>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <url> [--resume] [--store <file>]" << std::endl;
+        print_batch_usage(argv[0]);
+        std::cerr << "       " << argv[0] << " --store <file> --query stats|expiring <days>|chains-to <fp|subject>\n";
+        return 1;
+    }
+
+    // --store <file>: add every chain seen to a deduplicated certificate
+    // store instead of printing it in full; --query reads the store back
+    std::string store_path;
+    int query_at = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--store") == 0 && i + 1 < argc) store_path = argv[++i];
+        else if (strcmp(argv[i], "--query") == 0 && i + 1 < argc) query_at = ++i;
+    }
+    CertStore store;
+    if (!store_path.empty() && !store.load(store_path)) {
+        std::cerr << "Not a certificate store: " << store_path << std::endl;
         return 1;
     }
+    if (query_at) {
+        if (store_path.empty()) {
+            std::cerr << "--query needs --store <file>" << std::endl;
+            return 1;
+        }
+        return run_query(store, argc, argv, query_at);
+    }
+    auto save_store = [&] {
+        if (store_path.empty()) return;
+        if (!store.save(store_path)) std::cerr << "Failed to write " << store_path << std::endl;
+        std::cerr << "[Store] " << store.host_count() << " hosts, " << store.cert_count()
+                  << " distinct certificates\n";
+    };
 
     curl_global_init(CURL_GLOBAL_DEFAULT);
 
-    CURL* curl = curl_easy_init();
-    if (curl) {
-        curl_easy_setopt(curl, CURLOPT_URL, argv[1]);
-        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
-        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2L);
-        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-        curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
-        curl_easy_setopt(curl, CURLOPT_CERTINFO, 1L);
-
-        CURLcode res = curl_easy_perform(curl);
-        if (res == CURLE_OK) {
-            printChain(curl);
-        } else {
-            std::cerr << "curl_easy_perform() failed: " 
-                      << curl_easy_strerror(res) << std::endl;
+    DiveOptions options;
+    options.nobody = true;
+    options.keep_body = false;
+    options.debug_events = false;
+    options.tls_info = false;
+    if (!store_path.empty()) {
+        // The store needs the parsed chain, not curl's text dump of it
+        options.tls_info = true;
+        options.certinfo = false;
+    }
+
+    // --resume: resume TLS sessions from the shared cache and report full
+    // vs resumed handshakes. Off by default: a resumed handshake carries no
+    // certificates, and the chain is what this tool is for.
+    bool resume = false;
+    for (int i = 2; i < argc; i++) resume = resume || strcmp(argv[i], "--resume") == 0;
+    if (resume) options.tls_sessions = &TlsSessionCache::shared();
+
+    // --results <file>: also append a fixed-schema row per probe; the leaf
+    // fingerprint and expiry come from the parsed chain
+    std::unique_ptr<ResultsWriter> results;
+    if (!open_results_arg(argc, argv, "certchain", results)) return 1;
+    if (results) options.tls_info = true;
+
+    BatchOptions batch;
+    if (parse_batch_args(argc, argv, batch)) {
+        batch.results = results.get();
+        unsigned long full = 0, resumed = 0;
+        double full_ms = 0, resumed_ms = 0;
+        size_t failed = run_batch(batch, options, [&](const DiveResult& r) {
+            if (store_path.empty()) print_certchain(r);
+            else store_chain(store, r);
+            print_tls_handshake(r);
+            if (!r.tls.handshake_known) return;
+            double ms = (r.timings.appconnect - r.timings.connect) / 1000.0;
+            if (r.tls.resumed) {
+                resumed++;
+                resumed_ms += ms;
+            } else {
+                full++;
+                full_ms += ms;
+            }
+        });
+        if (resume) {
+            std::cerr << "[TLS session] " << full << " full (avg " << (full ? full_ms / full : 0) << " ms), "
+                      << resumed << " resumed (avg " << (resumed ? resumed_ms / resumed : 0) << " ms)\n";
+            save_tls_session_cache();
         }
+        close_results(results);
+        save_store();
+        curl_global_cleanup();
+        return failed > 0 ? 1 : 0;
+    }
 
-        curl_easy_cleanup(curl);
+    DiveResult result = dive(argv[1], options);
+    if (result.ok() && !store_path.empty()) {
+        store_chain(store, result);
+        print_tls_handshake(result);
+    } else if (result.ok()) {
+        print_certchain(result);
+        if (result.tls.resumed && result.certinfo.empty()) {
+            std::cout << "(Session resumed: the server sent no certificates; run without --resume for the chain)\n";
+        }
+        print_tls_handshake(result);
+    } else {
+        std::cerr << "curl_easy_perform() failed: " 
+                  << result.error() << std::endl;
     }
+    if (results) results->append(result);
+    close_results(results);
+    print_dns_cache_stats();
+    if (resume) save_tls_session_cache();
+    save_store();
 
     curl_global_cleanup();
     return 0;
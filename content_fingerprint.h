@@ -0,0 +1,382 @@
+// content_fingerprint.h
+// Streaming fingerprints of a page's visible text, and an index that
+// clusters near-duplicate pages.
+//
+// ContentFingerprinter is fed body chunks from the write callback as they
+// arrive. It skips tags, comments, scripts and styles, splits the text
+// into lower-case words, and hashes every run of kShingleWords words (a
+// shingle) into two sketches:
+//
+//   SimHash: 64 bits, each the sign of the sum of that bit over all
+//            shingles; similar texts differ in few bits.
+//   MinHash: for each of kMinHashes hash functions, the smallest shingle
+//            hash seen; the share of equal slots between two pages
+//            estimates the Jaccard similarity of their shingle sets.
+//
+// Nothing of the body is kept: the state is the current word's hash, the
+// last few word hashes and the sketches.
+//
+// NearDuplicateIndex splits each MinHash into kBands bands and buckets the
+// page under each band's hash (locality-sensitive hashing). A new page is
+// only compared with the pages sharing a bucket, never with the whole
+// batch. Matches above the threshold, and pages with the same exact body
+// hash, are joined into clusters with a union-find.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static const int kShingleWords = 4;
+static const int kMinHashes = 64;
+
+struct ContentFingerprint {
+    uint64_t simhash = 0;
+    std::array<uint32_t, kMinHashes> minhash{};
+    uint64_t shingles = 0;
+    uint64_t text_bytes = 0;  // visible text, separators included
+};
+
+// MinHash estimate of the Jaccard similarity of two pages' shingles
+inline double fingerprint_similarity(const ContentFingerprint& a, const ContentFingerprint& b) {
+    if (a.shingles == 0 || b.shingles == 0) return a.shingles == b.shingles ? 1.0 : 0.0;
+    int same = 0;
+    for (int i = 0; i < kMinHashes; i++) same += a.minhash[i] == b.minhash[i];
+    return double(same) / kMinHashes;
+}
+
+inline int fingerprint_distance(const ContentFingerprint& a, const ContentFingerprint& b) {
+    return __builtin_popcountll(a.simhash ^ b.simhash);
+}
+
+class ContentFingerprinter {
+public:
+    ContentFingerprinter() {
+        counts_.fill(0);
+        result_.minhash.fill(UINT32_MAX);
+    }
+
+    void feed(const char* data, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            unsigned char c = static_cast<unsigned char>(data[i]);
+            switch (state_) {
+                case TEXT:
+                    if (c == '<') {
+                        end_word();
+                        state_ = TAG_START;
+                        tag_len_ = 0;
+                    } else if (c == '&') {
+                        end_word();
+                        state_ = ENTITY;
+                        entity_len_ = 0;
+                    } else {
+                        text(c);
+                    }
+                    break;
+                case TAG_START:
+                    // "<!--" opens a comment, anything else a tag or declaration
+                    if (c == '!' && tag_len_ == 0) {
+                        tag_[tag_len_++] = '!';
+                    } else if (c == '-' && tag_len_ >= 1 && tag_len_ < 3 && tag_[0] == '!') {
+                        tag_[tag_len_++] = '-';
+                        if (tag_len_ == 3) {
+                            state_ = COMMENT;
+                            dashes_ = 0;
+                        }
+                    } else if (c == '>') {
+                        close_tag();
+                    } else if (is_space(c) || c == '/') {
+                        state_ = tag_len_ > 0 || c != '/' ? TAG : TAG_START;
+                        if (c == '/' && tag_len_ == 0) closing_ = true;
+                    } else {
+                        if (tag_len_ < sizeof(tag_)) tag_[tag_len_++] = char(lower(c));
+                        else state_ = TAG;
+                    }
+                    break;
+                case TAG:
+                    if (c == '>') close_tag();
+                    break;
+                case COMMENT:
+                    if (c == '>' && dashes_ >= 2) state_ = TEXT;
+                    dashes_ = c == '-' ? dashes_ + 1 : 0;
+                    break;
+                case RAW:
+                    // Inside <script> or <style> until "</script" / "</style"
+                    if (lower(c) == raw_end_[raw_match_]) {
+                        if (++raw_match_ == raw_end_len_) {
+                            state_ = TAG;
+                            closing_ = true;
+                            raw_match_ = 0;
+                        }
+                    } else {
+                        raw_match_ = c == '<' ? 1 : 0;
+                    }
+                    break;
+                case ENTITY:
+                    if (c == ';' || is_space(c) || ++entity_len_ > 10) state_ = TEXT;
+                    if (c == '<') {
+                        state_ = TAG_START;
+                        tag_len_ = 0;
+                    }
+                    break;
+            }
+        }
+    }
+
+    // The sketches, once the body is complete
+    ContentFingerprint finish() {
+        end_word();
+        // A page shorter than one shingle still gets one from what it has
+        if (result_.shingles == 0 && words_ > 0) add_shingle(shingle());
+        ContentFingerprint out = result_;
+        out.simhash = 0;
+        for (int bit = 0; bit < 64; bit++) {
+            if (counts_[size_t(bit)] > 0) out.simhash |= 1ULL << bit;
+        }
+        return out;
+    }
+
+private:
+    enum State : uint8_t { TEXT, TAG_START, TAG, COMMENT, RAW, ENTITY };
+
+    static bool is_space(unsigned char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f'; }
+    static unsigned char lower(unsigned char c) { return c >= 'A' && c <= 'Z' ? c + 32 : c; }
+    static bool word_byte(unsigned char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c >= 0x80;
+    }
+
+    static uint64_t mix(uint64_t x) {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        return x ^ (x >> 33);
+    }
+
+    // Odd multipliers and offsets for the MinHash functions, the same in
+    // every process so fingerprints stay comparable
+    struct Seeds {
+        std::array<uint64_t, kMinHashes> a, b;
+        Seeds() {
+            uint64_t s = 0x9e3779b97f4a7c15ULL;
+            for (int i = 0; i < kMinHashes; i++) {
+                a[size_t(i)] = mix(s += 0x9e3779b97f4a7c15ULL) | 1;
+                b[size_t(i)] = mix(s += 0x9e3779b97f4a7c15ULL);
+            }
+        }
+    };
+    static const Seeds& seeds() {
+        static const Seeds s;
+        return s;
+    }
+
+    void close_tag() {
+        state_ = TEXT;
+        if (closing_) {
+            closing_ = false;
+            return;
+        }
+        auto is = [&](const char* name, size_t n) { return tag_len_ == n && std::equal(name, name + n, tag_); };
+        if (is("script", 6)) start_raw("</script");
+        if (is("style", 5)) start_raw("</style");
+    }
+
+    void start_raw(const char* end) {
+        raw_end_ = end;
+        raw_end_len_ = int(std::char_traits<char>::length(end));
+        raw_match_ = 0;
+        state_ = RAW;
+    }
+
+    void text(unsigned char c) {
+        result_.text_bytes++;
+        if (word_byte(c)) {
+            word_hash_ = (word_hash_ ^ lower(c)) * 1099511628211ULL;
+            in_word_ = true;
+        } else {
+            end_word();
+        }
+    }
+
+    void end_word() {
+        if (!in_word_) return;
+        recent_[words_ % kShingleWords] = word_hash_;
+        words_++;
+        word_hash_ = 14695981039346656037ULL;
+        in_word_ = false;
+        if (words_ >= uint64_t(kShingleWords)) add_shingle(shingle());
+    }
+
+    // Hash of the last kShingleWords words, in order
+    uint64_t shingle() const {
+        uint64_t h = 0;
+        uint64_t n = std::min<uint64_t>(words_, kShingleWords);
+        for (uint64_t i = words_ - n; i < words_; i++) h = mix(h ^ recent_[i % kShingleWords]);
+        return h;
+    }
+
+    void add_shingle(uint64_t h) {
+        result_.shingles++;
+        for (int bit = 0; bit < 64; bit++) counts_[size_t(bit)] += (h >> bit) & 1 ? 1 : -1;
+        const Seeds& s = seeds();
+        for (int i = 0; i < kMinHashes; i++) {
+            uint32_t v = uint32_t((s.a[size_t(i)] * h + s.b[size_t(i)]) >> 32);
+            if (v < result_.minhash[size_t(i)]) result_.minhash[size_t(i)] = v;
+        }
+    }
+
+    State state_ = TEXT;
+    char tag_[8];
+    size_t tag_len_ = 0;
+    bool closing_ = false;
+    int dashes_ = 0;
+    int entity_len_ = 0;
+    const char* raw_end_ = "";
+    int raw_end_len_ = 0;
+    int raw_match_ = 0;
+
+    uint64_t word_hash_ = 14695981039346656037ULL;
+    bool in_word_ = false;
+    uint64_t recent_[kShingleWords] = {};
+    uint64_t words_ = 0;
+    std::array<int32_t, 64> counts_;
+    ContentFingerprint result_;
+};
+
+class NearDuplicateIndex {
+public:
+    static const int kBands = 16;  // of kMinHashes / kBands rows each
+    static const int kRows = kMinHashes / kBands;
+    static const size_t kMaxCompare = 16;  // most recent members of a bucket compared with a new page
+
+    explicit NearDuplicateIndex(double threshold = 0.8) : threshold_(threshold) {}
+
+    size_t add(const std::string& url, uint64_t exact, const ContentFingerprint& fp) {
+        size_t id = pages_.size();
+        pages_.push_back(Page{url, exact, fp});
+        parent_.push_back(id);
+
+        auto same = exact_.find(exact);
+        if (same != exact_.end()) {
+            exact_duplicates_++;
+            join(id, same->second);
+        } else {
+            exact_.emplace(exact, id);
+        }
+
+        for (int band = 0; band < kBands; band++) {
+            uint64_t key = uint64_t(band) << 56;
+            for (int r = 0; r < kRows; r++) key = mix(key ^ fp.minhash[size_t(band * kRows + r)]);
+            std::vector<size_t>& bucket = buckets_[key];
+            lookups_++;
+            size_t from = bucket.size() > kMaxCompare ? bucket.size() - kMaxCompare : 0;
+            for (size_t i = from; i < bucket.size(); i++) {
+                size_t other = bucket[i];
+                if (find(other) == find(id)) continue;
+                comparisons_++;
+                if (fingerprint_similarity(fp, pages_[other].fp) >= threshold_) join(id, other);
+            }
+            bucket.push_back(id);
+        }
+        return id;
+    }
+
+    // Groups of two or more pages, largest first
+    std::vector<std::vector<size_t>> clusters() {
+        std::unordered_map<size_t, std::vector<size_t>> groups;
+        for (size_t i = 0; i < pages_.size(); i++) groups[find(i)].push_back(i);
+        std::vector<std::vector<size_t>> out;
+        for (auto& g : groups) {
+            if (g.second.size() > 1) out.push_back(std::move(g.second));
+        }
+        std::sort(out.begin(), out.end(), [](const auto& a, const auto& b) {
+            return a.size() != b.size() ? a.size() > b.size() : a.front() < b.front();
+        });
+        return out;
+    }
+
+    size_t size() const { return pages_.size(); }
+    const std::string& url(size_t id) const { return pages_[id].url; }
+    uint64_t exact(size_t id) const { return pages_[id].exact; }
+    const ContentFingerprint& fingerprint(size_t id) const { return pages_[id].fp; }
+    double threshold() const { return threshold_; }
+    uint64_t exact_duplicates() const { return exact_duplicates_; }
+    uint64_t lookups() const { return lookups_; }
+    uint64_t comparisons() const { return comparisons_; }
+
+private:
+    struct Page {
+        std::string url;
+        uint64_t exact;
+        ContentFingerprint fp;
+    };
+
+    static uint64_t mix(uint64_t x) {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        return x;
+    }
+
+    size_t find(size_t i) {
+        while (parent_[i] != i) {
+            parent_[i] = parent_[parent_[i]];
+            i = parent_[i];
+        }
+        return i;
+    }
+
+    void join(size_t a, size_t b) {
+        a = find(a);
+        b = find(b);
+        if (a != b) parent_[std::max(a, b)] = std::min(a, b);
+    }
+
+    double threshold_;
+    std::vector<Page> pages_;
+    std::vector<size_t> parent_;
+    std::unordered_map<uint64_t, size_t> exact_;
+    std::unordered_map<uint64_t, std::vector<size_t>> buckets_;
+    uint64_t exact_duplicates_ = 0;
+    uint64_t lookups_ = 0;
+    uint64_t comparisons_ = 0;
+};
+
+inline void print_fingerprint(uint64_t exact, const ContentFingerprint& fp, std::ostream& out = std::cout) {
+    char buf[160];
+    snprintf(buf, sizeof(buf), "[Fingerprint] exact %016llx simhash %016llx, %llu shingles over %llu text bytes\n",
+             (unsigned long long)exact, (unsigned long long)fp.simhash, (unsigned long long)fp.shingles,
+             (unsigned long long)fp.text_bytes);
+    out << buf;
+}
+
+// "[Duplicates] ..." summary and one "[Cluster]" line per group
+inline void print_duplicate_report(NearDuplicateIndex& index, std::ostream& out = std::cout, size_t max_urls = 5) {
+    std::vector<std::vector<size_t>> clusters = index.clusters();
+    size_t clustered = 0;
+    for (const auto& c : clusters) clustered += c.size();
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.2f", index.threshold());
+    out << "[Duplicates] " << index.size() << " pages: " << clusters.size() << " clusters of identical or similar pages ("
+        << clustered << " pages, " << index.exact_duplicates() << " exact copies) at similarity >= " << buf << "; "
+        << index.lookups() << " bucket lookups, " << index.comparisons() << " comparisons\n";
+
+    for (size_t i = 0; i < clusters.size(); i++) {
+        const std::vector<size_t>& c = clusters[i];
+        double lowest = 1.0;
+        for (size_t id : c) lowest = std::min(lowest, fingerprint_similarity(index.fingerprint(c[0]), index.fingerprint(id)));
+        bool exact = std::all_of(c.begin(), c.end(), [&](size_t id) { return index.exact(id) == index.exact(c[0]); });
+        snprintf(buf, sizeof(buf), "%.2f", lowest);
+        out << "[Cluster " << i + 1 << "] " << c.size() << " pages, "
+            << (exact ? std::string("identical") : "similarity >= " + std::string(buf) + " to the first") << ":";
+        for (size_t k = 0; k < c.size() && k < max_urls; k++) out << " " << index.url(c[k]);
+        if (c.size() > max_urls) out << " (+" << c.size() - max_urls << " more)";
+        out << "\n";
+    }
+}
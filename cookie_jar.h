@@ -0,0 +1,482 @@
+// cookie_jar.h
+// RFC 6265 cookie jar shared by the transfers of a tool, and kept on disk
+// between runs.
+//
+// Set-Cookie lines are parsed as in section 5.2 (Expires, Max-Age, Domain,
+// Path, Secure, HttpOnly, plus SameSite from the 6265bis draft) and stored
+// as in 5.3. Cookies hang off a trie of domain labels, TLD first, so the
+// cookies for a request host are found by walking its labels once: domain
+// cookies are picked up on the way down, host-only cookies at the end.
+// There is no public suffix list; a Domain attribute without a dot (a bare
+// TLD) is refused, which is all curl does without libpsl.
+//
+// The file is binary ("WDCOOKS1", then one record per cookie with
+// length-prefixed strings), written to a temporary file and renamed, mode
+// 0600 since it holds session cookies. Session cookies are kept too, as
+// curl's own cookie jar does, so a login carries over to the next run.
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <arpa/inet.h>
+#include <curl/curl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum CookieSameSite : uint8_t { SAMESITE_UNSET, SAMESITE_NONE, SAMESITE_LAX, SAMESITE_STRICT };
+
+struct Cookie {
+    std::string name;
+    std::string value;
+    std::string domain;  // lowercase, no leading dot
+    std::string path;
+    int64_t expires = 0;   // unix seconds, 0 for a session cookie
+    int64_t creation = 0;  // unix microseconds, orders cookies of equal path length
+    bool host_only = true;
+    bool secure = false;
+    bool http_only = false;
+    CookieSameSite same_site = SAMESITE_UNSET;
+
+    // What the cookie costs in a Cookie header: "name=value"
+    size_t size() const { return name.size() + 1 + value.size(); }
+};
+
+// The parts of a request URL cookies care about
+struct CookieUrl {
+    std::string host;  // lowercase
+    std::string path;  // "/" if empty
+    bool secure = false;
+
+    static bool parse(const std::string& url, CookieUrl& out) {
+        CURLU* u = curl_url();
+        char* scheme = nullptr;
+        char* host = nullptr;
+        char* path = nullptr;
+        bool ok = curl_url_set(u, CURLUPART_URL, url.c_str(), CURLU_GUESS_SCHEME) == CURLUE_OK &&
+                  curl_url_get(u, CURLUPART_SCHEME, &scheme, 0) == CURLUE_OK &&
+                  curl_url_get(u, CURLUPART_HOST, &host, 0) == CURLUE_OK;
+        if (ok) {
+            out.host = host;
+            for (char& c : out.host) c = char(tolower(static_cast<unsigned char>(c)));
+            out.secure = strcmp(scheme, "https") == 0;
+            out.path = curl_url_get(u, CURLUPART_PATH, &path, 0) == CURLUE_OK && path && *path ? path : "/";
+        }
+        curl_free(scheme);
+        curl_free(host);
+        curl_free(path);
+        curl_url_cleanup(u);
+        return ok;
+    }
+};
+
+// What the jar does with a Set-Cookie line
+enum CookieVerdict { COOKIE_STORED, COOKIE_DELETED, COOKIE_MALFORMED, COOKIE_FOREIGN_DOMAIN, COOKIE_INSECURE };
+
+inline const char* cookie_verdict_name(CookieVerdict verdict) {
+    switch (verdict) {
+    case COOKIE_STORED: return "stored";
+    case COOKIE_DELETED: return "deleted";
+    case COOKIE_MALFORMED: return "ignored: malformed";
+    case COOKIE_FOREIGN_DOMAIN: return "ignored: Domain does not match the host";
+    case COOKIE_INSECURE: return "ignored: Secure cookie over http";
+    }
+    return "?";
+}
+
+inline std::string_view cookie_trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t' || s.back() == '\r' || s.back() == '\n')) {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+inline bool cookie_iequals(std::string_view a, const char* b) {
+    return a.size() == strlen(b) && strncasecmp(a.data(), b, a.size()) == 0;
+}
+
+// Section 5.1.4: the directory of the request path
+inline std::string cookie_default_path(const std::string& path) {
+    if (path.empty() || path[0] != '/') return "/";
+    size_t slash = path.rfind('/');
+    return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+inline bool cookie_path_match(const std::string& request_path, const std::string& cookie_path) {
+    if (request_path.compare(0, cookie_path.size(), cookie_path) != 0) return false;
+    return request_path.size() == cookie_path.size() || cookie_path.back() == '/' ||
+           request_path[cookie_path.size()] == '/';
+}
+
+inline bool cookie_host_is_ip(const std::string& host) {
+    unsigned char buf[sizeof(in6_addr)];
+    return host.find(':') != std::string::npos || host[0] == '[' || inet_pton(AF_INET, host.c_str(), buf) == 1;
+}
+
+// Section 5.2: parse the value of a Set-Cookie header (or the whole line,
+// "Set-Cookie:" included) received for the given URL. Expiry is resolved
+// against now; a cookie that is already expired comes back with expires
+// set to 1.
+inline bool parse_set_cookie(std::string_view line, const CookieUrl& url, Cookie& out, int64_t now) {
+    if (line.size() > 11 && strncasecmp(line.data(), "set-cookie:", 11) == 0) line.remove_prefix(11);
+    size_t semi = line.find(';');
+    std::string_view pair = line.substr(0, semi);
+    size_t eq = pair.find('=');
+    if (eq == std::string_view::npos) return false;
+    std::string_view name = cookie_trim(pair.substr(0, eq));
+    if (name.empty()) return false;
+
+    out = Cookie();
+    out.name.assign(name);
+    out.value.assign(cookie_trim(pair.substr(eq + 1)));
+
+    bool has_max_age = false;
+    std::string domain_attr;
+    std::string path_attr;
+    while (semi != std::string_view::npos) {
+        line.remove_prefix(semi + 1);
+        semi = line.find(';');
+        std::string_view attr = line.substr(0, semi);
+        size_t aeq = attr.find('=');
+        std::string_view key = cookie_trim(attr.substr(0, aeq));
+        std::string_view value = aeq == std::string_view::npos ? std::string_view() : cookie_trim(attr.substr(aeq + 1));
+
+        if (cookie_iequals(key, "expires")) {
+            if (has_max_age) continue;
+            time_t when = curl_getdate(std::string(value).c_str(), nullptr);
+            if (when != -1) out.expires = std::max<int64_t>(1, when);
+        } else if (cookie_iequals(key, "max-age")) {
+            if (value.empty() || !(isdigit(static_cast<unsigned char>(value[0])) || value[0] == '-')) continue;
+            long long delta = strtoll(std::string(value).c_str(), nullptr, 10);
+            out.expires = delta <= 0 ? 1 : now + delta;
+            has_max_age = true;
+        } else if (cookie_iequals(key, "domain")) {
+            domain_attr.assign(value);
+            if (!domain_attr.empty() && domain_attr[0] == '.') domain_attr.erase(0, 1);
+            for (char& c : domain_attr) c = char(tolower(static_cast<unsigned char>(c)));
+        } else if (cookie_iequals(key, "path")) {
+            path_attr.assign(value);
+        } else if (cookie_iequals(key, "secure")) {
+            out.secure = true;
+        } else if (cookie_iequals(key, "httponly")) {
+            out.http_only = true;
+        } else if (cookie_iequals(key, "samesite")) {
+            out.same_site = cookie_iequals(value, "strict") ? SAMESITE_STRICT
+                            : cookie_iequals(value, "lax") ? SAMESITE_LAX
+                            : cookie_iequals(value, "none") ? SAMESITE_NONE : SAMESITE_UNSET;
+        }
+    }
+
+    out.path = !path_attr.empty() && path_attr[0] == '/' ? path_attr : cookie_default_path(url.path);
+    if (domain_attr.empty() || domain_attr == url.host) {
+        out.domain = url.host;
+        out.host_only = true;
+    } else {
+        out.domain = domain_attr;
+        out.host_only = false;
+    }
+    return true;
+}
+
+class CookieJar {
+public:
+    // Per cookie domain, for the bloat report
+    struct Site {
+        std::string domain;
+        size_t cookies = 0;
+        size_t bytes = 0;
+        std::string largest;  // name of the largest cookie
+        size_t largest_bytes = 0;
+    };
+
+    // path may be empty for a jar that only lives in memory
+    explicit CookieJar(const std::string& path = "") : path_(path) {
+        nodes_.emplace_back();
+        load();
+    }
+
+    CookieJar(const CookieJar&) = delete;
+    CookieJar& operator=(const CookieJar&) = delete;
+
+    // Section 5.3: store, replace or delete the cookie from a Set-Cookie line
+    CookieVerdict set(const std::string& url, std::string_view line) {
+        CookieUrl target;
+        if (!CookieUrl::parse(url, target)) return COOKIE_MALFORMED;
+        return set(target, line);
+    }
+
+    CookieVerdict set(const CookieUrl& url, std::string_view line) {
+        int64_t now = time(nullptr);
+        Cookie cookie;
+        if (!parse_set_cookie(line, url, cookie, now)) return COOKIE_MALFORMED;
+        CookieVerdict verdict = check(url, cookie, now);
+        if (verdict != COOKIE_STORED && verdict != COOKIE_DELETED) return verdict;
+
+        std::vector<Cookie>& list = nodes_[node_for(cookie.domain, true)].cookies;
+        // Same name, domain (the node) and path replaces, host-only or not
+        // (RFC 6265 5.3 step 11)
+        auto same = std::find_if(list.begin(), list.end(), [&](const Cookie& c) {
+            return c.name == cookie.name && c.path == cookie.path;
+        });
+        dirty_ = true;
+        if (verdict == COOKIE_DELETED) {
+            if (same != list.end()) {
+                list.erase(same);
+                count_--;
+            }
+            return COOKIE_DELETED;
+        }
+        cookie.creation = same != list.end() ? same->creation : next_creation();
+        if (same != list.end()) {
+            *same = std::move(cookie);
+        } else {
+            list.push_back(std::move(cookie));
+            count_++;
+        }
+        return COOKIE_STORED;
+    }
+
+    // What set() would do with a parsed cookie received for url
+    static CookieVerdict check(const CookieUrl& url, const Cookie& cookie, int64_t now) {
+        if (!cookie.host_only &&
+            (cookie.domain.find('.') == std::string::npos || !domain_match(url.host, cookie.domain))) {
+            return COOKIE_FOREIGN_DOMAIN;
+        }
+        if (cookie.secure && !url.secure) return COOKIE_INSECURE;
+        return cookie.expires != 0 && cookie.expires <= now ? COOKIE_DELETED : COOKIE_STORED;
+    }
+
+    // Section 5.4: the Cookie header value for a request, longest path
+    // first, then oldest first. Empty when nothing matches.
+    std::string header_for(const std::string& url, size_t* count = nullptr) {
+        std::string header;
+        if (count) *count = 0;
+        CookieUrl target;
+        if (!CookieUrl::parse(url, target)) return header;
+
+        std::vector<const Cookie*> matches;
+        int64_t now = time(nullptr);
+        walk(target.host, [&](const Cookie& c, bool exact) {
+            if (c.host_only && !exact) return;
+            if (c.expires != 0 && c.expires <= now) return;
+            if (c.secure && !target.secure) return;
+            if (!cookie_path_match(target.path, c.path)) return;
+            matches.push_back(&c);
+        });
+        std::sort(matches.begin(), matches.end(), [](const Cookie* a, const Cookie* b) {
+            if (a->path.size() != b->path.size()) return a->path.size() > b->path.size();
+            return a->creation < b->creation;
+        });
+        for (const Cookie* c : matches) {
+            if (!header.empty()) header += "; ";
+            header += c->name;
+            header += '=';
+            header += c->value;
+        }
+        if (count) *count = matches.size();
+        return header;
+    }
+
+    size_t size() const { return count_; }
+
+    // Cookie count and bytes per cookie domain, largest first
+    std::vector<Site> sites() const {
+        std::vector<Site> out;
+        for (const Node& node : nodes_) {
+            if (node.cookies.empty()) continue;
+            Site site;
+            site.domain = node.cookies[0].domain;
+            for (const Cookie& c : node.cookies) {
+                site.cookies++;
+                site.bytes += c.size();
+                if (c.size() > site.largest_bytes) {
+                    site.largest_bytes = c.size();
+                    site.largest = c.name;
+                }
+            }
+            out.push_back(std::move(site));
+        }
+        std::sort(out.begin(), out.end(), [](const Site& a, const Site& b) { return a.bytes > b.bytes; });
+        return out;
+    }
+
+    // Write the unexpired cookies to disk. Returns false on failure.
+    bool save() {
+        if (path_.empty() || !dirty_) return true;
+        std::string tmp = path_ + ".tmp." + std::to_string(getpid());
+        mode_t old_mask = umask(077);
+        FILE* f = fopen(tmp.c_str(), "wb");
+        umask(old_mask);
+        if (!f) return false;
+        fwrite(kMagic, sizeof(kMagic), 1, f);
+        int64_t now = time(nullptr);
+        for (const Node& node : nodes_) {
+            for (const Cookie& c : node.cookies) {
+                if (c.expires != 0 && c.expires <= now) continue;
+                uint8_t flags = uint8_t((c.host_only ? 1 : 0) | (c.secure ? 2 : 0) | (c.http_only ? 4 : 0));
+                fwrite(&flags, 1, 1, f);
+                fwrite(&c.same_site, 1, 1, f);
+                fwrite(&c.expires, sizeof(int64_t), 1, f);
+                fwrite(&c.creation, sizeof(int64_t), 1, f);
+                write_field(f, c.name);
+                write_field(f, c.value);
+                write_field(f, c.domain);
+                write_field(f, c.path);
+            }
+        }
+        bool ok = fclose(f) == 0 && rename(tmp.c_str(), path_.c_str()) == 0;
+        if (!ok) unlink(tmp.c_str());
+        dirty_ = !ok;
+        return ok;
+    }
+
+private:
+    static constexpr char kMagic[8] = {'W', 'D', 'C', 'O', 'O', 'K', 'S', '1'};
+
+    // One domain label; children are keyed by the next label towards the host
+    struct Node {
+        std::map<std::string, uint32_t, std::less<>> children;
+        std::vector<Cookie> cookies;
+    };
+
+    static bool domain_match(const std::string& host, const std::string& domain) {
+        if (host == domain) return true;
+        return host.size() > domain.size() && !cookie_host_is_ip(host) &&
+               host.compare(host.size() - domain.size(), domain.size(), domain) == 0 &&
+               host[host.size() - domain.size() - 1] == '.';
+    }
+
+    // Labels right to left; an IP address is a single label, so domain
+    // cookies never match part of it
+    template <typename Fn>
+    static void for_each_label(const std::string& host, Fn fn) {
+        if (cookie_host_is_ip(host)) {
+            fn(std::string_view(host), true);
+            return;
+        }
+        std::string_view rest(host);
+        while (!rest.empty()) {
+            size_t dot = rest.rfind('.');
+            std::string_view label = dot == std::string_view::npos ? rest : rest.substr(dot + 1);
+            rest = dot == std::string_view::npos ? std::string_view() : rest.substr(0, dot);
+            if (!fn(label, rest.empty())) return;
+        }
+    }
+
+    uint32_t node_for(const std::string& domain, bool create) {
+        uint32_t node = 0;
+        for_each_label(domain, [&](std::string_view label, bool) {
+            auto it = nodes_[node].children.find(label);
+            if (it != nodes_[node].children.end()) {
+                node = it->second;
+                return true;
+            }
+            if (!create) {
+                node = UINT32_MAX;
+                return false;
+            }
+            uint32_t child = uint32_t(nodes_.size());
+            nodes_[node].children.emplace(std::string(label), child);
+            nodes_.emplace_back();
+            node = child;
+            return true;
+        });
+        return node;
+    }
+
+    // Every cookie stored on the path from the TLD down to the host; exact
+    // is true for the host's own node
+    template <typename Fn>
+    void walk(const std::string& host, Fn fn) const {
+        uint32_t node = 0;
+        for_each_label(host, [&](std::string_view label, bool last) {
+            auto it = nodes_[node].children.find(label);
+            if (it == nodes_[node].children.end()) return false;
+            node = it->second;
+            for (const Cookie& c : nodes_[node].cookies) fn(c, last);
+            return true;
+        });
+    }
+
+    int64_t next_creation() {
+        timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        int64_t us = int64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+        last_creation_ = std::max(us, last_creation_ + 1);
+        return last_creation_;
+    }
+
+    static void write_field(FILE* f, const std::string& s) {
+        uint32_t n = uint32_t(s.size());
+        fwrite(&n, sizeof(n), 1, f);
+        fwrite(s.data(), 1, n, f);
+    }
+
+    static bool read_field(FILE* f, std::string& s) {
+        uint32_t n = 0;
+        if (fread(&n, sizeof(n), 1, f) != 1 || n > (1u << 20)) return false;
+        s.resize(n);
+        return n == 0 || fread(&s[0], 1, n, f) == n;
+    }
+
+    void load() {
+        if (path_.empty()) return;
+        FILE* f = fopen(path_.c_str(), "rb");
+        if (!f) return;
+        char magic[sizeof(kMagic)];
+        if (fread(magic, sizeof(magic), 1, f) == 1 && memcmp(magic, kMagic, sizeof(kMagic)) == 0) {
+            int64_t now = time(nullptr);
+            Cookie c;
+            uint8_t flags = 0;
+            while (fread(&flags, 1, 1, f) == 1 && fread(&c.same_site, 1, 1, f) == 1 &&
+                   fread(&c.expires, sizeof(int64_t), 1, f) == 1 && fread(&c.creation, sizeof(int64_t), 1, f) == 1 &&
+                   read_field(f, c.name) && read_field(f, c.value) && read_field(f, c.domain) &&
+                   read_field(f, c.path)) {
+                if (c.expires != 0 && c.expires <= now) continue;
+                c.host_only = flags & 1;
+                c.secure = flags & 2;
+                c.http_only = flags & 4;
+                last_creation_ = std::max(last_creation_, c.creation);
+                nodes_[node_for(c.domain, true)].cookies.push_back(c);
+                count_++;
+            }
+        }
+        fclose(f);
+    }
+
+    std::string path_;
+    std::vector<Node> nodes_;  // nodes_[0] is the root
+    size_t count_ = 0;
+    int64_t last_creation_ = 0;
+    bool dirty_ = false;
+};
+
+// Servers commonly refuse request headers over 8 KB (nginx's default
+// large_client_header_buffers, Apache's LimitRequestFieldSize)
+constexpr size_t kCookieHeaderLimit = 8190;
+
+// "[Jar]" lines: totals, then cookie count and bytes per site
+inline void print_cookie_jar_report(const CookieJar& jar, std::ostream& out = std::cout) {
+    std::vector<CookieJar::Site> sites = jar.sites();
+    size_t bytes = 0;
+    for (const auto& site : sites) bytes += site.bytes;
+    out << "[Jar] " << jar.size() << " cookies for " << sites.size() << " sites, " << bytes << " bytes\n";
+    for (const auto& site : sites) {
+        out << "[Jar]   " << std::left << std::setw(32) << site.domain << std::right << std::setw(5) << site.cookies
+            << " cookies " << std::setw(7) << site.bytes << " bytes  (largest: " << site.largest << ", "
+            << site.largest_bytes << " bytes)";
+        if (site.bytes > kCookieHeaderLimit) out << "  over the 8 KB header limit";
+        out << "\n";
+    }
+}
@@ -1,73 +1,106 @@
+#include <cstring>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <curl/curl.h>
-#include <string.h>
-#include <algorithm> // For std::transform
+#include "dive.h"
+#include "daemon_protocol.h"
+#include "batch.h"
 
-// Callback function to process incoming headers
-// This function is called for every header received from the server.
-size_t header_callback(char* buffer, size_t size, size_t nitems, void* userdata) {
-    size_t total_size = size * nitems;
-    std::string header_line(buffer, total_size);
-
-    // Create a lowercase version of the header line for a case-insensitive comparison.
-    std::string lower_header = header_line;
-    std::transform(lower_header.begin(), lower_header.end(), lower_header.begin(),
-                   [](unsigned char c){ return std::tolower(c); });
-
-    // Check if the lowercase header starts with "set-cookie:"
-    if (lower_header.find("set-cookie:") == 0) {
-        // Print the original header line, which contains the cookie information
-        std::cout << "[Cookie] " << header_line;
-    }
-
-    return total_size;
-}
-
-// Dummy write callback to discard the response body
-// We are only interested in the headers for this tool.
-size_t write_callback(void* contents, size_t size, size_t nmemb, void* userp) {
-    return size * nmemb;
+// One line per Set-Cookie with the attributes as the jar reads them
+static void print_cookie_attributes(const DiveResult& r) {
+    CookieUrl url;
+    if (!CookieUrl::parse(r.url, url)) return;
+    int64_t now = time(nullptr);
+    r.headers.each(HEADER_SET_COOKIE, [&](const HeaderLine& h) {
+        Cookie c;
+        if (!parse_set_cookie(h.value, url, c, now)) {
+            std::cout << "[Cookie]   (malformed)\n";
+            return;
+        }
+        static const char* same_site[] = {"", " SameSite=None", " SameSite=Lax", " SameSite=Strict"};
+        std::cout << "[Cookie]   " << c.name << " (" << c.size() << " bytes) " << (c.host_only ? "host " : "domain .")
+                  << c.domain << " path " << c.path << " | "
+                  << (c.expires == 0 ? std::string("session")
+                      : c.expires <= now ? std::string("expired")
+                      : "expires in " + std::to_string(c.expires - now) + "s")
+                  << (c.secure ? " Secure" : "") << (c.http_only ? " HttpOnly" : "") << same_site[c.same_site]
+                  << " -> " << cookie_verdict_name(CookieJar::check(url, c, now)) << "\n";
+    });
 }
 
 int main(int argc, char* argv[]) {
+    // A running webdived answers from its warm connections instead
+    int daemon_status = 0;
+    if (daemon_forward("cookies", argc, argv, daemon_status)) return daemon_status;
+
     // Check if a URL was provided as a command-line argument
     if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <url>\n";
+        std::cerr << "Usage: " << argv[0] << " <url> [--jar <file>]\n";
+        print_batch_usage(argv[0]);
         return 1;
     }
 
-    std::string url = argv[1];
-    std::cout << "Performing request to: " << url << "\n\n";
+    // Only the Set-Cookie lines of the first response are of interest;
+    // the body is discarded as it arrives.
+    DiveOptions options;
+    options.follow_redirects = false;
+    options.keep_body = false;
+    options.debug_events = false;
+    options.tls_info = false;
+    options.certinfo = false;
 
-    // Initialize the curl session
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-        std::cerr << "Failed to initialize libcurl.\n";
-        return 1;
+    // --jar <file>: keep the cookies in a jar on disk and send them back on
+    // later requests, so a batch run sees the cookies built up by the URLs
+    // before it; ends with a per-site count and size report
+    std::unique_ptr<CookieJar> jar;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--jar") == 0) jar.reset(new CookieJar(argv[i + 1]));
+    }
+    options.cookie_jar = jar.get();
+
+    // --results <file>: also append a fixed-schema row per probe
+    std::unique_ptr<ResultsWriter> results;
+    if (!open_results_arg(argc, argv, "cookies", results)) return 1;
+    options.hash_body = results != nullptr;
+    auto view = [&](const DiveResult& r) {
+        print_cookies(r);
+        if (!jar) return;
+        print_cookie_attributes(r);
+        print_cookies_sent(r);
+    };
+    auto save_jar = [&] {
+        if (!jar) return;
+        std::cout << "\n";
+        print_cookie_jar_report(*jar);
+        if (!jar->save()) std::cerr << "Failed to save the cookie jar\n";
+    };
+
+    BatchOptions batch;
+    if (parse_batch_args(argc, argv, batch)) {
+        batch.results = results.get();
+        size_t failed = run_batch(batch, options, view);
+        close_results(results);
+        save_jar();
+        return failed > 0 ? 1 : 0;
     }
 
-    // Set the URL to fetch
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    std::string url = argv[1];
+    std::cout << "Performing request to: " << url << "\n\n";
 
-    // Set the header callback function to intercept and print cookies
-    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
-    
-    // Set a dummy write callback to discard the response body, as we don't need it.
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-    
-    // Perform the request
-    CURLcode res = curl_easy_perform(curl);
+    DiveResult result = dive(url, options);
+    view(result);
+    if (results) results->append(result);
+    close_results(results);
 
     // Check for errors
-    if (res != CURLE_OK) {
-        std::cerr << "\ncurl_easy_perform() failed: " << curl_easy_strerror(res) << "\n";
+    if (!result.ok()) {
+        std::cerr << "\ncurl_easy_perform() failed: " << result.error() << "\n";
     }
 
-    // Clean up the curl session
-    curl_easy_cleanup(curl);
-
     std::cout << "\nRequest complete.\n";
+    save_jar();
+    print_dns_cache_stats();
 
     return 0;
 }
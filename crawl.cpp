@@ -0,0 +1,743 @@
+// crawl.cpp
+// Concurrent crawler built on the dive engine and the streaming link
+// extractor.
+//
+// Workers each own a deque of pages to fetch. Links a worker discovers go
+// onto its own deque (newest first, so it stays on the part of the site it
+// is in); an idle worker steals the oldest page from another worker. Before
+// a page is fetched its host must grant a slot: every host has a token
+// bucket (--rate, --burst) and a cap on concurrent fetches (--per-host).
+// Pages for a host that is out of tokens are parked with that host, not
+// spun on, so other hosts keep going and parked pages come back in order
+// once the host is ready again.
+//
+// URLs are normalised (lower-case scheme and host, no default port, no
+// fragment) and only their 64-bit hash is kept in the visited set.
+// --checkpoint saves the visited set and every page not yet finished, and
+// a crawl started with the same checkpoint continues from there.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <shared_mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <curl/curl.h>
+#include "dive.h"
+#include "html_links.h"
+#include "results_store.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct CrawlItem {
+    std::string url;  // normalised
+    uint32_t depth = 0;
+};
+
+// Lower-case scheme and host, drop the default port and the fragment.
+// Returns "" for anything that is not http(s).
+std::string normalize_url(const std::string& url) {
+    CURLU* u = curl_url();
+    std::string out;
+    char* scheme = nullptr;
+    char* host = nullptr;
+    char* full = nullptr;
+    if (curl_url_set(u, CURLUPART_URL, url.c_str(), CURLU_GUESS_SCHEME) == CURLUE_OK &&
+        curl_url_get(u, CURLUPART_SCHEME, &scheme, 0) == CURLUE_OK &&
+        curl_url_get(u, CURLUPART_HOST, &host, 0) == CURLUE_OK &&
+        (strcasecmp(scheme, "http") == 0 || strcasecmp(scheme, "https") == 0)) {
+        std::string lower = host;
+        for (auto& c : lower) c = char(tolower(uint8_t(c)));
+        curl_url_set(u, CURLUPART_HOST, lower.c_str(), 0);
+        curl_url_set(u, CURLUPART_FRAGMENT, nullptr, 0);
+        if (curl_url_get(u, CURLUPART_URL, &full, CURLU_NO_DEFAULT_PORT) == CURLUE_OK) out = full;
+    }
+    curl_free(scheme);
+    curl_free(host);
+    curl_free(full);
+    curl_url_cleanup(u);
+    return out;
+}
+
+std::string url_host(const std::string& url) {
+    size_t start = url.find("://");
+    if (start == std::string::npos) return "";
+    start += 3;
+    size_t end = url.find_first_of("/?#", start);
+    std::string host = url.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    size_t at = host.rfind('@');
+    if (at != std::string::npos) host = host.substr(at + 1);
+    if (!host.empty() && host[0] == '[') return host.substr(0, host.find(']') + 1);
+    return host.substr(0, host.find(':'));
+}
+
+// ---------------------------------------------------------------------------
+// Visited set: 64-bit URL hashes in sharded open-addressed tables, 8 bytes
+// per URL. Two URLs colliding is the only way a page is wrongly skipped
+// (about 1 in 3e6 for a 10M page crawl).
+// ---------------------------------------------------------------------------
+
+class VisitedSet {
+public:
+    static uint64_t hash(const std::string& url) {
+        uint64_t h = 1469598103934665603ull;  // FNV-1a, then a splitmix64 finish for the low bits
+        for (unsigned char c : url) {
+            h ^= c;
+            h *= 1099511628211ull;
+        }
+        h ^= h >> 30;
+        h *= 0xbf58476d1ce4e5b9ull;
+        h ^= h >> 27;
+        h *= 0x94d049bb133111ebull;
+        h ^= h >> 31;
+        return h ? h : 1;  // 0 marks an empty slot
+    }
+
+    // True if the hash was not in the set yet
+    bool insert(uint64_t h) {
+        Shard& shard = shards_[h >> (64 - kShardBits)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if ((shard.count + 1) * 10 > shard.table.size() * 7) grow(shard);
+        size_t mask = shard.table.size() - 1;
+        for (size_t i = h & mask; ; i = (i + 1) & mask) {
+            if (shard.table[i] == h) return false;
+            if (shard.table[i] == 0) {
+                shard.table[i] = h;
+                shard.count++;
+                return true;
+            }
+        }
+    }
+
+    size_t size() {
+        size_t n = 0;
+        for (auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            n += shard.count;
+        }
+        return n;
+    }
+
+    // Every hash, for the checkpoint (callers stop the workers first)
+    template <typename Fn>
+    void for_each(Fn fn) {
+        for (auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for (uint64_t h : shard.table) {
+                if (h) fn(h);
+            }
+        }
+    }
+
+private:
+    static constexpr int kShardBits = 6;
+
+    struct Shard {
+        std::mutex mutex;
+        std::vector<uint64_t> table = std::vector<uint64_t>(1024);
+        size_t count = 0;
+    };
+
+    static void grow(Shard& shard) {
+        std::vector<uint64_t> old(shard.table.size() * 2);
+        old.swap(shard.table);
+        size_t mask = shard.table.size() - 1;
+        for (uint64_t h : old) {
+            if (!h) continue;
+            size_t i = h & mask;
+            while (shard.table[i]) i = (i + 1) & mask;
+            shard.table[i] = h;
+        }
+    }
+
+    Shard shards_[1 << kShardBits];
+};
+
+// ---------------------------------------------------------------------------
+// Per-host politeness: token bucket plus a concurrency cap. Pages for a host
+// that cannot take them yet are parked in FIFO order with the host, and the
+// host is put on a timer heap for when its next token is due.
+// ---------------------------------------------------------------------------
+
+class HostScheduler {
+public:
+    HostScheduler(double rate, double burst, int per_host)
+        : rate_(rate), burst_(std::max(1.0, burst)), per_host_(per_host) {}
+
+    // Take a slot for item's host now, or park the item. True if the caller
+    // may fetch it.
+    bool acquire_or_park(CrawlItem&& item) {
+        std::string host = url_host(item.url);
+        std::lock_guard<std::mutex> lock(mutex_);
+        Host& h = hosts_[host];
+        Clock::time_point now = Clock::now();
+        if (h.parked.empty() && try_take(h, now)) return true;
+
+        h.parked.push_back(std::move(item));
+        parked_++;
+        schedule(host, h, now);
+        return false;
+    }
+
+    // A parked page whose host is ready, with its slot already taken
+    bool take_parked(CrawlItem& out) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Clock::time_point now = Clock::now();
+        while (!timers_.empty() && timers_.top().first <= now) {
+            std::string host = timers_.top().second;
+            timers_.pop();
+            Host& h = hosts_[host];
+            h.timer_armed = false;
+            if (h.parked.empty()) continue;
+            if (!try_take(h, now)) {
+                schedule(host, h, now);
+                continue;
+            }
+            out = std::move(h.parked.front());
+            h.parked.pop_front();
+            parked_--;
+            if (!h.parked.empty()) schedule(host, h, now);
+            return true;
+        }
+        return false;
+    }
+
+    void release(const std::string& url) {
+        std::string host = url_host(url);
+        std::lock_guard<std::mutex> lock(mutex_);
+        Host& h = hosts_[host];
+        h.active--;
+        if (!h.parked.empty()) schedule(host, h, Clock::now());
+    }
+
+    // When the earliest parked page may become ready
+    Clock::time_point next_ready() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return timers_.empty() ? Clock::time_point::max() : timers_.top().first;
+    }
+
+    size_t parked() const { return parked_; }
+
+    template <typename Fn>
+    void for_each_parked(Fn fn) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& entry : hosts_) {
+            for (const auto& item : entry.second.parked) fn(item);
+        }
+    }
+
+private:
+    struct Host {
+        double tokens = -1;  // < 0: not initialised, starts with a full bucket
+        Clock::time_point refilled;
+        int active = 0;
+        bool timer_armed = false;
+        std::deque<CrawlItem> parked;
+    };
+
+    void refill(Host& h, Clock::time_point now) {
+        if (h.tokens < 0) {
+            h.tokens = burst_;
+        } else {
+            double elapsed = std::chrono::duration<double>(now - h.refilled).count();
+            h.tokens = std::min(burst_, h.tokens + elapsed * rate_);
+        }
+        h.refilled = now;
+    }
+
+    bool try_take(Host& h, Clock::time_point now) {
+        refill(h, now);
+        if (h.active >= per_host_ || h.tokens < 1.0) return false;
+        h.tokens -= 1.0;
+        h.active++;
+        return true;
+    }
+
+    // Wake the host when its next token is due. A host that is only
+    // waiting for a free slot is woken by release() instead.
+    void schedule(const std::string& host, Host& h, Clock::time_point now) {
+        if (h.timer_armed) return;
+        if (h.active >= per_host_ && h.tokens >= 1.0) return;
+        double wait = h.tokens >= 1.0 ? 0.0 : (1.0 - h.tokens) / rate_;
+        auto when = now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(wait));
+        timers_.push({when, host});
+        h.timer_armed = true;
+    }
+
+    using Timer = std::pair<Clock::time_point, std::string>;
+
+    double rate_;
+    double burst_;
+    int per_host_;
+    std::mutex mutex_;
+    std::unordered_map<std::string, Host> hosts_;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers_;
+    std::atomic<size_t> parked_{0};
+};
+
+// ---------------------------------------------------------------------------
+// Crawler
+// ---------------------------------------------------------------------------
+
+struct CrawlOptions {
+    int workers = 8;
+    uint32_t max_depth = 2;
+    size_t max_pages = 0;               // 0 = no limit
+    std::string scope = "host";         // host, domain or all
+    double rate = 2.0;                  // fetches per second per host
+    double burst = 2.0;
+    int per_host = 2;                   // concurrent fetches per host
+    size_t max_page_bytes = 4 << 20;    // larger bodies are cut off
+    std::string checkpoint;
+    int checkpoint_interval = 10;       // seconds
+    ResultsWriter* results = nullptr;   // a row per page fetched
+};
+
+std::atomic<bool> g_stop{false};
+
+void on_signal(int) { g_stop = true; }
+
+class Crawler {
+public:
+    explicit Crawler(const CrawlOptions& options)
+        : options_(options),
+          scheduler_(options.rate, options.burst, options.per_host),
+          queues_(options.workers),
+          in_flight_(options.workers) {}
+
+    // Seed from the start URL, or from the checkpoint when one exists
+    bool start(const std::string& url) {
+        std::string seed = normalize_url(url);
+        if (seed.empty()) {
+            std::cerr << "Not an http(s) URL: " << url << "\n";
+            return false;
+        }
+        root_ = url_host(seed);
+        if (options_.scope == "domain" && root_.compare(0, 4, "www.") == 0) root_ = root_.substr(4);
+
+        if (!options_.checkpoint.empty() && load_checkpoint()) return true;
+        visited_.insert(VisitedSet::hash(seed));
+        push(0, CrawlItem{seed, 0});
+        return true;
+    }
+
+    void run() {
+        auto started = Clock::now();
+        std::vector<std::thread> threads;
+        for (int i = 0; i < options_.workers; i++) threads.emplace_back([this, i] { worker(i); });
+
+        // The main thread only writes checkpoints
+        auto last_checkpoint = Clock::now();
+        while (outstanding_ > 0 && !g_stop) {
+            std::unique_lock<std::mutex> lock(idle_mutex_);
+            idle_cv_.wait_for(lock, std::chrono::milliseconds(200));
+            lock.unlock();
+            if (!options_.checkpoint.empty() &&
+                Clock::now() - last_checkpoint >= std::chrono::seconds(options_.checkpoint_interval)) {
+                save_checkpoint();
+                last_checkpoint = Clock::now();
+            }
+        }
+        done_ = true;
+        idle_cv_.notify_all();
+        for (auto& t : threads) t.join();
+
+        double elapsed = std::chrono::duration<double>(Clock::now() - started).count();
+        std::cerr << "[Crawl] " << fetched_ << " pages, " << failed_ << " failed, " << visited_.size()
+                  << " URLs seen, " << std::fixed << std::setprecision(2) << elapsed << "s ("
+                  << (elapsed > 0 ? (fetched_ - resumed_) / elapsed : 0) << " pages/s)\n";
+
+        if (options_.checkpoint.empty()) return;
+        if (outstanding_ > 0) {
+            save_checkpoint();
+            std::cerr << "[Crawl] Stopped; " << outstanding_ << " pages left in " << options_.checkpoint << "\n";
+        } else {
+            std::remove(options_.checkpoint.c_str());  // finished, nothing to resume
+        }
+    }
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<CrawlItem> items;
+    };
+
+    // Queue a page on a worker's deque
+    void push(int worker, CrawlItem&& item) {
+        outstanding_++;
+        {
+            std::lock_guard<std::mutex> lock(queues_[worker].mutex);
+            queues_[worker].items.push_back(std::move(item));
+        }
+        idle_cv_.notify_one();
+    }
+
+    // Own deque: newest first
+    bool pop_local(int worker, CrawlItem& out) {
+        WorkQueue& q = queues_[worker];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.items.empty()) return false;
+        out = std::move(q.items.back());
+        q.items.pop_back();
+        return true;
+    }
+
+    // Someone else's deque: oldest (shallowest) first
+    bool steal(int thief, CrawlItem& out) {
+        int n = int(queues_.size());
+        int start = int(std::hash<std::thread::id>()(std::this_thread::get_id()) % n);
+        for (int k = 0; k < n; k++) {
+            int victim = (start + k) % n;
+            if (victim == thief) continue;
+            WorkQueue& q = queues_[victim];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (q.items.empty()) continue;
+            out = std::move(q.items.front());
+            q.items.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    // Next page this worker may fetch right now, slot already taken
+    bool next(int id, CrawlItem& out) {
+        if (scheduler_.take_parked(out)) return true;
+        while (pop_local(id, out) || steal(id, out)) {
+            if (scheduler_.acquire_or_park(std::move(out))) return true;
+        }
+        return false;
+    }
+
+    void worker(int id) {
+        while (!done_ && !g_stop) {
+            CrawlItem item;
+            bool got;
+            {
+                // Moving a page between deques, parking and in-flight happens
+                // under the shared lock so a checkpoint never misses it
+                std::shared_lock<std::shared_mutex> lock(state_mutex_);
+                bool reserved = reserve_page();
+                got = reserved && next(id, item);
+                if (got) {
+                    in_flight_[id] = item;
+                } else if (reserved) {
+                    started_--;
+                }
+            }
+            if (!got) {
+                if (options_.max_pages && max_pages_done()) g_stop = true;
+                std::unique_lock<std::mutex> lock(idle_mutex_);
+                auto wake = std::min(scheduler_.next_ready(), Clock::now() + std::chrono::milliseconds(100));
+                idle_cv_.wait_until(lock, wake);
+                continue;
+            }
+
+            std::vector<CrawlItem> found = fetch(item);
+            scheduler_.release(item.url);
+
+            {
+                std::shared_lock<std::shared_mutex> lock(state_mutex_);
+                for (auto& child : found) push(id, std::move(child));
+                in_flight_[id] = CrawlItem();
+                outstanding_--;
+            }
+            idle_cv_.notify_all();
+        }
+    }
+
+    // Take one of the --max-pages slots before taking a page, so workers
+    // checking at the same time cannot all take the last one
+    bool reserve_page() {
+        size_t n = started_.load();
+        do {
+            if (options_.max_pages && n >= options_.max_pages) return false;
+        } while (!started_.compare_exchange_weak(n, n + 1));
+        return true;
+    }
+
+    // Every slot taken and every page fetched. Under the exclusive lock no
+    // worker holds a slot it may still hand back.
+    bool max_pages_done() {
+        std::unique_lock<std::shared_mutex> lock(state_mutex_);
+        if (started_ < options_.max_pages) return false;
+        for (const auto& item : in_flight_) {
+            if (!item.url.empty()) return false;
+        }
+        return true;
+    }
+
+    bool in_scope(const std::string& host) const {
+        if (options_.scope == "all") return true;
+        if (host == root_) return true;
+        if (options_.scope != "domain") return false;
+        return host.size() > root_.size() && host.compare(host.size() - root_.size(), root_.size(), root_) == 0 &&
+               host[host.size() - root_.size() - 1] == '.';
+    }
+
+    // Fetch one page, print its record and return the new pages it links to
+    std::vector<CrawlItem> fetch(const CrawlItem& item) {
+        std::vector<CrawlItem> found;
+        size_t links = 0;
+        bool want_links = item.depth < options_.max_depth;
+
+        auto follow = [&](const std::string& url) {
+            std::string next = normalize_url(url);
+            if (next.empty() || !in_scope(url_host(next))) return;
+            if (!visited_.insert(VisitedSet::hash(next))) return;
+            found.push_back(CrawlItem{next, item.depth + 1});
+        };
+
+        HtmlLinkExtractor extractor([&](const HtmlLink& link) {
+            links++;
+            // Navigation only: assets (img, script, css) are counted, not crawled
+            if (link.tag == "a" || link.tag == "area" || link.tag == "iframe" || link.tag == "frame" ||
+                link.tag == "meta") {
+                follow(link.url);
+            }
+        });
+
+        DiveOptions options;
+        options.keep_body = false;
+        options.debug_events = false;
+        options.tls_info = false;
+        options.certinfo = false;
+        options.hash_body = options_.results != nullptr;
+
+        const DiveResult* live = nullptr;
+        bool html = false;
+        size_t received = 0;
+        options.on_body = [&](const char* data, size_t size) {
+            if (received == 0) {
+                html = is_html(*live);
+                extractor.set_base(live->effective_url);
+            }
+            size = std::min(size, options_.max_page_bytes - received);
+            received += size;
+            if (html && want_links) extractor.feed(data, size);
+            return received < options_.max_page_bytes;
+        };
+
+        DiveTransfer transfer(item.url, options);
+        live = &transfer.result;
+        transfer.perform();
+        const DiveResult& r = transfer.result;
+        bool ok = r.ok() || (r.code == CURLE_WRITE_ERROR && received >= options_.max_page_bytes);
+        if (options_.results) options_.results->append(r);
+
+        // A redirect target is a page of its own; don't fetch it twice
+        if (ok && !r.effective_url.empty() && r.effective_url != item.url) {
+            std::string final_url = normalize_url(r.effective_url);
+            if (!final_url.empty()) visited_.insert(VisitedSet::hash(final_url));
+        }
+
+        std::ostringstream line;
+        line << "[Crawl] " << item.url << " -> ";
+        if (!ok) {
+            failed_++;
+            line << "error: " << r.error();
+        } else {
+            if (!r.effective_url.empty() && r.effective_url != item.url) line << r.effective_url << " ";
+            line << r.response_code;
+        }
+        line << " (depth " << item.depth << ", " << links << " links, " << found.size() << " new, "
+             << std::fixed << std::setprecision(3) << r.total_time_us / 1e6 << "s)\n";
+        {
+            std::lock_guard<std::mutex> lock(output_mutex_);
+            std::cout << line.str() << std::flush;
+        }
+        fetched_++;
+        return found;
+    }
+
+    static bool is_html(const DiveResult& r) {
+        // The last Content-Type seen belongs to the final response
+        std::string_view type = r.headers.last(HEADER_CONTENT_TYPE);
+        if (type.empty()) return true;  // no type given: try it
+        for (size_t i = 0; i + 4 <= type.size(); i++) {
+            if (header_name_is(type.substr(i, 4), "html")) return true;
+        }
+        return false;
+    }
+
+    // Checkpoint file:
+    //   "WDCRAWL1", u64 pages fetched, u64 visited count, visited hashes,
+    //   u64 pending count, then per page: u32 depth, u32 length, URL bytes.
+    // Written to a temporary file and renamed, so a kill mid-write leaves
+    // the previous checkpoint intact.
+    void save_checkpoint() {
+        std::vector<CrawlItem> pending;
+        std::vector<uint64_t> hashes;
+        {
+            std::unique_lock<std::shared_mutex> lock(state_mutex_);  // workers pause between pages
+            for (auto& q : queues_) {
+                std::lock_guard<std::mutex> qlock(q.mutex);
+                pending.insert(pending.end(), q.items.begin(), q.items.end());
+            }
+            scheduler_.for_each_parked([&](const CrawlItem& item) { pending.push_back(item); });
+            for (const auto& item : in_flight_) {
+                if (!item.url.empty()) pending.push_back(item);  // refetched on resume
+            }
+            visited_.for_each([&](uint64_t h) { hashes.push_back(h); });
+        }
+
+        std::string tmp = options_.checkpoint + ".tmp";
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        auto put64 = [&](uint64_t v) { out.write(reinterpret_cast<const char*>(&v), sizeof(v)); };
+        auto put32 = [&](uint32_t v) { out.write(reinterpret_cast<const char*>(&v), sizeof(v)); };
+        out.write("WDCRAWL1", 8);
+        put64(fetched_);
+        put64(hashes.size());
+        out.write(reinterpret_cast<const char*>(hashes.data()), hashes.size() * sizeof(uint64_t));
+        put64(pending.size());
+        for (const auto& item : pending) {
+            put32(item.depth);
+            put32(uint32_t(item.url.size()));
+            out.write(item.url.data(), item.url.size());
+        }
+        out.close();
+        if (!out || std::rename(tmp.c_str(), options_.checkpoint.c_str()) != 0) {
+            std::cerr << "[Crawl] Failed to write checkpoint " << options_.checkpoint << "\n";
+        }
+    }
+
+    bool load_checkpoint() {
+        std::ifstream in(options_.checkpoint, std::ios::binary);
+        if (!in) return false;
+        char magic[8];
+        uint64_t fetched = 0, nvisited = 0, npending = 0;
+        auto get64 = [&](uint64_t& v) { return bool(in.read(reinterpret_cast<char*>(&v), sizeof(v))); };
+        if (!in.read(magic, 8) || memcmp(magic, "WDCRAWL1", 8) != 0 || !get64(fetched) || !get64(nvisited)) {
+            std::cerr << "[Crawl] Ignoring unreadable checkpoint " << options_.checkpoint << "\n";
+            return false;
+        }
+        for (uint64_t i = 0; i < nvisited; i++) {
+            uint64_t h = 0;
+            if (!get64(h)) return false;
+            visited_.insert(h);
+        }
+        if (!get64(npending)) return false;
+        for (uint64_t i = 0; i < npending; i++) {
+            uint32_t depth = 0, len = 0;
+            in.read(reinterpret_cast<char*>(&depth), sizeof(depth));
+            in.read(reinterpret_cast<char*>(&len), sizeof(len));
+            std::string url(len, '\0');
+            if (!in.read(&url[0], len)) return false;
+            push(int(i % queues_.size()), CrawlItem{url, depth});
+        }
+        fetched_ = fetched;
+        resumed_ = fetched;
+        started_ = fetched;
+        std::cerr << "[Crawl] Resuming from " << options_.checkpoint << ": " << npending << " pending, "
+                  << nvisited << " URLs seen, " << fetched << " pages already fetched\n";
+        return true;
+    }
+
+    CrawlOptions options_;
+    std::string root_;
+    VisitedSet visited_;
+    HostScheduler scheduler_;
+    std::vector<WorkQueue> queues_;
+    std::vector<CrawlItem> in_flight_;  // per worker, for the checkpoint
+
+    std::shared_mutex state_mutex_;
+    std::mutex idle_mutex_;
+    std::condition_variable idle_cv_;
+    std::mutex output_mutex_;
+
+    std::atomic<size_t> outstanding_{0};  // queued + parked + in flight
+    std::atomic<size_t> started_{0};
+    std::atomic<size_t> fetched_{0};
+    size_t resumed_ = 0;  // pages fetched before the checkpoint was loaded
+    std::atomic<size_t> failed_{0};
+    std::atomic<bool> done_{false};
+};
+
+void usage(const char* tool) {
+    std::cerr << "Usage: " << tool << " <url> [options]\n"
+              << "Options:\n"
+              << "  --depth <n>            link depth from the start page (default: 2)\n"
+              << "  --scope <host|domain|all>  which links to follow (default: host)\n"
+              << "  --max-pages <n>        stop after n pages\n"
+              << "  --workers <n>          worker threads (default: 8)\n"
+              << "  --rate <r>             fetches per second per host (default: 2)\n"
+              << "  --burst <n>            token bucket size per host (default: 2)\n"
+              << "  --per-host <n>         concurrent fetches per host (default: 2)\n"
+              << "  --checkpoint <file>    save progress there and resume from it\n"
+              << "  --checkpoint-interval <s>  seconds between checkpoints (default: 10)\n"
+              << "  --results <file>       also append a row per page to a results file\n";
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    CrawlOptions options;
+    std::string url;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--depth" && has_value) {
+            options.max_depth = uint32_t(std::max(0, std::atoi(argv[++i])));
+        } else if (arg == "--scope" && has_value) {
+            options.scope = argv[++i];
+        } else if (arg == "--max-pages" && has_value) {
+            options.max_pages = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--workers" && has_value) {
+            options.workers = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--rate" && has_value) {
+            options.rate = std::max(0.01, std::atof(argv[++i]));
+        } else if (arg == "--burst" && has_value) {
+            options.burst = std::atof(argv[++i]);
+        } else if (arg == "--per-host" && has_value) {
+            options.per_host = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--checkpoint" && has_value) {
+            options.checkpoint = argv[++i];
+        } else if (arg == "--checkpoint-interval" && has_value) {
+            options.checkpoint_interval = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--results" && has_value) {
+            i++;  // opened below
+        } else {
+            url = arg;
+        }
+    }
+    if (url.empty() || (options.scope != "host" && options.scope != "domain" && options.scope != "all")) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::unique_ptr<ResultsWriter> results;
+    if (!open_results_arg(argc, argv, "crawl", results)) return 1;
+    options.results = results.get();
+
+    // Global libcurl initialization, before any worker thread exists
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    Crawler crawler(options);
+    if (!crawler.start(url)) return 1;
+    crawler.run();
+    close_results(results);
+    print_dns_cache_stats();
+
+    // Global libcurl cleanup
+    curl_global_cleanup();
+    return 0;
+}
@@ -0,0 +1,193 @@
+// daemon_protocol.h
+// Protocol between webdived and its clients (the tools and the GUI).
+//
+// A client connects to the daemon's Unix socket and sends one request line,
+// "<tool> <url>\n". The daemon runs the probe on its warm state (open
+// connections, DNS and TLS session caches) and answers with frames:
+//
+//   u8 type, 3 reserved bytes, u32 payload length (host order), payload
+//
+// DAEMON_FRAME_OUTPUT and DAEMON_FRAME_ERROR carry what the tool would have
+// written to stdout and stderr, as it is produced. DAEMON_FRAME_EXIT ends
+// the response with the tool's exit status as an i32, and the daemon closes
+// the connection.
+//
+// Socket: $WEBDIVE_SOCKET, else $XDG_RUNTIME_DIR/webdive.sock, else
+// /tmp/webdive-<uid>.sock.
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+enum DaemonFrameType : uint8_t {
+    DAEMON_FRAME_OUTPUT = 1,
+    DAEMON_FRAME_ERROR = 2,
+    DAEMON_FRAME_EXIT = 3,
+};
+
+struct DaemonFrameHeader {
+    uint8_t type;
+    uint8_t reserved[3];
+    uint32_t length;
+};
+static_assert(sizeof(DaemonFrameHeader) == 8, "frame header is 8 bytes on the wire");
+
+static const size_t kDaemonMaxRequest = 8192;
+static const uint32_t kDaemonMaxFrame = 1u << 20;
+
+inline std::string daemon_socket_path() {
+    if (const char* env = getenv("WEBDIVE_SOCKET")) return env;
+    if (const char* runtime = getenv("XDG_RUNTIME_DIR")) return std::string(runtime) + "/webdive.sock";
+    return "/tmp/webdive-" + std::to_string(getuid()) + ".sock";
+}
+
+inline bool daemon_socket_address(const std::string& path, sockaddr_un& addr) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) return false;
+    memcpy(addr.sun_path, path.data(), path.size());
+    return true;
+}
+
+// Connected socket, or -1 when no daemon is listening
+inline int daemon_connect(const std::string& path) {
+    sockaddr_un addr;
+    if (!daemon_socket_address(path, addr)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+inline bool daemon_write_all(int fd, const void* data, size_t size) {
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= size_t(n);
+    }
+    return true;
+}
+
+inline bool daemon_write_frame(int fd, DaemonFrameType type, const void* data, size_t size) {
+    DaemonFrameHeader header = {type, {0, 0, 0}, uint32_t(size)};
+    return daemon_write_all(fd, &header, sizeof(header)) && (size == 0 || daemon_write_all(fd, data, size));
+}
+
+// The request line. Tool names and URLs never contain spaces or line breaks.
+inline std::string daemon_request(const std::string& tool, const std::string& url) {
+    return tool + " " + url + "\n";
+}
+
+inline bool daemon_parse_request(std::string_view line, std::string& tool, std::string& url) {
+    size_t space = line.find(' ');
+    if (space == std::string_view::npos || space == 0 || space + 1 >= line.size()) return false;
+    tool.assign(line.substr(0, space));
+    url.assign(line.substr(space + 1));
+    return url.find_first_of(" \r\n") == std::string::npos;
+}
+
+// Splits a byte stream into frames, whatever sizes it arrives in
+class DaemonFrameReader {
+public:
+    // Calls fn(type, payload) for every complete frame. Returns false once
+    // the stream is malformed.
+    template <typename Fn>
+    bool feed(const char* data, size_t size, Fn fn) {
+        buffer_.append(data, size);
+        size_t used = 0;
+        while (buffer_.size() - used >= sizeof(DaemonFrameHeader)) {
+            DaemonFrameHeader header;
+            memcpy(&header, buffer_.data() + used, sizeof(header));
+            if (header.length > kDaemonMaxFrame) return false;
+            if (buffer_.size() - used - sizeof(header) < header.length) break;
+            fn(DaemonFrameType(header.type), std::string_view(buffer_.data() + used + sizeof(header), header.length));
+            used += sizeof(header) + header.length;
+        }
+        buffer_.erase(0, used);
+        return true;
+    }
+
+    // Exit status carried by a DAEMON_FRAME_EXIT payload
+    static int exit_status(std::string_view payload) {
+        int32_t status = 1;
+        if (payload.size() == sizeof(status)) memcpy(&status, payload.data(), sizeof(status));
+        return status;
+    }
+
+private:
+    std::string buffer_;
+};
+
+// Hand "tool <url>" to a running daemon instead of probing in this process.
+// Only used with --daemon (removed from argv here) or with $WEBDIVE_DAEMON
+// set, and only for the plain single-URL form: anything with options runs
+// locally. Returns true when the daemon answered, with the tool's status.
+inline bool daemon_forward(const char* tool, int& argc, char* argv[], int& status) {
+    bool requested = false;
+    int kept = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--daemon") == 0) {
+            requested = true;
+        } else {
+            argv[kept++] = argv[i];
+        }
+    }
+    argc = kept;
+    argv[argc] = nullptr;
+
+    const char* env = getenv("WEBDIVE_DAEMON");
+    if (!requested && (!env || !*env || strcmp(env, "0") == 0 || strcmp(env, "off") == 0)) return false;
+    if (argc != 2 || argv[1][0] == '-' || strpbrk(argv[1], " \r\n")) {
+        if (requested) std::cerr << "[Daemon] only a single URL is forwarded, running locally\n";
+        return false;
+    }
+
+    std::string path = daemon_socket_path();
+    int fd = daemon_connect(path);
+    if (fd < 0) {
+        if (requested) std::cerr << "[Daemon] not running at " << path << ", running locally\n";
+        return false;
+    }
+
+    std::string request = daemon_request(tool, argv[1]);
+    bool exited = false;
+    status = 1;
+    if (daemon_write_all(fd, request.data(), request.size())) {
+        DaemonFrameReader reader;
+        char buf[64 * 1024];
+        bool valid = true;
+        while (valid && !exited) {
+            ssize_t n = read(fd, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            valid = reader.feed(buf, size_t(n), [&](DaemonFrameType type, std::string_view payload) {
+                if (type == DAEMON_FRAME_OUTPUT) {
+                    std::cout.write(payload.data(), std::streamsize(payload.size())).flush();
+                } else if (type == DAEMON_FRAME_ERROR) {
+                    std::cerr.write(payload.data(), std::streamsize(payload.size())).flush();
+                } else if (type == DAEMON_FRAME_EXIT) {
+                    status = DaemonFrameReader::exit_status(payload);
+                    exited = true;
+                }
+            });
+        }
+    }
+    close(fd);
+    if (!exited) std::cerr << "[Daemon] connection closed before the probe finished\n";
+    return true;
+}
@@ -0,0 +1,34 @@
+#include <iostream>
+#include <string>
+#include <curl/curl.h>
+#include "dive.h"
+#include "results_store.h"
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <url>\n";
+        print_happy_eyeballs_usage(argv[0]);
+        return 1;
+    }
+
+    // --results <file>: also append a fixed-schema row for the fetch
+    std::unique_ptr<ResultsWriter> results;
+    if (!open_results_arg(argc, argv, "dive", results)) return 1;
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    // One resolution, one connection, one transfer for every view
+    DiveOptions options;
+    options.hash_body = results != nullptr;
+    parse_happy_eyeballs_args(argc, argv, options.happy_eyeballs);
+    DiveResult result = dive(argv[1], options);
+
+    print_dive(result, options.happy_eyeballs.delay_ms);
+
+    print_dns_cache_stats(std::cout);
+    if (results) results->append(result);
+    close_results(results);
+
+    curl_global_cleanup();
+    return 0;
+}
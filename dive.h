@@ -0,0 +1,1019 @@
+// dive.h
+// Single-transfer probe engine shared by the Web Dive tools.
+//
+// One curl transfer collects everything the individual tools print: the
+// resolved addresses, header lines, Set-Cookie lines, the redirect chain,
+// the body, the verbose debug events and the TLS session and certificate
+// details. The tools are thin views over a DiveResult, and the combined
+// `dive` tool prints every view from a single fetch.
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <curl/curl.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+#include <openssl/evp.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <strings.h>
+#include "dns_cache.h"
+#include "tls_sessions.h"
+#include "cookie_jar.h"
+#include "header_parse.h"
+#include "redirect_cache.h"
+#include "validator_store.h"
+#include "content_fingerprint.h"
+#include "happy_eyeballs.h"
+
+// One CURLOPT_DEBUGFUNCTION event. Payload bytes are kept for text and
+// header events only; data events just record their size.
+struct DiveDebugEvent {
+    std::chrono::system_clock::time_point when;
+    curl_infotype type;
+    size_t size = 0;
+    std::string data;
+};
+
+// Phase boundaries reported by curl, in microseconds from the start of the
+// last request (CURLINFO_*_TIME_T)
+struct DiveTimings {
+    curl_off_t namelookup = 0;
+    curl_off_t connect = 0;
+    curl_off_t appconnect = 0;     // TLS handshake done, 0 without TLS
+    curl_off_t pretransfer = 0;
+    curl_off_t starttransfer = 0;  // first response byte
+    curl_off_t total = 0;
+};
+
+// One response in the redirect chain
+struct DiveHop {
+    std::string status_line;
+    long status = 0;
+    std::string location;
+
+    // Only when redirects are walked hop by hop
+    std::string url;            // the URL requested
+    DiveTimings timings;
+    bool reused = false;        // sent on a connection that was already open
+    bool cached = false;        // known permanent redirect, not requested
+    std::string cache_control;  // decides whether a 301/308 may be cached
+};
+
+// Certificate summary as printed by the tls view
+struct DiveCert {
+    std::string subject;
+    std::string issuer;
+    std::string sha256;
+    int64_t not_before = 0;  // unix seconds
+    int64_t not_after = 0;
+    bool is_ca = false;
+};
+
+// TLS session details, captured while the connection is still alive
+struct DiveTls {
+    bool available = false;
+    std::string version;
+    std::string cipher;
+    int bits = 0;
+    std::string alpn;
+    std::vector<DiveCert> chain;
+    bool has_leaf = false;
+    DiveCert leaf;
+
+    // Filled whenever a session cache is attached, even without tls_info
+    bool handshake_known = false;
+    bool resumed = false;             // abbreviated handshake with a cached session
+    bool early_data_offered = false;  // the session allows 0-RTT (curl does not send early data)
+};
+
+// Which parts of the transfer to collect. The defaults collect everything.
+struct DiveOptions {
+    bool follow_redirects = true;
+    bool walk_redirects = false;  // follow hop by hop rather than inside curl: per-hop timing, loop checks
+    bool nobody = false;       // HEAD-style request, no body downloaded
+    bool keep_body = true;     // keep the response body in memory
+    bool keep_headers = true;  // header lines, cookies and redirect hops (and TLS details, read at their end)
+    bool debug_events = true;  // record CURLOPT_DEBUGFUNCTION events
+    bool tls_info = true;      // SSL* details via CURLINFO_TLS_SSL_PTR
+    bool certinfo = true;      // curl_certinfo text lists
+    bool resolve = true;       // resolve once through the DNS cache and pin it via CURLOPT_RESOLVE
+    bool resolve_cache_only = false;  // only pin cache hits; misses are left to curl's own resolver
+    HappyEyeballsOptions happy_eyeballs;  // race IPv6 and IPv4 here before the transfer; delay_ms also goes to curl
+    bool verbose = false;      // plain CURLOPT_VERBOSE to stderr
+    bool fail_on_error = false;  // treat HTTP >= 400 as a transfer error (CURLOPT_FAILONERROR)
+    bool hash_body = false;    // FNV-1a 64 of the body into DiveResult::body_hash, kept or not
+    bool fingerprint = false;  // SimHash/MinHash of the visible text into DiveResult::fingerprint, kept or not
+    long http_version = 0;     // CURLOPT_HTTP_VERSION, 0 for curl's default
+    bool pipewait = false;     // wait for a connection that can multiplex rather than open another
+    TlsSessionCache* tls_sessions = nullptr;  // resume TLS sessions from this cache
+    CookieJar* cookie_jar = nullptr;  // send and store cookies; redirects are then walked hop by hop
+    RedirectCache* redirect_cache = nullptr;  // skip known permanent redirects when walking without a jar
+    ValidatorStore* validators = nullptr;  // conditional requests from, and results into, this store
+    std::string range;         // CURLOPT_RANGE, e.g. "0-1023"
+    std::string ca_file;       // CURLOPT_CAINFO, to trust a private CA instead of the system store
+    curl_off_t resume_from = 0;  // continue a partial download at this offset
+
+    // When set, body chunks are handed over as they arrive instead of being
+    // kept. Returning false aborts the transfer (CURLE_WRITE_ERROR).
+    std::function<bool(const char* data, size_t size)> on_body;
+
+    // When set, called with the expected and received body size as the
+    // transfer progresses (CURLOPT_XFERINFOFUNCTION)
+    std::function<void(curl_off_t total, curl_off_t now)> on_progress;
+
+    // When set, debug events are handed over as they happen instead of
+    // being stored in the result.
+    std::function<void(const DiveDebugEvent&)> on_debug_event;
+
+    // Lowest-overhead form of the above: the raw callback arguments, with
+    // no timestamp taken and nothing copied. Takes precedence when set.
+    std::function<void(curl_infotype type, const char* data, size_t size)> on_debug_data;
+};
+
+// FNV-1a 64, continued across body chunks
+static const uint64_t kDiveBodyHashBasis = 14695981039346656037ULL;
+
+inline uint64_t dive_body_hash(uint64_t hash, const char* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= uint8_t(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+struct DiveResult {
+    std::string url;
+    std::string effective_url;
+    CURLcode code = CURLE_OK;
+    long response_code = 0;
+    curl_off_t total_time_us = 0;
+    curl_off_t download_bytes = 0;  // body bytes received by this transfer
+    uint64_t body_hash = 0;         // with hash_body
+    ContentFingerprint fingerprint;  // with fingerprint
+    curl_off_t download_speed = 0;  // average bytes/sec
+    std::chrono::system_clock::time_point started;  // when perform() (or an earlier race()) began
+    DiveTimings timings;
+    std::string primary_ip;  // address of the last connection used
+    long local_port = 0;
+    long new_connections = 0;  // 0 when an existing connection was reused
+    long http_version = 0;     // CURL_HTTP_VERSION_* of the last response
+    size_t cookies_sent = 0;   // cookies in the last request's Cookie header
+    ValidatorChange change = VALIDATOR_NONE;  // with validators: new, unchanged or changed
+    uint64_t bytes_saved = 0;                  // body not downloaded thanks to a 304
+    size_t cookie_bytes_sent = 0;
+
+    std::string host;
+    long port = 0;
+    bool resolved = false;
+    std::vector<std::string> addresses;   // A
+    std::vector<std::string> addresses6;  // AAAA
+    HappyEyeballsResult eyeballs;          // with happy_eyeballs.race
+
+    DiveHeaders headers;  // every response's header lines, Set-Cookie included
+    std::vector<DiveHop> hops;
+    bool redirect_loop = false;   // walking stopped at a URL already visited
+    bool redirect_limit = false;  // walking stopped after kMaxRedirects hops
+    std::string body;
+    std::vector<DiveDebugEvent> events;
+    DiveTls tls;
+    std::vector<std::vector<std::string>> certinfo;
+
+    bool ok() const { return code == CURLE_OK; }
+    std::string error() const { return curl_easy_strerror(code); }
+};
+
+inline std::string dive_sha256_fingerprint(X509* cert) {
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int n = 0;
+    if (!X509_digest(cert, EVP_sha256(), md, &n)) return "";
+    std::string out;
+    char hex[4];
+    for (unsigned int i = 0; i < n; i++) {
+        snprintf(hex, sizeof(hex), i + 1 < n ? "%02X:" : "%02X", md[i]);
+        out += hex;
+    }
+    return out;
+}
+
+inline DiveCert dive_cert_summary(X509* cert) {
+    DiveCert out;
+    char* subj = X509_NAME_oneline(X509_get_subject_name(cert), nullptr, 0);
+    char* issuer = X509_NAME_oneline(X509_get_issuer_name(cert), nullptr, 0);
+    out.subject = subj ? subj : "N/A";
+    out.issuer = issuer ? issuer : "N/A";
+    out.sha256 = dive_sha256_fingerprint(cert);
+    std::tm tm{};
+    if (ASN1_TIME_to_tm(X509_get0_notBefore(cert), &tm) == 1) out.not_before = timegm(&tm);
+    if (ASN1_TIME_to_tm(X509_get0_notAfter(cert), &tm) == 1) out.not_after = timegm(&tm);
+    out.is_ca = X509_check_ca(cert) > 0;
+    OPENSSL_free(subj);
+    OPENSSL_free(issuer);
+    return out;
+}
+
+// A single probe transfer. The easy handle is configured in the constructor
+// so it can be run with perform() or added to a curl_multi by the caller,
+// who then hands the result code to finish().
+class DiveTransfer {
+public:
+    DiveTransfer(const std::string& url, const DiveOptions& options)
+        : options_(options) {
+        result.url = url;
+        curl_ = curl_easy_init();
+        if (!curl_) return;
+
+        parse_target();
+        if (options_.resolve) pin_resolution();
+        curl_easy_setopt(curl_, CURLOPT_HAPPY_EYEBALLS_TIMEOUT_MS, options_.happy_eyeballs.delay_ms);
+
+        curl_easy_setopt(curl_, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl_, CURLOPT_PRIVATE, this);
+        curl_easy_setopt(curl_, CURLOPT_HEADERFUNCTION, header_callback);
+        curl_easy_setopt(curl_, CURLOPT_HEADERDATA, this);
+        curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, write_callback);
+        curl_easy_setopt(curl_, CURLOPT_WRITEDATA, this);
+        curl_easy_setopt(curl_, CURLOPT_FOLLOWLOCATION, options_.follow_redirects && !walking() ? 1L : 0L);
+        if (options_.nobody) curl_easy_setopt(curl_, CURLOPT_NOBODY, 1L);
+        if (options_.certinfo) curl_easy_setopt(curl_, CURLOPT_CERTINFO, 1L);
+        if (!options_.ca_file.empty()) curl_easy_setopt(curl_, CURLOPT_CAINFO, options_.ca_file.c_str());
+        if (options_.http_version) curl_easy_setopt(curl_, CURLOPT_HTTP_VERSION, options_.http_version);
+        if (options_.pipewait) curl_easy_setopt(curl_, CURLOPT_PIPEWAIT, 1L);
+        if (options_.tls_sessions) options_.tls_sessions->attach(curl_);
+        if (walking() || options_.cookie_jar) start_hops();
+        if (options_.validators && !walking()) send_validators();
+        if (options_.hash_body) result.body_hash = kDiveBodyHashBasis;
+        if (options_.fingerprint) fingerprinter_.reset(new ContentFingerprinter());
+        if (options_.fail_on_error) curl_easy_setopt(curl_, CURLOPT_FAILONERROR, 1L);
+        if (!options_.range.empty()) curl_easy_setopt(curl_, CURLOPT_RANGE, options_.range.c_str());
+        if (options_.resume_from > 0) curl_easy_setopt(curl_, CURLOPT_RESUME_FROM_LARGE, options_.resume_from);
+        if (options_.on_progress) {
+            curl_easy_setopt(curl_, CURLOPT_NOPROGRESS, 0L);
+            curl_easy_setopt(curl_, CURLOPT_XFERINFOFUNCTION, progress_callback);
+            curl_easy_setopt(curl_, CURLOPT_XFERINFODATA, this);
+        }
+        if (options_.debug_events) {
+            curl_easy_setopt(curl_, CURLOPT_VERBOSE, 1L);
+            curl_easy_setopt(curl_, CURLOPT_DEBUGFUNCTION, debug_callback);
+            curl_easy_setopt(curl_, CURLOPT_DEBUGDATA, this);
+        } else if (options_.verbose) {
+            curl_easy_setopt(curl_, CURLOPT_VERBOSE, 1L);
+        }
+    }
+
+    ~DiveTransfer() {
+        if (curl_) curl_easy_cleanup(curl_);
+        if (raced_fd_ >= 0) close(raced_fd_);  // never handed to curl
+        curl_slist_free_all(resolve_list_);
+        curl_slist_free_all(header_list_);
+    }
+
+    DiveTransfer(const DiveTransfer&) = delete;
+    DiveTransfer& operator=(const DiveTransfer&) = delete;
+
+    CURL* handle() const { return curl_; }
+
+    // With happy_eyeballs.race, connect here (once per handle). perform()
+    // does it first thing; a caller that wants the winner earlier, or the
+    // race's packets captured, calls it itself.
+    void race() {
+        if (!options_.happy_eyeballs.race || !result.resolved || result.eyeballs.ran) return;
+        result.started = std::chrono::system_clock::now();
+        raced_before_perform_ = true;
+        race_connection();
+    }
+
+    // Run the transfer on the calling thread
+    void perform() {
+        if (!curl_) {
+            result.code = CURLE_FAILED_INIT;
+            return;
+        }
+        if (!raced_before_perform_) result.started = std::chrono::system_clock::now();
+        race();
+        raced_before_perform_ = false;
+        CURLcode code;
+        do {
+            code = curl_easy_perform(curl_);
+        } while (next_hop(code));
+        finish(code);
+    }
+
+    // When walking, redirects are followed here rather than by curl, on the
+    // same handle so keep-alive connections carry over between hops. Each
+    // hop gets its own timings and the cookies for its own URL, including
+    // any set by the hop before. Returns true when the handle now points at
+    // the next hop and has to be run again.
+    bool next_hop(CURLcode code) {
+        if (!walking() || code != CURLE_OK) return false;
+        record_hop();
+        long status = 0;
+        char* location = nullptr;
+        curl_easy_getinfo(curl_, CURLINFO_RESPONSE_CODE, &status);
+        if (status < 300 || status > 399 || curl_easy_getinfo(curl_, CURLINFO_REDIRECT_URL, &location) != CURLE_OK ||
+            !location) {
+            return false;
+        }
+        std::string target = location;
+        if (options_.redirect_cache && !result.hops.empty()) {
+            options_.redirect_cache->remember(hop_url_, status, target, result.hops.back().cache_control);
+        }
+        curl_off_t elapsed = 0;
+        curl_easy_getinfo(curl_, CURLINFO_TOTAL_TIME_T, &elapsed);
+        earlier_hops_us_ += elapsed;
+        if (!advance(target)) return false;
+        curl_easy_setopt(curl_, CURLOPT_URL, hop_url_.c_str());
+        if (options_.cookie_jar) send_cookies();
+        return true;
+    }
+
+    // Clear what the last perform() collected, keeping the target and its
+    // resolution, so the handle and its open connection can be used again
+    void reset_result() {
+        DiveResult fresh;
+        fresh.url = result.url;
+        fresh.host = result.host;
+        fresh.port = result.port;
+        fresh.resolved = result.resolved;
+        fresh.addresses = result.addresses;
+        fresh.addresses6 = result.addresses6;
+        fresh.eyeballs = result.eyeballs;
+        fresh.headers = std::move(result.headers);
+        fresh.headers.clear();
+        result = std::move(fresh);
+        if (walking() || options_.cookie_jar) start_hops();
+        if (options_.hash_body) result.body_hash = kDiveBodyHashBasis;
+        if (options_.fingerprint) fingerprinter_.reset(new ContentFingerprinter());
+    }
+
+    // Collect what is only available once the transfer is over
+    void finish(CURLcode code) {
+        result.code = code;
+        char* effective = nullptr;
+        if (curl_easy_getinfo(curl_, CURLINFO_EFFECTIVE_URL, &effective) == CURLE_OK && effective) {
+            result.effective_url = effective;
+        }
+        curl_easy_getinfo(curl_, CURLINFO_RESPONSE_CODE, &result.response_code);
+        curl_easy_getinfo(curl_, CURLINFO_TOTAL_TIME_T, &result.total_time_us);
+        curl_easy_getinfo(curl_, CURLINFO_SIZE_DOWNLOAD_T, &result.download_bytes);
+        curl_easy_getinfo(curl_, CURLINFO_SPEED_DOWNLOAD_T, &result.download_speed);
+        read_timings(result.timings);
+        result.total_time_us += earlier_hops_us_;
+        if (walking()) record_hop();
+        char* primary = nullptr;
+        if (curl_easy_getinfo(curl_, CURLINFO_PRIMARY_IP, &primary) == CURLE_OK && primary) result.primary_ip = primary;
+        curl_easy_getinfo(curl_, CURLINFO_LOCAL_PORT, &result.local_port);
+        curl_easy_getinfo(curl_, CURLINFO_NUM_CONNECTS, &result.new_connections);
+        curl_easy_getinfo(curl_, CURLINFO_HTTP_VERSION, &result.http_version);
+        if (fingerprinter_) result.fingerprint = fingerprinter_->finish();
+
+        if (options_.certinfo) {
+            struct curl_certinfo* certinfo = nullptr;
+            if (curl_easy_getinfo(curl_, CURLINFO_CERTINFO, &certinfo) == CURLE_OK && certinfo) {
+                for (int i = 0; i < certinfo->num_of_certs; ++i) {
+                    std::vector<std::string> fields;
+                    for (curl_slist* s = certinfo->certinfo[i]; s; s = s->next) {
+                        fields.push_back(s->data);
+                    }
+                    result.certinfo.push_back(std::move(fields));
+                }
+            }
+        }
+
+        if (options_.validators && !walking() && code == CURLE_OK) {
+            result.change = options_.validators->record(
+                result.url, result.response_code, result.headers.last(HEADER_ETAG),
+                result.headers.last(HEADER_LAST_MODIFIED), !options_.nobody, result.download_bytes, result.body_hash,
+                uint64_t(result.download_bytes), &result.bytes_saved);
+        }
+    }
+
+    DiveResult result;
+
+private:
+    static constexpr int kMaxRedirects = 30;
+
+    bool walking() const { return options_.follow_redirects && (options_.walk_redirects || options_.cookie_jar); }
+
+    // Point the handle at the first request. With a cookie jar this runs
+    // even when redirects are not followed, so the one request still sends
+    // the jar's cookies and stores the ones it gets.
+    void start_hops() {
+        hop_url_ = result.url;
+        visited_.clear();
+        earlier_hops_us_ = 0;
+        if (walking()) skip_cached();
+        curl_easy_setopt(curl_, CURLOPT_URL, hop_url_.c_str());
+        if (options_.cookie_jar) send_cookies();
+    }
+
+    // Move on to the next URL of the chain, stopping at loops and at the
+    // hop limit
+    bool advance(const std::string& target) {
+        visited_.push_back(hop_url_);
+        if (std::find(visited_.begin(), visited_.end(), target) != visited_.end()) {
+            result.redirect_loop = true;
+            return false;
+        }
+        if (visited_.size() >= size_t(kMaxRedirects)) {
+            result.redirect_limit = true;
+            return false;
+        }
+        hop_url_ = target;
+        return skip_cached();
+    }
+
+    // Hops the redirect cache already knows are recorded without a request.
+    // Not with a cookie jar: a skipped hop would never deliver the cookies
+    // it sets, and the session would differ from an uncached run.
+    bool skip_cached() {
+        if (options_.cookie_jar) return true;
+        std::string target;
+        long status = 0;
+        while (options_.redirect_cache && options_.redirect_cache->lookup(hop_url_, target, status)) {
+            DiveHop hop;
+            hop.status_line = std::to_string(status) + " (cached permanent redirect)";
+            hop.status = status;
+            hop.location = target;
+            hop.url = hop_url_;
+            hop.cached = true;
+            result.hops.push_back(std::move(hop));
+            if (!advance(target)) return false;
+        }
+        return true;
+    }
+
+    // Timings and connection reuse of the request just finished, filed
+    // under the response it produced
+    void record_hop() {
+        if (result.hops.empty() || result.hops.back().cached) return;
+        DiveHop& hop = result.hops.back();
+        hop.url = hop_url_;
+        read_timings(hop.timings);
+        long connects = 0;
+        curl_easy_getinfo(curl_, CURLINFO_NUM_CONNECTS, &connects);
+        hop.reused = connects == 0;
+    }
+
+    void read_timings(DiveTimings& t) {
+        curl_easy_getinfo(curl_, CURLINFO_NAMELOOKUP_TIME_T, &t.namelookup);
+        curl_easy_getinfo(curl_, CURLINFO_CONNECT_TIME_T, &t.connect);
+        curl_easy_getinfo(curl_, CURLINFO_APPCONNECT_TIME_T, &t.appconnect);
+        curl_easy_getinfo(curl_, CURLINFO_PRETRANSFER_TIME_T, &t.pretransfer);
+        curl_easy_getinfo(curl_, CURLINFO_STARTTRANSFER_TIME_T, &t.starttransfer);
+        curl_easy_getinfo(curl_, CURLINFO_TOTAL_TIME_T, &t.total);
+    }
+
+    // If-None-Match / If-Modified-Since from the last scan; the body is
+    // hashed to tell a real change from a server ignoring them
+    void send_validators() {
+        options_.hash_body = true;
+        for (const std::string& header : options_.validators->conditional_headers(result.url)) {
+            header_list_ = curl_slist_append(header_list_, header.c_str());
+        }
+        if (header_list_) curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, header_list_);
+    }
+
+    void send_cookies() {
+        std::string header = options_.cookie_jar->header_for(hop_url_, &result.cookies_sent);
+        result.cookie_bytes_sent = header.size();
+        curl_easy_setopt(curl_, CURLOPT_COOKIE, header.empty() ? nullptr : header.c_str());
+    }
+
+    void parse_target() {
+        CURLU* u = curl_url();
+        char* host = nullptr;
+        char* port = nullptr;
+        if (curl_url_set(u, CURLUPART_URL, result.url.c_str(), CURLU_GUESS_SCHEME) == CURLUE_OK &&
+            curl_url_get(u, CURLUPART_HOST, &host, 0) == CURLUE_OK &&
+            curl_url_get(u, CURLUPART_PORT, &port, CURLU_DEFAULT_PORT) == CURLUE_OK) {
+            result.host = host;
+            result.port = std::stol(port);
+        }
+        curl_free(host);
+        curl_free(port);
+        curl_url_cleanup(u);
+    }
+
+    // Resolve the host once, A and AAAA together, through the shared DNS
+    // cache and hand the addresses to curl so it does not look them up
+    // again; curl then races the two families itself. If the DNS server
+    // cannot be reached, the system resolver is tried before giving up.
+    void pin_resolution() {
+        // IPv6 literals need no lookup
+        if (result.host.empty() || result.host[0] == '[') return;
+
+        if (!dns_cached_resolve_dual(result.host, result.addresses, result.addresses6, options_.resolve_cache_only) &&
+            !options_.resolve_cache_only) {
+            addrinfo hints{}, *res = nullptr;
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            if (getaddrinfo(result.host.c_str(), nullptr, &hints, &res) == 0) {
+                for (auto p = res; p; p = p->ai_next) {
+                    char ip[INET6_ADDRSTRLEN];
+                    if (p->ai_family == AF_INET6) {
+                        inet_ntop(AF_INET6, &reinterpret_cast<sockaddr_in6*>(p->ai_addr)->sin6_addr, ip, sizeof(ip));
+                        result.addresses6.push_back(ip);
+                    } else if (p->ai_family == AF_INET) {
+                        inet_ntop(AF_INET, &reinterpret_cast<sockaddr_in*>(p->ai_addr)->sin_addr, ip, sizeof(ip));
+                        result.addresses.push_back(ip);
+                    }
+                }
+                freeaddrinfo(res);
+            }
+        }
+
+        result.resolved = !result.addresses.empty() || !result.addresses6.empty();
+        if (result.resolved) pin_addresses(result.addresses6, result.addresses);
+    }
+
+    // CURLOPT_RESOLVE entry "host:port:[v6],v4", replacing any earlier one
+    void pin_addresses(const std::vector<std::string>& v6, const std::vector<std::string>& v4) {
+        std::string entry = result.host + ":" + std::to_string(result.port) + ":";
+        bool first = true;
+        for (const auto& ip : v6) {
+            entry += (first ? "[" : ",[") + ip + "]";
+            first = false;
+        }
+        for (const auto& ip : v4) {
+            entry += (first ? "" : ",") + ip;
+            first = false;
+        }
+        curl_slist_free_all(resolve_list_);
+        resolve_list_ = curl_slist_append(nullptr, entry.c_str());
+        curl_easy_setopt(curl_, CURLOPT_RESOLVE, resolve_list_);
+    }
+
+    // Race the families here (happy_eyeballs.h) and pin the winner, whose
+    // connected socket open_socket hands to curl. The race runs before
+    // curl_easy_perform(), so curl's own connect time then covers no
+    // handshake.
+    void race_connection() {
+        HappyEyeballs race(result.addresses6, result.addresses, result.port, options_.happy_eyeballs);
+        result.eyeballs = race.run(raced_fd_);
+        const HappyEyeballsAttempt* won = result.eyeballs.won();
+        if (!won) return;  // curl tries again and reports the failure
+        std::vector<std::string> none, winner(1, won->address);
+        if (won->family == AF_INET6) {
+            pin_addresses(winner, none);
+        } else {
+            pin_addresses(none, winner);
+        }
+        curl_easy_setopt(curl_, CURLOPT_OPENSOCKETFUNCTION, open_socket);
+        curl_easy_setopt(curl_, CURLOPT_OPENSOCKETDATA, this);
+        curl_easy_setopt(curl_, CURLOPT_SOCKOPTFUNCTION, socket_options);
+        curl_easy_setopt(curl_, CURLOPT_SOCKOPTDATA, this);
+    }
+
+    // The first connection to the race's winner gets the raced socket;
+    // every other connection (redirects elsewhere) a fresh one
+    static curl_socket_t open_socket(void* userdata, curlsocktype purpose, curl_sockaddr* address) {
+        DiveTransfer* self = static_cast<DiveTransfer*>(userdata);
+        const HappyEyeballsAttempt* won = self->result.eyeballs.won();
+        if (purpose == CURLSOCKTYPE_IPCXN && self->raced_fd_ >= 0 && won && address->family == won->family) {
+            char ip[INET6_ADDRSTRLEN] = "";
+            long port = 0;
+            if (address->family == AF_INET6) {
+                const sockaddr_in6* a = reinterpret_cast<const sockaddr_in6*>(&address->addr);
+                inet_ntop(AF_INET6, &a->sin6_addr, ip, sizeof(ip));
+                port = ntohs(a->sin6_port);
+            } else {
+                const sockaddr_in* a = reinterpret_cast<const sockaddr_in*>(&address->addr);
+                inet_ntop(AF_INET, &a->sin_addr, ip, sizeof(ip));
+                port = ntohs(a->sin_port);
+            }
+            if (won->address == ip && port == self->result.port) {
+                curl_socket_t fd = self->raced_fd_;
+                self->raced_fd_ = -1;
+                self->handing_over_ = true;
+                return fd;
+            }
+        }
+        return socket(address->family, address->socktype | SOCK_CLOEXEC, address->protocol);
+    }
+
+    static int socket_options(void* userdata, curl_socket_t, curlsocktype) {
+        DiveTransfer* self = static_cast<DiveTransfer*>(userdata);
+        bool raced = self->handing_over_;
+        self->handing_over_ = false;
+        return raced ? CURL_SOCKOPT_ALREADY_CONNECTED : CURL_SOCKOPT_OK;
+    }
+
+    // The SSL* behind the connection, only valid while it is open
+    SSL* current_ssl() const {
+        // CURLINFO_TLS_SSL_PTR hands back a curl_tlssessioninfo wrapping the SSL*
+        struct curl_tlssessioninfo* info = nullptr;
+        if (curl_easy_getinfo(curl_, CURLINFO_TLS_SSL_PTR, &info) != CURLE_OK || !info ||
+            info->backend != CURLSSLBACKEND_OPENSSL || !info->internals) return nullptr;
+        return static_cast<SSL*>(info->internals);
+    }
+
+    void capture_resumption(SSL* ssl) {
+        DiveTls& tls = result.tls;
+        tls.handshake_known = true;
+        tls.resumed = SSL_session_reused(ssl) == 1;
+        SSL_SESSION* session = SSL_get_session(ssl);
+        tls.early_data_offered = session && SSL_SESSION_get_max_early_data(session) > 0;
+    }
+
+    // The SSL* is only valid while its connection is open, so read it at
+    // the end of each response header block rather than after the transfer.
+    void capture_tls() {
+        SSL* ssl = current_ssl();
+        if (!ssl) return;
+
+        DiveTls& tls = result.tls;
+        tls = DiveTls();
+        tls.available = true;
+        tls.version = SSL_get_version(ssl);
+
+        const SSL_CIPHER* cipher = SSL_get_current_cipher(ssl);
+        if (cipher) {
+            tls.cipher = SSL_CIPHER_get_name(cipher);
+            SSL_CIPHER_get_bits(cipher, &tls.bits);
+        }
+
+        const unsigned char* proto = nullptr;
+        unsigned int proto_len = 0;
+        SSL_get0_alpn_selected(ssl, &proto, &proto_len);
+        if (proto && proto_len > 0) tls.alpn.assign(reinterpret_cast<const char*>(proto), proto_len);
+
+        STACK_OF(X509)* chain = SSL_get_peer_cert_chain(ssl);
+        if (chain) {
+            int n = sk_X509_num(chain);
+            for (int i = 0; i < n; i++) tls.chain.push_back(dive_cert_summary(sk_X509_value(chain, i)));
+        }
+
+        X509* leaf = SSL_get_peer_certificate(ssl);
+        if (leaf) {
+            tls.has_leaf = true;
+            tls.leaf = dive_cert_summary(leaf);
+            X509_free(leaf);
+        }
+        capture_resumption(ssl);
+    }
+
+    static size_t header_callback(char* buffer, size_t size, size_t nitems, void* userdata) {
+        size_t total = size * nitems;
+        DiveTransfer* self = static_cast<DiveTransfer*>(userdata);
+        if (!self->options_.keep_headers) return total;
+        std::string_view raw(buffer, total);
+        HeaderLine line = parse_header_line(raw);
+
+        if (line.kind == HEADER_LINE_STATUS) {
+            DiveHop hop;
+            hop.status_line.assign(line.line);
+            hop.status = line.status;
+            self->result.hops.push_back(std::move(hop));
+        } else if (line.id == HEADER_SET_COOKIE) {
+            if (self->options_.cookie_jar) self->options_.cookie_jar->set(self->hop_url_, line.value);
+        } else if (line.id == HEADER_LOCATION && !self->result.hops.empty()) {
+            self->result.hops.back().location.assign(line.value);
+        } else if (line.id == HEADER_CACHE_CONTROL && !self->result.hops.empty()) {
+            self->result.hops.back().cache_control.assign(line.value);
+        } else if (line.kind == HEADER_LINE_END) {
+            // The body that follows belongs to this URL, so streaming
+            // consumers can resolve links before the transfer is over
+            char* effective = nullptr;
+            if (curl_easy_getinfo(self->curl_, CURLINFO_EFFECTIVE_URL, &effective) == CURLE_OK && effective) {
+                self->result.effective_url = effective;
+            }
+            if (self->options_.tls_info) {
+                self->capture_tls();
+            } else if (self->options_.tls_sessions) {
+                if (SSL* ssl = self->current_ssl()) self->capture_resumption(ssl);
+            }
+        }
+
+        self->result.headers.add(raw, line);
+        return total;
+    }
+
+    static size_t write_callback(void* contents, size_t size, size_t nmemb, void* userp) {
+        DiveTransfer* self = static_cast<DiveTransfer*>(userp);
+        size_t total = size * nmemb;
+        if (self->options_.hash_body) {
+            self->result.body_hash = dive_body_hash(self->result.body_hash, static_cast<char*>(contents), total);
+        }
+        if (self->fingerprinter_) self->fingerprinter_->feed(static_cast<char*>(contents), total);
+        if (self->options_.on_body) return self->options_.on_body(static_cast<char*>(contents), total) ? total : 0;
+        if (self->options_.keep_body) self->result.body.append(static_cast<char*>(contents), total);
+        return total;
+    }
+
+    static int progress_callback(void* userp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t, curl_off_t) {
+        static_cast<DiveTransfer*>(userp)->options_.on_progress(dltotal, dlnow);
+        return 0;
+    }
+
+    static int debug_callback(CURL*, curl_infotype type, char* data, size_t size, void* userptr) {
+        DiveTransfer* self = static_cast<DiveTransfer*>(userptr);
+        if (type > CURLINFO_DATA_OUT) return 0;  // skip raw TLS records
+        if (self->options_.on_debug_data) {
+            self->options_.on_debug_data(type, data, size);
+            return 0;
+        }
+
+        DiveDebugEvent event;
+        event.when = std::chrono::system_clock::now();
+        event.type = type;
+        event.size = size;
+        if (type == CURLINFO_TEXT || type == CURLINFO_HEADER_IN || type == CURLINFO_HEADER_OUT) {
+            event.data.assign(data, size);
+        }
+
+        if (self->options_.on_debug_event) {
+            self->options_.on_debug_event(event);
+        } else {
+            self->result.events.push_back(std::move(event));
+        }
+        return 0;
+    }
+
+    DiveOptions options_;
+    CURL* curl_ = nullptr;
+    curl_slist* resolve_list_ = nullptr;
+    int raced_fd_ = -1;           // the race's winner until curl takes it
+    bool handing_over_ = false;   // open_socket just returned raced_fd_
+    bool raced_before_perform_ = false;  // race() set result.started
+    curl_slist* header_list_ = nullptr;  // conditional request headers
+    std::unique_ptr<ContentFingerprinter> fingerprinter_;
+    std::string hop_url_;  // request URL of the current hop (cookie jar and walking)
+    std::vector<std::string> visited_;  // URLs of the chain so far (walking only)
+    curl_off_t earlier_hops_us_ = 0;
+};
+
+// Run one probe on the calling thread
+inline DiveResult dive(const std::string& url, const DiveOptions& options = DiveOptions()) {
+    DiveTransfer transfer(url, options);
+    transfer.perform();
+    return std::move(transfer.result);
+}
+
+// ---------------------------------------------------------------------------
+// Views: each prints what the matching standalone tool has always printed.
+// ---------------------------------------------------------------------------
+
+inline void print_dns(const DiveResult& r, std::ostream& out = std::cout) {
+    out << "[DNS] Resolving " << r.host << "...\n";
+    if (!r.resolved) {
+        out << "[DNS] Resolution failed\n";
+        return;
+    }
+    for (const auto& ip : r.addresses) out << "[DNS] A Record: " << ip << "\n";
+    for (const auto& ip : r.addresses6) out << "[DNS] AAAA Record: " << ip << "\n";
+}
+
+inline void print_headers(const DiveResult& r, std::ostream& out = std::cout) {
+    out << r.headers.raw();
+}
+
+inline void print_cookies(const DiveResult& r, std::ostream& out = std::cout) {
+    r.headers.each(HEADER_SET_COOKIE, [&](const HeaderLine& h) { out << "[Cookie] " << h.line << "\n"; });
+}
+
+// What the cookie jar added to the last request
+inline void print_cookies_sent(const DiveResult& r, std::ostream& out = std::cout) {
+    out << "[Cookie] sent " << r.cookies_sent << " cookies, " << r.cookie_bytes_sent << " bytes";
+    if (r.cookie_bytes_sent > kCookieHeaderLimit) out << " (over the 8 KB header limit)";
+    out << "\n";
+}
+
+inline bool dive_url_is_https(const std::string& url) { return strncasecmp(url.c_str(), "https://", 8) == 0; }
+inline bool dive_url_is_http(const std::string& url) { return strncasecmp(url.c_str(), "http://", 7) == 0; }
+
+// Status and Location per response; walked chains also get per-hop timing,
+// connection reuse and warnings for downgrades and loops
+inline void print_redirects(const DiveResult& r, std::ostream& out = std::cout) {
+    for (size_t i = 0; i < r.hops.size(); i++) {
+        const DiveHop& hop = r.hops[i];
+        out << "\n[Status] " << hop.status_line << "\n";
+        if (hop.cached) {
+            out << "[Hop " << i + 1 << "] " << hop.url << " | not requested\n";
+        } else if (!hop.url.empty()) {
+            const DiveTimings& t = hop.timings;
+            char ms[160];
+            snprintf(ms, sizeof(ms), "dns %.2f | connect %.2f | tls %.2f | ttfb %.2f | total %.2f ms",
+                     t.namelookup / 1000.0, t.connect > 0 ? (t.connect - t.namelookup) / 1000.0 : 0.0,
+                     t.appconnect > 0 ? (t.appconnect - t.connect) / 1000.0 : 0.0,
+                     (t.starttransfer - t.pretransfer) / 1000.0, t.total / 1000.0);
+            out << "[Hop " << i + 1 << "] " << hop.url << " | " << ms << " | "
+                << (hop.reused ? "reused connection" : "new connection") << "\n";
+        }
+        if (hop.location.empty()) continue;
+        out << "[Redirect] -> " << hop.location << "\n";
+
+        const std::string& target = i + 1 < r.hops.size() && !r.hops[i + 1].url.empty() ? r.hops[i + 1].url
+                                                                                        : hop.location;
+        if (dive_url_is_https(hop.url) && dive_url_is_http(target)) {
+            out << "[Warning] HTTPS -> HTTP downgrade: " << hop.url << " -> " << target << "\n";
+        }
+    }
+    if (r.redirect_loop) out << "[Warning] Redirect loop: the chain returns to a URL it already visited\n";
+    if (r.redirect_limit) out << "[Warning] Stopped after " << r.hops.size() << " hops\n";
+}
+
+// "[Incremental] ..." line for a probe made with validators. Returns true
+// when the URL is unchanged, so the view can be skipped.
+inline bool print_incremental(const DiveResult& r, std::ostream& out = std::cout) {
+    if (r.change == VALIDATOR_NONE) return false;
+    out << "[Incremental] " << validator_change_name(r.change);
+    if (r.bytes_saved > 0) out << ", " << r.bytes_saved << " bytes not downloaded";
+    out << "\n";
+    return r.change == VALIDATOR_NOT_MODIFIED || r.change == VALIDATOR_SAME_CONTENT;
+}
+
+inline void print_body(const DiveResult& r, std::ostream& out = std::cout) {
+    out << "--- Full Body Content ---\n";
+    out << r.body;
+}
+
+inline void print_certificate(const DiveCert& cert, int index, std::ostream& out = std::cout) {
+    out << "Certificate " << index << ":\n";
+    out << "  Subject: " << cert.subject << "\n";
+    out << "  Issuer: " << cert.issuer << "\n";
+    if (!cert.sha256.empty()) out << "  SHA-256 Fingerprint: " << cert.sha256 << "\n";
+}
+
+inline void print_tls(const DiveResult& r, std::ostream& out = std::cout) {
+    const DiveTls& tls = r.tls;
+    if (!tls.available) {
+        std::cerr << "No SSL session available.\n";
+        return;
+    }
+
+    out << "\n[TLS Information]\n";
+    out << "  Protocol Version: " << tls.version << "\n";
+    if (!tls.cipher.empty()) {
+        out << "  Cipher Suite (full): " << tls.cipher << "\n";
+        out << "  Cipher Bits: " << tls.bits << "\n";
+    }
+    if (!tls.alpn.empty()) out << "  ALPN Protocol: " << tls.alpn << "\n";
+
+    for (size_t i = 0; i < tls.chain.size(); i++) print_certificate(tls.chain[i], i + 1, out);
+    if (tls.resumed && tls.chain.empty()) out << "  (Session resumed: the server sent no certificate chain)\n";
+
+    if (tls.has_leaf) {
+        out << "Leaf certificate info:\n";
+        print_certificate(tls.leaf, 0, out);
+    }
+}
+
+// "[TLS session] ..." line: full or resumed handshake and what it cost
+inline void print_tls_handshake(const DiveResult& r, std::ostream& out = std::cout) {
+    if (!r.tls.handshake_known) return;
+    if (r.new_connections == 0) {
+        out << "[TLS session] connection already open, no handshake\n";
+        return;
+    }
+    char ms[64];
+    snprintf(ms, sizeof(ms), "%.2f ms (appconnect %.2f ms)", (r.timings.appconnect - r.timings.connect) / 1000.0,
+             r.timings.appconnect / 1000.0);
+    out << "[TLS session] " << (r.tls.resumed ? "resumed" : "full") << " handshake, " << ms;
+    if (r.tls.early_data_offered) out << ", 0-RTT offered by the server (curl does not send early data)";
+    out << "\n";
+}
+
+inline void print_certchain(const DiveResult& r, std::ostream& out = std::cout) {
+    if (r.certinfo.empty()) {
+        out << "No SSL certificate information available." << std::endl;
+        return;
+    }
+
+    out << "--- Certificate Chain ---" << std::endl;
+    for (size_t i = 0; i < r.certinfo.size(); ++i) {
+        out << "\nCertificate " << (i + 1) << ":" << std::endl;
+        for (const auto& field : r.certinfo[i]) out << "  " << field << std::endl;
+    }
+}
+
+// Wall-clock "HH:MM:SS.mmm" as printed by the packets view. The
+// "HH:MM:SS" part is cached per thread, so localtime and strftime run once
+// per second rather than once per event.
+inline std::string dive_timestamp(std::chrono::system_clock::time_point when) {
+    using namespace std::chrono;
+    auto since_epoch = duration_cast<milliseconds>(when.time_since_epoch()).count();
+    long long second = since_epoch / 1000;
+    int ms = int(since_epoch % 1000);
+
+    thread_local long long cached_second = -1;
+    thread_local char cached[16];
+    if (second != cached_second) {
+        std::time_t t = std::time_t(second);
+        std::tm tm;
+        localtime_r(&t, &tm);
+        std::strftime(cached, sizeof(cached), "%H:%M:%S", &tm);
+        cached_second = second;
+    }
+
+    char buffer[24];
+    snprintf(buffer, sizeof(buffer), "%s.%03d", cached, ms);
+    return buffer;
+}
+
+// Print one debug event as a pseudo "packet". The counter is owned by the
+// caller so live and after-the-fact printing number events the same way.
+inline void print_packet_event(const DiveDebugEvent& ev, const std::string& dst, int& counter,
+                               std::ostream& out = std::cout) {
+    const std::string src = "LOCALHOST:random";  // pseudo source
+    auto ts = dive_timestamp(ev.when);
+    counter++;
+
+    switch (ev.type) {
+        case CURLINFO_TEXT:
+            out << "[" << ts << "] [INFO] " << ev.data;
+            break;
+        case CURLINFO_HEADER_OUT:
+            out << "[" << ts << "] [PACKET " << counter << "] OUT " << src << " -> " << dst << " | HEADER | " << ev.size << " bytes\n";
+            out << ev.data << "\n";
+            break;
+        case CURLINFO_HEADER_IN:
+            out << "[" << ts << "] [PACKET " << counter << "] IN " << dst << " -> " << src << " | HEADER | " << ev.size << " bytes\n";
+            out << ev.data << "\n";
+            break;
+        case CURLINFO_DATA_OUT:
+            out << "[" << ts << "] [PACKET " << counter << "] OUT " << src << " -> " << dst << " | DATA | " << ev.size << " bytes\n";
+            break;
+        case CURLINFO_DATA_IN:
+            out << "[" << ts << "] [PACKET " << counter << "] IN " << dst << " -> " << src << " | DATA | " << ev.size << " bytes\n";
+            break;
+        default:
+            break;
+    }
+}
+
+// The address the race connected to, else the first resolved one (IPv4
+// first), else the host
+inline std::string dive_connect_address(const DiveResult& r) {
+    if (const HappyEyeballsAttempt* won = r.eyeballs.won()) return won->address;
+    if (!r.addresses.empty()) return r.addresses.front();
+    return r.addresses6.empty() ? r.host : r.addresses6.front();
+}
+
+// Pseudo destination label for packet events: dive_connect_address and port
+inline std::string dive_packet_destination(const DiveResult& r) {
+    std::string ip = dive_connect_address(r);
+    if (ip.find(':') != std::string::npos) ip = "[" + ip + "]";
+    return ip + ":" + std::to_string(r.port);
+}
+
+inline void print_packets(const DiveResult& r, std::ostream& out = std::cout) {
+    std::string dst = dive_packet_destination(r);
+    int counter = 0;
+    for (const auto& ev : r.events) print_packet_event(ev, dst, counter, out);
+}
+
+// Every view of one dive, each under a section banner in the same layout
+// the GUI uses for "Run All". Shared by dive and the daemon's "dive" probe.
+inline void print_dive(const DiveResult& r, long eyeballs_delay_ms, std::ostream& out = std::cout) {
+    auto section = [&](const char* name) {
+        out << "// " << name << " =================================================\n\n";
+    };
+    const char* section_end = "\n\n\n\n\n\n";
+
+    if (!r.ok()) out << "curl_easy_perform() failed: " << r.error() << "\n\n";
+
+    section("dns");
+    print_dns(r, out);
+    print_happy_eyeballs(r.eyeballs, eyeballs_delay_ms, out);
+    out << section_end;
+
+    section("tls");
+    if (r.tls.available) {
+        print_tls(r, out);
+        out << "\n";
+        print_certchain(r, out);
+    } else {
+        out << "No SSL session available.\n";
+    }
+    out << section_end;
+
+    section("header");
+    print_headers(r, out);
+    out << section_end;
+
+    section("cookies");
+    print_cookies(r, out);
+    out << section_end;
+
+    section("html_body");
+    print_body(r, out);
+    out << section_end;
+
+    section("redirect");
+    print_redirects(r, out);
+    out << section_end;
+
+    section("packets");
+    print_packets(r, out);
+    out << section_end;
+}
@@ -1,7 +1,15 @@
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
 #include <iostream>
+#include <fstream>
+#include <set>
+#include <sstream>
 #include <string>
-#include <netdb.h>
+#include <vector>
 #include <arpa/inet.h>
+#include "dns_async.h"
+#include "dns_cache.h"
 
 // A simple Logger class for this standalone tool
 class Logger {
@@ -11,54 +19,275 @@ public:
     }
 };
 
-// DNSResolver class for resolving hostnames to IP addresses
+// DNSResolver class for resolving hostnames over the DNS wire protocol.
+// Lookups never block on the system resolver; everything goes through
+// AsyncDnsResolver so one host and a list of 100k hosts take the same path.
 class DNSResolver {
 public:
-    DNSResolver(Logger& logger) : logger_(logger) {}
+    DNSResolver(Logger& logger, const AsyncDnsResolver::Options& options, const std::vector<uint16_t>& types)
+        : logger_(logger), options_(options), types_(types) {}
 
+    // Single host: the classic "[DNS] A Record: ..." output
     void resolve(const std::string& hostname) {
         logger_.log("[DNS] Resolving " + hostname + "...\n");
-        addrinfo hints{}, *res;
-        hints.ai_family = AF_INET;
-        if (getaddrinfo(hostname.c_str(), NULL, &hints, &res) != 0) {
-            logger_.log("[DNS] Resolution failed\n");
+
+        if (is_ip_literal(hostname)) {
+            logger_.log("[DNS] Address literal: " + hostname + "\n");
             return;
         }
-        for (auto p = res; p; p = p->ai_next) {
-            sockaddr_in* addr = reinterpret_cast<sockaddr_in*>(p->ai_addr);
-            char ip[INET_ADDRSTRLEN];
-            inet_ntop(AF_INET, &addr->sin_addr, ip, sizeof(ip));
-            logger_.log("[DNS] A Record: " + std::string(ip) + "\n");
+
+        // Names from /etc/hosts never reach a DNS server
+        bool any = false;
+        for (uint16_t type : types_) {
+            for (const auto& ip : dns_hosts_lookup(hostname, type)) {
+                logger_.log("[DNS] " + std::string(dns_type_name(type)) + " Record: " + ip + " (hosts file)\n");
+                any = true;
+            }
+        }
+        if (any) return;
+
+        // Every answer repeats the CNAME chain; print each link once
+        std::set<std::string> seen_cnames;
+        std::string failure;
+        size_t next = 0;
+        AsyncDnsResolver resolver(options_, [&](const DnsAnswer& answer) {
+            remember(answer);
+            if (!answer.ok()) {
+                failure = answer.error();
+                return;
+            }
+            for (const auto& rr : answer.records) {
+                if (rr.type == DNS_CNAME && !seen_cnames.insert(rr.name + rr.data).second) continue;
+                logger_.log("[DNS] " + std::string(dns_type_name(rr.type)) + " Record: " + rr.data + "\n");
+                any = true;
+            }
+        });
+        bool started = resolver.run([&](DnsQuestion& q) {
+            while (next < types_.size()) {
+                uint16_t type = types_[next++];
+                uint32_t ttl = 0;
+                int rcode = 0;
+                std::vector<std::string> cached;
+                if (from_cache(hostname, type, cached, ttl, rcode)) {
+                    for (const auto& ip : cached) {
+                        logger_.log("[DNS] " + std::string(dns_type_name(type)) + " Record: " + ip +
+                                    " (cached, ttl " + std::to_string(ttl) + ")\n");
+                    }
+                    if (!cached.empty()) any = true;
+                    if (rcode) failure = std::string(dns_rcode_name(rcode)) + ", cached";
+                    continue;
+                }
+                q.host = hostname;
+                q.type = type;
+                return true;
+            }
+            return false;
+        });
+
+        if (!started) {
+            logger_.log("[DNS] Invalid DNS server: " + options_.server + "\n");
+        } else if (!any) {
+            logger_.log("[DNS] Resolution failed" + (failure.empty() ? "" : " (" + failure + ")") + "\n");
         }
-        freeaddrinfo(res);
+    }
+
+    // Bulk mode: one tab separated line per record, printed as answers arrive
+    //   host  TYPE  ttl  data
+    //   host  TYPE  -    ERROR:<rcode|TIMEOUT>
+    size_t resolve_all(std::istream& in) {
+        size_t failed = 0;
+        std::string host;
+        size_t next = types_.size();
+        AsyncDnsResolver resolver(options_, [&](const DnsAnswer& answer) {
+            remember(answer);
+            std::string prefix = answer.host + "\t" + dns_type_name(answer.type) + "\t";
+            if (!answer.ok()) {
+                failed++;
+                logger_.log(prefix + "-\tERROR:" + answer.error() + "\n");
+                return;
+            }
+            for (const auto& rr : answer.records) {
+                logger_.log(answer.host + "\t" + dns_type_name(rr.type) + "\t" +
+                            std::to_string(rr.ttl) + "\t" + rr.data + "\n");
+            }
+        });
+        bool started = resolver.run([&](DnsQuestion& q) {
+            while (true) {
+                if (next == types_.size()) {
+                    std::string line;
+                    do {
+                        if (!std::getline(in, line)) return false;
+                        host = getHostnameFromUrl(trim(line));
+                    } while (host.empty() || host[0] == '#');
+                    next = 0;
+                }
+                uint16_t type = types_[next++];
+                uint32_t ttl = 0;
+                int rcode = 0;
+                std::vector<std::string> cached;
+                if (from_cache(host, type, cached, ttl, rcode)) {
+                    for (const auto& ip : cached) {
+                        logger_.log(host + "\t" + dns_type_name(type) + "\t" + std::to_string(ttl) + "\t" + ip + "\n");
+                    }
+                    if (rcode) {
+                        failed++;
+                        logger_.log(host + "\t" + dns_type_name(type) + "\t-\tERROR:" + dns_rcode_name(rcode) + "\n");
+                    }
+                    continue;
+                }
+                q.host = host;
+                q.type = type;
+                return true;
+            }
+        });
+        if (!started) std::cerr << "Invalid DNS server: " << options_.server << "\n";
+        return failed;
+    }
+
+    // Utility function to extract the hostname from a URL
+    static std::string getHostnameFromUrl(const std::string& url) {
+        std::string host = url;
+        size_t start = url.find("//");
+        if (start != std::string::npos) {
+            size_t end = url.find_first_of("/?#", start + 2);
+            host = url.substr(start + 2, (end == std::string::npos ? url.size() : end) - (start + 2));
+        }
+        size_t at = host.rfind('@');
+        if (at != std::string::npos) host = host.substr(at + 1);
+        if (!host.empty() && host[0] == '[') return host.substr(1, host.find(']') - 1);
+        size_t colon = host.find(':');
+        if (colon != std::string::npos) host = host.substr(0, colon);
+        return host;
     }
 
 private:
+    // Fresh A/AAAA answers come straight from the shared cache, negative
+    // ones (no addresses, rcode NXDOMAIN or 0 for NODATA) included
+    static bool from_cache(const std::string& host, uint16_t type, std::vector<std::string>& addresses,
+                           uint32_t& ttl, int& rcode) {
+        if (type != DNS_A && type != DNS_AAAA) return false;
+        int family = type == DNS_AAAA ? AF_INET6 : AF_INET;
+        return DnsCache::shared().lookup(host, family, addresses, ttl, &rcode) == DnsCacheStatus::Hit;
+    }
+
+    // Store A/AAAA answers for the other tools
+    static void remember(const DnsAnswer& answer) { dns_cache_answer(answer); }
+
+    static std::string trim(const std::string& s) {
+        size_t start = s.find_first_not_of(" \t\r");
+        if (start == std::string::npos) return "";
+        return s.substr(start, s.find_last_not_of(" \t\r") - start + 1);
+    }
+
+    static bool is_ip_literal(const std::string& host) {
+        unsigned char buf[sizeof(in6_addr)];
+        return inet_pton(AF_INET, host.c_str(), buf) == 1 || inet_pton(AF_INET6, host.c_str(), buf) == 1;
+    }
+
     Logger& logger_;
+    AsyncDnsResolver::Options options_;
+    std::vector<uint16_t> types_;
 };
 
-// Utility function to extract the hostname from a URL
-std::string getHostnameFromUrl(const std::string& url) {
-    size_t start = url.find("//");
-    if (start != std::string::npos) {
-        size_t end = url.find('/', start + 2);
-        return url.substr(start + 2, (end == std::string::npos ? url.size() : end) - (start + 2));
-    }
-    return url;
+// A whole decimal number from min to INT_MAX
+bool parse_count(const char* text, long min, long& out) {
+    char* end = nullptr;
+    errno = 0;
+    long n = std::strtol(text, &end, 10);
+    if (end == text || *end || errno == ERANGE || n < min || n > INT_MAX) return false;
+    out = n;
+    return true;
+}
+
+void usage(const char* tool) {
+    std::cerr << "Usage: " << tool << " <url_or_hostname> [options]\n"
+              << "       " << tool << " --batch <file|-> [options]\n"
+              << "Options:\n"
+              << "  --server <ip[:port]>   DNS server (default: first nameserver in /etc/resolv.conf)\n"
+              << "  --type <A,AAAA,...>    record types: A, AAAA, CNAME, MX, TXT (default: A,AAAA)\n"
+              << "  --timeout <ms>         per attempt timeout (default: 2000)\n"
+              << "  --retries <n>          retries after the first attempt (default: 2)\n"
+              << "  --parallel <n>         queries in flight (default: 200)\n";
 }
 
 int main(int argc, char* argv[]) {
     if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <url_or_hostname>" << std::endl;
+        usage(argv[0]);
         return 1;
     }
 
-    std::string input = argv[1];
-    std::string hostname = getHostnameFromUrl(input);
+    AsyncDnsResolver::Options options;
+    std::vector<uint16_t> types = {DNS_A, DNS_AAAA};  // both families, asked at once
+    std::string input;
+    std::string batch;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--server" && has_value) {
+            options.server = argv[++i];
+            sockaddr_storage addr;
+            socklen_t addr_len = 0;
+            if (!dns_parse_server(options.server, addr, addr_len)) {
+                std::cerr << "Invalid --server: " << options.server << "\n";
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--type" && has_value) {
+            types.clear();
+            std::string list = argv[++i];
+            size_t start = 0;
+            while (start <= list.size()) {
+                size_t comma = list.find(',', start);
+                if (comma == std::string::npos) comma = list.size();
+                uint16_t type = dns_type_from_name(list.substr(start, comma - start));
+                if (!type) {
+                    std::cerr << "Unsupported record type: " << list.substr(start, comma - start) << "\n";
+                    return 1;
+                }
+                types.push_back(type);
+                start = comma + 1;
+            }
+        } else if ((arg == "--timeout" || arg == "--retries" || arg == "--parallel") && has_value) {
+            long n = 0;
+            if (!parse_count(argv[++i], arg == "--retries" ? 0 : 1, n)) {
+                std::cerr << "Invalid " << arg << ": " << argv[i] << "\n";
+                usage(argv[0]);
+                return 1;
+            }
+            if (arg == "--timeout") options.timeout_ms = int(n);
+            if (arg == "--retries") options.retries = int(n);
+            if (arg == "--parallel") options.max_in_flight = size_t(n);
+        } else if (arg == "--batch") {
+            batch = has_value ? argv[++i] : "-";
+        } else {
+            input = arg;
+        }
+    }
 
     Logger logger;
-    DNSResolver dnsResolver(logger);
-    dnsResolver.resolve(hostname);
+    DNSResolver dnsResolver(logger, options, types);
 
+    if (!batch.empty()) {
+        std::ifstream file;
+        if (batch != "-") {
+            file.open(batch);
+            if (!file) {
+                std::cerr << "Failed to open host list: " << batch << "\n";
+                return 1;
+            }
+        }
+        size_t failed = dnsResolver.resolve_all(batch == "-" ? std::cin : file);
+        print_dns_cache_stats();
+        return failed > 0 ? 1 : 0;
+    }
+
+    if (input.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    dnsResolver.resolve(DNSResolver::getHostnameFromUrl(input));
+    print_dns_cache_stats();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,677 @@
+// dns_async.h
+// Non-blocking bulk DNS resolver speaking the wire protocol directly.
+//
+// Queries are pipelined over one connected UDP socket to a configurable
+// server, with per-query timeouts and retries. A truncated UDP answer is
+// re-asked over TCP. Answers are handed to a callback as they arrive, so a
+// list of hostnames of any length can be streamed through it. Supports A,
+// AAAA, CNAME, MX and TXT.
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+enum DnsType : uint16_t {
+    DNS_A = 1,
+    DNS_CNAME = 5,
+    DNS_SOA = 6,
+    DNS_MX = 15,
+    DNS_TXT = 16,
+    DNS_AAAA = 28,
+    DNS_OPT = 41,
+};
+
+inline const char* dns_type_name(uint16_t type) {
+    switch (type) {
+        case DNS_A: return "A";
+        case DNS_CNAME: return "CNAME";
+        case DNS_MX: return "MX";
+        case DNS_TXT: return "TXT";
+        case DNS_AAAA: return "AAAA";
+        default: return "?";
+    }
+}
+
+// Returns 0 for an unsupported type name
+inline uint16_t dns_type_from_name(const std::string& name) {
+    for (uint16_t t : {DNS_A, DNS_CNAME, DNS_MX, DNS_TXT, DNS_AAAA}) {
+        if (strcasecmp(name.c_str(), dns_type_name(t)) == 0) return t;
+    }
+    return 0;
+}
+
+inline const char* dns_rcode_name(int rcode) {
+    switch (rcode) {
+        case 0: return "NOERROR";
+        case 1: return "FORMERR";
+        case 2: return "SERVFAIL";
+        case 3: return "NXDOMAIN";
+        case 4: return "NOTIMP";
+        case 5: return "REFUSED";
+        default: return "RCODE?";
+    }
+}
+
+struct DnsRecord {
+    std::string name;
+    uint16_t type = 0;
+    uint32_t ttl = 0;
+    std::string data;  // presentation form: address, target name, "pref host", quoted text
+};
+
+struct DnsAnswer {
+    std::string host;
+    uint16_t type = 0;
+    int rcode = 0;
+    bool timed_out = false;
+    bool unreachable = false;      // the server port refused the query
+    bool truncated_retry = false;  // answered over TCP after a truncated UDP reply
+    int attempts = 0;
+    std::vector<DnsRecord> records;
+    uint32_t negative_ttl = 0;     // how long "no such record" holds (RFC 2308), 0 without an SOA
+
+    bool ok() const { return !timed_out && !unreachable && rcode == 0; }
+    std::string error() const {
+        if (unreachable) return "UNREACHABLE";
+        return timed_out ? "TIMEOUT" : dns_rcode_name(rcode);
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Wire format
+// ---------------------------------------------------------------------------
+
+// Encode a standard recursive query with an EDNS0 OPT record advertising a
+// 1232 byte UDP payload, which keeps most answers out of the TCP fallback.
+inline bool dns_encode_query(uint16_t id, const std::string& host, uint16_t type, std::vector<uint8_t>& out) {
+    out.clear();
+    const uint8_t header[12] = {
+        uint8_t(id >> 8), uint8_t(id), 0x01, 0x00,  // RD
+        0, 1, 0, 0, 0, 0, 0, 1,                     // 1 question, 1 additional
+    };
+    out.insert(out.end(), header, header + sizeof(header));
+
+    size_t start = 0;
+    while (start < host.size()) {
+        size_t dot = host.find('.', start);
+        if (dot == std::string::npos) dot = host.size();
+        size_t len = dot - start;
+        if (len == 0 || len > 63) return false;
+        out.push_back(uint8_t(len));
+        out.insert(out.end(), host.begin() + start, host.begin() + dot);
+        start = dot + 1;
+    }
+    out.push_back(0);
+    if (out.size() - sizeof(header) > 255) return false;
+
+    const uint8_t tail[] = {
+        uint8_t(type >> 8), uint8_t(type), 0, 1,  // QTYPE, QCLASS IN
+        0, 0, DNS_OPT, 0x04, 0xd0,                // root, OPT, payload 1232
+        0, 0, 0, 0, 0, 0,                         // ext-rcode/flags, rdlen 0
+    };
+    out.insert(out.end(), tail, tail + sizeof(tail));
+    return true;
+}
+
+// Read a possibly compressed name starting at off. On success off is moved
+// past the name as it appears in place.
+inline bool dns_read_name(const uint8_t* msg, size_t len, size_t& off, std::string& name) {
+    name.clear();
+    size_t pos = off;
+    bool jumped = false;
+    int hops = 0;
+    while (true) {
+        if (pos >= len) return false;
+        uint8_t l = msg[pos];
+        if ((l & 0xc0) == 0xc0) {
+            if (pos + 1 >= len || ++hops > 16) return false;
+            if (!jumped) off = pos + 2;
+            jumped = true;
+            pos = ((l & 0x3f) << 8) | msg[pos + 1];
+            continue;
+        }
+        if (l & 0xc0) return false;
+        pos++;
+        if (l == 0) break;
+        if (pos + l > len) return false;
+        if (!name.empty()) name += '.';
+        name.append(reinterpret_cast<const char*>(msg + pos), l);
+        pos += l;
+    }
+    if (!jumped) off = pos;
+    return true;
+}
+
+struct DnsMessage {
+    uint16_t id = 0;
+    bool response = false;
+    bool truncated = false;
+    int rcode = 0;
+    std::string qname;
+    uint16_t qtype = 0;
+    std::vector<DnsRecord> answers;
+    uint32_t negative_ttl = 0;  // lesser of the authority SOA's TTL and its minimum field
+};
+
+inline bool dns_parse_message(const uint8_t* msg, size_t len, DnsMessage& out) {
+    if (len < 12) return false;
+    out.id = uint16_t(msg[0] << 8 | msg[1]);
+    out.response = msg[2] & 0x80;
+    out.truncated = msg[2] & 0x02;
+    out.rcode = msg[3] & 0x0f;
+    unsigned qdcount = msg[4] << 8 | msg[5];
+    unsigned ancount = msg[6] << 8 | msg[7];
+    unsigned nscount = msg[8] << 8 | msg[9];
+
+    size_t off = 12;
+    for (unsigned i = 0; i < qdcount; i++) {
+        std::string name;
+        if (!dns_read_name(msg, len, off, name) || off + 4 > len) return false;
+        if (i == 0) {
+            out.qname = name;
+            out.qtype = uint16_t(msg[off] << 8 | msg[off + 1]);
+        }
+        off += 4;
+    }
+
+    for (unsigned i = 0; i < ancount; i++) {
+        DnsRecord rr;
+        if (!dns_read_name(msg, len, off, rr.name) || off + 10 > len) return false;
+        rr.type = uint16_t(msg[off] << 8 | msg[off + 1]);
+        rr.ttl = uint32_t(msg[off + 4]) << 24 | uint32_t(msg[off + 5]) << 16 |
+                 uint32_t(msg[off + 6]) << 8 | msg[off + 7];
+        uint16_t rdlen = uint16_t(msg[off + 8] << 8 | msg[off + 9]);
+        off += 10;
+        if (off + rdlen > len) return false;
+        const uint8_t* rd = msg + off;
+
+        char ip[INET6_ADDRSTRLEN];
+        size_t name_off = off;
+        switch (rr.type) {
+            case DNS_A:
+                if (rdlen != 4) return false;
+                rr.data = inet_ntop(AF_INET, rd, ip, sizeof(ip));
+                break;
+            case DNS_AAAA:
+                if (rdlen != 16) return false;
+                rr.data = inet_ntop(AF_INET6, rd, ip, sizeof(ip));
+                break;
+            case DNS_CNAME:
+                if (!dns_read_name(msg, len, name_off, rr.data)) return false;
+                break;
+            case DNS_MX: {
+                if (rdlen < 3) return false;
+                std::string exchange;
+                name_off += 2;
+                if (!dns_read_name(msg, len, name_off, exchange)) return false;
+                rr.data = std::to_string(rd[0] << 8 | rd[1]) + " " + exchange;
+                break;
+            }
+            case DNS_TXT:
+                for (size_t p = 0; p < rdlen;) {
+                    uint8_t l = rd[p++];
+                    if (p + l > rdlen) return false;
+                    if (!rr.data.empty()) rr.data += ' ';
+                    rr.data += '"';
+                    rr.data.append(reinterpret_cast<const char*>(rd + p), l);
+                    rr.data += '"';
+                    p += l;
+                }
+                break;
+            default:
+                off += rdlen;
+                continue;  // not something we report
+        }
+        off += rdlen;
+        out.answers.push_back(std::move(rr));
+    }
+
+    // A negative answer carries the zone's SOA in the authority section;
+    // its minimum field ends the rdata. A malformed authority section only
+    // loses the negative TTL.
+    for (unsigned i = 0; i < nscount; i++) {
+        std::string name;
+        if (!dns_read_name(msg, len, off, name) || off + 10 > len) break;
+        uint16_t type = uint16_t(msg[off] << 8 | msg[off + 1]);
+        uint32_t ttl = uint32_t(msg[off + 4]) << 24 | uint32_t(msg[off + 5]) << 16 |
+                       uint32_t(msg[off + 6]) << 8 | msg[off + 7];
+        uint16_t rdlen = uint16_t(msg[off + 8] << 8 | msg[off + 9]);
+        off += 10;
+        if (off + rdlen > len) break;
+        if (type == DNS_SOA && rdlen >= 22) {
+            const uint8_t* minimum = msg + off + rdlen - 4;
+            uint32_t soa_min = uint32_t(minimum[0]) << 24 | uint32_t(minimum[1]) << 16 |
+                               uint32_t(minimum[2]) << 8 | minimum[3];
+            out.negative_ttl = std::min(ttl, soa_min);
+            break;
+        }
+        off += rdlen;
+    }
+    return true;
+}
+
+// "ip", "ip:port", "[ipv6]:port" -> socket address (port defaults to 53)
+inline bool dns_parse_server(const std::string& spec, sockaddr_storage& addr, socklen_t& addr_len) {
+    std::string host = spec;
+    long port = 53;
+    auto parse_port = [&port](const std::string& text) {
+        char* end = nullptr;
+        port = std::strtol(text.c_str(), &end, 10);
+        return end != text.c_str() && *end == '\0' && port > 0 && port <= 65535;
+    };
+    if (!spec.empty() && spec[0] == '[') {
+        size_t close = spec.find(']');
+        if (close == std::string::npos) return false;
+        host = spec.substr(1, close - 1);
+        if (close + 1 < spec.size() && (spec[close + 1] != ':' || !parse_port(spec.substr(close + 2)))) return false;
+    } else if (std::count(spec.begin(), spec.end(), ':') == 1) {
+        size_t colon = spec.find(':');
+        host = spec.substr(0, colon);
+        if (!parse_port(spec.substr(colon + 1))) return false;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    auto* v4 = reinterpret_cast<sockaddr_in*>(&addr);
+    auto* v6 = reinterpret_cast<sockaddr_in6*>(&addr);
+    if (inet_pton(AF_INET, host.c_str(), &v4->sin_addr) == 1) {
+        v4->sin_family = AF_INET;
+        v4->sin_port = htons(port);
+        addr_len = sizeof(sockaddr_in);
+        return true;
+    }
+    if (inet_pton(AF_INET6, host.c_str(), &v6->sin6_addr) == 1) {
+        v6->sin6_family = AF_INET6;
+        v6->sin6_port = htons(port);
+        addr_len = sizeof(sockaddr_in6);
+        return true;
+    }
+    return false;
+}
+
+// First nameserver from /etc/resolv.conf
+inline std::string dns_default_server() {
+    std::ifstream conf("/etc/resolv.conf");
+    std::string line;
+    while (std::getline(conf, line)) {
+        std::istringstream in(line);
+        std::string key, value;
+        if (in >> key >> value && key == "nameserver") return value;
+    }
+    return "127.0.0.1";
+}
+
+// Addresses for host from /etc/hosts (A and AAAA only)
+inline std::vector<std::string> dns_hosts_lookup(const std::string& host, uint16_t type) {
+    std::vector<std::string> found;
+    if (type != DNS_A && type != DNS_AAAA) return found;
+    std::ifstream hosts("/etc/hosts");
+    std::string line;
+    while (std::getline(hosts, line)) {
+        std::istringstream in(line.substr(0, line.find('#')));
+        std::string ip, name;
+        if (!(in >> ip)) continue;
+        bool v6 = ip.find(':') != std::string::npos;
+        if (v6 != (type == DNS_AAAA)) continue;
+        while (in >> name) {
+            if (strcasecmp(name.c_str(), host.c_str()) == 0) {
+                found.push_back(ip);
+                break;
+            }
+        }
+    }
+    return found;
+}
+
+// ---------------------------------------------------------------------------
+// Resolver
+// ---------------------------------------------------------------------------
+
+struct DnsQuestion {
+    std::string host;
+    uint16_t type = DNS_A;
+};
+
+class AsyncDnsResolver {
+public:
+    struct Options {
+        std::string server = dns_default_server();
+        int timeout_ms = 2000;       // per attempt
+        int retries = 2;             // extra attempts after the first
+        size_t max_in_flight = 200;  // outstanding queries
+    };
+
+    using ResultFn = std::function<void(const DnsAnswer&)>;
+    using SourceFn = std::function<bool(DnsQuestion&)>;
+
+    AsyncDnsResolver(const Options& options, ResultFn on_result)
+        : options_(options), on_result_(std::move(on_result)), slots_(65536) {
+        if (options_.max_in_flight > 60000) options_.max_in_flight = 60000;
+        std::random_device rd;
+        next_id_ = uint16_t(rd());
+    }
+
+    ~AsyncDnsResolver() {
+        for (auto& slot : slots_) {
+            if (slot && slot->tcp_fd >= 0) close(slot->tcp_fd);
+        }
+        if (udp_fd_ >= 0) close(udp_fd_);
+        if (epoll_fd_ >= 0) close(epoll_fd_);
+    }
+
+    // Resolve everything the source yields. Returns false if the server
+    // address is unusable.
+    bool run(const SourceFn& source) {
+        if (!dns_parse_server(options_.server, server_, server_len_)) return false;
+
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        udp_fd_ = socket(server_.ss_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (epoll_fd_ < 0 || udp_fd_ < 0) return false;
+        if (connect(udp_fd_, reinterpret_cast<sockaddr*>(&server_), server_len_) != 0) return false;
+
+        // Hundreds of answers can land between two reads; keep them from being dropped
+        int rcvbuf = 4 << 20;
+        setsockopt(udp_fd_, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = kUdpTag;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, udp_fd_, &ev);
+
+        source_ = &source;
+        fill();
+
+        const int max_events = 128;
+        epoll_event events[max_events];
+        while (in_flight_ > 0) {
+            int n = epoll_wait(epoll_fd_, events, max_events, wait_ms());
+            if (n < 0 && errno != EINTR) break;
+            for (int i = 0; i < n; i++) {
+                if (events[i].data.u64 == kUdpTag) {
+                    read_udp();
+                } else {
+                    service_tcp(uint16_t(events[i].data.u64), events[i].events);
+                }
+            }
+            expire();
+            fill();
+        }
+        source_ = nullptr;
+        return true;
+    }
+
+private:
+    static constexpr uint64_t kUdpTag = 1ull << 32;
+
+    struct Pending {
+        DnsQuestion question;
+        std::vector<uint8_t> query;
+        int attempts = 0;
+        std::chrono::steady_clock::time_point deadline;
+
+        // TCP fallback state
+        int tcp_fd = -1;
+        size_t tcp_sent = 0;
+        std::vector<uint8_t> tcp_in;
+    };
+
+    struct Deadline {
+        std::chrono::steady_clock::time_point when;
+        uint16_t id;
+        int attempt;
+    };
+
+    // Pull questions from the source until the in-flight limit is reached
+    void fill() {
+        DnsQuestion q;
+        while (in_flight_ < options_.max_in_flight && (*source_)(q)) {
+            uint16_t id = allocate_id();
+            auto pending = std::make_unique<Pending>();
+            pending->question = q;
+            if (!dns_encode_query(id, q.host, q.type, pending->query)) {
+                DnsAnswer answer;
+                answer.host = q.host;
+                answer.type = q.type;
+                answer.rcode = 1;  // FORMERR: not a valid name
+                on_result_(answer);
+                continue;
+            }
+            slots_[id] = std::move(pending);
+            in_flight_++;
+            send_udp(id);
+        }
+    }
+
+    uint16_t allocate_id() {
+        while (slots_[next_id_]) next_id_++;
+        return next_id_++;
+    }
+
+    void arm(uint16_t id) {
+        Pending& p = *slots_[id];
+        p.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(options_.timeout_ms);
+        deadlines_.push_back({p.deadline, id, p.attempts});
+    }
+
+    void send_udp(uint16_t id) {
+        Pending& p = *slots_[id];
+        p.attempts++;
+        // A full socket buffer is treated like a lost packet: the timeout retries it
+        send(udp_fd_, p.query.data(), p.query.size(), 0);
+        arm(id);
+    }
+
+    void read_udp() {
+        uint8_t buf[4096];
+        while (true) {
+            ssize_t n = recv(udp_fd_, buf, sizeof(buf), 0);
+            if (n < 0) {
+                if (errno == ECONNREFUSED) fail_all_unreachable();
+                break;
+            }
+            handle_response(buf, size_t(n), false);
+        }
+    }
+
+    // ICMP port unreachable on the connected socket: nothing is listening,
+    // so waiting out the retries would only stall every query.
+    void fail_all_unreachable() {
+        for (size_t id = 0; id < slots_.size(); id++) {
+            auto& slot = slots_[id];
+            if (!slot || slot->tcp_fd >= 0) continue;
+            DnsAnswer answer;
+            answer.host = slot->question.host;
+            answer.type = slot->question.type;
+            answer.unreachable = true;
+            answer.attempts = slot->attempts;
+            complete(uint16_t(id), answer);
+        }
+    }
+
+    void handle_response(const uint8_t* buf, size_t len, bool over_tcp) {
+        DnsMessage msg;
+        if (!dns_parse_message(buf, len, msg) || !msg.response) return;
+
+        // Match on id and the echoed question so stray or late replies are
+        // ignored. Once a query has moved to TCP, UDP replies for it are too.
+        auto& slot = slots_[msg.id];
+        if (!slot || (!over_tcp && slot->tcp_fd >= 0)) return;
+        if (msg.qtype != slot->question.type ||
+            strcasecmp(msg.qname.c_str(), slot->question.host.c_str()) != 0) return;
+
+        if (msg.truncated && !over_tcp) {
+            start_tcp(msg.id);
+            return;
+        }
+
+        DnsAnswer answer;
+        answer.host = slot->question.host;
+        answer.type = slot->question.type;
+        answer.rcode = msg.rcode;
+        answer.attempts = slot->attempts;
+        answer.truncated_retry = over_tcp;
+        answer.records = std::move(msg.answers);
+        answer.negative_ttl = msg.negative_ttl;
+        complete(msg.id, answer);
+    }
+
+    void start_tcp(uint16_t id) {
+        Pending& p = *slots_[id];
+        p.tcp_sent = 0;  // nothing carries over from an earlier connection
+        p.tcp_in.clear();
+        p.tcp_fd = socket(server_.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (p.tcp_fd < 0) return;  // left to time out
+        connect(p.tcp_fd, reinterpret_cast<sockaddr*>(&server_), server_len_);
+
+        // Two byte length prefix, then the same query
+        std::vector<uint8_t> framed = {uint8_t(p.query.size() >> 8), uint8_t(p.query.size())};
+        framed.insert(framed.end(), p.query.begin(), p.query.end());
+        p.query.swap(framed);
+
+        epoll_event ev{};
+        ev.events = EPOLLOUT | EPOLLIN;
+        ev.data.u64 = id;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, p.tcp_fd, &ev);
+        arm(id);
+    }
+
+    void service_tcp(uint16_t id, uint32_t events) {
+        auto& slot = slots_[id];
+        if (!slot || slot->tcp_fd < 0) return;
+        Pending& p = *slot;
+
+        if (events & EPOLLOUT && p.tcp_sent < p.query.size()) {
+            ssize_t n = send(p.tcp_fd, p.query.data() + p.tcp_sent, p.query.size() - p.tcp_sent, MSG_NOSIGNAL);
+            if (n > 0) p.tcp_sent += size_t(n);
+            if (p.tcp_sent == p.query.size()) {
+                epoll_event ev{};
+                ev.events = EPOLLIN;
+                ev.data.u64 = id;
+                epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, p.tcp_fd, &ev);
+            }
+        }
+
+        if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+            uint8_t buf[4096];
+            ssize_t n;
+            while ((n = recv(p.tcp_fd, buf, sizeof(buf), 0)) > 0) {
+                p.tcp_in.insert(p.tcp_in.end(), buf, buf + n);
+            }
+            if (p.tcp_in.size() >= 2) {
+                size_t want = size_t(p.tcp_in[0]) << 8 | p.tcp_in[1];
+                if (p.tcp_in.size() >= want + 2) {
+                    std::vector<uint8_t> msg(p.tcp_in.begin() + 2, p.tcp_in.begin() + 2 + want);
+                    handle_response(msg.data(), msg.size(), true);
+                    return;
+                }
+            }
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                close_tcp(p);  // server gave up; the deadline reports it
+            }
+        }
+    }
+
+    void close_tcp(Pending& p) {
+        if (p.tcp_fd < 0) return;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, p.tcp_fd, nullptr);
+        close(p.tcp_fd);
+        p.tcp_fd = -1;
+    }
+
+    void complete(uint16_t id, const DnsAnswer& answer) {
+        close_tcp(*slots_[id]);
+        slots_[id].reset();
+        in_flight_--;
+        on_result_(answer);
+    }
+
+    // Retry or give up on queries whose deadline has passed. Deadlines are
+    // queued in send order and the timeout is fixed, so the queue stays sorted.
+    void expire() {
+        auto now = std::chrono::steady_clock::now();
+        while (!deadlines_.empty() && deadlines_.front().when <= now) {
+            Deadline d = deadlines_.front();
+            deadlines_.pop_front();
+            auto& slot = slots_[d.id];
+            if (!slot || slot->attempts != d.attempt || slot->deadline != d.when) continue;  // stale
+
+            if (slot->attempts <= options_.retries) {
+                if (slot->tcp_fd >= 0) {
+                    close_tcp(*slot);
+                    slot->attempts++;
+                    slot->query.erase(slot->query.begin(), slot->query.begin() + 2);
+                    start_tcp(d.id);
+                } else {
+                    send_udp(d.id);
+                }
+                continue;
+            }
+
+            DnsAnswer answer;
+            answer.host = slot->question.host;
+            answer.type = slot->question.type;
+            answer.timed_out = true;
+            answer.attempts = slot->attempts;
+            complete(d.id, answer);
+        }
+    }
+
+    int wait_ms() const {
+        if (deadlines_.empty()) return -1;
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadlines_.front().when - std::chrono::steady_clock::now()).count();
+        return left > 0 ? int(left) + 1 : 0;
+    }
+
+    Options options_;
+    ResultFn on_result_;
+    const SourceFn* source_ = nullptr;
+
+    sockaddr_storage server_{};
+    socklen_t server_len_ = 0;
+    int epoll_fd_ = -1;
+    int udp_fd_ = -1;
+
+    std::vector<std::unique_ptr<Pending>> slots_;  // indexed by query id
+    std::deque<Deadline> deadlines_;
+    uint16_t next_id_ = 0;
+    size_t in_flight_ = 0;
+};
+
+// Ask one question and wait for its answer
+inline DnsAnswer dns_query(const std::string& host, uint16_t type,
+                           const AsyncDnsResolver::Options& options = AsyncDnsResolver::Options()) {
+    DnsAnswer result;
+    result.host = host;
+    result.type = type;
+    result.timed_out = true;
+
+    bool asked = false;
+    AsyncDnsResolver resolver(options, [&](const DnsAnswer& answer) { result = answer; });
+    resolver.run([&](DnsQuestion& q) {
+        if (asked) return false;
+        asked = true;
+        q.host = host;
+        q.type = type;
+        return true;
+    });
+    return result;
+}
@@ -0,0 +1,393 @@
+// dns_cache.h
+// Persistent, TTL-aware DNS cache shared by every tool.
+//
+// The cache is a fixed-size open-addressed table in a memory-mapped file,
+// so concurrent tool processes share it without a server. Each slot is
+// guarded by a sequence counter: readers never take a lock and simply retry
+// if a writer was active. Writers serialise on a mutex within the process
+// (flock() locks belong to the open file, which every thread shares) and on
+// flock() across processes. Entries expire with the record TTL; an expired
+// entry is reported as stale and is still served if a fresh lookup fails.
+// An answer with no addresses (NODATA, NXDOMAIN) is cached too, for the
+// negative TTL of the zone's SOA, so a host without IPv6 is not asked for
+// AAAA on every run.
+//
+// Location: $WEBDIVE_DNS_CACHE, else $XDG_CACHE_HOME/webdive/dns.cache, else
+// ~/.cache/webdive/dns.cache. WEBDIVE_DNS_CACHE=off disables it.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "dns_async.h"
+
+enum class DnsCacheStatus { Hit, Stale, Miss };
+
+// Counted from every thread that resolves through the cache (the crawler)
+struct DnsCacheStats {
+    std::atomic<unsigned long> hits{0};
+    std::atomic<unsigned long> misses{0};
+    std::atomic<unsigned long> stale{0};
+};
+
+class DnsCache {
+public:
+    static constexpr uint32_t kSlots = 4096;
+    static constexpr uint32_t kProbe = 8;          // slots searched per key
+    static constexpr int64_t kMaxTtl = 86400;      // clamp absurd TTLs
+    static constexpr int64_t kMaxStale = 86400;    // how long an expired entry may be served
+    static constexpr uint32_t kNegativeTtl = 300;  // for a negative answer without an SOA
+    static constexpr uint32_t kMaxNegativeTtl = 3600;
+
+    // Process-wide handle on the default cache file
+    static DnsCache& shared() {
+        static DnsCache cache(default_path());
+        return cache;
+    }
+
+    static std::string default_path() {
+        if (const char* env = getenv("WEBDIVE_DNS_CACHE")) return env;
+        std::string dir;
+        if (const char* xdg = getenv("XDG_CACHE_HOME")) {
+            dir = xdg;
+        } else if (const char* home = getenv("HOME")) {
+            dir = std::string(home) + "/.cache";
+        } else {
+            return "";
+        }
+        return dir + "/webdive/dns.cache";
+    }
+
+    explicit DnsCache(const std::string& path) { open_file(path); }
+
+    ~DnsCache() {
+        if (map_) munmap(map_, map_size());
+        if (fd_ >= 0) close(fd_);
+    }
+
+    DnsCache(const DnsCache&) = delete;
+    DnsCache& operator=(const DnsCache&) = delete;
+
+    bool enabled() const { return map_ != nullptr; }
+
+    // Look host up for AF_INET/AF_INET6. Stale entries fill addresses too.
+    // A cached negative answer is a hit with no addresses; rcode tells
+    // NXDOMAIN (3) from NODATA (0).
+    DnsCacheStatus lookup(const std::string& host, int family, std::vector<std::string>& addresses,
+                          uint32_t& ttl_left, int* rcode = nullptr) {
+        addresses.clear();
+        ttl_left = 0;
+        Record rec;
+        if (!enabled() || !find(host, family, rec)) {
+            stats.misses++;
+            return DnsCacheStatus::Miss;
+        }
+        if (rcode) *rcode = rec.rcode;
+
+        for (int i = 0; i < rec.count; i++) {
+            char ip[INET6_ADDRSTRLEN];
+            inet_ntop(family, rec.addrs[i], ip, sizeof(ip));
+            addresses.push_back(ip);
+        }
+
+        int64_t now = time(nullptr);
+        if (rec.expires > now) {
+            ttl_left = uint32_t(rec.expires - now);
+            stats.hits++;
+            return DnsCacheStatus::Hit;
+        }
+        if (now - rec.expires > kMaxStale) {
+            addresses.clear();
+            stats.misses++;
+            return DnsCacheStatus::Miss;
+        }
+        stats.stale++;
+        return DnsCacheStatus::Stale;
+    }
+
+    // No addresses stores a negative answer with its rcode
+    void store(const std::string& host, int family, const std::vector<std::string>& addresses, uint32_t ttl,
+               int rcode = 0) {
+        if (!enabled() || ttl == 0 || host.size() >= sizeof(Record::host)) return;
+
+        Record rec{};
+        rec.family = uint16_t(family);
+        rec.rcode = uint8_t(rcode);
+        rec.hash = key_hash(host, family);
+        rec.host_len = uint8_t(host.size());
+        for (size_t i = 0; i < host.size(); i++) rec.host[i] = char(tolower(uint8_t(host[i])));
+        rec.expires = time(nullptr) + std::min<int64_t>(ttl, kMaxTtl);
+        for (const auto& ip : addresses) {
+            if (rec.count == kMaxAddrs) break;
+            if (inet_pton(family, ip.c_str(), rec.addrs[rec.count]) == 1) rec.count++;
+        }
+        if (rec.count == 0 && !addresses.empty()) return;
+
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        flock(fd_, LOCK_EX);
+        Slot& slot = slots_[pick_slot(rec)];
+        uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+        slot.seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(&slot.rec, &rec, sizeof(rec));
+        slot.seq.store(seq + 2, std::memory_order_release);
+        flock(fd_, LOCK_UN);
+    }
+
+    DnsCacheStats stats;
+
+private:
+    static constexpr int kMaxAddrs = 8;
+
+    // Plain data copied in and out of a slot under the sequence counter
+    struct Record {
+        uint16_t family;  // 0 = empty
+        uint8_t count;     // 0 for a negative answer
+        uint8_t host_len;
+        uint8_t rcode;     // of a negative answer
+        uint8_t reserved[3];
+        uint64_t hash;
+        int64_t expires;  // unix seconds
+        char host[120];
+        uint8_t addrs[kMaxAddrs][16];
+    };
+
+    struct Slot {
+        std::atomic<uint32_t> seq;  // odd while a writer is inside
+        uint32_t reserved;
+        Record rec;
+    };
+
+    struct Header {
+        char magic[8];
+        uint32_t slots;
+        uint32_t slot_size;
+    };
+
+    static_assert(std::atomic<uint32_t>::is_always_lock_free, "seqlock needs lock-free atomics");
+
+    static constexpr char kMagic[8] = {'W', 'D', 'D', 'N', 'S', 'C', '1', 0};
+
+    static size_t map_size() { return sizeof(Header) + sizeof(Slot) * kSlots; }
+
+    static uint64_t key_hash(const std::string& host, int family) {
+        uint64_t h = 1469598103934665603ull ^ uint64_t(family);  // FNV-1a
+        for (unsigned char c : host) {
+            h ^= uint64_t(tolower(c));
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+
+    void open_file(const std::string& path) {
+        if (path.empty() || path == "off") return;
+
+        // Create the parent directory on first use
+        size_t slash = path.rfind('/');
+        if (slash != std::string::npos && slash > 0) {
+            std::string dir = path.substr(0, slash);
+            for (size_t p = dir.find('/', 1); ; p = dir.find('/', p + 1)) {
+                mkdir(dir.substr(0, p).c_str(), 0700);
+                if (p == std::string::npos) break;
+            }
+        }
+
+        fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (fd_ < 0) return;
+
+        flock(fd_, LOCK_EX);
+        struct stat st{};
+        fstat(fd_, &st);
+        bool fresh = size_t(st.st_size) != map_size();
+        if (fresh && ftruncate(fd_, 0) == 0 && ftruncate(fd_, map_size()) != 0) {
+            flock(fd_, LOCK_UN);
+            close(fd_);
+            fd_ = -1;
+            return;
+        }
+
+        void* map = mmap(nullptr, map_size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (map == MAP_FAILED) {
+            flock(fd_, LOCK_UN);
+            close(fd_);
+            fd_ = -1;
+            return;
+        }
+        map_ = map;
+        Header* header = static_cast<Header*>(map_);
+        if (fresh || memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 ||
+            header->slots != kSlots || header->slot_size != sizeof(Slot)) {
+            memset(map_, 0, map_size());
+            memcpy(header->magic, kMagic, sizeof(kMagic));
+            header->slots = kSlots;
+            header->slot_size = sizeof(Slot);
+        }
+        slots_ = reinterpret_cast<Slot*>(static_cast<char*>(map_) + sizeof(Header));
+        flock(fd_, LOCK_UN);
+    }
+
+    // Consistent copy of a slot; false if a writer kept it busy
+    static bool read_slot(const Slot& slot, Record& out) {
+        for (int tries = 0; tries < 64; tries++) {
+            uint32_t before = slot.seq.load(std::memory_order_acquire);
+            if (before & 1) continue;
+            memcpy(&out, &slot.rec, sizeof(out));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) == before) return true;
+        }
+        return false;
+    }
+
+    bool matches(const Record& rec, uint64_t hash, const std::string& host, int family) const {
+        if (rec.family != family || rec.hash != hash || rec.host_len != host.size()) return false;
+        return strncasecmp(rec.host, host.c_str(), host.size()) == 0;
+    }
+
+    bool find(const std::string& host, int family, Record& out) const {
+        uint64_t hash = key_hash(host, family);
+        for (uint32_t i = 0; i < kProbe; i++) {
+            const Slot& slot = slots_[(hash + i) % kSlots];
+            Record rec;
+            if (!read_slot(slot, rec)) continue;
+            if (matches(rec, hash, host, family)) {
+                out = rec;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Same key, else an empty slot, else the entry that expires first
+    uint32_t pick_slot(const Record& rec) const {
+        std::string host(rec.host, rec.host_len);
+        uint32_t victim = uint32_t(rec.hash % kSlots);
+        int64_t oldest = INT64_MAX;
+        for (uint32_t i = 0; i < kProbe; i++) {
+            uint32_t index = uint32_t((rec.hash + i) % kSlots);
+            const Record& cur = slots_[index].rec;  // stable: we hold the write lock
+            if (cur.family == 0 || matches(cur, rec.hash, host, rec.family)) return index;
+            if (cur.expires < oldest) {
+                oldest = cur.expires;
+                victim = index;
+            }
+        }
+        return victim;
+    }
+
+    int fd_ = -1;
+    void* map_ = nullptr;
+    Slot* slots_ = nullptr;
+    std::mutex write_mutex_;  // flock() does not exclude threads sharing fd_
+};
+
+// The part of a lookup that needs no DNS query: an address literal,
+// /etc/hosts or a fresh cache entry. Returns true when that settles it;
+// otherwise addresses may still hold a stale entry to fall back on.
+inline bool dns_resolve_locally(const std::string& host, uint16_t type, std::vector<std::string>& addresses,
+                                bool cache_only) {
+    // An address literal is its own answer, and has none in the other family
+    int family = type == DNS_AAAA ? AF_INET6 : AF_INET;
+    unsigned char literal[sizeof(in6_addr)];
+    if (inet_pton(AF_INET, host.c_str(), literal) == 1 || inet_pton(AF_INET6, host.c_str(), literal) == 1) {
+        addresses.clear();
+        if (inet_pton(family, host.c_str(), literal) == 1) addresses.push_back(host);
+        return true;
+    }
+
+    addresses = dns_hosts_lookup(host, type);
+    if (!addresses.empty()) return true;
+
+    uint32_t ttl_left = 0;
+    DnsCacheStatus status = DnsCache::shared().lookup(host, family, addresses, ttl_left);
+    return status == DnsCacheStatus::Hit || cache_only;
+}
+
+// The server answered, if only to say the name does not exist (NXDOMAIN)
+inline bool dns_answered(const DnsAnswer& answer) { return answer.ok() || answer.rcode == 3; }
+
+// Cache an A or AAAA answer: its addresses for the lowest TTL of the
+// records (the CNAME chain bounds the lifetime too), or, for NODATA and
+// NXDOMAIN, the fact that there are none for the negative TTL. A failed
+// query is not cached. Returns the answer's addresses.
+inline std::vector<std::string> dns_cache_answer(const DnsAnswer& answer) {
+    std::vector<std::string> fresh;
+    if (!dns_answered(answer) || (answer.type != DNS_A && answer.type != DNS_AAAA)) return fresh;
+    uint32_t ttl = UINT32_MAX;
+    for (const auto& rr : answer.records) {
+        ttl = std::min(ttl, rr.ttl);
+        if (rr.type == answer.type) fresh.push_back(rr.data);
+    }
+    if (fresh.empty()) {
+        uint32_t negative_ttl = answer.negative_ttl ? answer.negative_ttl : DnsCache::kNegativeTtl;
+        ttl = std::min({ttl, negative_ttl, DnsCache::kMaxNegativeTtl});
+    }
+    DnsCache::shared().store(answer.host, answer.type == DNS_AAAA ? AF_INET6 : AF_INET, fresh, ttl, answer.rcode);
+    return fresh;
+}
+
+// Take a query's addresses into the cache and addresses. A failed answer
+// leaves addresses (a stale entry) alone; an empty one clears them.
+inline void dns_store_answer(const DnsAnswer& answer, std::vector<std::string>& addresses) {
+    std::vector<std::string> fresh = dns_cache_answer(answer);
+    if (dns_answered(answer)) addresses = fresh;
+}
+
+// Resolve host through /etc/hosts, then the shared cache, then a DNS query.
+// A successful query refreshes the cache; if it fails a stale entry is
+// served instead. Returns false when no address could be found.
+inline bool dns_cached_resolve(const std::string& host, uint16_t type, std::vector<std::string>& addresses,
+                               bool cache_only = false) {
+    if (dns_resolve_locally(host, type, addresses, cache_only)) return !addresses.empty();
+    dns_store_answer(dns_query(host, type), addresses);
+    return !addresses.empty();
+}
+
+// A and AAAA at once. Families the hosts file or the cache cannot settle
+// are asked in the same resolver run, so a dual-stack lookup takes one
+// round trip rather than two. Returns false when neither family has an
+// address.
+inline bool dns_cached_resolve_dual(const std::string& host, std::vector<std::string>& v4,
+                                    std::vector<std::string>& v6, bool cache_only = false) {
+    // A name in /etc/hosts is not looked up in DNS for the other family
+    // either, as with the system resolver
+    v4 = dns_hosts_lookup(host, DNS_A);
+    v6 = dns_hosts_lookup(host, DNS_AAAA);
+    if (!v4.empty() || !v6.empty()) return true;
+
+    std::vector<uint16_t> ask;
+    if (!dns_resolve_locally(host, DNS_A, v4, cache_only)) ask.push_back(DNS_A);
+    if (!dns_resolve_locally(host, DNS_AAAA, v6, cache_only)) ask.push_back(DNS_AAAA);
+    if (!ask.empty()) {
+        size_t next = 0;
+        AsyncDnsResolver resolver(AsyncDnsResolver::Options(), [&](const DnsAnswer& answer) {
+            dns_store_answer(answer, answer.type == DNS_AAAA ? v6 : v4);
+        });
+        resolver.run([&](DnsQuestion& q) {
+            if (next == ask.size()) return false;
+            q.host = host;
+            q.type = ask[next++];
+            return true;
+        });
+    }
+    return !v4.empty() || !v6.empty();
+}
+
+inline void print_dns_cache_stats(std::ostream& out = std::cerr) {
+    const DnsCache& cache = DnsCache::shared();
+    if (!cache.enabled()) return;
+    const DnsCacheStats& s = cache.stats;
+    if (s.hits + s.misses + s.stale == 0) return;
+    out << "[DNS cache] hits=" << s.hits << " misses=" << s.misses << " stale=" << s.stale << "\n";
+}
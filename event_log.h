@@ -0,0 +1,263 @@
+// event_log.h
+// Recording of curl debug events off the transfer thread.
+//
+// The debug callback only copies each event into fixed-size slots of a
+// preallocated single-producer/single-consumer ring, stamped with
+// CLOCK_MONOTONIC nanoseconds: no allocation, no locks, no formatting and
+// no I/O on the thread doing the transfer. A writer thread drains the ring,
+// hands each event to a sink (which may format it) and can append the raw
+// slots to a binary log that EventLog::decode() reads back later. If the
+// writer falls behind and the ring fills up, events are dropped and
+// counted rather than stalling the transfer.
+//
+// Log file: a 96-byte EventLogHeader followed by the slots exactly as they
+// were in the ring. A slot of type EVENT_DROPPED at the end carries the
+// number of dropped events in its size field.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <curl/curl.h>
+#include <time.h>
+
+enum : uint8_t { EVENT_DROPPED = 0xff };
+
+// One ring slot. The first slot of an event carries the header and the
+// start of its payload; the rest of the payload continues in the next
+// slots, all 64 bytes of each used as data.
+struct EventSlot {
+    uint64_t ts_ns;   // CLOCK_MONOTONIC
+    uint32_t size;    // event size as reported by curl
+    uint16_t length;  // payload bytes kept (text and header events only)
+    uint8_t type;     // curl_infotype or EVENT_DROPPED
+    uint8_t reserved;
+    char data[48];
+};
+static_assert(sizeof(EventSlot) == 64, "EventSlot must stay one cache line");
+
+struct EventLogHeader {
+    char magic[8];            // "WDEVLOG1"
+    uint32_t slot_size;       // sizeof(EventSlot)
+    uint32_t reserved;
+    int64_t realtime_offset;  // add to ts_ns for CLOCK_REALTIME nanoseconds
+    char label[72];           // free text from the recorder, e.g. the destination
+};
+static_assert(sizeof(EventLogHeader) == 96, "EventLogHeader layout is part of the file format");
+
+// An event as handed to the sink. data is only valid during the call.
+struct LoggedEvent {
+    int64_t ts_ns;  // CLOCK_REALTIME
+    uint8_t type;
+    uint32_t size;
+    const char* data;
+    size_t length;
+};
+
+inline int64_t event_clock_ns(clockid_t clock) {
+    timespec ts;
+    clock_gettime(clock, &ts);
+    return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+class EventLog {
+public:
+    using Sink = std::function<void(const LoggedEvent&)>;
+
+    static constexpr size_t kSlots = 1 << 16;  // 4 MB
+    static constexpr size_t kMaxPayload = 16384;
+
+    // log_path may be empty for no binary log
+    EventLog(const std::string& log_path = "", const std::string& label = "")
+        : slots_(new EventSlot[kSlots]) {
+        realtime_offset_ = event_clock_ns(CLOCK_REALTIME) - event_clock_ns(CLOCK_MONOTONIC);
+        if (log_path.empty()) return;
+        file_ = fopen(log_path.c_str(), "wb");
+        if (!file_) {
+            failed_ = true;
+            return;
+        }
+        EventLogHeader header{};
+        memcpy(header.magic, "WDEVLOG1", 8);
+        header.slot_size = sizeof(EventSlot);
+        header.realtime_offset = realtime_offset_;
+        strncpy(header.label, label.c_str(), sizeof(header.label) - 1);
+        fwrite(&header, sizeof(header), 1, file_);
+    }
+
+    ~EventLog() {
+        stop();
+        if (file_) fclose(file_);
+    }
+
+    EventLog(const EventLog&) = delete;
+    EventLog& operator=(const EventLog&) = delete;
+
+    // False if a log file was asked for and could not be created
+    bool ok() const { return !failed_; }
+
+    void start(Sink sink) {
+        sink_ = std::move(sink);
+        running_ = true;
+        writer_ = std::thread([this] { drain_loop(); });
+    }
+
+    // Drain what is left and join the writer
+    void stop() {
+        if (!writer_.joinable()) return;
+        running_ = false;
+        writer_.join();
+        uint64_t dropped = dropped_.load();
+        if (dropped) {
+            EventSlot slot{};
+            slot.ts_ns = uint64_t(event_clock_ns(CLOCK_MONOTONIC));
+            slot.type = EVENT_DROPPED;
+            slot.size = uint32_t(dropped);
+            if (file_) fwrite(&slot, sizeof(slot), 1, file_);
+            deliver(slot, nullptr, 0);
+        }
+        if (file_) fflush(file_);
+    }
+
+    // Producer side, called from the debug callback
+    void record(curl_infotype type, const char* data, size_t size) {
+        bool keep = type == CURLINFO_TEXT || type == CURLINFO_HEADER_IN || type == CURLINFO_HEADER_OUT;
+        size_t length = keep ? std::min(size, kMaxPayload) : 0;
+        size_t need = slots_for(length);
+
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        if (head + need - tail_cache_ > kSlots) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (head + need - tail_cache_ > kSlots) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+
+        EventSlot& first = slots_[head & (kSlots - 1)];
+        first.ts_ns = uint64_t(event_clock_ns(CLOCK_MONOTONIC));
+        first.size = uint32_t(size);
+        first.length = uint16_t(length);
+        first.type = uint8_t(type);
+        first.reserved = 0;
+        size_t n = std::min(length, sizeof(first.data));
+        memcpy(first.data, data, n);
+        for (size_t i = 1; n < length; i++) {
+            size_t chunk = std::min(length - n, sizeof(EventSlot));
+            memcpy(&slots_[(head + i) & (kSlots - 1)], data + n, chunk);
+            n += chunk;
+        }
+        head_.store(head + need, std::memory_order_release);
+    }
+
+    uint64_t dropped() const { return dropped_.load(); }
+    int64_t realtime_offset() const { return realtime_offset_; }
+
+    // Read a binary log back, calling sink for every event. Returns false
+    // if the file is missing or not an event log.
+    static bool decode(const std::string& path, const Sink& sink, std::string* label = nullptr) {
+        FILE* f = fopen(path.c_str(), "rb");
+        if (!f) return false;
+        EventLogHeader header{};
+        if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, "WDEVLOG1", 8) != 0 ||
+            header.slot_size != sizeof(EventSlot)) {
+            fclose(f);
+            return false;
+        }
+        if (label) *label = std::string(header.label, strnlen(header.label, sizeof(header.label)));
+
+        EventSlot slot;
+        std::string payload;
+        while (fread(&slot, sizeof(slot), 1, f) == 1) {
+            size_t n = std::min<size_t>(slot.length, sizeof(slot.data));
+            payload.assign(slot.data, n);
+            bool truncated = false;
+            while (n < slot.length) {
+                char chunk[sizeof(EventSlot)];
+                if (fread(chunk, sizeof(chunk), 1, f) != 1) {
+                    truncated = true;
+                    break;
+                }
+                size_t take = std::min(slot.length - n, sizeof(chunk));
+                payload.append(chunk, take);
+                n += take;
+            }
+            if (truncated) break;
+            sink(LoggedEvent{int64_t(slot.ts_ns) + header.realtime_offset, slot.type, slot.size, payload.data(),
+                             payload.size()});
+        }
+        fclose(f);
+        return true;
+    }
+
+private:
+    static size_t slots_for(size_t length) {
+        size_t rest = length > sizeof(EventSlot::data) ? length - sizeof(EventSlot::data) : 0;
+        return 1 + (rest + sizeof(EventSlot) - 1) / sizeof(EventSlot);
+    }
+
+    void drain_loop() {
+        while (true) {
+            bool stopping = !running_.load();
+            uint64_t tail = tail_.load(std::memory_order_relaxed);
+            uint64_t head = head_.load(std::memory_order_acquire);
+            if (tail == head) {
+                if (stopping) break;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            if (file_) write_raw(tail, head);
+            while (tail < head) {
+                const EventSlot& slot = slots_[tail & (kSlots - 1)];
+                size_t need = slots_for(slot.length);
+                size_t n = std::min<size_t>(slot.length, sizeof(slot.data));
+                if (n == slot.length) {
+                    deliver(slot, slot.data, n);
+                } else {
+                    payload_.assign(slot.data, n);
+                    for (size_t i = 1; i < need; i++) {
+                        size_t take = std::min(slot.length - payload_.size(), sizeof(EventSlot));
+                        payload_.append(reinterpret_cast<const char*>(&slots_[(tail + i) & (kSlots - 1)]), take);
+                    }
+                    deliver(slot, payload_.data(), payload_.size());
+                }
+                tail += need;
+            }
+            tail_.store(tail, std::memory_order_release);
+        }
+    }
+
+    // Slots [from, to) straight to the file, in at most two pieces
+    void write_raw(uint64_t from, uint64_t to) {
+        while (from < to) {
+            size_t index = from & (kSlots - 1);
+            size_t count = std::min<uint64_t>(to - from, kSlots - index);
+            fwrite(&slots_[index], sizeof(EventSlot), count, file_);
+            from += count;
+        }
+    }
+
+    void deliver(const EventSlot& slot, const char* data, size_t length) {
+        if (sink_) sink_(LoggedEvent{int64_t(slot.ts_ns) + realtime_offset_, slot.type, slot.size, data, length});
+    }
+
+    std::unique_ptr<EventSlot[]> slots_;
+    alignas(64) std::atomic<uint64_t> head_{0};  // written by the producer
+    uint64_t tail_cache_ = 0;                    // producer's last view of tail_
+    alignas(64) std::atomic<uint64_t> tail_{0};  // written by the writer
+    alignas(64) std::atomic<uint64_t> dropped_{0};
+    std::atomic<bool> running_{false};
+    int64_t realtime_offset_ = 0;
+    FILE* file_ = nullptr;
+    bool failed_ = false;
+    Sink sink_;
+    std::string payload_;
+    std::thread writer_;
+};
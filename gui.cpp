@@ -1,78 +1,664 @@
 // gui.cpp
 #include <gtk/gtk.h>
+#include <algorithm>
 #include <iostream>
 #include <string>
-#include <array>
-#include <cstdio>
-#include <vector>   // <<--- Add this line
+#include <vector>
+#include "daemon_protocol.h"
+#include "output_spill.h"
+
+struct ToolJob;
+
+// One tool's output. All of it goes to the spill file; the text buffer
+// only holds spill lines [first_line, ...) up to shown_end, between the
+// start and end marks, so a huge output costs the widget no more than a
+// few thousand lines.
+struct OutputSection {
+    std::string tool;
+    OutputSpill spill;
+    GtkTextMark* start = nullptr;  // left gravity, just after the "// tool ====" header
+    GtkTextMark* end = nullptr;    // right gravity, before the spacing
+    uint64_t first_line = 0;       // first spill line in the buffer
+    uint64_t shown_end = 0;        // spill offset where the buffer's text ends
+    bool top_note = false;         // an "[... earlier lines ...]" line precedes the text
+    bool bottom_note = false;      // a "[... later output ...]" line follows it
+    bool follow = true;            // new output is shown as it arrives
+};
+
+// State shared by every callback
+struct GuiState {
+    GtkWidget* text_view = nullptr;
+    GtkEntry* url_entry = nullptr;
+    GtkWidget* status_label = nullptr;
+    std::vector<ToolJob*> jobs;              // tools still running
+    std::vector<OutputSection*> sections;    // current batch, in buffer order
+    guint flush_source = 0;                  // idle callback moving spilled output into the buffer
+
+    // Incremental search over every section's spill, a range per idle call
+    std::string query;
+    guint search_source = 0;
+    size_t search_section = 0;
+    uint64_t search_offset = 0;
+    size_t search_stop_section = 0;  // where the search started; it wraps around to here
+    uint64_t search_stop_offset = 0;
+    bool search_wrapped = false;
+    bool has_match = false;
+    size_t match_section = 0;
+    uint64_t match_offset = 0;
+    std::string search_status;
+};
 
 // Structure to hold pointers for callbacks
 struct CallbackData {
-    GtkWidget* text_view;
-    GtkEntry* url_entry;
+    GuiState* state;
     std::string tool_name;
 };
 
-// Add this after the existing CallbackData struct
-struct RunAllData {
-    GtkWidget* text_view;
-    GtkEntry* url_entry;
-    std::vector<std::string> tools;
+// One running tool. Its output goes to its section's spill as chunks
+// arrive on the pipe, or as frames from webdived when it is running.
+struct ToolJob {
+    GuiState* state;
+    std::string tool;
+    std::string url;
+    GSubprocess* process = nullptr;
+    GSocketConnection* connection = nullptr;  // webdived, instead of process
+    DaemonFrameReader frames;
+    int daemon_status = -1;  // from the exit frame; -1 until it arrives
+    GInputStream* output = nullptr;
+    GCancellable* cancellable = nullptr;
+    OutputSection* section = nullptr;
+    gint64 started_us = 0;
+    std::string pending;  // trailing bytes of an incomplete UTF-8 sequence
+    bool after_cr = false;  // the last chunk ended with '\r'
+    bool cancelled = false;
 };
 
-// Function to run an external binary and capture output (stderr + stdout)
-std::string run_tool(const std::string& tool, const std::string& url) {
-    // Redirect stderr (2) to stdout (1) with 2>&1
-    std::string command = "./" + tool + " " + url + " 2>&1";
+static const gsize kReadChunk = 16 * 1024;
+static const uint64_t kFlushBytes = 64 * 1024;          // text moved into the buffer per section and idle call
+static const uint64_t kSectionLines = 5000;             // scrollback kept in the buffer per section
+static const uint64_t kSectionBytes = 2 * 1024 * 1024;
+static const uint64_t kSearchBytes = 8 * 1024 * 1024;   // spill searched per idle call
+
+static GtkTextBuffer* output_buffer(GuiState* state) {
+    return gtk_text_view_get_buffer(GTK_TEXT_VIEW(state->text_view));
+}
+
+static void update_status(GuiState* state) {
+    std::string text = state->jobs.empty() ? "Idle" : std::to_string(state->jobs.size()) + " running";
+    if (!state->search_status.empty()) text += " - " + state->search_status;
+    gtk_label_set_text(GTK_LABEL(state->status_label), text.c_str());
+}
 
-    std::array<char, 256> buffer;
-    std::string result;
-    FILE* pipe = popen(command.c_str(), "r");
-    if (!pipe) return "Failed to run " + tool;
+static GtkTextIter mark_iter(GuiState* state, GtkTextMark* mark) {
+    GtkTextIter iter;
+    gtk_text_buffer_get_iter_at_mark(output_buffer(state), &iter, mark);
+    return iter;
+}
 
-    while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {
-        result += buffer.data();
+// Append a "// tool ====" section to the buffer. Its output goes between
+// two marks: start has left gravity and end right gravity, so text
+// inserted at end lands between them and both keep their place.
+static OutputSection* add_section(GuiState* state, const std::string& tool) {
+    GtkTextBuffer* buffer = output_buffer(state);
+    GtkTextIter end;
+
+    std::string header = "// " + tool + " =================================================\n\n";
+    gtk_text_buffer_get_end_iter(buffer, &end);
+    gtk_text_buffer_insert(buffer, &end, header.c_str(), -1);
+
+    // Six newlines after each tool
+    const char* spacing = "\n\n\n\n\n\n";
+    gtk_text_buffer_get_end_iter(buffer, &end);
+    gtk_text_buffer_insert(buffer, &end, spacing, -1);
+
+    gtk_text_buffer_get_end_iter(buffer, &end);
+    gtk_text_iter_backward_chars(&end, 6);
+    OutputSection* section = new OutputSection();
+    section->tool = tool;
+    section->start = gtk_text_buffer_create_mark(buffer, nullptr, &end, TRUE);
+    section->end = gtk_text_buffer_create_mark(buffer, nullptr, &end, FALSE);
+    state->sections.push_back(section);
+    return section;
+}
+
+// Spill bytes [from, to) as text for the buffer. The spill only holds
+// valid UTF-8, so all that can be wrong is a character cut at to, which is
+// left for the next read.
+static std::string read_spill(OutputSection* section, uint64_t from, uint64_t to) {
+    std::string text;
+    section->spill.read(from, size_t(to - from), text);
+    const gchar* end = nullptr;
+    if (!g_utf8_validate(text.data(), text.size(), &end)) text.resize(end - text.data());
+    return text;
+}
+
+static void clear_section_text(GuiState* state, OutputSection* section) {
+    GtkTextIter start = mark_iter(state, section->start);
+    GtkTextIter end = mark_iter(state, section->end);
+    gtk_text_buffer_delete(output_buffer(state), &start, &end);
+    section->top_note = false;
+    section->bottom_note = false;
+}
+
+// Rewrite the "[... earlier lines ...]" line for the current first_line
+static void update_top_note(GuiState* state, OutputSection* section) {
+    GtkTextBuffer* buffer = output_buffer(state);
+    if (section->top_note) {
+        GtkTextIter start = mark_iter(state, section->start);
+        GtkTextIter end = start;
+        gtk_text_iter_forward_line(&end);
+        gtk_text_buffer_delete(buffer, &start, &end);
+        section->top_note = false;
     }
+    if (section->first_line == 0) return;
+    std::string note = "[... " + std::to_string(section->first_line) + " earlier lines not shown; search to reach them]\n";
+    GtkTextIter start = mark_iter(state, section->start);
+    gtk_text_buffer_insert(buffer, &start, note.data(), note.size());
+    section->top_note = true;
+}
 
-    pclose(pipe);
-    return result;
+// First line of the window that ends with the output: the last
+// kSectionLines lines, fewer when they are longer than kSectionBytes
+static uint64_t tail_first_line(const OutputSpill& spill) {
+    uint64_t last = spill.lines() - 1;
+    uint64_t first = last >= kSectionLines ? last - kSectionLines + 1 : 0;
+    if (spill.size() > kSectionBytes) first = std::max(first, spill.line_at_or_after(spill.size() - kSectionBytes));
+    return std::min(first, last);
 }
 
+// Empty a section and follow its output from tail_first_line; the idle
+// flush fills it in
+static void show_tail(GuiState* state, OutputSection* section) {
+    clear_section_text(state, section);
+    section->first_line = tail_first_line(section->spill);
+    section->shown_end = section->spill.line_start(section->first_line);
+    section->follow = true;
+    update_top_note(state, section);
+}
 
-// Callback for tool buttons
-static void on_tool_clicked(GtkButton* button, gpointer user_data) {
-    CallbackData* data = static_cast<CallbackData*>(user_data);
-    const gchar* url = gtk_entry_get_text(data->url_entry);
+// Drop lines from the top of a section until it is back within
+// kSectionLines and kSectionBytes. The line being written stays.
+static void trim_section(GuiState* state, OutputSection* section) {
+    const OutputSpill& spill = section->spill;
+    uint64_t last = spill.line_of(section->shown_end);
+    uint64_t first = section->first_line;
+    if (last - first >= kSectionLines) first = last - kSectionLines + 1;
+    if (section->shown_end - spill.line_start(first) > kSectionBytes) {
+        first = std::min(last, std::max(first, spill.line_at_or_after(section->shown_end - kSectionBytes)));
+    }
+    if (first == section->first_line) return;
+
+    GtkTextIter start = mark_iter(state, section->start);
+    if (section->top_note) gtk_text_iter_forward_line(&start);
+    GtkTextIter end = start;
+    gtk_text_iter_forward_lines(&end, gint(first - section->first_line));
+    gtk_text_buffer_delete(output_buffer(state), &start, &end);
+    section->first_line = first;
+    update_top_note(state, section);
+}
 
-    // Clear text buffer
-    GtkTextBuffer* buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(data->text_view));
-    gtk_text_buffer_set_text(buffer, "", -1);
+// Move up to kFlushBytes of a following section's spilled output into the
+// buffer, cut at a line end when there is one. A section that has fallen
+// more than a window behind skips to the tail instead of pushing
+// everything through the buffer, as long as that moves it forward: a
+// single line longer than the window has no later line to skip to.
+static void flush_section(GuiState* state, OutputSection* section) {
+    const OutputSpill& spill = section->spill;
+    uint64_t size = spill.size();
+    if (!section->follow || section->shown_end >= size) return;
+    if ((spill.line_of(size) - spill.line_of(section->shown_end) >= kSectionLines ||
+         size - section->shown_end > kSectionBytes) &&
+        spill.line_start(tail_first_line(spill)) > section->shown_end) {
+        show_tail(state, section);
+    }
 
-    // Run the tool and display output
-    std::string output = run_tool(data->tool_name, url);
-    gtk_text_buffer_set_text(buffer, output.c_str(), -1);
+    uint64_t to = std::min(size, section->shown_end + kFlushBytes);
+    if (to < size) {
+        uint64_t line = spill.line_start(spill.line_of(to));
+        if (line > section->shown_end) to = line;
+    }
+    std::string text = read_spill(section, section->shown_end, to);
+    if (text.empty()) {
+        section->shown_end = to;  // unreadable spill: skip it rather than retry forever
+        return;
+    }
+    GtkTextIter end = mark_iter(state, section->end);
+    gtk_text_buffer_insert(output_buffer(state), &end, text.data(), text.size());
+    section->shown_end += text.size();
+    trim_section(state, section);
 }
 
-// New callback for “Run All”
-static void on_run_all_clicked(GtkButton* button, gpointer user_data) {
-    RunAllData* data = static_cast<RunAllData*>(user_data);
-    const gchar* url = gtk_entry_get_text(data->url_entry);
+// Idle callback: runs below redraws and input, so output arriving faster
+// than GTK can lay it out never freezes the window
+static gboolean flush_output(gpointer user_data) {
+    GuiState* state = static_cast<GuiState*>(user_data);
+    bool more = false;
+    for (OutputSection* section : state->sections) {
+        flush_section(state, section);
+        if (section->follow && section->shown_end < section->spill.size()) more = true;
+    }
+    if (more) return G_SOURCE_CONTINUE;
+    state->flush_source = 0;
+    return G_SOURCE_REMOVE;
+}
 
-    GtkTextBuffer* buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(data->text_view));
-    gtk_text_buffer_set_text(buffer, "", -1);
+static void schedule_flush(GuiState* state) {
+    if (!state->flush_source) state->flush_source = g_idle_add(flush_output, state);
+}
+
+// GtkTextBuffer breaks lines at \r, \r\n and \n; the spill's line index
+// only knows \n, so the other two are converted before the text is stored.
+static void normalize_line_ends(ToolJob* job, std::string& text) {
+    size_t out = 0;
+    for (char c : text) {
+        bool skip = c == '\n' && job->after_cr;
+        job->after_cr = c == '\r';
+        if (!skip) text[out++] = c == '\r' ? '\n' : c;
+    }
+    text.resize(out);
+}
+
+static void append_to_section(ToolJob* job, std::string text) {
+    normalize_line_ends(job, text);
+    if (text.empty()) return;
+    job->section->spill.append(text.data(), text.size());
+    schedule_flush(job->state);
+}
+
+// GtkTextBuffer only accepts valid UTF-8. A multi-byte character split
+// across two reads is held back until the rest arrives; bytes that are
+// genuinely invalid (binary bodies) are replaced.
+static std::string take_valid_utf8(ToolJob* job, const char* data, gsize len, bool eof) {
+    job->pending.append(data, len);
+    std::string out;
+
+    const gchar* end = nullptr;
+    if (g_utf8_validate(job->pending.data(), job->pending.size(), &end)) {
+        out.swap(job->pending);
+        return out;
+    }
+
+    size_t valid = end - job->pending.data();
+    if (!eof && job->pending.size() - valid < 4) {
+        out = job->pending.substr(0, valid);
+        job->pending.erase(0, valid);
+        return out;
+    }
+
+    gchar* fixed = g_utf8_make_valid(job->pending.data(), job->pending.size());
+    out = fixed;
+    g_free(fixed);
+    job->pending.clear();
+    return out;
+}
+
+static void finish_job(ToolJob* job, const std::string& status) {
+    append_to_section(job, take_valid_utf8(job, "", 0, true));
+
+    double elapsed = (g_get_monotonic_time() - job->started_us) / 1e6;
+    char line[128];
+    g_snprintf(line, sizeof(line), "\n[%s %s in %.2fs]\n", job->tool.c_str(), status.c_str(), elapsed);
+    append_to_section(job, line);
+
+    GuiState* state = job->state;
+    state->jobs.erase(std::remove(state->jobs.begin(), state->jobs.end(), job), state->jobs.end());
+    update_status(state);
+
+    g_object_unref(job->cancellable);
+    if (job->process) g_object_unref(job->process);
+    if (job->connection) g_object_unref(job->connection);
+    delete job;
+}
+
+static std::string exit_status_text(int status) {
+    return status == 0 ? "finished" : "exited with status " + std::to_string(status);
+}
+
+static void on_process_exited(GObject* source, GAsyncResult* result, gpointer user_data) {
+    ToolJob* job = static_cast<ToolJob*>(user_data);
+    g_subprocess_wait_finish(G_SUBPROCESS(source), result, nullptr);
+
+    std::string status;
+    if (job->cancelled) {
+        status = "cancelled";
+    } else if (g_subprocess_get_if_exited(job->process)) {
+        status = exit_status_text(g_subprocess_get_exit_status(job->process));
+    } else {
+        status = "finished";
+    }
+    finish_job(job, status);
+}
+
+static void read_next_chunk(ToolJob* job);
+
+static void on_chunk_read(GObject* source, GAsyncResult* result, gpointer user_data) {
+    ToolJob* job = static_cast<ToolJob*>(user_data);
+    GError* error = nullptr;
+    GBytes* bytes = g_input_stream_read_bytes_finish(G_INPUT_STREAM(source), result, &error);
+
+    gsize size = 0;
+    const char* data = bytes ? static_cast<const char*>(g_bytes_get_data(bytes, &size)) : nullptr;
+    bool valid = true;
+    if (size > 0 && job->connection) {
+        // stdout and stderr frames both go to the section, as with the
+        // merged pipe of a spawned tool
+        valid = job->frames.feed(data, size, [job](DaemonFrameType type, std::string_view payload) {
+            if (type == DAEMON_FRAME_EXIT) {
+                job->daemon_status = DaemonFrameReader::exit_status(payload);
+            } else {
+                append_to_section(job, take_valid_utf8(job, payload.data(), payload.size(), false));
+            }
+        });
+    } else if (size > 0) {
+        append_to_section(job, take_valid_utf8(job, data, size, false));
+    }
+    if (size > 0 && valid && job->daemon_status < 0) {
+        g_bytes_unref(bytes);
+        read_next_chunk(job);
+        return;
+    }
+
+    // End of output, read error or cancellation: reap the process, or close
+    // the daemon connection
+    if (bytes) g_bytes_unref(bytes);
+    if (error) g_error_free(error);
+    if (job->connection) {
+        g_io_stream_close(G_IO_STREAM(job->connection), nullptr, nullptr);
+        if (job->cancelled) {
+            finish_job(job, "cancelled");
+        } else if (job->daemon_status < 0) {
+            finish_job(job, "lost its connection to webdived");
+        } else {
+            finish_job(job, exit_status_text(job->daemon_status) + " (webdived)");
+        }
+        return;
+    }
+    g_subprocess_wait_async(job->process, nullptr, on_process_exited, job);
+}
+
+// Reads run at idle priority too, below redraws and input, so a tool
+// flooding its pipe cannot starve the window
+static void read_next_chunk(ToolJob* job) {
+    g_input_stream_read_bytes_async(job->output, kReadChunk, G_PRIORITY_DEFAULT_IDLE, job->cancellable,
+                                    on_chunk_read, job);
+}
+
+// Launch ./tool <url> without blocking the main loop. The URL is passed as
+// an argument, never through a shell. stderr is merged into stdout.
+static void spawn_tool(ToolJob* job) {
+    std::string program = "./" + job->tool;
+    GError* error = nullptr;
+    job->process = g_subprocess_new(
+        static_cast<GSubprocessFlags>(G_SUBPROCESS_FLAGS_STDOUT_PIPE | G_SUBPROCESS_FLAGS_STDERR_MERGE),
+        &error, program.c_str(), job->url.c_str(), nullptr);
+    if (!job->process) {
+        finish_job(job, std::string("failed to start: ") + (error ? error->message : "unknown error"));
+        if (error) g_error_free(error);
+        return;
+    }
+    job->output = g_subprocess_get_stdout_pipe(job->process);
+    read_next_chunk(job);
+}
+
+static void on_daemon_connected(GObject* source, GAsyncResult* result, gpointer user_data) {
+    ToolJob* job = static_cast<ToolJob*>(user_data);
+    job->connection = g_socket_client_connect_finish(G_SOCKET_CLIENT(source), result, nullptr);
+    g_object_unref(source);
+    if (job->cancelled) {
+        finish_job(job, "cancelled");
+        return;
+    }
+
+    // The request is one short line on a local socket, written in one go.
+    // Without a daemon the tool runs itself.
+    std::string request = daemon_request(job->tool, job->url);
+    GOutputStream* out = job->connection ? g_io_stream_get_output_stream(G_IO_STREAM(job->connection)) : nullptr;
+    if (!out || !g_output_stream_write_all(out, request.data(), request.size(), nullptr, nullptr, nullptr)) {
+        if (job->connection) g_object_unref(job->connection);
+        job->connection = nullptr;
+        spawn_tool(job);
+        return;
+    }
+    job->output = g_io_stream_get_input_stream(G_IO_STREAM(job->connection));
+    read_next_chunk(job);
+}
+
+// Replace a section's text with the lines around a match, read back from
+// the spill. Unless the window reaches the end of the output, the section
+// stops following new output until the search is cleared.
+static void show_lines_around(GuiState* state, OutputSection* section, uint64_t offset, uint64_t len) {
+    const OutputSpill& spill = section->spill;
+    uint64_t line = spill.line_of(offset);
+    uint64_t first = line > kSectionLines / 2 ? line - kSectionLines / 2 : 0;
+    if (offset > kSectionBytes / 2) first = std::max(first, std::min(line, spill.line_at_or_after(offset - kSectionBytes / 2)));
+    uint64_t to = spill.line_start(line + kSectionLines / 2);
+    uint64_t limit = offset + len + kSectionBytes / 2;
+    if (to > limit) {
+        uint64_t cut = spill.line_start(spill.line_of(limit));
+        to = cut >= offset + len ? cut : limit;
+    }
+
+    clear_section_text(state, section);
+    section->first_line = first;
+    section->shown_end = spill.line_start(first);
+    update_top_note(state, section);
+    std::string text = read_spill(section, section->shown_end, to);
+    GtkTextBuffer* buffer = output_buffer(state);
+    GtkTextIter end = mark_iter(state, section->end);
+    gtk_text_buffer_insert(buffer, &end, text.data(), text.size());
+    section->shown_end += text.size();
+    section->follow = section->shown_end >= spill.size();
+    if (!section->follow) {
+        const char* note = "\n[... later output not shown; clear the search to follow it]";
+        end = mark_iter(state, section->end);
+        gtk_text_buffer_insert(buffer, &end, note, -1);
+        section->bottom_note = true;
+    }
+}
+
+// Select the match at spill offset and scroll to it, loading its window
+// from the spill first when it is not in the buffer
+static void show_match(GuiState* state, size_t index, uint64_t offset) {
+    OutputSection* section = state->sections[index];
+    const OutputSpill& spill = section->spill;
+    uint64_t len = state->query.size();
+    if (offset < spill.line_start(section->first_line) || offset + len > section->shown_end) {
+        show_lines_around(state, section, offset, len);
+    }
+
+    // Buffer lines match spill lines one to one after the top note
+    uint64_t line = spill.line_of(offset);
+    GtkTextIter start = mark_iter(state, section->start);
+    gint buffer_line = gtk_text_iter_get_line(&start) + (section->top_note ? 1 : 0) + gint(line - section->first_line);
+    gint index_in_line = gint(offset - spill.line_start(line));
+    GtkTextBuffer* buffer = output_buffer(state);
+    GtkTextIter match_start, match_end;
+    gtk_text_buffer_get_iter_at_line_index(buffer, &match_start, buffer_line, index_in_line);
+    gtk_text_buffer_get_iter_at_line_index(buffer, &match_end, buffer_line, index_in_line + gint(len));
+    gtk_text_buffer_select_range(buffer, &match_start, &match_end);
+    gtk_text_view_scroll_to_mark(GTK_TEXT_VIEW(state->text_view), gtk_text_buffer_get_insert(buffer), 0.1, TRUE, 0.0, 0.5);
+
+    state->has_match = true;
+    state->match_section = index;
+    state->match_offset = offset;
+    state->search_status = "match in " + section->tool + " line " + std::to_string(line + 1) + " of " +
+                           std::to_string(spill.lines());
+    update_status(state);
+}
+
+// Idle callback: search kSearchBytes of the spills, from where the last
+// call stopped, wrapping around to where the search started
+static gboolean search_step(gpointer user_data) {
+    GuiState* state = static_cast<GuiState*>(user_data);
+    uint64_t budget = kSearchBytes;
+    while (budget > 0) {
+        if (state->search_section >= state->sections.size()) {
+            if (state->search_wrapped) break;
+            state->search_wrapped = true;
+            state->search_section = 0;
+            state->search_offset = 0;
+            continue;
+        }
+        if (state->search_wrapped && state->search_section > state->search_stop_section) break;
+
+        OutputSection* section = state->sections[state->search_section];
+        bool last = state->search_wrapped && state->search_section == state->search_stop_section;
+        uint64_t limit = last ? std::min(section->spill.size(), state->search_stop_offset) : section->spill.size();
+        uint64_t to = std::min(limit, state->search_offset + budget);
+        uint64_t found = section->spill.find(state->query, state->search_offset, to);
+        if (found != OutputSpill::npos) {
+            state->search_source = 0;
+            show_match(state, state->search_section, found);
+            return G_SOURCE_REMOVE;
+        }
+        budget -= std::min(budget, to - std::min(to, state->search_offset));
+        state->search_offset = to;
+        if (to >= limit) {
+            if (last) break;
+            state->search_section++;
+            state->search_offset = 0;
+        }
+    }
+    if (budget == 0) return G_SOURCE_CONTINUE;
+
+    state->search_source = 0;
+    state->has_match = false;
+    state->search_status = "no match for \"" + state->query + "\"";
+    update_status(state);
+    return G_SOURCE_REMOVE;
+}
+
+static void cancel_search(GuiState* state) {
+    if (state->search_source) g_source_remove(state->search_source);
+    state->search_source = 0;
+}
+
+// Search every section for state->query, starting at offset in section
+// index. Large outputs are searched a range per idle call.
+static void start_search(GuiState* state, size_t index, uint64_t offset) {
+    cancel_search(state);
+    if (index >= state->sections.size()) index = 0, offset = 0;
+    state->search_section = state->search_stop_section = index;
+    state->search_offset = state->search_stop_offset = offset;
+    state->search_wrapped = false;
+    state->search_status = "searching...";
+    update_status(state);
+    state->search_source = g_idle_add(search_step, state);
+}
+
+// An empty search: sections showing an earlier window go back to
+// following their output
+static void clear_search(GuiState* state) {
+    cancel_search(state);
+    state->has_match = false;
+    state->search_status.clear();
+    for (OutputSection* section : state->sections) {
+        if (!section->follow) show_tail(state, section);
+    }
+    schedule_flush(state);
+    update_status(state);
+}
 
-    std::string all_output;
+// Typing refines the search from the current match, so the selection
+// grows with the query instead of jumping ahead
+static void on_search_changed(GtkSearchEntry* entry, gpointer user_data) {
+    GuiState* state = static_cast<GuiState*>(user_data);
+    state->query = gtk_entry_get_text(GTK_ENTRY(entry));
+    if (state->query.empty()) {
+        clear_search(state);
+        return;
+    }
+    if (state->has_match) {
+        start_search(state, state->match_section, state->match_offset);
+    } else {
+        start_search(state, 0, 0);
+    }
+}
 
-    for (const auto& tool : data->tools) {
-        // Header
-        all_output += "// " + tool + " =================================================\n\n";
-        // Tool output
-        all_output += run_tool(tool, url);
-        // Six newlines after each tool
-        all_output += "\n\n\n\n\n\n";
+// Enter or Ctrl-G: the next match
+static void on_search_next(GtkSearchEntry* entry, gpointer user_data) {
+    GuiState* state = static_cast<GuiState*>(user_data);
+    if (state->query.empty()) return;
+    if (state->has_match) {
+        start_search(state, state->match_section, state->match_offset + 1);
+    } else {
+        start_search(state, 0, 0);
     }
+}
 
-    gtk_text_buffer_set_text(buffer, all_output.c_str(), -1);
+// Escape clears the search
+static void on_search_stop(GtkSearchEntry* entry, gpointer user_data) {
+    gtk_entry_set_text(GTK_ENTRY(entry), "");
+}
+
+// Drop every section, with its spill file, for a fresh batch of runs
+static void clear_sections(GuiState* state) {
+    cancel_search(state);
+    state->has_match = false;
+    state->search_status.clear();
+    GtkTextBuffer* buffer = output_buffer(state);
+    for (OutputSection* section : state->sections) {
+        gtk_text_buffer_delete_mark(buffer, section->start);
+        gtk_text_buffer_delete_mark(buffer, section->end);
+        delete section;
+    }
+    state->sections.clear();
+    gtk_text_buffer_set_text(buffer, "", -1);
+}
+
+// Ask webdived for the probe when it is running, which reuses its open
+// connections; otherwise spawn the tool. Both paths are asynchronous.
+static void start_tool(GuiState* state, const std::string& tool, const std::string& url) {
+    // A fresh batch of runs starts with a clean view
+    if (state->jobs.empty()) clear_sections(state);
+
+    ToolJob* job = new ToolJob();
+    job->state = state;
+    job->tool = tool;
+    job->url = url;
+    job->section = add_section(state, tool);
+    job->started_us = g_get_monotonic_time();
+    job->cancellable = g_cancellable_new();
+    state->jobs.push_back(job);
+    update_status(state);
+
+    // The daemon protocol cannot carry a URL with spaces or line breaks
+    std::string path = daemon_socket_path();
+    if (url.find_first_of(" \r\n") != std::string::npos || !g_file_test(path.c_str(), G_FILE_TEST_EXISTS)) {
+        spawn_tool(job);
+        return;
+    }
+    GSocketClient* client = g_socket_client_new();
+    GSocketAddress* address = g_unix_socket_address_new(path.c_str());
+    g_socket_client_connect_async(client, G_SOCKET_CONNECTABLE(address), job->cancellable, on_daemon_connected, job);
+    g_object_unref(address);
+}
+
+// Callback for tool buttons. Tools clicked while others are still running
+// run in parallel, each in its own section.
+static void on_tool_clicked(GtkButton* button, gpointer user_data) {
+    CallbackData* data = static_cast<CallbackData*>(user_data);
+    const gchar* url = gtk_entry_get_text(data->state->url_entry);
+    start_tool(data->state, data->tool_name, url);
+}
+
+// New callback for “Run All”
+// The combined dive tool makes a single fetch and prints every tool's
+// section, instead of seven processes each connecting to the target.
+static void on_run_all_clicked(GtkButton* button, gpointer user_data) {
+    GuiState* state = static_cast<GuiState*>(user_data);
+    const gchar* url = gtk_entry_get_text(state->url_entry);
+    start_tool(state, "dive", url);
+}
+
+// Stop every running tool; each section is closed with "[tool cancelled ...]"
+static void on_cancel_clicked(GtkButton* button, gpointer user_data) {
+    GuiState* state = static_cast<GuiState*>(user_data);
+    for (ToolJob* job : state->jobs) {
+        job->cancelled = true;
+        g_cancellable_cancel(job->cancellable);
+        if (job->process) g_subprocess_force_exit(job->process);
+    }
 }
 
 int main(int argc, char* argv[]) {
@@ -110,8 +696,28 @@ int main(int argc, char* argv[]) {
     GtkWidget* text_view = gtk_text_view_new();
     gtk_text_view_set_editable(GTK_TEXT_VIEW(text_view), FALSE);
     gtk_container_add(GTK_CONTAINER(scrolled_window), text_view);
-    
 
+    // Status line: how many tools are running, and the search box
+    GtkWidget* status_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    gtk_box_pack_start(GTK_BOX(vbox), status_box, FALSE, FALSE, 2);
+
+    GtkWidget* status_label = gtk_label_new("Idle");
+    gtk_widget_set_halign(status_label, GTK_ALIGN_START);
+    gtk_box_pack_start(GTK_BOX(status_box), status_label, TRUE, TRUE, 2);
+
+    GtkWidget* search_entry = gtk_search_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(search_entry), "Search output...");
+    gtk_box_pack_start(GTK_BOX(status_box), search_entry, FALSE, FALSE, 2);
+
+    GuiState* state = new GuiState();
+    state->text_view = text_view;
+    state->url_entry = GTK_ENTRY(url_entry);
+    state->status_label = status_label;
+
+    g_signal_connect(search_entry, "search-changed", G_CALLBACK(on_search_changed), state);
+    g_signal_connect(search_entry, "activate", G_CALLBACK(on_search_next), state);
+    g_signal_connect(search_entry, "next-match", G_CALLBACK(on_search_next), state);
+    g_signal_connect(search_entry, "stop-search", G_CALLBACK(on_search_stop), state);
 
 
     // Tool buttons
@@ -124,24 +730,22 @@ int main(int argc, char* argv[]) {
         gtk_box_pack_start(GTK_BOX(button_box), button, TRUE, TRUE, 2);
 
         // Allocate callback data
-        CallbackData* data = new CallbackData{ text_view, GTK_ENTRY(url_entry), tool };
+        CallbackData* data = new CallbackData{ state, tool };
         g_signal_connect(button, "clicked", G_CALLBACK(on_tool_clicked), data);
     }
 
         // Create “Run All” button
     GtkWidget* run_all_button = gtk_button_new_with_label("Run All");
     gtk_box_pack_start(GTK_BOX(button_box), run_all_button, TRUE, TRUE, 2);
+    g_signal_connect(run_all_button, "clicked", G_CALLBACK(on_run_all_clicked), state);
 
-    // Allocate RunAllData
-    RunAllData* run_all_data = new RunAllData{ text_view, GTK_ENTRY(url_entry), tools };
-
-
-    // Connect the callback
-    g_signal_connect(run_all_button, "clicked", G_CALLBACK(on_run_all_clicked), run_all_data);
+    // Cancel every running tool
+    GtkWidget* cancel_button = gtk_button_new_with_label("Cancel");
+    gtk_box_pack_start(GTK_BOX(button_box), cancel_button, TRUE, TRUE, 2);
+    g_signal_connect(cancel_button, "clicked", G_CALLBACK(on_cancel_clicked), state);
 
     gtk_widget_show_all(window);
     gtk_main();
 
     return 0;
 }
-
@@ -0,0 +1,357 @@
+// happy_eyeballs.h
+// Dual-stack connection racing (RFC 8305, Happy Eyeballs v2).
+//
+// The AAAA and A answers are interleaved, IPv6 first, and connection
+// attempts start one after the other, a Connection Attempt Delay apart
+// (250 ms by default), or as soon as the previous attempt fails. The first
+// attempt to connect wins and the others are closed. Every attempt keeps
+// its address, start, end and outcome, so a slow or broken path of one
+// family shows up as attempts that failed, timed out or were overtaken
+// while the other family connected.
+//
+// With settle, the race goes on after the winner until every family has
+// had an attempt finish (or settle_ms have passed), so both families get
+// a connect time. The transfer starts that much later.
+//
+// DiveTransfer hands the winning socket to curl, so the race's connection
+// is the one the probe uses.
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+struct HappyEyeballsOptions {
+    bool race = false;       // race the connection here rather than leave it to curl
+    long delay_ms = 250;     // Connection Attempt Delay (RFC 8305 recommends 250, at least 100)
+    long timeout_ms = 10000; // give up on the whole race after this
+    bool settle = false;     // after the winner, wait for the other family's attempt too
+    long settle_ms = 2000;   // ... but no longer than this after the winner
+};
+
+enum HappyEyeballsOutcome : uint8_t {
+    EYEBALLS_CONNECTED,   // the winner
+    EYEBALLS_LATE,        // connected after the winner (settle only), then closed
+    EYEBALLS_FAILED,      // refused, unreachable, ...
+    EYEBALLS_CANCELLED,   // still connecting when the race was decided
+    EYEBALLS_TIMED_OUT,   // still connecting when the race gave up
+};
+
+inline const char* happy_eyeballs_outcome_name(HappyEyeballsOutcome outcome) {
+    switch (outcome) {
+        case EYEBALLS_CONNECTED: return "connected";
+        case EYEBALLS_LATE: return "also connected";
+        case EYEBALLS_FAILED: return "failed";
+        case EYEBALLS_CANCELLED: return "cancelled";
+        default: return "timed out";
+    }
+}
+
+struct HappyEyeballsAttempt {
+    std::string address;
+    int family = AF_INET;
+    int64_t started_us = 0;   // since the race began
+    int64_t finished_us = 0;
+    HappyEyeballsOutcome outcome = EYEBALLS_CANCELLED;
+    std::string error;        // with EYEBALLS_FAILED
+
+    int64_t elapsed_us() const { return finished_us - started_us; }
+};
+
+struct HappyEyeballsResult {
+    bool ran = false;
+    int winner = -1;          // index into attempts
+    int64_t total_us = 0;     // race start to winner (or to giving up)
+    std::vector<HappyEyeballsAttempt> attempts;
+
+    bool connected() const { return winner >= 0; }
+    const HappyEyeballsAttempt* won() const { return winner >= 0 ? &attempts[size_t(winner)] : nullptr; }
+
+    // Connect time of the family's first attempt that connected, -1 if none did
+    int64_t family_connect_us(int family) const {
+        for (const auto& a : attempts) {
+            if (a.family == family && (a.outcome == EYEBALLS_CONNECTED || a.outcome == EYEBALLS_LATE)) {
+                return a.elapsed_us();
+            }
+        }
+        return -1;
+    }
+};
+
+inline const char* happy_eyeballs_family_name(int family) { return family == AF_INET6 ? "IPv6" : "IPv4"; }
+
+// RFC 8305 section 4: alternate the families, starting with IPv6
+inline std::vector<std::pair<std::string, int>> happy_eyeballs_order(const std::vector<std::string>& v6,
+                                                                     const std::vector<std::string>& v4) {
+    std::vector<std::pair<std::string, int>> order;
+    for (size_t i = 0; i < std::max(v6.size(), v4.size()); i++) {
+        if (i < v6.size()) order.emplace_back(v6[i], AF_INET6);
+        if (i < v4.size()) order.emplace_back(v4[i], AF_INET);
+    }
+    return order;
+}
+
+// Race connections to port on the addresses and return the winner's
+// connected socket in fd (-1 when every attempt failed). The caller owns it.
+class HappyEyeballs {
+public:
+    HappyEyeballs(const std::vector<std::string>& v6, const std::vector<std::string>& v4, long port,
+                  const HappyEyeballsOptions& options)
+        : order_(happy_eyeballs_order(v6, v4)), port_(port), options_(options) {}
+
+    HappyEyeballsResult run(int& fd) {
+        fd = -1;
+        result_ = HappyEyeballsResult();
+        result_.ran = true;
+        start_ = Clock::now();
+        int64_t delay_us = std::max(0L, options_.delay_ms) * 1000;
+        int64_t deadline_us = std::max(1L, options_.timeout_ms) * 1000;
+        int64_t next_start_us = 0;
+
+        while (true) {
+            int64_t now = now_us();
+            bool decided = result_.winner >= 0;
+            if (decided && options_.settle) {
+                int64_t settle_us = result_.attempts[size_t(result_.winner)].finished_us + options_.settle_ms * 1000;
+                deadline_us = std::min(deadline_us, settle_us);
+            }
+            if (now >= deadline_us) break;
+
+            // Start the next attempt when its delay is up or nothing is in
+            // flight. Once decided, settle only adds a family that has not
+            // been tried yet.
+            if (!decided && next_ < order_.size() && (now >= next_start_us || in_flight_.empty())) {
+                launch(next_++);
+                next_start_us = now_us() + delay_us;
+                continue;
+            }
+            if (decided && options_.settle) launch_untried_families();
+            if (decided && (!options_.settle || in_flight_.empty())) break;
+            if (in_flight_.empty() && next_ >= order_.size()) break;
+
+            int64_t wait_us = deadline_us - now;
+            if (!decided && next_ < order_.size()) wait_us = std::min(wait_us, next_start_us - now);
+            poll_once(int(std::max<int64_t>(0, (wait_us + 999) / 1000)));
+        }
+
+        // Whatever is still connecting lost the race or ran out of time
+        bool cancelled = result_.winner >= 0 && !options_.settle;
+        for (size_t i : in_flight_) {
+            HappyEyeballsAttempt& a = result_.attempts[i];
+            a.finished_us = now_us();
+            a.outcome = cancelled ? EYEBALLS_CANCELLED : EYEBALLS_TIMED_OUT;
+            close(fds_[i]);
+        }
+        in_flight_.clear();
+        result_.total_us = result_.winner >= 0 ? result_.attempts[size_t(result_.winner)].finished_us : now_us();
+        fd = winner_fd_;
+        return result_;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    int64_t now_us() const {
+        return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start_).count();
+    }
+
+    void launch(size_t index) {
+        const auto& target = order_[index];
+        HappyEyeballsAttempt a;
+        a.address = target.first;
+        a.family = target.second;
+        a.started_us = now_us();
+        size_t slot = result_.attempts.size();
+        result_.attempts.push_back(a);
+        fds_.push_back(-1);
+
+        sockaddr_storage addr{};
+        socklen_t len = 0;
+        if (!make_address(target.first, target.second, addr, len)) {
+            fail(slot, "bad address");
+            return;
+        }
+        int fd = socket(target.second, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+        if (fd < 0) {
+            fail(slot, strerror(errno));
+            return;
+        }
+        fds_[slot] = fd;
+        if (connect(fd, reinterpret_cast<sockaddr*>(&addr), len) == 0) {
+            connected(slot);
+        } else if (errno == EINPROGRESS) {
+            in_flight_.push_back(slot);
+        } else {
+            int err = errno;
+            close(fd);
+            fail(slot, strerror(err));
+        }
+    }
+
+    // Settle: one attempt for every family that has none yet
+    void launch_untried_families() {
+        for (int family : {AF_INET6, AF_INET}) {
+            bool tried = std::any_of(result_.attempts.begin(), result_.attempts.end(),
+                                     [family](const HappyEyeballsAttempt& a) { return a.family == family; });
+            if (tried) continue;
+            for (size_t i = next_; i < order_.size(); i++) {
+                if (order_[i].second != family) continue;
+                std::swap(order_[i], order_[next_]);
+                launch(next_++);
+                break;
+            }
+        }
+    }
+
+    void poll_once(int timeout_ms) {
+        std::vector<pollfd> pfds;
+        for (size_t i : in_flight_) pfds.push_back(pollfd{fds_[i], POLLOUT, 0});
+        int n = poll(pfds.data(), pfds.size(), timeout_ms);
+        if (n <= 0) return;
+
+        std::vector<size_t> still;
+        for (size_t k = 0; k < pfds.size(); k++) {
+            size_t i = in_flight_[k];
+            if (!pfds[k].revents) {
+                still.push_back(i);
+                continue;
+            }
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if (getsockopt(fds_[i], SOL_SOCKET, SO_ERROR, &err, &len) != 0) err = errno;
+            if (err == 0) {
+                connected(i);
+            } else {
+                close(fds_[i]);
+                fail(i, strerror(err));
+            }
+        }
+        in_flight_.swap(still);
+    }
+
+    void connected(size_t i) {
+        HappyEyeballsAttempt& a = result_.attempts[i];
+        a.finished_us = now_us();
+        if (result_.winner < 0) {
+            a.outcome = EYEBALLS_CONNECTED;
+            result_.winner = int(i);
+            winner_fd_ = fds_[i];
+        } else {
+            a.outcome = EYEBALLS_LATE;
+            close(fds_[i]);
+        }
+    }
+
+    void fail(size_t i, const char* error) {
+        HappyEyeballsAttempt& a = result_.attempts[i];
+        a.finished_us = now_us();
+        a.outcome = EYEBALLS_FAILED;
+        a.error = error;
+    }
+
+    bool make_address(const std::string& ip, int family, sockaddr_storage& addr, socklen_t& len) const {
+        if (family == AF_INET6) {
+            sockaddr_in6* v6 = reinterpret_cast<sockaddr_in6*>(&addr);
+            v6->sin6_family = AF_INET6;
+            v6->sin6_port = htons(uint16_t(port_));
+            len = sizeof(sockaddr_in6);
+            return inet_pton(AF_INET6, ip.c_str(), &v6->sin6_addr) == 1;
+        }
+        sockaddr_in* v4 = reinterpret_cast<sockaddr_in*>(&addr);
+        v4->sin_family = AF_INET;
+        v4->sin_port = htons(uint16_t(port_));
+        len = sizeof(sockaddr_in);
+        return inet_pton(AF_INET, ip.c_str(), &v4->sin_addr) == 1;
+    }
+
+    std::vector<std::pair<std::string, int>> order_;
+    long port_;
+    HappyEyeballsOptions options_;
+    Clock::time_point start_;
+    HappyEyeballsResult result_;
+    std::vector<int> fds_;          // per attempt
+    std::vector<size_t> in_flight_;
+    size_t next_ = 0;
+    int winner_fd_ = -1;
+};
+
+// "--happy-eyeballs [delay_ms]" races the connection; "--race-all" also
+// waits for the losing family. Returns true when racing was requested.
+inline bool parse_happy_eyeballs_args(int argc, char* argv[], HappyEyeballsOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--happy-eyeballs") {
+            options.race = true;
+            char* end = nullptr;
+            if (i + 1 < argc) {
+                long ms = std::strtol(argv[i + 1], &end, 10);
+                if (end != argv[i + 1] && *end == '\0') {
+                    options.delay_ms = std::max(0L, ms);
+                    i++;
+                }
+            }
+        } else if (arg == "--race-all") {
+            options.race = true;
+            options.settle = true;
+        }
+    }
+    return options.race;
+}
+
+inline void print_happy_eyeballs_usage(const char* tool) {
+    std::cerr << "       " << tool << " <url> --happy-eyeballs [delay_ms] [--race-all]\n";
+}
+
+// "[Eyeballs] ..." lines: one per attempt, then the winner and the connect
+// time of each family
+inline void print_happy_eyeballs(const HappyEyeballsResult& r, long delay_ms, std::ostream& out = std::cout) {
+    if (!r.ran) return;
+    char line[256];
+    for (const auto& a : r.attempts) {
+        snprintf(line, sizeof(line), "[Eyeballs] +%.1f ms %s %s: %s after %.2f ms", a.started_us / 1000.0,
+                 happy_eyeballs_family_name(a.family), a.address.c_str(), happy_eyeballs_outcome_name(a.outcome),
+                 a.elapsed_us() / 1000.0);
+        out << line;
+        if (!a.error.empty()) out << " (" << a.error << ")";
+        out << "\n";
+    }
+    if (r.attempts.empty()) {
+        out << "[Eyeballs] no addresses to race\n";
+        return;
+    }
+
+    const HappyEyeballsAttempt* won = r.won();
+    if (won) {
+        snprintf(line, sizeof(line), "[Eyeballs] %s won with %s in %.2f ms (attempt delay %ld ms)",
+                 happy_eyeballs_family_name(won->family), won->address.c_str(), r.total_us / 1000.0, delay_ms);
+    } else {
+        snprintf(line, sizeof(line), "[Eyeballs] every attempt failed after %.2f ms", r.total_us / 1000.0);
+    }
+    out << line;
+    for (int family : {AF_INET6, AF_INET}) {
+        int64_t us = r.family_connect_us(family);
+        bool tried = std::any_of(r.attempts.begin(), r.attempts.end(),
+                                 [family](const HappyEyeballsAttempt& a) { return a.family == family; });
+        out << " | " << happy_eyeballs_family_name(family) << " ";
+        if (us >= 0) {
+            snprintf(line, sizeof(line), "connect %.2f ms", us / 1000.0);
+            out << line;
+        } else {
+            out << (tried ? "did not connect" : "not tried");
+        }
+    }
+    out << "\n";
+}
@@ -1,65 +1,109 @@
+#include <atomic>
+#include <csignal>
 #include <iostream>
 #include <string>
 #include <curl/curl.h>
+#include "dive.h"
+#include "daemon_protocol.h"
+#include "batch.h"
+#include "repeat.h"
+#include "load.h"
 
-// A simple Logger class for this standalone tool
-class Logger {
-public:
-    void log(const std::string& message) {
-        std::cout << message;
-    }
-};
+std::atomic<bool> g_stop{false};
 
-// Callback function to handle the header data.
-// It is called by libcurl for each header line.
-size_t headerCallback(char* buffer, size_t size, size_t nitems, void* userdata) {
-    size_t total = size * nitems;
-    Logger* logger = static_cast<Logger*>(userdata);
-    if (logger) {
-        // Log the header line directly
-        logger->log(std::string(buffer, total));
-    }
-    return total;
-}
+void on_signal(int) { g_stop = true; }
 
 int main(int argc, char* argv[]) {
+    // A running webdived answers from its warm connections instead
+    int daemon_status = 0;
+    if (daemon_forward("header", argc, argv, daemon_status)) return daemon_status;
+
     if (argc < 2) {
         std::cerr << "Usage: " << argv[0] << " <url>" << std::endl;
+        print_batch_usage(argv[0]);
+        print_repeat_usage(argv[0]);
+        print_load_usage(argv[0]);
+        print_happy_eyeballs_usage(argv[0]);
         return 1;
     }
 
-    // Initialize a simple logger for the tool
-    Logger logger;
-
     // Global libcurl initialization
     curl_global_init(CURL_GLOBAL_DEFAULT);
 
-    CURL* curl = curl_easy_init();
-    if (curl) {
-        // Set the URL from the command line argument
-        curl_easy_setopt(curl, CURLOPT_URL, argv[1]);
+    // We are only interested in the headers of the first response,
+    // so tell the engine not to download the body or follow redirects
+    DiveOptions options;
+    options.nobody = true;
+    options.follow_redirects = false;
+    options.keep_body = false;
+    options.debug_events = false;
+    options.tls_info = false;
+    options.certinfo = false;
 
-        // Tell libcurl to write the headers to our custom callback function
-        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, headerCallback);
-        // Pass our logger instance to the callback function
-        curl_easy_setopt(curl, CURLOPT_HEADERDATA, &logger);
+    // --results <file>: also append a fixed-schema row per probe
+    std::unique_ptr<ResultsWriter> results;
+    if (!open_results_arg(argc, argv, "header", results)) return 1;
 
-        // We are only interested in the headers, so tell libcurl not to download the body
-        curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    // --incremental <file>: conditional requests from the last scan's validators
+    std::unique_ptr<ValidatorStore> validators;
+    open_validators_arg(argc, argv, validators);
+    options.validators = validators.get();
+    auto view = [](const DiveResult& r) {
+        if (!print_incremental(r)) print_headers(r);
+    };
 
-        // Perform the request
-        CURLcode res = curl_easy_perform(curl);
-        if (res != CURLE_OK) {
-            logger.log("curl_easy_perform() failed: " + std::string(curl_easy_strerror(res)) + "\n");
-        }
+    // Load mode: Ctrl-C stops issuing requests and prints the totals
+    LoadOptions load;
+    bool load_mode = parse_load_args(argc, argv, load);
+    if (load.invalid) {
+        print_load_usage(argv[0]);
+        curl_global_cleanup();
+        return 1;
+    }
+    if (load_mode) {
+        signal(SIGINT, on_signal);
+        signal(SIGTERM, on_signal);
+        int status = LoadGenerator(load, options).run(g_stop);
+        print_dns_cache_stats();
+        curl_global_cleanup();
+        return status;
+    }
+
+    RepeatOptions repeat;
+    if (parse_repeat_args(argc, argv, repeat)) {
+        int status = run_repeat(repeat, options);
+        curl_global_cleanup();
+        return status;
+    }
 
-        // Cleanup
-        curl_easy_cleanup(curl);
+    BatchOptions batch;
+    if (parse_batch_args(argc, argv, batch)) {
+        batch.results = results.get();
+        size_t failed = run_batch(batch, options, view);
+        close_results(results);
+        if (validators) save_validators(*validators);
+        curl_global_cleanup();
+        return failed > 0 ? 1 : 0;
     }
 
+    // --happy-eyeballs: race IPv6 against IPv4; the report goes to stderr
+    // so the headers stay as they were
+    parse_happy_eyeballs_args(argc, argv, options.happy_eyeballs);
+    DiveResult result = dive(argv[1], options);
+    print_happy_eyeballs(result.eyeballs, options.happy_eyeballs.delay_ms, std::cerr);
+    if (!result.ok()) {
+        print_headers(result);
+        std::cout << "curl_easy_perform() failed: " << result.error() << "\n";
+    } else {
+        view(result);
+    }
+    if (results) results->append(result);
+    close_results(results);
+    if (validators) save_validators(*validators);
+    print_dns_cache_stats();
+
     // Global libcurl cleanup
     curl_global_cleanup();
 
     return 0;
 }
-
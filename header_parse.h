@@ -0,0 +1,241 @@
+// header_parse.h
+// Response header lines parsed in place, on the buffer curl hands to the
+// header callback.
+//
+// parse_header_line() splits a line into status line, field (name and
+// trimmed value) or the blank line ending the block, as string_views into
+// the caller's buffer: nothing is copied or allocated. The ':' and the line
+// ending are found in one SSE2 pass, 16 bytes at a time, and field names
+// are matched case-insensitively against a table of well-known names, so
+// callers switch on a HeaderId instead of comparing strings.
+//
+// DiveHeaders keeps every line of a transfer in one growing buffer with a
+// fixed-size index entry per line. Once both have grown to the size of a
+// typical response, adding a line allocates nothing.
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <strings.h>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Well-known field names. Anything else is HEADER_OTHER and matched by name.
+enum HeaderId : uint8_t {
+    HEADER_OTHER,
+    HEADER_ACCEPT_RANGES,
+    HEADER_AGE,
+    HEADER_ALT_SVC,
+    HEADER_CACHE_CONTROL,
+    HEADER_CONNECTION,
+    HEADER_CONTENT_ENCODING,
+    HEADER_CONTENT_LENGTH,
+    HEADER_CONTENT_RANGE,
+    HEADER_CONTENT_TYPE,
+    HEADER_DATE,
+    HEADER_ETAG,
+    HEADER_EXPIRES,
+    HEADER_KEEP_ALIVE,
+    HEADER_LAST_MODIFIED,
+    HEADER_LOCATION,
+    HEADER_SERVER,
+    HEADER_SET_COOKIE,
+    HEADER_STRICT_TRANSPORT_SECURITY,
+    HEADER_TRANSFER_ENCODING,
+    HEADER_VARY,
+    HEADER_ID_COUNT
+};
+
+inline std::string_view header_id_name(HeaderId id) {
+    static const std::string_view names[HEADER_ID_COUNT] = {
+        "", "accept-ranges", "age", "alt-svc", "cache-control", "connection", "content-encoding",
+        "content-length", "content-range", "content-type", "date", "etag", "expires", "keep-alive",
+        "last-modified", "location", "server", "set-cookie", "strict-transport-security",
+        "transfer-encoding", "vary",
+    };
+    return names[id];
+}
+
+// Case-insensitive comparison with a lowercase name
+inline bool header_name_is(std::string_view name, std::string_view lower) {
+    return name.size() == lower.size() && strncasecmp(name.data(), lower.data(), lower.size()) == 0;
+}
+
+inline HeaderId header_id(std::string_view name) {
+    // Few names share a length, so nearly every candidate is ruled out
+    // before any bytes are compared
+    for (int id = 1; id < HEADER_ID_COUNT; id++) {
+        std::string_view known = header_id_name(HeaderId(id));
+        if (known.size() == name.size() && header_name_is(name, known)) return HeaderId(id);
+    }
+    return HEADER_OTHER;
+}
+
+enum HeaderKind : uint8_t {
+    HEADER_LINE_STATUS,  // "HTTP/1.1 200 OK"
+    HEADER_LINE_FIELD,   // "Name: value"
+    HEADER_LINE_END,     // the blank line after the block
+    HEADER_LINE_OTHER,   // anything else (obsolete line folding, junk)
+};
+
+struct HeaderLine {
+    HeaderKind kind = HEADER_LINE_OTHER;
+    HeaderId id = HEADER_OTHER;
+    int status = 0;          // status lines
+    std::string_view line;   // without the line ending
+    std::string_view name;   // fields
+    std::string_view value;  // fields, without surrounding whitespace
+};
+
+// Offsets of the first ':' and of the first CR or LF in p[0, n); n when
+// absent. Only a ':' before the line ending counts.
+inline void header_scan(const char* p, size_t n, size_t& colon, size_t& eol) {
+    colon = n;
+    eol = n;
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i c_colon = _mm_set1_epi8(':');
+    const __m128i c_cr = _mm_set1_epi8('\r');
+    const __m128i c_lf = _mm_set1_epi8('\n');
+    for (; i + 16 <= n; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        unsigned ends = unsigned(_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, c_cr), _mm_cmpeq_epi8(chunk, c_lf))));
+        if (colon == n) {
+            unsigned colons = unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, c_colon)));
+            if (colons) colon = i + unsigned(__builtin_ctz(colons));
+        }
+        if (ends) {
+            eol = i + unsigned(__builtin_ctz(ends));
+            if (colon > eol) colon = n;
+            return;
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        char c = p[i];
+        if (c == '\r' || c == '\n') {
+            eol = i;
+            if (colon > eol) colon = n;
+            return;
+        }
+        if (c == ':' && colon == n) colon = i;
+    }
+}
+
+inline std::string_view header_trim(std::string_view s) {
+    size_t start = 0;
+    while (start < s.size() && (s[start] == ' ' || s[start] == '\t')) start++;
+    size_t end = s.size();
+    while (end > start && (s[end - 1] == ' ' || s[end - 1] == '\t')) end--;
+    return s.substr(start, end - start);
+}
+
+// Parse one line as delivered to CURLOPT_HEADERFUNCTION
+inline HeaderLine parse_header_line(std::string_view raw) {
+    HeaderLine out;
+    size_t colon, eol;
+    header_scan(raw.data(), raw.size(), colon, eol);
+    out.line = raw.substr(0, eol);
+    if (out.line.empty()) {
+        out.kind = HEADER_LINE_END;
+    } else if (out.line.size() > 5 && memcmp(out.line.data(), "HTTP/", 5) == 0) {
+        out.kind = HEADER_LINE_STATUS;
+        size_t sp = out.line.find(' ');
+        if (sp != std::string_view::npos) {
+            for (size_t i = sp + 1; i < out.line.size() && out.line[i] >= '0' && out.line[i] <= '9'; i++) {
+                out.status = out.status * 10 + (out.line[i] - '0');
+            }
+        }
+    } else if (colon < eol && colon > 0 && out.line[0] != ' ' && out.line[0] != '\t') {
+        out.kind = HEADER_LINE_FIELD;
+        out.name = out.line.substr(0, colon);
+        out.value = header_trim(out.line.substr(colon + 1));
+        out.id = header_id(out.name);
+    }
+    return out;
+}
+
+// Every header line of a transfer, in order
+class DiveHeaders {
+public:
+    // Append a line as received, line ending included
+    void add(std::string_view raw, const HeaderLine& parsed) {
+        Entry e;
+        e.offset = uint32_t(block_.size());
+        e.length = uint32_t(parsed.line.size());
+        e.value_offset = parsed.kind == HEADER_LINE_FIELD ? uint32_t(parsed.value.data() - raw.data()) : 0;
+        e.value_length = uint32_t(parsed.value.size());
+        e.name_length = uint16_t(std::min<size_t>(parsed.name.size(), UINT16_MAX));
+        e.kind = parsed.kind;
+        e.id = parsed.id;
+        e.status = parsed.status;
+        block_.append(raw.data(), raw.size());
+        entries_.push_back(e);
+    }
+
+    // Drop the lines, keeping the memory for the next transfer
+    void clear() {
+        block_.clear();
+        entries_.clear();
+    }
+
+    size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+
+    // The whole block, exactly as received
+    std::string_view raw() const { return block_; }
+
+    HeaderLine operator[](size_t i) const {
+        const Entry& e = entries_[i];
+        std::string_view all(block_);
+        HeaderLine out;
+        out.kind = HeaderKind(e.kind);
+        out.id = HeaderId(e.id);
+        out.status = e.status;
+        out.line = all.substr(e.offset, e.length);
+        if (out.kind == HEADER_LINE_FIELD) {
+            out.name = all.substr(e.offset, e.name_length);
+            out.value = all.substr(e.offset + e.value_offset, e.value_length);
+        }
+        return out;
+    }
+
+    // Call fn for every field with the given id
+    template <typename Fn>
+    void each(HeaderId id, Fn fn) const {
+        for (size_t i = 0; i < entries_.size(); i++) {
+            if (entries_[i].kind == HEADER_LINE_FIELD && entries_[i].id == id) fn((*this)[i]);
+        }
+    }
+
+    // Value of the last field with the given id (the final response's, after
+    // redirects); empty when there is none
+    std::string_view last(HeaderId id) const {
+        for (size_t i = entries_.size(); i-- > 0;) {
+            if (entries_[i].kind == HEADER_LINE_FIELD && entries_[i].id == id) return (*this)[i].value;
+        }
+        return std::string_view();
+    }
+
+private:
+    struct Entry {
+        uint32_t offset;
+        uint32_t length;  // without the line ending
+        uint32_t value_offset;
+        uint32_t value_length;
+        uint16_t name_length;
+        uint8_t kind;
+        uint8_t id;
+        int status;
+    };
+
+    std::string block_;
+    std::vector<Entry> entries_;
+};
@@ -1,63 +1,434 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
 #include <string>
 #include <curl/curl.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "dive.h"
+#include "batch.h"
+#include "daemon_protocol.h"
+#include "html_links.h"
+#include "repeat.h"
+#include "results_store.h"
 
-// A simple Logger class for this standalone tool
-class Logger {
+// Streaming mode: the body goes straight to the output through one fixed
+// buffer, so memory use stays the same whether the body is 1 KB or 100 GB.
+// With fd -1 the body is only counted (--links without --output).
+class BodyStream {
 public:
-    void log(const std::string& message) {
-        std::cout << message;
+    static const size_t kBufferSize = 64 * 1024;
+
+    BodyStream(int fd, curl_off_t max_bytes) : fd_(fd), max_bytes_(max_bytes) {}
+
+    // Body chunk from the engine. Returns false to stop the transfer, either
+    // because --max-bytes was reached or because the output failed.
+    bool write(const char* data, size_t size) {
+        if (max_bytes_ > 0 && written_ + curl_off_t(size) >= max_bytes_) {
+            size = size_t(max_bytes_ - written_);
+            limit_reached_ = true;
+        }
+        written_ += size;
+
+        while (size > 0) {
+            size_t n = std::min(size, kBufferSize - used_);
+            memcpy(buffer_ + used_, data, n);
+            used_ += n;
+            data += n;
+            size -= n;
+            if (used_ == kBufferSize && !flush()) return false;
+        }
+        return !limit_reached_;
+    }
+
+    bool flush() {
+        if (fd_ < 0) {
+            used_ = 0;
+            return true;
+        }
+        size_t done = 0;
+        while (done < used_) {
+            ssize_t n = ::write(fd_, buffer_ + done, used_ - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                failed_ = true;
+                return false;
+            }
+            done += size_t(n);
+        }
+        used_ = 0;
+        return true;
     }
+
+    curl_off_t written() const { return written_; }
+    bool limit_reached() const { return limit_reached_; }
+    bool failed() const { return failed_; }
+
+private:
+    int fd_;
+    curl_off_t max_bytes_;
+    char buffer_[kBufferSize];
+    size_t used_ = 0;
+    curl_off_t written_ = 0;
+    bool limit_reached_ = false;
+    bool failed_ = false;
 };
 
-// Callback function to handle the response body data.
-// It is called by libcurl as data is received.
-size_t writeCallback(void* contents, size_t size, size_t nmemb, void* userp) {
-    // Append the received data to the string buffer
-    static_cast<std::string*>(userp)->append(static_cast<char*>(contents), size * nmemb);
-    return size * nmemb;
+// "[Stream] ..." progress lines on stderr, at most one per second
+class RateReporter {
+public:
+    explicit RateReporter(curl_off_t offset) : offset_(offset) {}
+
+    void update(curl_off_t total, curl_off_t now) {
+        auto t = std::chrono::steady_clock::now();
+        if (t - last_ < std::chrono::seconds(1)) return;
+        double seconds = std::chrono::duration<double>(t - last_).count();
+        double rate = (now - last_bytes_) / seconds;
+        last_ = t;
+        last_bytes_ = now;
+
+        std::cerr << "[Stream] " << offset_ + now << " bytes";
+        if (total > 0) std::cerr << " of " << offset_ + total;
+        std::cerr << ", " << format_rate(rate) << "\n";
+    }
+
+    static std::string format_rate(double bytes_per_sec) {
+        char buf[32];
+        if (bytes_per_sec >= 1024.0 * 1024.0) {
+            snprintf(buf, sizeof(buf), "%.2f MB/s", bytes_per_sec / (1024.0 * 1024.0));
+        } else {
+            snprintf(buf, sizeof(buf), "%.2f KB/s", bytes_per_sec / 1024.0);
+        }
+        return buf;
+    }
+
+private:
+    curl_off_t offset_;
+    std::chrono::steady_clock::time_point last_ = std::chrono::steady_clock::now();
+    curl_off_t last_bytes_ = 0;
+};
+
+// --bench: run the link extractor over a saved page with each scanner, in
+// write-callback sized chunks, and report throughput
+int run_bench(const std::string& path, int iterations) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to open " << path << "\n";
+        return 1;
+    }
+    std::stringstream ss;
+    ss << file.rdbuf();
+    const std::string page = ss.str();
+    const size_t chunk = CURL_MAX_WRITE_SIZE;
+
+    std::vector<HtmlScanFn> scanners = {html_scan_scalar};
+#ifdef HTML_LINKS_X86
+    scanners.push_back(html_scan_sse2);
+    if (html_best_scanner() == html_scan_avx2) scanners.push_back(html_scan_avx2);
+#endif
+
+    std::cout << "[Bench] " << path << ": " << page.size() << " bytes x " << iterations << " iterations\n";
+    for (HtmlScanFn scan : scanners) {
+        size_t links = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            HtmlLinkExtractor extractor([](const HtmlLink&) {}, "http://bench.invalid/");
+            extractor.set_scanner(scan);
+            for (size_t off = 0; off < page.size(); off += chunk) {
+                extractor.feed(page.data() + off, std::min(chunk, page.size() - off));
+            }
+            links = extractor.links();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double rate = double(page.size()) * iterations / seconds;
+        std::cout << "[Bench] " << std::left << std::setw(7) << html_scanner_name(scan) << std::right
+                  << " tokenizer " << RateReporter::format_rate(rate) << ", " << links << " links per pass\n";
+    }
+
+    // Reference: the scanner alone, skipping from '<' to '<'
+    HtmlScanFn best = html_best_scanner();
+    size_t tags = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        const char* end = page.data() + page.size();
+        for (const char* p = best(page.data(), end, '<', '<'); p < end; p = best(p + 1, end, '<', '<')) tags++;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "[Bench] " << std::left << std::setw(7) << html_scanner_name(best) << std::right
+              << " '<' scan  " << RateReporter::format_rate(double(page.size()) * iterations / seconds) << ", "
+              << tags / iterations << " '<' per pass\n";
+    return 0;
+}
+
+void usage(const char* tool) {
+    std::cerr << "Usage: " << tool << " <url> [options]\n"
+              << "Streaming options (body is written as it arrives, nothing is kept in memory):\n"
+              << "  --stream             stream the raw body to stdout\n"
+              << "  --output <file>      stream the body to a file\n"
+              << "  --resume             continue a partial --output file with an HTTP Range request\n"
+              << "  --max-bytes <n>      stop after n body bytes\n"
+              << "  --range <a-b>        request only this byte range\n"
+              << "  --links              print the page's links (tag, attribute, absolute URL) as they stream in\n"
+              << "  --results <file>     also append a fixed-schema row (status, timings, size, hash) to a results file\n"
+              << "Fingerprints (the body is hashed as it arrives, never kept):\n"
+              << "  --fingerprint        print the exact hash and the SimHash of the visible text instead of the body;\n"
+              << "                       with --batch, cluster identical and near-identical pages at the end\n"
+              << "  --near <0..1>        MinHash similarity that counts as near-identical (default 0.8)\n"
+              << "Incremental (buffered mode only):\n"
+              << "  --incremental <file> send the validators stored by the last run (If-None-Match, If-Modified-Since)\n"
+              << "                       and print only bodies that changed; the store is updated afterwards\n"
+              << "Timing:\n"
+              << "  " << tool << " <url> --repeat N [--export <file.json|->]\n"
+              << "Batch:\n"
+              << "  " << tool << " --batch <file|-> [--parallel N] [--results <file>] [--incremental <file>]\n"
+              << "Benchmark:\n"
+              << "  " << tool << " --bench <file.html> [--iterations n]\n";
 }
 
 int main(int argc, char* argv[]) {
+    // A running webdived answers from its warm connections instead
+    int daemon_status = 0;
+    if (daemon_forward("html_body", argc, argv, daemon_status)) return daemon_status;
+
     if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <url>" << std::endl;
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::string url;
+    std::string output;
+    std::string range;
+    curl_off_t max_bytes = 0;
+    bool stream = false;
+    bool resume = false;
+    bool links = false;
+    bool batch = false;
+    bool fingerprint = false;
+    double near = 0.8;
+    std::string bench;
+    int iterations = 20;
+    RepeatOptions repeat;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--stream") {
+            stream = true;
+        } else if (arg == "--output" && has_value) {
+            output = argv[++i];
+            stream = true;
+        } else if (arg == "--resume") {
+            resume = true;
+        } else if (arg == "--max-bytes" && has_value) {
+            max_bytes = std::strtoll(argv[++i], nullptr, 10);
+            stream = true;
+        } else if (arg == "--links") {
+            links = true;
+            stream = true;
+        } else if (arg == "--bench" && has_value) {
+            bench = argv[++i];
+        } else if (arg == "--iterations" && has_value) {
+            iterations = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--repeat" && has_value) {
+            repeat.runs = std::max(1L, std::strtol(argv[++i], nullptr, 10));
+        } else if (arg == "--export" && has_value) {
+            repeat.export_path = argv[++i];
+        } else if (arg == "--range" && has_value) {
+            range = argv[++i];
+            stream = true;
+        } else if ((arg == "--results" || arg == "--incremental") && has_value) {
+            i++;  // opened below
+        } else if (arg == "--batch") {
+            batch = true;
+            if (has_value) i++;  // parsed by parse_batch_args
+        } else if (arg == "--parallel" && has_value) {
+            i++;
+        } else if (arg == "--fingerprint") {
+            fingerprint = true;
+        } else if (arg == "--near" && has_value) {
+            near = std::min(1.0, std::max(0.0, std::strtod(argv[++i], nullptr)));
+            fingerprint = true;
+        } else {
+            url = arg;
+        }
+    }
+
+    if (!bench.empty()) return run_bench(bench, iterations);
+
+    if ((url.empty() && !batch) || (resume && output.empty()) || (resume && !range.empty())) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // --incremental <file>: conditional requests from the last run's validators.
+    // Buffered mode only: a 304 has no body, and streaming would have
+    // already truncated --output for it.
+    std::unique_ptr<ValidatorStore> validators;
+    open_validators_arg(argc, argv, validators);
+    if (validators && (stream || repeat.runs > 0)) {
+        std::cerr << "--incremental only works in buffered mode (no --stream, --output, --links, --range, --repeat)\n";
         return 1;
     }
 
-    // Initialize a simple logger for the tool
-    Logger logger;
-    std::string response_body;
+    // --results <file>: also append a fixed-schema row for the probe
+    std::unique_ptr<ResultsWriter> results;
+    if (!open_results_arg(argc, argv, "html_body", results)) return 1;
 
     // Global libcurl initialization
     curl_global_init(CURL_GLOBAL_DEFAULT);
 
-    CURL* curl = curl_easy_init();
-    if (curl) {
-        // Set the URL from the command line argument
-        curl_easy_setopt(curl, CURLOPT_URL, argv[1]);
+    DiveOptions options;
+    options.follow_redirects = false;
+    options.debug_events = false;
+    options.tls_info = false;
+    options.certinfo = false;
+    options.hash_body = results != nullptr || fingerprint;
+    options.validators = validators.get();
+    // --fingerprint: sketches are built in the write callback, so the body
+    // itself is not kept
+    options.fingerprint = fingerprint;
+    if (fingerprint) options.keep_body = false;
+
+    if (repeat.runs > 0) {
+        repeat.url = url;
+        int status = run_repeat(repeat, options);
+        curl_global_cleanup();
+        return status;
+    }
+
+    // Unchanged bodies are not printed again. With --fingerprint every
+    // page's sketch goes into the near-duplicate index instead.
+    NearDuplicateIndex duplicates(near);
+    auto view = [&](const DiveResult& r) {
+        if (print_incremental(r)) return;
+        if (!fingerprint) {
+            print_body(r);
+            return;
+        }
+        print_fingerprint(r.body_hash, r.fingerprint);
+        duplicates.add(r.effective_url.empty() ? r.url : r.effective_url, r.body_hash, r.fingerprint);
+    };
 
-        // Tell libcurl where to send the received data
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
-        // Pass our string buffer to the callback function
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response_body);
+    BatchOptions batch_options;
+    if (batch && parse_batch_args(argc, argv, batch_options)) {
+        batch_options.results = results.get();
+        size_t failed = run_batch(batch_options, options, view);
+        if (fingerprint) print_duplicate_report(duplicates);
+        close_results(results);
+        if (validators) save_validators(*validators);
+        curl_global_cleanup();
+        return failed > 0 ? 1 : 0;
+    }
 
-        // Perform the request
-        CURLcode res = curl_easy_perform(curl);
-        if (res != CURLE_OK) {
-            logger.log("curl_easy_perform() failed: " + std::string(curl_easy_strerror(res)) + "\n");
+    if (!stream) {
+        DiveResult result = dive(url, options);
+        if (!result.ok()) {
+            std::cout << "curl_easy_perform() failed: " << result.error() << "\n";
         } else {
-            // Log the full body content if the request was successful
-            logger.log("--- Full Body Content ---\n");
-            logger.log(response_body);
+            // Print the full body content if the request was successful
+            view(result);
+        }
+        if (results) results->append(result);
+        close_results(results);
+        if (validators) save_validators(*validators);
+        print_dns_cache_stats();
+        curl_global_cleanup();
+        return 0;
+    }
+
+    // --links writes the links to stdout; the body only goes to --output
+    int fd = links ? -1 : STDOUT_FILENO;
+    curl_off_t offset = 0;
+    if (!output.empty()) {
+        fd = open(output.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (resume ? O_APPEND : O_TRUNC), 0644);
+        if (fd < 0) {
+            std::cerr << "Failed to open " << output << ": " << strerror(errno) << "\n";
+            return 1;
+        }
+        struct stat st{};
+        if (resume && fstat(fd, &st) == 0) offset = st.st_size;
+    }
+
+    BodyStream body(fd, max_bytes);
+    RateReporter reporter(offset);
+    options.keep_body = false;
+    options.follow_redirects = true;
+    options.range = range;
+    options.resume_from = offset;
+    options.fail_on_error = !output.empty();  // never append an error page to a download
+    options.on_progress = [&](curl_off_t total, curl_off_t now) { reporter.update(total, now); };
+
+    // Links are tokenized inside the write callback, chunk by chunk, and
+    // resolved against the URL the body actually came from
+    std::unique_ptr<HtmlLinkExtractor> extractor;
+    std::map<std::string, size_t> per_tag;
+    if (links) {
+        extractor.reset(new HtmlLinkExtractor([&](const HtmlLink& link) {
+            std::cout << link.tag << "\t" << link.attr << "\t" << link.url << "\n";
+            per_tag[link.tag]++;
+        }));
+    }
+    const DiveResult* live = nullptr;
+    options.on_body = [&](const char* data, size_t size) {
+        curl_off_t before = body.written();
+        bool more = body.write(data, size);
+        if (extractor) {
+            if (extractor->bytes() == 0) extractor->set_base(live->effective_url);
+            extractor->feed(data, size_t(body.written() - before));  // --max-bytes applies here too
         }
+        return more;
+    };
+
+    if (offset > 0) std::cerr << "[Stream] Resuming at byte " << offset << "\n";
+    DiveTransfer transfer(url, options);
+    live = &transfer.result;
+    transfer.perform();
+    const DiveResult& result = transfer.result;
+    body.flush();
+    if (fd >= 0 && fd != STDOUT_FILENO) close(fd);
+
+    bool ok = result.ok() || (result.code == CURLE_WRITE_ERROR && body.limit_reached() && !body.failed());
+    if (offset > 0 && result.response_code == 416) {
+        std::cerr << "[Stream] Nothing to resume, " << output << " is already complete\n";
+        ok = true;
+    } else if (!ok) {
+        std::cerr << "curl_easy_perform() failed: " << result.error() << "\n";
+    } else if (result.response_code >= 400) {  // only reachable when streaming to stdout
+        std::cerr << "[Stream] Server returned " << result.response_code << "\n";
+    } else if (!range.empty() && result.response_code == 200) {
+        std::cerr << "[Stream] Server ignored the range and sent the whole body\n";
+    }
 
-        // Cleanup
-        curl_easy_cleanup(curl);
+    double seconds = result.total_time_us / 1e6;
+    if (fingerprint && ok) print_fingerprint(result.body_hash, result.fingerprint, std::cerr);
+    std::cerr << "[Stream] " << body.written() << " bytes in " << std::fixed << std::setprecision(2) << seconds
+              << "s (" << RateReporter::format_rate(seconds > 0 ? body.written() / seconds : 0) << ")"
+              << (body.limit_reached() ? ", stopped at --max-bytes" : "") << "\n";
+    if (extractor) {
+        std::cerr << "[Links] " << extractor->links() << " links";
+        const char* sep = ": ";
+        for (const auto& entry : per_tag) {
+            std::cerr << sep << entry.first << "=" << entry.second;
+            sep = " ";
+        }
+        std::cerr << "\n";
     }
+    if (results) results->append(result);
+    close_results(results);
+    print_dns_cache_stats();
 
     // Global libcurl cleanup
     curl_global_cleanup();
 
-    return 0;
+    return ok ? 0 : 1;
 }
-
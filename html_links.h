@@ -0,0 +1,684 @@
+// html_links.h
+// Incremental HTML tokenizer that pulls links out of a page while it streams.
+//
+// The tokenizer is fed body chunks straight from the write callback and
+// never holds the document: only the tag currently being read is kept, and
+// attribute values are capped. Text between tags is skipped with a vector
+// scan for '<', quoted attribute values with a scan for the closing quote
+// and '&'. Every href/src/srcset/action/poster/data attribute and every
+// <meta http-equiv="refresh"> target is resolved against the document base
+// (the effective URL, or <base href>) and handed to a callback.
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <curl/curl.h>
+#include <strings.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HTML_LINKS_X86 1
+#endif
+
+// One extracted reference
+struct HtmlLink {
+    std::string tag;   // element name, lower case
+    std::string attr;  // attribute the URL came from ("content" for meta refresh)
+    std::string raw;   // value as written, entities decoded
+    std::string url;   // resolved absolute URL
+};
+
+// ---------------------------------------------------------------------------
+// Byte scanners: first occurrence of c1 or c2 in [p, end), or end.
+// ---------------------------------------------------------------------------
+
+using HtmlScanFn = const char* (*)(const char* p, const char* end, char c1, char c2);
+
+inline const char* html_scan_scalar(const char* p, const char* end, char c1, char c2) {
+    for (; p < end; p++) {
+        if (*p == c1 || *p == c2) return p;
+    }
+    return end;
+}
+
+#ifdef HTML_LINKS_X86
+inline const char* html_scan_sse2(const char* p, const char* end, char c1, char c2) {
+    const __m128i v1 = _mm_set1_epi8(c1);
+    const __m128i v2 = _mm_set1_epi8(c2);
+    for (; end - p >= 16; p += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, v1), _mm_cmpeq_epi8(chunk, v2)));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    return html_scan_scalar(p, end, c1, c2);
+}
+
+__attribute__((target("avx2")))
+inline const char* html_scan_avx2(const char* p, const char* end, char c1, char c2) {
+    const __m256i v1 = _mm256_set1_epi8(c1);
+    const __m256i v2 = _mm256_set1_epi8(c2);
+    for (; end - p >= 32; p += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, v1), _mm256_cmpeq_epi8(chunk, v2));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hit));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    return html_scan_sse2(p, end, c1, c2);
+}
+#endif
+
+// Widest scanner this CPU supports
+inline HtmlScanFn html_best_scanner() {
+#ifdef HTML_LINKS_X86
+    static const HtmlScanFn best = __builtin_cpu_supports("avx2") ? html_scan_avx2 : html_scan_sse2;
+    return best;
+#else
+    return html_scan_scalar;
+#endif
+}
+
+inline const char* html_scanner_name(HtmlScanFn scan) {
+#ifdef HTML_LINKS_X86
+    if (scan == html_scan_avx2) return "avx2";
+    if (scan == html_scan_sse2) return "sse2";
+#endif
+    return "scalar";
+}
+
+// ---------------------------------------------------------------------------
+// Helpers
+// ---------------------------------------------------------------------------
+
+// Decode the character references that show up in URLs. Unknown named
+// references are left as written, like browsers do for attribute values.
+inline std::string html_decode_entities(const std::string& in) {
+    std::string out;
+    out.reserve(in.size());
+    for (size_t i = 0; i < in.size(); i++) {
+        if (in[i] != '&') {
+            out += in[i];
+            continue;
+        }
+        size_t semi = in.find(';', i + 1);
+        if (semi == std::string::npos || semi - i > 10) {
+            out += '&';
+            continue;
+        }
+        std::string name = in.substr(i + 1, semi - i - 1);
+        unsigned long code = 0;
+        if (!name.empty() && name[0] == '#') {
+            bool hex = name.size() > 1 && (name[1] == 'x' || name[1] == 'X');
+            char* stop = nullptr;
+            code = std::strtoul(name.c_str() + (hex ? 2 : 1), &stop, hex ? 16 : 10);
+            if (*stop || code == 0 || code > 0x10FFFF) code = 0;
+        } else if (name == "amp") {
+            code = '&';
+        } else if (name == "lt") {
+            code = '<';
+        } else if (name == "gt") {
+            code = '>';
+        } else if (name == "quot") {
+            code = '"';
+        } else if (name == "apos") {
+            code = '\'';
+        } else if (name == "nbsp") {
+            code = 0xA0;
+        }
+        if (!code) {
+            out += '&';
+            continue;
+        }
+
+        // UTF-8 encode
+        if (code < 0x80) {
+            out += char(code);
+        } else if (code < 0x800) {
+            out += char(0xC0 | (code >> 6));
+            out += char(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            out += char(0xE0 | (code >> 12));
+            out += char(0x80 | ((code >> 6) & 0x3F));
+            out += char(0x80 | (code & 0x3F));
+        } else {
+            out += char(0xF0 | (code >> 18));
+            out += char(0x80 | ((code >> 12) & 0x3F));
+            out += char(0x80 | ((code >> 6) & 0x3F));
+            out += char(0x80 | (code & 0x3F));
+        }
+        i = semi;
+    }
+    return out;
+}
+
+// URL attribute values ignore leading/trailing whitespace and embedded
+// tabs and newlines
+inline std::string html_clean_url(const std::string& value) {
+    std::string out;
+    size_t start = value.find_first_not_of(" \t\r\n\f");
+    if (start == std::string::npos) return out;
+    size_t end = value.find_last_not_of(" \t\r\n\f");
+    for (size_t i = start; i <= end; i++) {
+        if (value[i] != '\t' && value[i] != '\n' && value[i] != '\r') out += value[i];
+    }
+    return out;
+}
+
+// Resolve ref against base with curl's URL parser (RFC 3986 reference
+// resolution). Returns "" if the result is not a valid URL.
+inline std::string html_resolve_url(CURLU* base, const std::string& ref) {
+    if (!base) return ref;
+    CURLU* u = curl_url_dup(base);
+    std::string out;
+    char* full = nullptr;
+    if (curl_url_set(u, CURLUPART_URL, ref.c_str(), CURLU_NON_SUPPORT_SCHEME) == CURLUE_OK &&
+        curl_url_get(u, CURLUPART_URL, &full, 0) == CURLUE_OK) {
+        out = full;
+    }
+    curl_free(full);
+    curl_url_cleanup(u);
+    return out;
+}
+
+// ---------------------------------------------------------------------------
+// Tokenizer
+// ---------------------------------------------------------------------------
+
+class HtmlLinkExtractor {
+public:
+    using LinkFn = std::function<void(const HtmlLink&)>;
+
+    static constexpr size_t kMaxValue = 8192;  // longer attribute values are dropped
+    static constexpr size_t kMaxName = 64;
+    static constexpr size_t kMaxAttrs = 64;
+    static constexpr size_t kMaxResolved = 4096;  // memoised reference resolutions
+
+    explicit HtmlLinkExtractor(LinkFn on_link, const std::string& base = "")
+        : on_link_(std::move(on_link)), scan_(html_best_scanner()) {
+        if (!base.empty()) set_base(base);
+    }
+
+    ~HtmlLinkExtractor() {
+        if (base_) curl_url_cleanup(base_);
+    }
+
+    HtmlLinkExtractor(const HtmlLinkExtractor&) = delete;
+    HtmlLinkExtractor& operator=(const HtmlLinkExtractor&) = delete;
+
+    // URL that relative references resolve against. A <base href> in the
+    // document takes precedence once seen.
+    void set_base(const std::string& url) {
+        if (base_from_document_) return;
+        CURLU* u = curl_url();
+        if (curl_url_set(u, CURLUPART_URL, url.c_str(), CURLU_GUESS_SCHEME) != CURLUE_OK) {
+            curl_url_cleanup(u);
+            return;
+        }
+        if (base_) curl_url_cleanup(base_);
+        base_ = u;
+        resolved_.clear();
+
+        char* full = nullptr;
+        base_url_.clear();
+        if (curl_url_set(u, CURLUPART_FRAGMENT, nullptr, 0) == CURLUE_OK &&
+            curl_url_get(u, CURLUPART_URL, &full, 0) == CURLUE_OK) {
+            base_url_ = full;
+        }
+        curl_free(full);
+    }
+
+    // Use a specific scanner (the benchmark compares them)
+    void set_scanner(HtmlScanFn scan) { scan_ = scan; }
+    HtmlScanFn scanner() const { return scan_; }
+
+    size_t links() const { return links_; }
+    uint64_t bytes() const { return bytes_; }
+
+    // Feed the next chunk of the document
+    void feed(const char* data, size_t size) {
+        const char* p = data;
+        const char* end = data + size;
+        bytes_ += size;
+
+        while (p < end) {
+            switch (state_) {
+                case State::Data: {
+                    p = scan_(p, end, '<', '<');
+                    if (p == end) return;
+                    state_ = State::TagOpen;
+                    p++;
+                    break;
+                }
+                case State::TagOpen: {
+                    char c = *p;
+                    if (is_alpha(c)) {
+                        start_tag();
+                        state_ = State::TagName;
+                        continue;  // reprocess as part of the name
+                    }
+                    if (c == '!') {
+                        state_ = State::MarkupDecl;
+                        dashes_ = 0;
+                    } else if (c == '/' || c == '?') {
+                        state_ = State::BogusComment;  // end tags carry no links
+                    } else {
+                        state_ = State::Data;  // a literal '<'
+                        continue;
+                    }
+                    p++;
+                    break;
+                }
+                case State::MarkupDecl: {
+                    // "<!--" starts a comment, anything else (doctype, CDATA) runs to '>'
+                    if (*p == '-' && ++dashes_ < 2) {
+                        p++;
+                        break;
+                    }
+                    if (*p == '-') {
+                        state_ = State::Comment;
+                        dashes_ = 0;
+                        p++;
+                        break;
+                    }
+                    state_ = State::BogusComment;
+                    break;
+                }
+                case State::Comment: {
+                    // Look for "-->", possibly split across chunks
+                    // (dashes_ counts the '-' run just before the current position)
+                    const char* gt = scan_(p, end, '>', '>');
+                    int run = 0;
+                    while (run < 2 && gt - run > p && gt[-run - 1] == '-') run++;
+                    dashes_ = run == gt - p ? std::min(dashes_ + run, 2) : run;
+                    if (gt == end) return;
+                    p = gt + 1;
+                    if (dashes_ >= 2) state_ = State::Data;
+                    dashes_ = 0;
+                    break;
+                }
+                case State::BogusComment: {
+                    p = scan_(p, end, '>', '>');
+                    if (p == end) return;
+                    state_ = State::Data;
+                    p++;
+                    break;
+                }
+                case State::TagName: {
+                    while (p < end && !is_space(*p) && *p != '/' && *p != '>') {
+                        if (tag_.size() < kMaxName) tag_ += to_lower(*p);
+                        p++;
+                    }
+                    if (p == end) return;
+                    char c = *p;
+                    if (is_space(c)) {
+                        want_tag_ = wanted_tag(tag_);
+                        state_ = State::BeforeAttr;
+                    } else if (c == '/') {
+                        want_tag_ = wanted_tag(tag_);
+                        self_closing_ = true;
+                        state_ = State::BeforeAttr;
+                    } else if (c == '>') {
+                        want_tag_ = wanted_tag(tag_);
+                        end_tag();
+                    }
+                    p++;
+                    break;
+                }
+                case State::BeforeAttr: {
+                    char c = *p;
+                    if (c == '>') {
+                        end_tag();
+                    } else if (c == '/') {
+                        self_closing_ = true;
+                    } else if (!is_space(c)) {
+                        self_closing_ = false;
+                        start_attr();
+                        state_ = State::AttrName;
+                        continue;
+                    }
+                    p++;
+                    break;
+                }
+                case State::AttrName: {
+                    while (p < end && *p != '=' && *p != '>' && *p != '/' && !is_space(*p)) {
+                        if (want_tag_ && attr_name_.size() < kMaxName) attr_name_ += to_lower(*p);
+                        p++;
+                    }
+                    if (p == end) return;
+                    char c = *p;
+                    if (c == '=') {
+                        state_ = State::BeforeValue;
+                    } else if (is_space(c)) {
+                        state_ = State::AfterAttrName;
+                    } else if (c == '>' || c == '/') {
+                        end_attr();
+                        state_ = State::BeforeAttr;
+                        continue;
+                    }
+                    p++;
+                    break;
+                }
+                case State::AfterAttrName: {
+                    char c = *p;
+                    if (c == '=') {
+                        state_ = State::BeforeValue;
+                        p++;
+                    } else if (is_space(c)) {
+                        p++;
+                    } else {
+                        end_attr();
+                        state_ = State::BeforeAttr;
+                    }
+                    break;
+                }
+                case State::BeforeValue: {
+                    char c = *p;
+                    want_value_ = !attr_name_.empty() && wanted_attr(attr_name_);
+                    if (c == '"' || c == '\'') {
+                        quote_ = c;
+                        state_ = State::ValueQuoted;
+                    } else if (c == '>') {
+                        end_attr();
+                        state_ = State::BeforeAttr;
+                        continue;
+                    } else if (!is_space(c)) {
+                        state_ = State::ValueUnquoted;
+                        continue;
+                    }
+                    p++;
+                    break;
+                }
+                case State::ValueQuoted: {
+                    // Values nobody asked for are skipped without copying
+                    const char* q = scan_(p, end, quote_, want_value_ ? '&' : quote_);
+                    append_value(p, q - p);
+                    if (q == end) return;
+                    if (*q == '&') {
+                        has_entity_ = true;
+                        append_value(q, 1);
+                        p = q + 1;
+                        break;
+                    }
+                    end_attr();
+                    state_ = State::BeforeAttr;
+                    p = q + 1;
+                    break;
+                }
+                case State::ValueUnquoted: {
+                    char c = *p;
+                    if (is_space(c) || c == '>') {
+                        end_attr();
+                        state_ = State::BeforeAttr;
+                        if (c == '>') continue;
+                    } else {
+                        if (c == '&') has_entity_ = true;
+                        append_value(p, 1);
+                    }
+                    p++;
+                    break;
+                }
+                case State::RawText: {
+                    // <script>/<style> content is not markup; only its end tag matters
+                    p = scan_(p, end, '<', '<');
+                    if (p == end) return;
+                    state_ = State::RawLt;
+                    p++;
+                    break;
+                }
+                case State::RawLt: {
+                    if (*p == '/') {
+                        raw_end_.clear();
+                        state_ = State::RawEndName;
+                        p++;
+                    } else {
+                        state_ = State::RawText;
+                    }
+                    break;
+                }
+                case State::RawEndName: {
+                    char c = *p;
+                    if (is_alpha(c) && raw_end_.size() < raw_tag_.size()) {
+                        raw_end_ += to_lower(c);
+                        p++;
+                    } else if (raw_end_ == raw_tag_ && (is_space(c) || c == '>' || c == '/')) {
+                        state_ = State::BogusComment;
+                    } else {
+                        state_ = State::RawText;
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+private:
+    enum class State {
+        Data, TagOpen, MarkupDecl, Comment, BogusComment,
+        TagName, BeforeAttr, AttrName, AfterAttrName, BeforeValue, ValueQuoted, ValueUnquoted,
+        RawText, RawLt, RawEndName,
+    };
+
+    struct Attr {
+        std::string name;
+        std::string value;
+    };
+
+    // ASCII only: HTML tag and attribute names are case-insensitive in ASCII
+    static bool is_space(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f'; }
+    static bool is_alpha(char c) { return uint8_t((c | 0x20) - 'a') < 26; }
+    static char to_lower(char c) { return uint8_t(c - 'A') < 26 ? char(c | 0x20) : c; }
+
+    // Exact match against a literal without strlen
+    template <size_t N>
+    static bool is(const std::string& s, const char (&lit)[N]) {
+        return s.size() == N - 1 && memcmp(s.data(), lit, N - 1) == 0;
+    }
+
+    // Only these elements and attributes can carry a link; everything else
+    // is tokenized without keeping names or values
+    static bool wanted_tag(const std::string& t) {
+        switch (t.size()) {
+            case 1: return t[0] == 'a';
+            case 3: return is(t, "img");
+            case 4: return is(t, "area") || is(t, "link") || is(t, "base") || is(t, "meta") || is(t, "form");
+            case 5: return is(t, "embed") || is(t, "audio") || is(t, "video") || is(t, "track") ||
+                           is(t, "input") || is(t, "frame");
+            case 6: return is(t, "source") || is(t, "script") || is(t, "iframe") || is(t, "button") ||
+                           is(t, "object");
+        }
+        return false;
+    }
+
+    static bool wanted_attr(const std::string& n) {
+        return is(n, "href") || is(n, "src") || is(n, "srcset") || is(n, "action") || is(n, "formaction") ||
+               is(n, "poster") || is(n, "data") || is(n, "http-equiv") || is(n, "content") || is(n, "type");
+    }
+
+    void start_tag() {
+        tag_.clear();
+        attrs_.clear();
+        self_closing_ = false;
+        want_tag_ = false;
+    }
+
+    void start_attr() {
+        attr_name_.clear();
+        attr_value_.clear();
+        has_entity_ = false;
+        value_too_long_ = false;
+        want_value_ = false;
+    }
+
+    void append_value(const char* p, size_t n) {
+        if (!want_value_ || value_too_long_) return;
+        if (attr_value_.size() + n > kMaxValue) {
+            value_too_long_ = true;
+            attr_value_.clear();
+            return;
+        }
+        attr_value_.append(p, n);
+    }
+
+    void end_attr() {
+        if (!want_value_ || value_too_long_ || attrs_.size() >= kMaxAttrs) return;
+        attrs_.push_back({attr_name_, has_entity_ ? html_decode_entities(attr_value_) : attr_value_});
+        attr_name_.clear();
+        attr_value_.clear();
+    }
+
+    const std::string* attr(const char* name) const {
+        for (const auto& a : attrs_) {
+            if (a.name == name) return &a.value;
+        }
+        return nullptr;
+    }
+
+    void end_tag() {
+        emit_links();
+        state_ = State::Data;
+        if (self_closing_) return;
+        if (is(tag_, "script") || is(tag_, "style") || is(tag_, "textarea") || is(tag_, "title") || is(tag_, "xmp")) {
+            raw_tag_ = tag_;
+            state_ = State::RawText;
+        }
+    }
+
+    // Pages repeat the same references (nav bars, icons), so resolutions
+    // are memoised per base; the memo is bounded and reset with the base
+    const std::string& resolve(const std::string& ref) {
+        // "#frag" only replaces the base's fragment (rustdoc source pages
+        // are thousands of line anchors), no parse needed
+        if (ref[0] == '#' && !base_url_.empty()) {
+            fragment_url_ = base_url_ + ref;
+            return fragment_url_;
+        }
+        auto it = resolved_.find(ref);
+        if (it != resolved_.end()) return it->second;
+        if (resolved_.size() >= kMaxResolved) resolved_.clear();
+        return resolved_.emplace(ref, html_resolve_url(base_, ref)).first->second;
+    }
+
+    void emit(const char* attr_name, const std::string& value) {
+        std::string ref = html_clean_url(value);
+        if (ref.empty()) return;
+        if (strncasecmp(ref.c_str(), "javascript:", 11) == 0 || strncasecmp(ref.c_str(), "data:", 5) == 0) return;
+
+        HtmlLink link;
+        link.tag = tag_;
+        link.attr = attr_name;
+        link.url = resolve(ref);
+        if (link.url.empty()) return;
+        link.raw = std::move(ref);
+        links_++;
+        on_link_(link);
+    }
+
+    // srcset="a.png 1x, b.png 2x": one URL per candidate
+    void emit_srcset(const std::string& value) {
+        size_t i = 0;
+        while (i < value.size()) {
+            while (i < value.size() && (is_space(value[i]) || value[i] == ',')) i++;
+            size_t start = i;
+            while (i < value.size() && !is_space(value[i])) i++;
+            std::string url = value.substr(start, i - start);
+            while (!url.empty() && url.back() == ',') url.pop_back();
+            if (!url.empty()) emit("srcset", url);
+            while (i < value.size() && value[i] != ',') i++;
+        }
+    }
+
+    // content="5; url=/next"
+    void emit_refresh(const std::string& content) {
+        size_t pos = content.find_first_of(";,");
+        if (pos == std::string::npos) return;
+        pos = content.find_first_not_of(" \t;,", pos);
+        if (pos == std::string::npos) return;
+        if (content.size() - pos > 3 && strncasecmp(content.c_str() + pos, "url", 3) == 0) {
+            size_t eq = content.find_first_not_of(" \t", pos + 3);
+            if (eq != std::string::npos && content[eq] == '=') pos = eq + 1;
+        }
+        std::string target = html_clean_url(content.substr(pos));
+        if (target.size() >= 2 && (target[0] == '\'' || target[0] == '"')) {
+            size_t close = target.find(target[0], 1);
+            target = target.substr(1, close == std::string::npos ? std::string::npos : close - 1);
+        }
+        emit("content", target);
+    }
+
+    void emit_links() {
+        if (!want_tag_ || attrs_.empty()) return;
+        const std::string& t = tag_;
+
+        if (t == "base") {
+            const std::string* href = attr("href");
+            if (href && !base_from_document_) {
+                std::string resolved = html_resolve_url(base_, html_clean_url(*href));
+                if (!resolved.empty()) {
+                    set_base(resolved);
+                    base_from_document_ = true;
+                }
+            }
+            return;
+        }
+        if (t == "meta") {
+            const std::string* equiv = attr("http-equiv");
+            const std::string* content = attr("content");
+            if (equiv && content && strcasecmp(equiv->c_str(), "refresh") == 0) emit_refresh(*content);
+            return;
+        }
+
+        for (const auto& a : attrs_) {
+            const std::string& n = a.name;
+            if (n == "href" && (t == "a" || t == "area" || t == "link")) {
+                emit("href", a.value);
+            } else if (n == "src" && t != "input") {
+                emit("src", a.value);
+            } else if (n == "src" && t == "input") {
+                const std::string* type = attr("type");
+                if (type && strcasecmp(type->c_str(), "image") == 0) emit("src", a.value);
+            } else if (n == "srcset" && (t == "img" || t == "source")) {
+                emit_srcset(a.value);
+            } else if (n == "action" && t == "form") {
+                emit("action", a.value);
+            } else if (n == "formaction" && (t == "button" || t == "input")) {
+                emit("formaction", a.value);
+            } else if (n == "poster" && t == "video") {
+                emit("poster", a.value);
+            } else if (n == "data" && t == "object") {
+                emit("data", a.value);
+            }
+        }
+    }
+
+    LinkFn on_link_;
+    HtmlScanFn scan_;
+    CURLU* base_ = nullptr;
+    bool base_from_document_ = false;
+    std::unordered_map<std::string, std::string> resolved_;
+    std::string base_url_;      // base without its fragment
+    std::string fragment_url_;
+
+    State state_ = State::Data;
+    std::string tag_;
+    bool self_closing_ = false;
+    bool want_tag_ = false;
+    bool want_value_ = false;
+    std::vector<Attr> attrs_;
+    std::string attr_name_;
+    std::string attr_value_;
+    bool has_entity_ = false;
+    bool value_too_long_ = false;
+    char quote_ = '"';
+    int dashes_ = 0;
+    std::string raw_tag_;
+    std::string raw_end_;
+
+    size_t links_ = 0;
+    uint64_t bytes_ = 0;
+};
@@ -0,0 +1,405 @@
+// load.h
+// Load generation for the header tool.
+//
+// Worker threads each drive their own curl_multi, and so their own
+// connection pool, with a pool of reusable DiveTransfer handles. Two modes:
+//
+//   open loop (--rate R):         requests are due at fixed intervals no
+//                                 matter how the server responds. Latency
+//                                 is measured from when a request was due,
+//                                 not from when it was sent, so a stalled
+//                                 server cannot hide its stall by slowing
+//                                 the client down (coordinated omission).
+//   closed loop (--concurrency C): C requests are kept in flight; each
+//                                 completion starts the next one.
+//
+// Every interval the workers' counters and latency histograms are swapped
+// out and printed as one line: throughput, status classes, error classes
+// and percentiles.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <curl/curl.h>
+#include "dive.h"
+#include "repeat.h"
+
+struct LoadOptions {
+    std::string url;
+    double rate = 0;          // requests/sec over all workers, open loop
+    long concurrency = 0;     // requests in flight over all workers, closed loop
+    int threads = 0;          // 0 = one per CPU
+    double duration = 10;     // seconds
+    double interval = 1;      // seconds between report lines
+    long timeout_ms = 10000;  // per request
+    long max_in_flight = 4096;  // per worker, open loop
+    bool invalid = false;     // an option value was rejected
+};
+
+// Whole-string numbers within [min, max]; anything else is rejected
+inline bool load_parse_long(const char* text, long min, long max, long& out) {
+    char* end = nullptr;
+    errno = 0;
+    long n = std::strtol(text, &end, 10);
+    if (end == text || *end || errno == ERANGE || n < min || n > max) return false;
+    out = n;
+    return true;
+}
+
+inline bool load_parse_positive(const char* text, double& out) {
+    char* end = nullptr;
+    errno = 0;
+    double n = std::strtod(text, &end);
+    if (end == text || *end || errno == ERANGE || !std::isfinite(n) || n <= 0) return false;
+    out = n;
+    return true;
+}
+
+// Recognise "--rate", "--concurrency" and their companions. Returns true
+// when load mode was requested. A value that does not parse or is out of
+// range is reported and sets options.invalid; the caller prints usage.
+inline bool parse_load_args(int argc, char* argv[], LoadOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        bool ok = true;
+        long n = 0;
+        if (arg == "--rate" && has_value) {
+            ok = load_parse_positive(argv[++i], options.rate);
+        } else if (arg == "--concurrency" && has_value) {
+            ok = load_parse_long(argv[++i], 1, INT_MAX, options.concurrency);
+        } else if (arg == "--threads" && has_value) {
+            ok = load_parse_long(argv[++i], 0, 1024, n);
+            if (ok) options.threads = int(n);
+        } else if (arg == "--duration" && has_value) {
+            ok = load_parse_positive(argv[++i], options.duration);
+        } else if (arg == "--interval" && has_value) {
+            ok = load_parse_positive(argv[++i], options.interval);
+            options.interval = std::max(0.1, options.interval);
+        } else if (arg == "--timeout" && has_value) {
+            ok = load_parse_long(argv[++i], 1, INT_MAX, options.timeout_ms);
+        } else if (options.url.empty() && arg.compare(0, 2, "--") != 0) {
+            options.url = arg;
+        }
+        if (!ok) {
+            std::cerr << "Invalid " << arg << ": " << argv[i] << "\n";
+            options.invalid = true;
+        }
+    }
+    return (options.rate > 0) != (options.concurrency > 0) && !options.url.empty();
+}
+
+inline void print_load_usage(const char* tool) {
+    std::cerr << "       " << tool << " <url> --rate <req/s> | --concurrency <n>\n"
+              << "            [--threads n] [--duration s] [--interval s] [--timeout ms]\n";
+}
+
+// Error classes reported per interval
+enum LoadError { LOAD_ERR_CONNECT, LOAD_ERR_TLS, LOAD_ERR_TIMEOUT, LOAD_ERR_OTHER, LOAD_ERR_COUNT };
+
+inline LoadError load_error_class(CURLcode code) {
+    switch (code) {
+        case CURLE_COULDNT_RESOLVE_HOST:
+        case CURLE_COULDNT_CONNECT:
+            return LOAD_ERR_CONNECT;
+        case CURLE_SSL_CONNECT_ERROR:
+        case CURLE_PEER_FAILED_VERIFICATION:
+            return LOAD_ERR_TLS;
+        case CURLE_OPERATION_TIMEDOUT:
+            return LOAD_ERR_TIMEOUT;
+        default:
+            return LOAD_ERR_OTHER;
+    }
+}
+
+struct LoadCounters {
+    uint64_t status[6] = {};  // by hundreds: 1xx..5xx, [0] for anything else
+    uint64_t errors[LOAD_ERR_COUNT] = {};
+    LatencyHistogram latency;  // microseconds, successful and failed alike
+
+    uint64_t completed() const {
+        uint64_t n = 0;
+        for (uint64_t s : status) n += s;
+        for (uint64_t e : errors) n += e;
+        return n;
+    }
+
+    void add(const LoadCounters& other) {
+        for (int i = 0; i < 6; i++) status[i] += other.status[i];
+        for (int i = 0; i < LOAD_ERR_COUNT; i++) errors[i] += other.errors[i];
+        latency.add(other.latency);
+    }
+};
+
+class LoadWorker {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // share of the total rate or concurrency; phase offsets this worker's
+    // schedule so workers do not fire in lockstep
+    LoadWorker(const LoadOptions& options, const DiveOptions& dive_options, double rate, long concurrency,
+               Clock::duration phase)
+        : options_(options), dive_options_(dive_options), rate_(rate), concurrency_(concurrency), phase_(phase) {}
+
+    void run(Clock::time_point start, Clock::time_point end, const std::atomic<bool>& stop) {
+        multi_ = curl_multi_init();
+        long pool = concurrency_ > 0 ? concurrency_ : std::min<long>(options_.max_in_flight, long(rate_) + 16);
+        curl_multi_setopt(multi_, CURLMOPT_MAXCONNECTS, pool);
+
+        Clock::duration gap = rate_ > 0 ? std::chrono::duration_cast<Clock::duration>(
+                                               std::chrono::duration<double>(1.0 / rate_))
+                                         : Clock::duration::zero();
+        Clock::time_point next_due = start + phase_;
+
+        while (true) {
+            Clock::time_point now = Clock::now();
+            bool sending = now < end && !stop;
+            if (sending) {
+                if (rate_ > 0) {
+                    // Every request that has come due is queued with its
+                    // due time, whether or not a handle is free for it
+                    for (; next_due <= now && next_due < end; next_due += gap) due_.push_back(next_due);
+                } else {
+                    for (long n = in_flight_ + long(due_.size()); n < concurrency_; n++) due_.push_back(now);
+                }
+                while (!due_.empty() && launch(due_.front())) due_.pop_front();
+            } else if (in_flight_ == 0) {
+                break;
+            }
+
+            int running = 0;
+            curl_multi_perform(multi_, &running);
+            collect();
+
+            int timeout = 100;
+            if (sending && rate_ > 0) {
+                auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next_due - Clock::now()).count();
+                timeout = int(std::max<long long>(0, std::min<long long>(timeout, wait)));
+            }
+            if (in_flight_ > 0 || timeout > 0) curl_multi_poll(multi_, nullptr, 0, timeout, nullptr);
+        }
+
+        // Requests that came due but never got a handle
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            unsent_ += due_.size();
+        }
+        due_.clear();
+        for (auto& slot : slots_) curl_multi_remove_handle(multi_, slot->transfer->handle());
+        curl_multi_cleanup(multi_);
+    }
+
+    // Counters since the last call, for the interval report
+    LoadCounters take() {
+        LoadCounters out;
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::swap(out, interval_);
+        return out;
+    }
+
+    uint64_t unsent() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return unsent_;
+    }
+
+private:
+    struct Slot {
+        std::unique_ptr<DiveTransfer> transfer;
+        Clock::time_point due;
+    };
+
+    // Start a request due at the given time. False when every handle is
+    // busy and the pool is at its limit.
+    bool launch(Clock::time_point due) {
+        Slot* slot = nullptr;
+        if (!free_.empty()) {
+            slot = free_.back();
+            free_.pop_back();
+            slot->transfer->reset_result();
+        } else if (long(slots_.size()) < (concurrency_ > 0 ? concurrency_ : options_.max_in_flight)) {
+            slots_.emplace_back(new Slot{std::unique_ptr<DiveTransfer>(new DiveTransfer(options_.url, dive_options_)),
+                                         due});
+            slot = slots_.back().get();
+            CURL* handle = slot->transfer->handle();
+            curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS, options_.timeout_ms);
+            by_transfer_[slot->transfer.get()] = slot;
+        } else {
+            return false;
+        }
+        slot->due = due;
+        curl_multi_add_handle(multi_, slot->transfer->handle());
+        in_flight_++;
+        return true;
+    }
+
+    void collect() {
+        int pending = 0;
+        while (CURLMsg* msg = curl_multi_info_read(multi_, &pending)) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            Clock::time_point done = Clock::now();
+            DiveTransfer* transfer = nullptr;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &transfer);
+            CURLcode code = msg->data.result;
+            curl_multi_remove_handle(multi_, msg->easy_handle);
+            in_flight_--;
+
+            Slot* slot = by_transfer_[transfer];
+            long status = 0;
+            if (code == CURLE_OK) curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &status);
+            int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(done - slot->due).count();
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (code != CURLE_OK) {
+                    interval_.errors[load_error_class(code)]++;
+                } else {
+                    interval_.status[status >= 100 && status < 600 ? status / 100 : 0]++;
+                }
+                interval_.latency.record(us);
+            }
+            free_.push_back(slot);
+        }
+    }
+
+    LoadOptions options_;
+    DiveOptions dive_options_;
+    double rate_;
+    long concurrency_;
+    Clock::duration phase_;
+
+    CURLM* multi_ = nullptr;
+    std::vector<std::unique_ptr<Slot>> slots_;
+    std::vector<Slot*> free_;
+    std::unordered_map<DiveTransfer*, Slot*> by_transfer_;
+    std::deque<Clock::time_point> due_;
+    long in_flight_ = 0;
+
+    std::mutex mutex_;  // guards what take() and unsent() read
+    LoadCounters interval_;
+    uint64_t unsent_ = 0;
+};
+
+class LoadGenerator {
+public:
+    LoadGenerator(const LoadOptions& options, const DiveOptions& dive_options)
+        : options_(options), dive_options_(dive_options) {
+        // Only the status code is needed; headers are not even parsed
+        dive_options_.keep_body = false;
+        dive_options_.keep_headers = false;
+        dive_options_.debug_events = false;
+        dive_options_.verbose = false;
+        dive_options_.tls_info = false;
+        dive_options_.certinfo = false;
+        if (options_.threads <= 0) options_.threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Returns the process exit status
+    int run(const std::atomic<bool>& stop) {
+        int n = options_.threads;
+        using Clock = LoadWorker::Clock;
+        for (int i = 0; i < n; i++) {
+            double rate = options_.rate / n;
+            long concurrency = options_.concurrency / n + (i < options_.concurrency % n ? 1 : 0);
+            auto phase = std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(options_.rate > 0 ? i / options_.rate : 0));
+            workers_.emplace_back(new LoadWorker(options_, dive_options_, rate, concurrency, phase));
+        }
+
+        std::cout << "[Load] " << options_.url << ": ";
+        if (options_.rate > 0) {
+            std::cout << "open loop at " << options_.rate << " req/s";
+        } else {
+            std::cout << "closed loop with " << options_.concurrency << " in flight";
+        }
+        std::cout << ", " << n << " threads, " << options_.duration << "s\n";
+
+        Clock::time_point start = Clock::now();
+        Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(
+                                            std::chrono::duration<double>(options_.duration));
+        std::vector<std::thread> threads;
+        std::atomic<int> running{n};
+        for (auto& worker : workers_) {
+            threads.emplace_back([&, w = worker.get()] {
+                w->run(start, end, stop);
+                running--;
+            });
+        }
+
+        auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options_.interval));
+        Clock::time_point last = start;
+        LoadCounters total;
+        while (running > 0) {
+            Clock::time_point next = last + interval;
+            while (running > 0 && Clock::now() < next) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            Clock::time_point now = Clock::now();
+            LoadCounters counters;
+            for (auto& worker : workers_) counters.add(worker->take());
+            if (counters.completed() > 0 || running > 0) {
+                print_line(std::chrono::duration<double>(now - start).count(),
+                           std::chrono::duration<double>(now - last).count(), counters);
+            }
+            total.add(counters);
+            last = now;
+        }
+        for (auto& t : threads) t.join();
+
+        uint64_t unsent = 0;
+        for (auto& worker : workers_) unsent += worker->unsent();
+        std::cout << "[Load] total";
+        print_line(-1, std::chrono::duration<double>(last - start).count(), total);
+        if (unsent) std::cout << "[Load] " << unsent << " requests came due but found no free handle\n";
+        uint64_t errors = 0;
+        for (uint64_t e : total.errors) errors += e;
+        return total.completed() > 0 && errors < total.completed() ? 0 : 1;
+    }
+
+private:
+    static std::string ms(int64_t us) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.2f", us / 1000.0);
+        return buf;
+    }
+
+    // One report line; at < 0 for the totals line
+    static void print_line(double at, double seconds, const LoadCounters& c) {
+        std::cout << (at >= 0 ? "[Load] " : " ");
+        if (at >= 0) std::cout << std::fixed << std::setprecision(1) << std::setw(6) << at << "s";
+        uint64_t done = c.completed();
+        std::cout << std::fixed << std::setprecision(1) << " " << std::setw(9) << (seconds > 0 ? done / seconds : 0)
+                  << " req/s |";
+        for (int i = 1; i <= 5; i++) {
+            if (c.status[i]) std::cout << " " << i << "xx=" << c.status[i];
+        }
+        if (c.status[0]) std::cout << " other=" << c.status[0];
+        static const char* names[LOAD_ERR_COUNT] = {"connect", "tls", "timeout", "error"};
+        for (int i = 0; i < LOAD_ERR_COUNT; i++) {
+            if (c.errors[i]) std::cout << " " << names[i] << "=" << c.errors[i];
+        }
+        std::cout << " |";
+        if (done > 0) {
+            std::cout << " p50 " << ms(c.latency.percentile(50)) << " p90 " << ms(c.latency.percentile(90))
+                      << " p99 " << ms(c.latency.percentile(99)) << " p99.9 " << ms(c.latency.percentile(99.9))
+                      << " max " << ms(c.latency.max()) << " ms";
+        }
+        std::cout << "\n";
+        std::cout.unsetf(std::ios::fixed);
+    }
+
+    LoadOptions options_;
+    DiveOptions dive_options_;
+    std::vector<std::unique_ptr<LoadWorker>> workers_;
+};
@@ -0,0 +1,409 @@
+// multiplex.h
+// Many paths on one origin, fetched as concurrent HTTP/2 streams over a
+// single connection.
+//
+// The paths (from a list, or the same-origin links of a page) are fetched
+// twice, each time on a fresh connection pool and without TLS session
+// resumption:
+//
+//   HTTP/2:   one connection (CURLPIPE_MULTIPLEX, CURLOPT_PIPEWAIT), at
+//             most --streams streams open at a time
+//   HTTP/1.1: up to --h1-connections parallel connections, one request at
+//             a time on each, the way a browser fetches
+//
+// Every stream is timed from the start of its run: when its request went
+// out and when its first response byte came in (stamped in the debug
+// callback, as curl's own timers restart for a queued transfer), and its
+// end. A request that went out well after the connection was ready was
+// queued behind others (a busy HTTP/1.1 connection, or the stream limit);
+// a long wait for the first byte on a shared connection is head-of-line
+// blocking below HTTP.
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include <curl/curl.h>
+#include "dive.h"
+#include "html_links.h"
+
+struct MultiplexOptions {
+    std::string url;             // the origin, and the page whose links are fetched without --multiplex <file>
+    std::string source;          // file or "-" with one path or same-origin URL per line
+    long streams = 100;          // concurrent HTTP/2 streams
+    long h1_connections = 6;     // parallel HTTP/1.1 connections
+    bool compare = true;         // also run over HTTP/1.1
+    bool per_stream = true;      // one line per stream
+};
+
+// Recognise "--multiplex [file|-]" and its companions. Returns true when
+// multiplex mode was requested.
+inline bool parse_multiplex_args(int argc, char* argv[], MultiplexOptions& options) {
+    bool multiplex = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--multiplex") {
+            multiplex = true;
+            if (has_value && (argv[i + 1][0] != '-' || strcmp(argv[i + 1], "-") == 0) && !strstr(argv[i + 1], "://")) {
+                options.source = argv[++i];
+            }
+        } else if (arg == "--streams" && has_value) {
+            options.streams = std::max(1L, std::strtol(argv[++i], nullptr, 10));
+        } else if (arg == "--h1-connections" && has_value) {
+            options.h1_connections = std::max(1L, std::strtol(argv[++i], nullptr, 10));
+        } else if (arg == "--h2-only") {
+            options.compare = false;
+        } else if (arg == "--summary") {
+            options.per_stream = false;
+        } else if (options.url.empty() && arg.compare(0, 2, "--") != 0) {
+            options.url = arg;
+        }
+    }
+    return multiplex && !options.url.empty();
+}
+
+inline void print_multiplex_usage(const char* tool) {
+    std::cerr << "       " << tool << " <url> --multiplex [paths-file|-] [--streams n] [--h1-connections n]\n"
+              << "            [--h2-only] [--summary]   (without a file: the page's same-origin links)\n";
+}
+
+// "scheme://host:port" of url, lower case; empty if it does not parse
+inline std::string multiplex_origin(const std::string& url) {
+    CURLU* u = curl_url();
+    std::string out;
+    char* scheme = nullptr;
+    char* host = nullptr;
+    char* port = nullptr;
+    if (curl_url_set(u, CURLUPART_URL, url.c_str(), 0) == CURLUE_OK &&
+        curl_url_get(u, CURLUPART_SCHEME, &scheme, 0) == CURLUE_OK &&
+        curl_url_get(u, CURLUPART_HOST, &host, 0) == CURLUE_OK &&
+        curl_url_get(u, CURLUPART_PORT, &port, CURLU_DEFAULT_PORT) == CURLUE_OK) {
+        out = std::string(scheme) + "://" + host + ":" + port;
+        std::transform(out.begin(), out.end(), out.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+    }
+    curl_free(scheme);
+    curl_free(host);
+    curl_free(port);
+    curl_url_cleanup(u);
+    return out;
+}
+
+// Absolute URL of ref against base, without its fragment; empty if it
+// does not parse
+inline std::string multiplex_resolve(const std::string& base, const std::string& ref) {
+    CURLU* u = curl_url();
+    std::string out;
+    char* full = nullptr;
+    if (curl_url_set(u, CURLUPART_URL, base.c_str(), 0) == CURLUE_OK &&
+        curl_url_set(u, CURLUPART_URL, ref.c_str(), 0) == CURLUE_OK &&
+        curl_url_set(u, CURLUPART_FRAGMENT, nullptr, 0) == CURLUE_OK &&
+        curl_url_get(u, CURLUPART_URL, &full, 0) == CURLUE_OK) {
+        out = full;
+    }
+    curl_free(full);
+    curl_url_cleanup(u);
+    return out;
+}
+
+struct MultiplexStream {
+    DiveResult result;
+    double sent_ms = 0;        // request on the wire, from the start of the run
+    double first_byte_ms = 0;
+    double done_ms = 0;
+};
+
+struct MultiplexRun {
+    std::string name;
+    std::vector<MultiplexStream> streams;
+    double wall_ms = 0;
+    long connections = 0;
+    long http_version = 0;     // negotiated by the first successful stream
+    size_t failed = 0;
+    curl_off_t bytes = 0;
+};
+
+class MultiplexProbe {
+public:
+    explicit MultiplexProbe(const MultiplexOptions& options) : options_(options) {}
+
+    int run() {
+        origin_ = multiplex_origin(options_.url);
+        if (origin_.empty()) {
+            std::cerr << "Not a URL: " << options_.url << "\n";
+            return 1;
+        }
+        if (!collect_urls()) return 1;
+        if (urls_.empty()) {
+            std::cerr << "[Multiplex] no same-origin paths to fetch\n";
+            return 1;
+        }
+        std::cout << "[Multiplex] " << urls_.size() << " paths on " << origin_;
+        if (skipped_ > 0) std::cout << " (" << skipped_ << " on other origins skipped)";
+        std::cout << "\n";
+
+        MultiplexRun h2 = fetch("HTTP/2", true);
+        print_run(h2);
+        if (h2.http_version != CURL_HTTP_VERSION_2_0 && h2.failed < h2.streams.size()) {
+            std::cout << "[Multiplex] the server did not negotiate HTTP/2 (got " << version_name(h2.http_version)
+                      << "), so nothing was multiplexed\n";
+        }
+        if (options_.compare) {
+            MultiplexRun h1 = fetch("HTTP/1.1", false);
+            print_run(h1);
+            print_comparison(h2, h1);
+        }
+        return h2.failed == 0 ? 0 : 1;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    bool add_url(const std::string& line) {
+        std::string url = multiplex_resolve(options_.url, line);
+        if (url.empty() || multiplex_origin(url) != origin_) {
+            skipped_++;
+            return false;
+        }
+        if (seen_.insert(url).second) urls_.push_back(url);
+        return true;
+    }
+
+    bool collect_urls() {
+        if (options_.source.empty()) return collect_links();
+
+        std::ifstream file;
+        std::istream* in = &std::cin;
+        if (options_.source != "-") {
+            file.open(options_.source);
+            if (!file) {
+                std::cerr << "Failed to open path list: " << options_.source << "\n";
+                return false;
+            }
+            in = &file;
+        }
+        std::string line;
+        while (std::getline(*in, line)) {
+            size_t start = line.find_first_not_of(" \t\r");
+            if (start == std::string::npos || line[start] == '#') continue;
+            size_t end = line.find_last_not_of(" \t\r");
+            add_url(line.substr(start, end - start + 1));
+        }
+        return true;
+    }
+
+    // Same-origin links of the page, tokenized as the body streams in
+    bool collect_links() {
+        DiveOptions options;
+        options.keep_body = false;
+        options.debug_events = false;
+        options.tls_info = false;
+        options.certinfo = false;
+        const DiveResult* live = nullptr;
+        HtmlLinkExtractor extractor([&](const HtmlLink& link) { add_url(link.url); });
+        options.on_body = [&](const char* data, size_t size) {
+            if (extractor.bytes() == 0) extractor.set_base(live->effective_url);
+            extractor.feed(data, size);
+            return true;
+        };
+        DiveTransfer transfer(options_.url, options);
+        live = &transfer.result;
+        transfer.perform();
+        if (!transfer.result.ok()) {
+            std::cerr << "Failed to fetch " << options_.url << ": " << transfer.result.error() << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // One pass over every URL on a fresh multi handle, so a fresh pool
+    MultiplexRun fetch(const char* name, bool multiplex) {
+        MultiplexRun run;
+        run.name = name;
+
+        DiveOptions options;
+        options.follow_redirects = false;
+        options.keep_body = false;
+        options.debug_events = true;  // only for the on_debug_data stamps below
+        options.tls_info = false;
+        options.certinfo = false;
+        options.http_version = multiplex ? CURL_HTTP_VERSION_2TLS : CURL_HTTP_VERSION_1_1;
+        options.pipewait = multiplex;
+
+        CURLM* multi = curl_multi_init();
+        if (multiplex) {
+            curl_multi_setopt(multi, CURLMOPT_PIPELINING, long(CURLPIPE_MULTIPLEX));
+            curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, 1L);
+            curl_multi_setopt(multi, CURLMOPT_MAX_CONCURRENT_STREAMS, options_.streams);
+        } else {
+            curl_multi_setopt(multi, CURLMOPT_PIPELINING, long(CURLPIPE_NOTHING));
+            curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, options_.h1_connections);
+        }
+        // HTTP/1.1 requests queue inside curl for a free connection; HTTP/2
+        // ones are held back here so no more than --streams are open
+        size_t limit = multiplex ? size_t(options_.streams) : urls_.size();
+
+        struct Slot {
+            std::unique_ptr<DiveTransfer> transfer;
+            size_t index;
+        };
+        std::vector<Slot> slots;
+        run.streams.resize(urls_.size());
+        size_t next = 0;
+        size_t in_flight = 0;
+        auto start = Clock::now();
+        auto since = [&](Clock::time_point t) { return std::chrono::duration<double, std::milli>(t - start).count(); };
+
+        while (next < urls_.size() || in_flight > 0) {
+            while (next < urls_.size() && in_flight < limit) {
+                MultiplexStream& stream = run.streams[next];
+                options.on_debug_data = [&stream, since](curl_infotype type, const char*, size_t) {
+                    if (type == CURLINFO_HEADER_OUT && stream.sent_ms == 0) stream.sent_ms = since(Clock::now());
+                    if (type == CURLINFO_HEADER_IN && stream.first_byte_ms == 0) stream.first_byte_ms = since(Clock::now());
+                };
+                Slot slot{std::unique_ptr<DiveTransfer>(new DiveTransfer(urls_[next], options)), next};
+                next++;
+                if (!slot.transfer->handle() || curl_multi_add_handle(multi, slot.transfer->handle()) != CURLM_OK) {
+                    slot.transfer->result.code = CURLE_FAILED_INIT;
+                    run.streams[slot.index].result = slot.transfer->result;
+                    continue;
+                }
+                slot.transfer->result.started = std::chrono::system_clock::now();
+                slots.push_back(std::move(slot));
+                in_flight++;
+            }
+
+            int running = 0;
+            curl_multi_perform(multi, &running);
+            int pending = 0;
+            while (CURLMsg* msg = curl_multi_info_read(multi, &pending)) {
+                if (msg->msg != CURLMSG_DONE) continue;
+                auto it = std::find_if(slots.begin(), slots.end(),
+                                       [&](const Slot& s) { return s.transfer->handle() == msg->easy_handle; });
+                if (it == slots.end()) continue;
+                CURLcode code = msg->data.result;
+                curl_multi_remove_handle(multi, msg->easy_handle);
+                it->transfer->finish(code);
+
+                MultiplexStream& stream = run.streams[it->index];
+                stream.result = std::move(it->transfer->result);
+                stream.done_ms = since(Clock::now());
+                slots.erase(it);
+                in_flight--;
+            }
+            if (in_flight > 0) curl_multi_poll(multi, nullptr, 0, 100, nullptr);
+        }
+        run.wall_ms = since(Clock::now());
+        curl_multi_cleanup(multi);
+
+        for (const MultiplexStream& s : run.streams) {
+            run.connections += s.result.new_connections;
+            run.bytes += s.result.download_bytes;
+            if (!s.result.ok()) {
+                run.failed++;
+            } else if (!run.http_version) {
+                run.http_version = s.result.http_version;
+            }
+        }
+        return run;
+    }
+
+    static const char* version_name(long version) {
+        switch (version) {
+            case CURL_HTTP_VERSION_1_0: return "HTTP/1.0";
+            case CURL_HTTP_VERSION_1_1: return "HTTP/1.1";
+            case CURL_HTTP_VERSION_2_0: return "HTTP/2";
+            case CURL_HTTP_VERSION_3: return "HTTP/3";
+            default: return "none";
+        }
+    }
+
+    static std::string ms(double v) {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(v < 10 ? 2 : 1) << v << "ms";
+        return out.str();
+    }
+
+    static double percentile(std::vector<double> values, double p) {
+        if (values.empty()) return 0;
+        size_t k = std::min(values.size() - 1, size_t(p * double(values.size())));
+        std::nth_element(values.begin(), values.begin() + long(k), values.end());
+        return values[k];
+    }
+
+    static std::string spread(const std::vector<double>& values) {
+        return "p50 " + ms(percentile(values, 0.50)) + " p90 " + ms(percentile(values, 0.90)) + " max " +
+               ms(values.empty() ? 0 : *std::max_element(values.begin(), values.end()));
+    }
+
+    void print_run(const MultiplexRun& run) {
+        // The first request goes out as soon as a connection is up; one
+        // sent later than that waited for a free connection or stream
+        double ready = -1;
+        for (const MultiplexStream& s : run.streams) {
+            if (s.result.ok() && (ready < 0 || s.sent_ms < ready)) ready = s.sent_ms;
+        }
+        if (ready < 0) ready = 0;
+
+        std::vector<double> queued, ttfb, total;
+        size_t waited = 0;
+        for (size_t i = 0; i < run.streams.size(); i++) {
+            const MultiplexStream& s = run.streams[i];
+            if (!s.result.ok()) {
+                if (options_.per_stream) {
+                    std::cout << "[Stream] " << run.name << " #" << i + 1 << " error: " << s.result.error() << "  "
+                              << s.result.url << "\n";
+                }
+                continue;
+            }
+            double queue = std::max(0.0, s.sent_ms - ready);
+            if (queue > 1.0) waited++;
+            queued.push_back(queue);
+            ttfb.push_back(s.first_byte_ms - s.sent_ms);
+            total.push_back(s.done_ms);
+            if (options_.per_stream) {
+                std::cout << "[Stream] " << run.name << " #" << i + 1 << " " << s.result.response_code << "  sent +"
+                          << ms(s.sent_ms) << "  ttfb " << ms(s.first_byte_ms - s.sent_ms) << "  done +" << ms(s.done_ms)
+                          << "  " << s.result.download_bytes << " B  "
+                          << (s.result.new_connections ? "new connection  " : "") << s.result.url << "\n";
+            }
+        }
+
+        bool tls = origin_.compare(0, 8, "https://") == 0;
+        std::cout << "[Multiplex] " << run.name << ": " << run.streams.size() << " requests over " << run.connections
+                  << (run.connections == 1 ? " connection" : " connections");
+        if (tls) std::cout << " (" << run.connections << (run.connections == 1 ? " TLS handshake)" : " TLS handshakes)");
+        std::cout << ", negotiated " << version_name(run.http_version) << ", " << run.failed << " failed, "
+                  << run.bytes << " bytes in " << ms(run.wall_ms) << ", connection ready at +" << ms(ready) << "\n";
+        std::cout << "[Multiplex] " << run.name << ": " << waited << " requests queued behind others (queue "
+                  << spread(queued) << "); ttfb " << spread(ttfb) << "; done " << spread(total) << "\n";
+    }
+
+    void print_comparison(const MultiplexRun& h2, const MultiplexRun& h1) {
+        std::cout << "[Multiplex] HTTP/2 vs HTTP/1.1: " << h2.connections << " vs " << h1.connections << " connections, "
+                  << ms(h2.wall_ms) << " vs " << ms(h1.wall_ms);
+        if (h2.wall_ms > 0) {
+            std::cout << " (" << std::fixed << std::setprecision(2) << h1.wall_ms / h2.wall_ms << "x)";
+            std::cout.unsetf(std::ios::fixed);
+        }
+        std::cout << "\n";
+    }
+
+    MultiplexOptions options_;
+    std::string origin_;
+    std::vector<std::string> urls_;
+    std::unordered_set<std::string> seen_;
+    size_t skipped_ = 0;
+};
+
+inline int run_multiplex(const MultiplexOptions& options) { return MultiplexProbe(options).run(); }
@@ -0,0 +1,151 @@
+// output_spill.h
+// Append-only spill file for tool output too large to keep in a widget.
+//
+// Output is written to an unlinked temporary file as it arrives, and the
+// offset of every line start is recorded as it goes. Any line can be read
+// back without a scan, and a search hit maps to its line with a binary
+// search of the index. The GUI keeps only a window of lines in its text
+// buffer and reads the rest from here.
+//
+// Lines end at '\n' only. When no temporary file can be created, or it
+// can no longer be written (a full disk), the output is kept in memory.
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unistd.h>
+
+class OutputSpill {
+public:
+    static constexpr uint64_t npos = ~uint64_t(0);
+    static constexpr size_t kSearchBlock = 1 << 20;
+
+    OutputSpill() {
+        const char* dir = getenv("TMPDIR");
+        std::string path = std::string(dir && *dir ? dir : "/tmp") + "/webdive-output-XXXXXX";
+        fd_ = mkstemp(&path[0]);
+        if (fd_ >= 0) unlink(path.c_str());
+        line_starts_.push_back(0);
+    }
+
+    ~OutputSpill() {
+        if (fd_ >= 0) close(fd_);
+    }
+
+    OutputSpill(const OutputSpill&) = delete;
+    OutputSpill& operator=(const OutputSpill&) = delete;
+
+    // Append text and index its line starts
+    void append(const char* data, size_t len) {
+        if (len == 0) return;
+        if (fd_ >= 0 && !write_file(data, len)) move_to_memory();
+        if (fd_ < 0) memory_.append(data, len);
+        for (const char* p = data; (p = static_cast<const char*>(memchr(p, '\n', len - (p - data)))); p++) {
+            line_starts_.push_back(size_ + uint64_t(p - data) + 1);
+        }
+        size_ += len;
+    }
+
+    uint64_t size() const { return size_; }
+
+    // Lines, counting the (possibly empty) one after the last '\n'
+    uint64_t lines() const { return line_starts_.size(); }
+
+    uint64_t line_start(uint64_t line) const { return line < lines() ? line_starts_[line] : size_; }
+
+    // Line containing the byte at offset
+    uint64_t line_of(uint64_t offset) const {
+        return uint64_t(std::upper_bound(line_starts_.begin(), line_starts_.end(), offset) - line_starts_.begin()) - 1;
+    }
+
+    // First line starting at or after offset (lines() when there is none)
+    uint64_t line_at_or_after(uint64_t offset) const {
+        return uint64_t(std::lower_bound(line_starts_.begin(), line_starts_.end(), offset) - line_starts_.begin());
+    }
+
+    // Bytes [offset, offset + len), clipped to the end of the spill
+    bool read(uint64_t offset, size_t len, std::string& out) const {
+        out.clear();
+        if (offset >= size_) return true;
+        len = size_t(std::min<uint64_t>(len, size_ - offset));
+        if (fd_ < 0) {
+            out.assign(memory_, size_t(offset), len);
+            return true;
+        }
+        out.resize(len);
+        size_t done = 0;
+        while (done < len) {
+            ssize_t n = pread(fd_, &out[done], len - done, off_t(offset + done));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                out.resize(done);
+                return false;
+            }
+            done += size_t(n);
+        }
+        return true;
+    }
+
+    // Offset of the first match of query starting in [from, to), ASCII
+    // letters compared without case; npos when there is none. The range is
+    // read in blocks that overlap by the query length, so matches across a
+    // block boundary (or running past to) are found too. A caller that must
+    // not block searches a large spill a range at a time.
+    uint64_t find(std::string_view query, uint64_t from, uint64_t to = npos) const {
+        to = std::min(to, size_);
+        if (query.empty() || from >= to) return npos;
+        std::string needle(query);
+        fold(&needle[0], needle.size());
+        std::boyer_moore_horspool_searcher<std::string::const_iterator> searcher(needle.begin(), needle.end());
+
+        std::string block;
+        for (uint64_t offset = from; offset < to;) {
+            size_t step = size_t(std::min<uint64_t>(kSearchBlock, to - offset));
+            if (!read(offset, step + needle.size() - 1, block)) return npos;
+            fold(&block[0], block.size());
+            auto it = std::search(block.cbegin(), block.cend(), searcher);
+            if (it != block.cend() && size_t(it - block.cbegin()) < step) return offset + uint64_t(it - block.cbegin());
+            offset += step;
+        }
+        return npos;
+    }
+
+private:
+    bool write_file(const char* data, size_t len) {
+        size_t done = 0;
+        while (done < len) {
+            ssize_t n = pwrite(fd_, data + done, len - done, off_t(size_ + done));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            done += size_t(n);
+        }
+        return true;
+    }
+
+    void move_to_memory() {
+        std::string all;
+        read(0, size_t(size_), all);
+        all.resize(size_t(size_), '?');  // keep offsets valid if the file cannot be read back either
+        close(fd_);
+        fd_ = -1;
+        memory_.swap(all);
+    }
+
+    static void fold(char* p, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            if (p[i] >= 'A' && p[i] <= 'Z') p[i] = char(p[i] - 'A' + 'a');
+        }
+    }
+
+    int fd_ = -1;
+    std::string memory_;  // without a temporary file
+    uint64_t size_ = 0;
+    std::vector<uint64_t> line_starts_;
+};
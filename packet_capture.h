@@ -0,0 +1,381 @@
+// packet_capture.h
+// Capture of one TCP peer's traffic with an AF_PACKET TPACKET_V3 ring.
+//
+// The kernel writes packets straight into a ring of blocks shared with us
+// through mmap; a classic BPF filter attached to the socket keeps only TCP
+// packets to or from the peer addresses (IPv4, or IPv6 without extension
+// headers), truncated to the headers, so the ring is never filled with
+// unrelated traffic. The capture thread
+// parses each packet in place and appends a fixed-size CapturedPacket to a
+// preallocated array: no copies of packet data and no allocation per
+// packet. Needs CAP_NET_RAW.
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <linux/filter.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// TCP flag bits as in the TCP header
+enum : uint8_t {
+    TCP_FLAG_FIN = 0x01,
+    TCP_FLAG_SYN = 0x02,
+    TCP_FLAG_RST = 0x04,
+    TCP_FLAG_PSH = 0x08,
+    TCP_FLAG_ACK = 0x10,
+};
+
+// One captured segment, summarised from its headers
+struct CapturedPacket {
+    int64_t ts_ns;        // kernel receive/transmit time, CLOCK_REALTIME
+    uint8_t src_ip[16];   // network byte order; an IPv4 address fills the first 4 bytes
+    uint8_t dst_ip[16];
+    uint16_t src_port;    // host byte order
+    uint16_t dst_port;
+    uint32_t seq;
+    uint32_t ack;
+    uint32_t wire_len;    // length on the wire
+    uint16_t payload;     // TCP payload bytes
+    uint8_t flags;        // TCP_FLAG_*
+    uint8_t tls_type;     // first TLS record: content type (20-23), 0 if none
+    uint8_t tls_handshake;  // handshake message type when tls_type == 22
+    uint8_t ifindex_loopback;
+    uint8_t ipv6;         // src_ip and dst_ip are IPv6 addresses
+};
+
+inline std::string tcp_flags_string(uint8_t flags) {
+    std::string out;
+    if (flags & TCP_FLAG_SYN) out += 'S';
+    if (flags & TCP_FLAG_FIN) out += 'F';
+    if (flags & TCP_FLAG_RST) out += 'R';
+    if (flags & TCP_FLAG_PSH) out += 'P';
+    if (flags & TCP_FLAG_ACK) out += '.';
+    return out;
+}
+
+// Name of the first TLS record in a segment, "" if it does not start one
+inline std::string tls_record_name(uint8_t type, uint8_t handshake) {
+    switch (type) {
+        case 20: return "TLS ChangeCipherSpec";
+        case 21: return "TLS Alert";
+        case 23: return "TLS ApplicationData";
+        case 22: break;
+        default: return "";
+    }
+    switch (handshake) {
+        case 1: return "TLS ClientHello";
+        case 2: return "TLS ServerHello";
+        case 4: return "TLS NewSessionTicket";
+        case 8: return "TLS EncryptedExtensions";
+        case 11: return "TLS Certificate";
+        case 12: return "TLS ServerKeyExchange";
+        case 13: return "TLS CertificateRequest";
+        case 14: return "TLS ServerHelloDone";
+        case 15: return "TLS CertificateVerify";
+        case 16: return "TLS ClientKeyExchange";
+        case 20: return "TLS Finished";
+        default: return "TLS Handshake (encrypted)";
+    }
+}
+
+class PacketCapture {
+public:
+    struct Stats {
+        uint64_t kernel_packets = 0;  // passed the filter
+        uint64_t kernel_drops = 0;    // ring was full
+        uint64_t not_recorded = 0;    // record array was full
+    };
+
+    static constexpr unsigned kBlockSize = 1 << 20;
+    static constexpr unsigned kBlockCount = 32;
+    static constexpr unsigned kFrameSize = 2048;
+    static constexpr unsigned kSnapLen = 256;  // IP + TCP headers + a TLS record header
+
+    // peers are IPv4 and IPv6 addresses of one host (every address a
+    // connection race may try); port is the peer's TCP port
+    PacketCapture(const std::vector<std::string>& peers, uint16_t port, size_t max_packets = 1 << 18)
+        : port_(port) {
+        packets_.reserve(max_packets);
+        for (const std::string& ip : peers) {
+            Peer peer;
+            peer.family = ip.find(':') != std::string::npos ? AF_INET6 : AF_INET;
+            if (inet_pton(peer.family, ip.c_str(), peer.address) != 1) {
+                error_ = "not an IP address: " + ip;
+                return;
+            }
+            peers_.push_back(peer);
+        }
+        if (peers_.empty()) {
+            error_ = "no address to capture";
+            return;
+        }
+        if (!open_ring()) close_ring();
+    }
+
+    ~PacketCapture() {
+        stop();
+        close_ring();
+    }
+
+    PacketCapture(const PacketCapture&) = delete;
+    PacketCapture& operator=(const PacketCapture&) = delete;
+
+    bool ok() const { return ring_ != nullptr; }
+    const std::string& error() const { return error_; }
+
+    void start() {
+        if (!ok() || thread_.joinable()) return;
+        running_ = true;
+        thread_ = std::thread([this] { loop(); });
+    }
+
+    // Stop after draining what the kernel has already put in the ring
+    void stop() {
+        if (!thread_.joinable()) return;
+        running_ = false;
+        thread_.join();
+
+        tpacket_stats_v3 st{};
+        socklen_t len = sizeof(st);
+        if (getsockopt(fd_, SOL_PACKET, PACKET_STATISTICS, &st, &len) == 0) {
+            stats_.kernel_packets += st.tp_packets;
+            stats_.kernel_drops += st.tp_drops;
+        }
+    }
+
+    // Valid once stop() has returned
+    const std::vector<CapturedPacket>& packets() const { return packets_; }
+    const Stats& stats() const { return stats_; }
+    uint16_t port() const { return port_; }
+
+private:
+    bool open_ring() {
+        fd_ = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, htons(ETH_P_ALL));
+        if (fd_ < 0) {
+            error_ = std::string("AF_PACKET socket: ") + strerror(errno);
+            return false;
+        }
+
+        std::vector<sock_filter> code = peer_filter();
+        sock_fprog prog{static_cast<unsigned short>(code.size()), code.data()};
+        if (setsockopt(fd_, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) != 0) {
+            error_ = std::string("SO_ATTACH_FILTER: ") + strerror(errno);
+            return false;
+        }
+
+        int version = TPACKET_V3;
+        if (setsockopt(fd_, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) != 0) {
+            error_ = std::string("TPACKET_V3: ") + strerror(errno);
+            return false;
+        }
+
+        tpacket_req3 req{};
+        req.tp_block_size = kBlockSize;
+        req.tp_block_nr = kBlockCount;
+        req.tp_frame_size = kFrameSize;
+        req.tp_frame_nr = (kBlockSize / kFrameSize) * kBlockCount;
+        req.tp_retire_blk_tov = 10;  // ms before a partly filled block is handed over
+        if (setsockopt(fd_, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) != 0) {
+            error_ = std::string("PACKET_RX_RING: ") + strerror(errno);
+            return false;
+        }
+
+        void* map = mmap(nullptr, size_t(kBlockSize) * kBlockCount, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_LOCKED, fd_, 0);
+        if (map == MAP_FAILED) {
+            map = mmap(nullptr, size_t(kBlockSize) * kBlockCount, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        }
+        if (map == MAP_FAILED) {
+            error_ = std::string("mmap ring: ") + strerror(errno);
+            return false;
+        }
+        ring_ = static_cast<uint8_t*>(map);
+
+        sockaddr_ll addr{};
+        addr.sll_family = AF_PACKET;
+        addr.sll_protocol = htons(ETH_P_ALL);
+        addr.sll_ifindex = 0;  // every interface; the filter picks the flow
+        if (bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            error_ = std::string("bind: ") + strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+    // Keep TCP packets whose source or destination is one of the peers.
+    // Offsets relative to the network header work on any link type,
+    // including loopback. The IP version picks the list of that family's
+    // peers; each address is compared a word at a time (one for IPv4, four
+    // for IPv6), a mismatch skips to the next comparison and a full match
+    // jumps to the accept at the end. Long jumps use BPF_JA, whose offset
+    // is not limited to 255 instructions.
+    std::vector<sock_filter> peer_filter() const {
+        std::vector<sock_filter> code;
+        std::vector<size_t> to_accept;  // BPF_JA instructions to patch
+        size_t to_v4 = 0, to_v6 = 0;
+        code.push_back({BPF_LD | BPF_B | BPF_ABS, 0, 0, uint32_t(SKF_NET_OFF + 0)});  // version
+        code.push_back({BPF_ALU | BPF_AND | BPF_K, 0, 0, 0xf0});
+        code.push_back({BPF_JMP | BPF_JEQ | BPF_K, 0, 1, 0x40});
+        to_v4 = code.size();
+        code.push_back({BPF_JMP | BPF_JA, 0, 0, 0});
+        code.push_back({BPF_JMP | BPF_JEQ | BPF_K, 0, 1, 0x60});
+        to_v6 = code.size();
+        code.push_back({BPF_JMP | BPF_JA, 0, 0, 0});
+        code.push_back({BPF_RET | BPF_K, 0, 0, 0});
+
+        for (int family : {AF_INET, AF_INET6}) {
+            bool v6 = family == AF_INET6;
+            size_t at = v6 ? to_v6 : to_v4;
+            code[at].k = uint32_t(code.size() - at - 1);
+            uint32_t words = v6 ? 4 : 1;
+            uint32_t protocol_at = v6 ? 6 : 9;  // IPv6 next header, IPv4 protocol
+            uint32_t source_at = v6 ? 8 : 12;
+            uint32_t destination_at = v6 ? 24 : 16;
+            code.push_back({BPF_LD | BPF_B | BPF_ABS, 0, 0, uint32_t(SKF_NET_OFF + protocol_at)});
+            code.push_back({BPF_JMP | BPF_JEQ | BPF_K, 0, 1, IPPROTO_TCP});
+            code.push_back({BPF_JMP | BPF_JA, 0, 0, 1});
+            code.push_back({BPF_RET | BPF_K, 0, 0, 0});
+            for (const Peer& peer : peers_) {
+                if (peer.family != family) continue;
+                for (uint32_t offset : {source_at, destination_at}) {
+                    // 2 instructions per word, then the jump to accept
+                    for (uint32_t i = 0; i < words; i++) {
+                        uint32_t w;
+                        memcpy(&w, peer.address + 4 * i, 4);
+                        code.push_back({BPF_LD | BPF_W | BPF_ABS, 0, 0, uint32_t(SKF_NET_OFF + offset + 4 * i)});
+                        code.push_back({BPF_JMP | BPF_JEQ | BPF_K, 0, uint8_t(2 * (words - i - 1) + 1), ntohl(w)});
+                    }
+                    to_accept.push_back(code.size());
+                    code.push_back({BPF_JMP | BPF_JA, 0, 0, 0});
+                }
+            }
+            code.push_back({BPF_RET | BPF_K, 0, 0, 0});
+        }
+        for (size_t at : to_accept) code[at].k = uint32_t(code.size() - at - 1);
+        code.push_back({BPF_RET | BPF_K, 0, 0, kSnapLen});
+        return code;
+    }
+
+    void close_ring() {
+        if (ring_) munmap(ring_, size_t(kBlockSize) * kBlockCount);
+        ring_ = nullptr;
+        if (fd_ >= 0) close(fd_);
+        fd_ = -1;
+    }
+
+    void loop() {
+        unsigned block = 0;
+        bool draining = false;
+        while (true) {
+            auto* desc = reinterpret_cast<tpacket_block_desc*>(ring_ + size_t(block) * kBlockSize);
+            if (!(__atomic_load_n(&desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+                // After stop() is requested, wait one retire timeout more so
+                // the partly filled block with the last packets is handed over
+                if (!running_) {
+                    if (draining) break;
+                    draining = true;
+                }
+                pollfd pfd{fd_, POLLIN | POLLERR, 0};
+                poll(&pfd, 1, draining ? 30 : 50);
+                continue;
+            }
+            read_block(desc);
+            __atomic_store_n(&desc->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+            block = (block + 1) % kBlockCount;
+        }
+    }
+
+    void read_block(tpacket_block_desc* desc) {
+        uint32_t count = desc->hdr.bh1.num_pkts;
+        auto* hdr = reinterpret_cast<tpacket3_hdr*>(reinterpret_cast<uint8_t*>(desc) + desc->hdr.bh1.offset_to_first_pkt);
+        for (uint32_t i = 0; i < count; i++) {
+            read_packet(hdr);
+            hdr = reinterpret_cast<tpacket3_hdr*>(reinterpret_cast<uint8_t*>(hdr) + hdr->tp_next_offset);
+        }
+    }
+
+    void read_packet(const tpacket3_hdr* hdr) {
+        const auto* ll = reinterpret_cast<const sockaddr_ll*>(
+            reinterpret_cast<const uint8_t*>(hdr) + TPACKET_ALIGN(sizeof(tpacket3_hdr)));
+        // Loopback shows every packet twice, as sent and as received
+        if (ll->sll_hatype == ARPHRD_LOOPBACK && ll->sll_pkttype == PACKET_OUTGOING) return;
+
+        const uint8_t* ip = reinterpret_cast<const uint8_t*>(hdr) + hdr->tp_net;
+        uint32_t caplen = hdr->tp_snaplen - (hdr->tp_net - hdr->tp_mac);
+        if (caplen < 20) return;
+        // IPv4: header length from IHL, total length at 2. IPv6: a fixed
+        // 40-byte header (the filter let no extension headers through) and
+        // the payload length at 4.
+        bool v6 = (ip[0] >> 4) == 6;
+        uint32_t ihl = v6 ? 40 : (ip[0] & 0x0f) * 4u;
+        uint32_t total = v6 ? 40 + ((uint32_t(ip[4]) << 8) | ip[5]) : (uint32_t(ip[2]) << 8) | ip[3];
+        if (caplen < ihl + 20) return;
+        const uint8_t* tcp = ip + ihl;
+        uint16_t sport = uint16_t((tcp[0] << 8) | tcp[1]);
+        uint16_t dport = uint16_t((tcp[2] << 8) | tcp[3]);
+        if (sport != port_ && dport != port_) return;
+
+        if (packets_.size() == packets_.capacity()) {
+            stats_.not_recorded++;
+            return;
+        }
+
+        CapturedPacket p{};
+        p.ts_ns = int64_t(hdr->tp_sec) * 1000000000 + hdr->tp_nsec;
+        if (v6) {
+            memcpy(p.src_ip, ip + 8, 16);
+            memcpy(p.dst_ip, ip + 24, 16);
+        } else {
+            memcpy(p.src_ip, ip + 12, 4);
+            memcpy(p.dst_ip, ip + 16, 4);
+        }
+        p.src_port = sport;
+        p.dst_port = dport;
+        p.seq = (uint32_t(tcp[4]) << 24) | (uint32_t(tcp[5]) << 16) | (uint32_t(tcp[6]) << 8) | tcp[7];
+        p.ack = (uint32_t(tcp[8]) << 24) | (uint32_t(tcp[9]) << 16) | (uint32_t(tcp[10]) << 8) | tcp[11];
+        p.flags = tcp[13];
+        p.wire_len = hdr->tp_len;
+        uint32_t doff = (tcp[12] >> 4) * 4u;
+        p.payload = total > ihl + doff ? uint16_t(total - ihl - doff) : 0;
+
+        // Does the payload start with a TLS record header?
+        const uint8_t* tls = tcp + doff;
+        uint32_t have = caplen > ihl + doff ? caplen - ihl - doff : 0;
+        if (p.payload >= 5 && have >= 5 && tls[0] >= 20 && tls[0] <= 23 && tls[1] == 3 && tls[2] <= 4) {
+            p.tls_type = tls[0];
+            if (tls[0] == 22 && have >= 6) p.tls_handshake = tls[5];
+        }
+        p.ifindex_loopback = ll->sll_hatype == ARPHRD_LOOPBACK;
+        p.ipv6 = v6;
+        packets_.push_back(p);
+    }
+
+    struct Peer {
+        int family = AF_INET;
+        uint8_t address[16] = {};  // in_addr or in6_addr, network byte order
+    };
+
+    std::vector<Peer> peers_;
+    uint16_t port_;
+    int fd_ = -1;
+    uint8_t* ring_ = nullptr;
+    std::string error_;
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+    std::vector<CapturedPacket> packets_;
+    Stats stats_;
+};
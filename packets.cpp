@@ -1,140 +1,291 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 #include <curl/curl.h>
-#include <arpa/inet.h>
-#include <netdb.h>
-#include <chrono>
-#include <iomanip>
+#include "dive.h"
+#include "daemon_protocol.h"
+#include "event_log.h"
+#include "packet_capture.h"
+
+// Which part of the transfer a captured segment belongs to
+enum class Phase { Connect, Tls, Request, Response, Close };
+
+const char* phase_name(Phase phase) {
+    switch (phase) {
+        case Phase::Connect: return "connect";
+        case Phase::Tls: return "tls";
+        case Phase::Request: return "request";
+        case Phase::Response: return "response";
+        case Phase::Close: return "close";
+    }
+    return "";
+}
+
+int64_t to_ns(std::chrono::system_clock::time_point when) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(when.time_since_epoch()).count();
+}
+
+std::string endpoint(const CapturedPacket& p, const uint8_t* ip, uint16_t port) {
+    char buf[INET6_ADDRSTRLEN];
+    inet_ntop(p.ipv6 ? AF_INET6 : AF_INET, ip, buf, sizeof(buf));
+    if (p.ipv6) return "[" + std::string(buf) + "]:" + std::to_string(port);
+    return std::string(buf) + ":" + std::to_string(port);
+}
 
-class Logger {
+// Labels each captured segment with its phase. A connection is in the
+// connect phase until its first payload, in the TLS phase until curl reports
+// the handshake done (or sends the request), then alternates between
+// request and response with the direction of the payload, and is closing
+// from the first FIN or RST on.
+class PhaseTracker {
 public:
-    void log(const std::string& msg) {
-        std::cout << msg;
+    PhaseTracker(const std::vector<DiveDebugEvent>& events, uint16_t peer_port) : peer_port_(peer_port) {
+        for (const auto& ev : events) {
+            bool handshake_done = ev.type == CURLINFO_TEXT && ev.data.compare(0, 20, "SSL connection using") == 0;
+            if (handshake_done || ev.type == CURLINFO_HEADER_OUT) ready_.push_back(to_ns(ev.when));
+        }
     }
-};
 
-Logger global_logger;
+    Phase classify(const CapturedPacket& p) {
+        bool out = p.dst_port == peer_port_;
+        Flow& flow = flows_[out ? p.src_port : p.dst_port];
+        if (flow.phase == Phase::Close || (p.flags & (TCP_FLAG_FIN | TCP_FLAG_RST))) {
+            flow.phase = Phase::Close;
+        } else if (p.flags & TCP_FLAG_SYN) {
+            flow.phase = Phase::Connect;
+            // The first handshake-done or request event after this SYN ends
+            // the TLS phase of this connection
+            auto it = std::lower_bound(ready_.begin(), ready_.end(), p.ts_ns);
+            flow.ready_ns = it == ready_.end() ? INT64_MAX : *it;
+        } else if (p.payload > 0) {
+            if (p.tls_type == 22 || p.tls_type == 20 || (p.tls_type && p.ts_ns < flow.ready_ns)) {
+                flow.phase = Phase::Tls;
+            } else {
+                flow.phase = out ? Phase::Request : Phase::Response;
+            }
+        }
+        return flow.phase;
+    }
 
-// Store resolved IP address for labeling pseudo-packets
-std::string resolved_ip;
-int packet_counter = 0;
+    size_t connections() const { return flows_.size(); }
 
-// Callback to capture HTTP response body
-size_t write_callback(void* contents, size_t size, size_t nmemb, void* userp) {
-    std::string* response = static_cast<std::string*>(userp);
-    response->append(static_cast<char*>(contents), size * nmemb);
-    return size * nmemb;
-}
+private:
+    struct Flow {
+        Phase phase = Phase::Connect;
+        int64_t ready_ns = INT64_MAX;
+    };
 
-// Function to get a timestamp string
-std::string current_timestamp() {
-    using namespace std::chrono;
-    auto now = system_clock::now();
-    auto ms = duration_cast<milliseconds>(now.time_since_epoch()) % 1000;
+    uint16_t peer_port_;
+    std::vector<int64_t> ready_;
+    std::map<uint16_t, Flow> flows_;  // keyed by local port
+};
 
-    auto t = system_clock::to_time_t(now);
-    std::tm tm = *std::localtime(&t);
+// Print curl's text and header events merged with the captured segments,
+// in time order
+void print_timeline(const DiveResult& result, const std::vector<DiveDebugEvent>& events,
+                    const PacketCapture& capture) {
+    const auto& packets = capture.packets();
+    PhaseTracker phases(events, capture.port());
+    int64_t start_ns = to_ns(result.started);
+    size_t counts[5] = {};
+    size_t out_count = 0;
 
-    char buffer[64];
-    std::strftime(buffer, sizeof(buffer), "%H:%M:%S", &tm);
-    std::ostringstream oss;
-    oss << buffer << "." << std::setfill('0') << std::setw(3) << ms.count();
-    return oss.str();
-}
+    size_t e = 0;
+    int counter = 0;
+    for (size_t i = 0; i <= packets.size(); i++) {
+        int64_t until = i < packets.size() ? packets[i].ts_ns : INT64_MAX;
+        for (; e < events.size() && to_ns(events[e].when) <= until; e++) {
+            const DiveDebugEvent& ev = events[e];
+            std::string ts = dive_timestamp(ev.when);
+            if (ev.type == CURLINFO_TEXT) {
+                std::cout << "[" << ts << "] [INFO] " << ev.data;
+            } else if (ev.type == CURLINFO_HEADER_OUT || ev.type == CURLINFO_HEADER_IN) {
+                std::cout << "[" << ts << "] [HTTP] " << (ev.type == CURLINFO_HEADER_OUT ? "OUT" : "IN")
+                          << " | HEADER | " << ev.size << " bytes\n" << ev.data << "\n";
+            }
+        }
+        if (i == packets.size()) break;
+
+        const CapturedPacket& p = packets[i];
+        bool out = p.dst_port == capture.port();
+        Phase phase = phases.classify(p);
+        counts[int(phase)]++;
+        if (out) out_count++;
 
-// Debug callback to mimic packets
-int debug_callback(CURL* handle, curl_infotype type, char* data, size_t size, void* userptr) {
-    std::string src = "LOCALHOST:random";   // pseudo source
-    std::string dst = resolved_ip + ":443"; // pseudo destination
-
-    auto ts = current_timestamp();
-    packet_counter++;
-
-    switch(type) {
-        case CURLINFO_TEXT:
-            global_logger.log("[" + ts + "] [INFO] " + std::string(data, size));
-            break;
-        case CURLINFO_HEADER_OUT:
-            global_logger.log("[" + ts + "] [PACKET " + std::to_string(packet_counter) + "] OUT " + src + " -> " + dst + " | HEADER | " + std::to_string(size) + " bytes\n");
-            global_logger.log(std::string(data, size) + "\n");
-            break;
-        case CURLINFO_HEADER_IN:
-            global_logger.log("[" + ts + "] [PACKET " + std::to_string(packet_counter) + "] IN " + dst + " -> " + src + " | HEADER | " + std::to_string(size) + " bytes\n");
-            global_logger.log(std::string(data, size) + "\n");
-            break;
-        case CURLINFO_DATA_OUT:
-            global_logger.log("[" + ts + "] [PACKET " + std::to_string(packet_counter) + "] OUT " + src + " -> " + dst + " | DATA | " + std::to_string(size) + " bytes\n");
-            break;
-        case CURLINFO_DATA_IN:
-            global_logger.log("[" + ts + "] [PACKET " + std::to_string(packet_counter) + "] IN " + dst + " -> " + src + " | DATA | " + std::to_string(size) + " bytes\n");
-            break;
-        default:
-            break;
+        char offset[32];
+        snprintf(offset, sizeof(offset), "+%.3fms", (p.ts_ns - start_ns) / 1e6);
+        auto when = std::chrono::system_clock::time_point(
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(p.ts_ns)));
+        std::cout << "[" << dive_timestamp(when) << "] [PACKET " << ++counter << "] " << (out ? "OUT " : "IN ")
+                  << endpoint(p, p.src_ip, p.src_port) << " -> " << endpoint(p, p.dst_ip, p.dst_port) << " | TCP "
+                  << tcp_flags_string(p.flags) << " seq=" << p.seq;
+        if (p.flags & TCP_FLAG_ACK) std::cout << " ack=" << p.ack;
+        std::cout << " | " << p.payload << " bytes | " << phase_name(phase);
+        std::string tls = tls_record_name(p.tls_type, p.tls_handshake);
+        if (!tls.empty()) std::cout << " | " << tls;
+        std::cout << " | " << offset << "\n";
     }
-    return 0;
+
+    const PacketCapture::Stats& stats = capture.stats();
+    std::cout << "[Capture] " << packets.size() << " packets (" << out_count << " out, " << packets.size() - out_count
+              << " in) on " << phases.connections() << " connection(s), " << stats.kernel_drops
+              << " dropped by the kernel";
+    if (stats.not_recorded) std::cout << ", " << stats.not_recorded << " not recorded";
+    std::cout << "\n[Capture] connect " << counts[0] << ", tls " << counts[1] << ", request " << counts[2]
+              << ", response " << counts[3] << ", close " << counts[4] << "\n";
+
+    const DiveTimings& t = result.timings;
+    auto ms = [](curl_off_t us) { return std::to_string(us / 1000) + "." + std::to_string(us % 1000 / 100) + "ms"; };
+    std::cout << "[Timing] dns " << ms(t.namelookup) << ", connect " << ms(t.connect);
+    if (t.appconnect) std::cout << ", tls " << ms(t.appconnect);
+    std::cout << ", first byte " << ms(t.starttransfer) << ", total " << ms(t.total) << "\n";
 }
 
-// Resolve host to IPv4 address
-bool resolve_host(const std::string& host, std::string& out_ip) {
-    addrinfo hints{}, *res = nullptr;
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_STREAM;
+DiveDebugEvent to_debug_event(const LoggedEvent& e) {
+    DiveDebugEvent ev;
+    ev.when = std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(e.ts_ns)));
+    ev.type = curl_infotype(e.type);
+    ev.size = e.size;
+    ev.data.assign(e.data ? e.data : "", e.length);
+    return ev;
+}
 
-    if(getaddrinfo(host.c_str(), "443", &hints, &res) != 0) {
-        return false;
+// --decode: print a binary event log the way the live view would have
+int decode_log(const std::string& path) {
+    std::string destination;
+    int counter = 0;
+    bool ok = EventLog::decode(path, [&](const LoggedEvent& e) {
+        if (e.type == EVENT_DROPPED) {
+            std::cout << "[Log] " << e.size << " events were dropped while recording\n";
+        } else {
+            print_packet_event(to_debug_event(e), destination, counter);
+        }
+    }, &destination);
+    if (!ok) {
+        std::cerr << "Not a packets event log: " << path << "\n";
+        return 1;
     }
+    return 0;
+}
 
-    sockaddr_in* addr = reinterpret_cast<sockaddr_in*>(res->ai_addr);
-    char ip[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &(addr->sin_addr), ip, sizeof(ip));
-    out_ip = ip;
-
-    freeaddrinfo(res);
-    return true;
+void usage(const char* tool) {
+    std::cerr << "Usage: " << tool << " <url> [--log <events.bin>] [--happy-eyeballs [delay_ms]] [--race-all]\n"
+              << "       " << tool << " --decode <events.bin>\n";
 }
 
 int main(int argc, char* argv[]) {
-    if(argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <url>\n";
+    // A running webdived answers from its warm connections instead
+    int daemon_status = 0;
+    if (daemon_forward("packets", argc, argv, daemon_status)) return daemon_status;
+
+    std::string url;
+    std::string log_path;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--decode" && i + 1 < argc) return decode_log(argv[i + 1]);
+        if (arg == "--log" && i + 1 < argc) {
+            log_path = argv[++i];
+        } else if (arg == "--happy-eyeballs") {
+            if (i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9') i++;  // the delay
+        } else if (arg != "--race-all") {
+            url = arg;
+        }
+    }
+    if(url.empty()) {
+        usage(argv[0]);
         return 1;
     }
 
-    std::string url = argv[1];
-    global_logger.log("Performing HTTPS request to: " + url + "\n");
+    std::cout << "Performing HTTPS request to: " << url << "\n";
+
+    // The debug callback only drops each event into the event log's ring;
+    // the log's writer thread does the rest. Without capture it prints the
+    // events as pseudo packets while the transfer runs. With capture it
+    // keeps them to be merged with the real segments afterwards.
+    std::string destination;
+    int packet_counter = 0;
+    bool capturing = false;
+    std::vector<DiveDebugEvent> events;
+    EventLog* log = nullptr;
 
-    // Extract hostname for pseudo IP labeling
-    std::string host = url.substr(url.find("://") + 3);
-    size_t slash_pos = host.find('/');
-    if(slash_pos != std::string::npos) host = host.substr(0, slash_pos);
+    DiveOptions options;
+    options.keep_body = false;
+    options.tls_info = false;
+    options.certinfo = false;
+    // The connection is raced up front, so every flow is labelled with the
+    // address that actually won, IPv6 or IPv4, and the capture sees the
+    // race's attempts
+    options.happy_eyeballs.race = true;
+    parse_happy_eyeballs_args(argc, argv, options.happy_eyeballs);
+    options.on_debug_data = [&log](curl_infotype type, const char* data, size_t size) {
+        log->record(type, data, size);
+    };
 
-    if(!resolve_host(host, resolved_ip)) {
-        std::cerr << "Failed to resolve host: " << host << "\n";
+    std::unique_ptr<DiveTransfer> transfer(new DiveTransfer(url, options));
+    const DiveResult& result = transfer->result;
+    if(!result.resolved) {
+        std::cerr << "Failed to resolve host: " << result.host << "\n";
         return 1;
     }
 
-    global_logger.log("Resolved " + host + " to " + resolved_ip + "\n");
+    // Capture the segments to and from every address the race may try.
+    // This needs CAP_NET_RAW; without it only curl's own view can be shown.
+    std::vector<std::string> peers(result.addresses6);
+    peers.insert(peers.end(), result.addresses.begin(), result.addresses.end());
+    PacketCapture capture(peers, uint16_t(result.port));
+    capturing = capture.ok();
+    if (capturing) capture.start();
 
-    CURL* curl = curl_easy_init();
-    if(curl) {
-        std::string response;
+    transfer->race();
+    std::cout << "Resolved " << result.host << " to " << dive_connect_address(result) << "\n";
+    print_happy_eyeballs(result.eyeballs, options.happy_eyeballs.delay_ms);
+    destination = dive_packet_destination(result);
+    if (!capturing) std::cout << "[Capture] Unavailable (" << capture.error() << "), showing curl events only\n";
 
-        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-
-        // Enable verbose mode and debug callback
-        curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
-        curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, debug_callback);
+    EventLog event_log(log_path, destination);
+    if (!event_log.ok()) {
+        std::cerr << "Failed to create " << log_path << "\n";
+        return 1;
+    }
+    log = &event_log;
 
-        CURLcode res = curl_easy_perform(curl);
-        if(res != CURLE_OK) {
-            global_logger.log("curl_easy_perform() failed: " + std::string(curl_easy_strerror(res)) + "\n");
+    event_log.start([&](const LoggedEvent& e) {
+        if (e.type == EVENT_DROPPED) return;
+        if (!capturing) {
+            print_packet_event(to_debug_event(e), destination, packet_counter);
+        } else if (e.type != CURLINFO_DATA_IN && e.type != CURLINFO_DATA_OUT) {
+            events.push_back(to_debug_event(e));
         }
+    });
+
+    transfer->perform();
+    event_log.stop();
+    if(!result.ok()) {
+        std::cout << "curl_easy_perform() failed: " << result.error() << "\n";
+    }
 
-        curl_easy_cleanup(curl);
+    if (capturing) {
+        // Closing the handle closes the connection; give the FIN exchange a
+        // moment to reach the ring before stopping
+        DiveResult done = std::move(transfer->result);
+        transfer.reset();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        capture.stop();
+        print_timeline(done, events, capture);
+    }
+    if (event_log.dropped()) {
+        std::cout << "[Log] " << event_log.dropped() << " events dropped, the writer fell behind\n";
     }
+    if (!log_path.empty()) std::cout << "[Log] Events written to " << log_path << "\n";
 
-    global_logger.log("Request complete.\n");
+    std::cout << "Request complete.\n";
+    print_dns_cache_stats();
     return 0;
 }
@@ -1,78 +1,84 @@
+#include <cstring>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <curl/curl.h>
-#include <algorithm> // For std::transform
-
-// Dummy write callback to discard the response body
-// We are only interested in the headers and redirect chain for this tool.
-size_t write_callback(void* contents, size_t size, size_t nmemb, void* userp) {
-    return size * nmemb;
-}
-
-// Header callback function to print the headers and redirect info
-size_t header_callback(char* buffer, size_t size, size_t nitems, void* userdata) {
-    size_t total_size = size * nitems;
-    std::string header_line(buffer, total_size);
-
-    // Check for HTTP status line at the beginning of the header block
-    if (header_line.find("HTTP/") == 0) {
-        std::cout << "\n[Status] " << header_line.substr(0, header_line.find('\n'));
-    }
-
-    // Check for "Location:" header, which indicates a redirect
-    std::string lower_header = header_line;
-    std::transform(lower_header.begin(), lower_header.end(), lower_header.begin(),
-                   [](unsigned char c){ return std::tolower(c); });
-
-    if (lower_header.find("location:") == 0) {
-        std::string location_url = header_line.substr(header_line.find(":") + 1);
-        // Trim leading/trailing whitespace
-        location_url.erase(0, location_url.find_first_not_of(" \t\n\r\f\v"));
-        std::cout << "[Redirect] -> " << location_url;
-    }
-
-    return total_size;
-}
+#include "dive.h"
+#include "daemon_protocol.h"
+#include "batch.h"
 
 int main(int argc, char* argv[]) {
+    // A running webdived answers from its warm connections instead
+    int daemon_status = 0;
+    if (daemon_forward("redirect", argc, argv, daemon_status)) return daemon_status;
+
     // Check if a URL was provided as a command-line argument
     if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <url>\n";
+        std::cerr << "Usage: " << argv[0] << " <url> [--jar <file>]\n";
+        print_batch_usage(argv[0]);
         return 1;
     }
 
-    std::string url = argv[1];
-    std::cout << "Performing request to: " << url << "\n";
-
-    // Initialize the curl session
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-        std::cerr << "Failed to initialize libcurl.\n";
-        return 1;
+    // Walk the whole chain hop by hop on one handle, skipping permanent
+    // redirects already in the cache; the body is discarded as it arrives
+    DiveOptions options;
+    options.walk_redirects = true;
+    options.redirect_cache = &RedirectCache::shared();
+    options.keep_body = false;
+    options.debug_events = false;
+    options.tls_info = false;
+    options.certinfo = false;
+
+    // --jar <file>: every hop sends the cookies for its own URL, including
+    // those set by the hops before it, and the jar is saved for the next run
+    std::unique_ptr<CookieJar> jar;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--jar") == 0) jar.reset(new CookieJar(argv[i + 1]));
+    }
+    options.cookie_jar = jar.get();
+
+    // --results <file>: also append a fixed-schema row per probe
+    std::unique_ptr<ResultsWriter> results;
+    if (!open_results_arg(argc, argv, "redirect", results)) return 1;
+    options.hash_body = results != nullptr;
+    auto view = [&](const DiveResult& r) {
+        print_redirects(r);
+        if (jar) print_cookies_sent(r);
+    };
+    auto save_jar = [&] {
+        if (!jar) return;
+        std::cout << "\n";
+        print_cookie_jar_report(*jar);
+        if (!jar->save()) std::cerr << "Failed to save the cookie jar\n";
+    };
+
+    BatchOptions batch;
+    if (parse_batch_args(argc, argv, batch)) {
+        batch.results = results.get();
+        size_t failed = run_batch(batch, options, view);
+        close_results(results);
+        save_jar();
+        save_redirect_cache();
+        return failed > 0 ? 1 : 0;
     }
 
-    // Set the initial URL
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-
-    // Enable automatic redirection following
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-
-    // Set header and write callback functions
-    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+    std::string url = argv[1];
+    std::cout << "Performing request to: " << url << "\n";
 
-    // Perform the request
-    CURLcode res = curl_easy_perform(curl);
+    DiveResult result = dive(url, options);
+    view(result);
+    if (results) results->append(result);
+    close_results(results);
 
     // Check for errors
-    if (res != CURLE_OK) {
-        std::cerr << "\ncurl_easy_perform() failed: " << curl_easy_strerror(res) << "\n";
+    if (!result.ok()) {
+        std::cerr << "\ncurl_easy_perform() failed: " << result.error() << "\n";
     }
 
-    // Clean up the curl session
-    curl_easy_cleanup(curl);
-
     std::cout << "\nRequest complete.\n";
+    save_jar();
+    save_redirect_cache();
+    print_dns_cache_stats();
 
     return 0;
 }
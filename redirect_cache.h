@@ -0,0 +1,219 @@
+// redirect_cache.h
+// Cache of permanent redirects (301 and 308), kept on disk between runs.
+//
+// A permanent redirect may be remembered without revalidating it (RFC 9110
+// 15.4.2, 15.4.9), so re-tracing a large URL list can skip every hop that
+// is already known and start at its target. Cache-Control is honoured:
+// no-store is not cached, max-age bounds the lifetime, and anything else is
+// kept for kDefaultLifetime.
+//
+// File: "WDREDIR1", then per entry the URL, the target (length-prefixed),
+// the status as u32 and the expiry as i64 unix seconds. Written to a
+// temporary file and renamed.
+//
+// Location: $WEBDIVE_REDIRECT_CACHE, else $XDG_CACHE_HOME/webdive/redirects,
+// else ~/.cache/webdive/redirects. WEBDIVE_REDIRECT_CACHE=off disables it.
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct RedirectCacheStats {
+    unsigned long hits = 0;    // hops answered from the cache
+    unsigned long stored = 0;  // permanent redirects learnt this run
+};
+
+class RedirectCache {
+public:
+    static constexpr int64_t kDefaultLifetime = 30 * 86400;
+    static constexpr size_t kMaxEntries = 1 << 20;
+
+    // Process-wide cache on the default file
+    static RedirectCache& shared() {
+        static RedirectCache cache(default_path());
+        return cache;
+    }
+
+    static std::string default_path() {
+        if (const char* env = getenv("WEBDIVE_REDIRECT_CACHE")) return env;
+        std::string dir;
+        if (const char* xdg = getenv("XDG_CACHE_HOME")) {
+            dir = xdg;
+        } else if (const char* home = getenv("HOME")) {
+            dir = std::string(home) + "/.cache";
+        } else {
+            return "";
+        }
+        return dir + "/webdive/redirects";
+    }
+
+    explicit RedirectCache(const std::string& path)
+        : path_(path), enabled_(path != "off") {
+        if (path_ == "off") path_.clear();
+        load();
+    }
+
+    RedirectCache(const RedirectCache&) = delete;
+    RedirectCache& operator=(const RedirectCache&) = delete;
+
+    bool enabled() const { return enabled_; }
+
+    // The cached target of url, if a permanent redirect is known for it
+    bool lookup(const std::string& url, std::string& target, long& status) {
+        if (!enabled_) return false;
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(url);
+        if (it == entries_.end() || it->second.expires <= int64_t(time(nullptr))) return false;
+        target = it->second.target;
+        status = it->second.status;
+        stats_.hits++;
+        return true;
+    }
+
+    // Record a 301/308 response; other statuses are ignored
+    void remember(const std::string& url, long status, const std::string& target, std::string_view cache_control) {
+        if (!enabled_ || (status != 301 && status != 308) || target.empty()) return;
+        int64_t lifetime = kDefaultLifetime;
+        if (directive(cache_control, "no-store") || directive(cache_control, "no-cache")) return;
+        size_t max_age = find_directive(cache_control, "max-age=");
+        if (max_age != std::string_view::npos) {
+            lifetime = strtoll(std::string(cache_control.substr(max_age + 8)).c_str(), nullptr, 10);
+            if (lifetime <= 0) return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (entries_.size() >= kMaxEntries && !entries_.count(url)) return;
+        entries_[url] = Entry{target, status, int64_t(time(nullptr)) + lifetime};
+        stats_.stored++;
+        dirty_ = true;
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return entries_.size();
+    }
+
+    RedirectCacheStats stats() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+    // Write the entries still valid to disk. Returns false on failure.
+    bool save() {
+        if (path_.empty()) return true;
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!dirty_) return true;
+
+        size_t slash = path_.rfind('/');
+        if (slash != std::string::npos && slash > 0) {
+            std::string dir = path_.substr(0, slash);
+            for (size_t p = dir.find('/', 1); ; p = dir.find('/', p + 1)) {
+                mkdir(dir.substr(0, p).c_str(), 0700);
+                if (p == std::string::npos) break;
+            }
+        }
+
+        std::string tmp = path_ + ".tmp." + std::to_string(getpid());
+        FILE* f = fopen(tmp.c_str(), "wb");
+        if (!f) return false;
+        fwrite(kMagic, sizeof(kMagic), 1, f);
+        int64_t now = time(nullptr);
+        for (const auto& entry : entries_) {
+            if (entry.second.expires <= now) continue;
+            uint32_t status = uint32_t(entry.second.status);
+            write_field(f, entry.first);
+            write_field(f, entry.second.target);
+            fwrite(&status, sizeof(status), 1, f);
+            fwrite(&entry.second.expires, sizeof(int64_t), 1, f);
+        }
+        bool ok = fclose(f) == 0 && rename(tmp.c_str(), path_.c_str()) == 0;
+        if (!ok) unlink(tmp.c_str());
+        dirty_ = !ok;
+        return ok;
+    }
+
+private:
+    static constexpr char kMagic[8] = {'W', 'D', 'R', 'E', 'D', 'I', 'R', '1'};
+
+    struct Entry {
+        std::string target;
+        long status = 0;
+        int64_t expires = 0;
+    };
+
+    // Offset of a Cache-Control directive (case-insensitive), npos if absent
+    static size_t find_directive(std::string_view header, const char* name) {
+        size_t n = strlen(name);
+        for (size_t i = 0; i + n <= header.size(); i++) {
+            if ((i == 0 || header[i - 1] == ' ' || header[i - 1] == ',') &&
+                strncasecmp(header.data() + i, name, n) == 0) {
+                return i;
+            }
+        }
+        return std::string_view::npos;
+    }
+
+    static bool directive(std::string_view header, const char* name) {
+        return find_directive(header, name) != std::string_view::npos;
+    }
+
+    static void write_field(FILE* f, const std::string& s) {
+        uint32_t n = uint32_t(s.size());
+        fwrite(&n, sizeof(n), 1, f);
+        fwrite(s.data(), 1, n, f);
+    }
+
+    static bool read_field(FILE* f, std::string& s) {
+        uint32_t n = 0;
+        if (fread(&n, sizeof(n), 1, f) != 1 || n > (1u << 16)) return false;
+        s.resize(n);
+        return n == 0 || fread(&s[0], 1, n, f) == n;
+    }
+
+    void load() {
+        if (path_.empty()) return;
+        FILE* f = fopen(path_.c_str(), "rb");
+        if (!f) return;
+        char magic[sizeof(kMagic)];
+        if (fread(magic, sizeof(magic), 1, f) == 1 && memcmp(magic, kMagic, sizeof(kMagic)) == 0) {
+            int64_t now = time(nullptr);
+            std::string url;
+            Entry entry;
+            uint32_t status = 0;
+            while (entries_.size() < kMaxEntries && read_field(f, url) && read_field(f, entry.target) &&
+                   fread(&status, sizeof(status), 1, f) == 1 && fread(&entry.expires, sizeof(int64_t), 1, f) == 1) {
+                entry.status = status;
+                if (entry.expires > now) entries_[url] = entry;
+            }
+        }
+        fclose(f);
+    }
+
+    std::string path_;
+    bool enabled_;
+    std::mutex mutex_;
+    std::unordered_map<std::string, Entry> entries_;
+    RedirectCacheStats stats_;
+    bool dirty_ = false;
+};
+
+// "[Redirect cache] ..." on stderr, after saving the cache
+inline void save_redirect_cache(std::ostream& out = std::cerr) {
+    RedirectCache& cache = RedirectCache::shared();
+    if (!cache.enabled()) return;
+    RedirectCacheStats s = cache.stats();
+    bool saved = cache.save();
+    out << "[Redirect cache] " << cache.size() << " permanent redirects, " << s.hits << " hops skipped, " << s.stored
+        << " learnt";
+    if (!saved) out << " (failed to save)";
+    out << "\n";
+}
@@ -0,0 +1,295 @@
+// repeat.h
+// Repeat mode for the curl based tools: where does a site spend its time?
+//
+// "--repeat N" fetches the URL N times on a fresh handle (cold: new DNS
+// lookup, TCP connect and TLS handshake every time) and N times on one
+// long-lived handle (warm: the connection is reused when the server keeps
+// it open). Each run is filed as cold or warm by whether curl actually
+// opened a new connection. Every phase goes into a log-linear histogram and
+// the report gives p50/p90/p99/p99.9/max per phase; "--export <file>"
+// writes the same numbers as JSON, one value per line, to diff between
+// deploys.
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <curl/curl.h>
+#include "dive.h"
+
+struct RepeatOptions {
+    std::string url;
+    long runs = 0;            // fetches per kind (cold and warm)
+    std::string export_path;  // JSON report, "-" for stdout
+};
+
+// Recognise "--repeat <n>" and "--export <file>"; the first other argument
+// is the URL. Returns true when repeat mode was requested.
+inline bool parse_repeat_args(int argc, char* argv[], RepeatOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--repeat" && i + 1 < argc) {
+            options.runs = std::max(1L, std::strtol(argv[++i], nullptr, 10));
+        } else if (arg == "--export" && i + 1 < argc) {
+            options.export_path = argv[++i];
+        } else if (options.url.empty() && arg.compare(0, 2, "--") != 0) {
+            options.url = arg;
+        }
+    }
+    return options.runs > 0 && !options.url.empty();
+}
+
+inline void print_repeat_usage(const char* tool) {
+    std::cerr << "       " << tool << " <url> --repeat N [--export <file.json|->]\n";
+}
+
+// Log-linear histogram in the style of HdrHistogram. Values (microseconds)
+// are exact below 128 and kept within 1/64 (about 1.6%) above that, in a
+// fixed array, so recording is a shift and an increment.
+class LatencyHistogram {
+public:
+    static constexpr int kSubBits = 7;  // 128 sub-buckets in the first bucket
+    static constexpr int64_t kHalf = 64;
+    static constexpr int kBuckets = 41;  // up to 2^47 us, about four years
+    static constexpr size_t kSize = size_t(kBuckets) * kHalf + kHalf;
+
+    void record(int64_t value) {
+        if (value < 0) value = 0;
+        counts_[std::min(index(uint64_t(value)), kSize - 1)]++;
+        if (count_ == 0 || value < min_) min_ = value;
+        max_ = std::max(max_, value);
+        count_++;
+    }
+
+    void add(const LatencyHistogram& other) {
+        if (other.count_ == 0) return;
+        for (size_t i = 0; i < kSize; i++) counts_[i] += other.counts_[i];
+        if (count_ == 0 || other.min_ < min_) min_ = other.min_;
+        max_ = std::max(max_, other.max_);
+        count_ += other.count_;
+    }
+
+    uint64_t count() const { return count_; }
+    int64_t max() const { return max_; }
+    int64_t min() const { return min_; }
+
+    // Highest value of the bucket holding the given percentile, as
+    // HdrHistogram reports it, capped at the exact maximum
+    int64_t percentile(double p) const {
+        if (count_ == 0) return 0;
+        uint64_t target = std::max<uint64_t>(1, uint64_t(std::ceil(p / 100.0 * double(count_))));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kSize; i++) {
+            seen += counts_[i];
+            if (seen >= target) return std::min(highest(i), max_);
+        }
+        return max_;
+    }
+
+private:
+    static size_t index(uint64_t v) {
+        int msb = 63 - __builtin_clzll(v | 1);
+        int bucket = msb < kSubBits ? 0 : msb - kSubBits + 1;
+        return size_t(bucket) * kHalf + (v >> bucket);
+    }
+
+    static int64_t highest(size_t i) {
+        if (i < size_t(2 * kHalf)) return int64_t(i);
+        size_t bucket = i / kHalf - 1;
+        int64_t sub = int64_t(i - bucket * kHalf);
+        return ((sub + 1) << bucket) - 1;
+    }
+
+    uint64_t counts_[kSize] = {};
+    uint64_t count_ = 0;
+    int64_t min_ = 0;
+    int64_t max_ = 0;
+};
+
+// Phases derived from curl's cumulative timings. The TLS phase is also
+// split by handshake kind when a session cache is attached.
+enum RepeatPhase {
+    PHASE_DNS, PHASE_CONNECT, PHASE_TLS, PHASE_TLS_FULL, PHASE_TLS_RESUMED, PHASE_TTFB, PHASE_TOTAL, PHASE_COUNT
+};
+
+inline const char* repeat_phase_name(int phase) {
+    static const char* names[PHASE_COUNT] = {"dns", "connect", "tls", "tls_full", "tls_resumed", "ttfb", "total"};
+    return names[phase];
+}
+
+struct RepeatStats {
+    uint64_t runs = 0;
+    LatencyHistogram phases[PHASE_COUNT];
+
+    // DNS, connect and TLS only exist for runs that opened a connection;
+    // ttfb is from the request being sent to the first response byte
+    void record(const DiveResult& r, bool new_connection) {
+        const DiveTimings& t = r.timings;
+        runs++;
+        if (new_connection) {
+            phases[PHASE_DNS].record(t.namelookup);
+            phases[PHASE_CONNECT].record(t.connect - t.namelookup);
+            if (t.appconnect > 0) {
+                phases[PHASE_TLS].record(t.appconnect - t.connect);
+                if (r.tls.handshake_known) {
+                    phases[r.tls.resumed ? PHASE_TLS_RESUMED : PHASE_TLS_FULL].record(t.appconnect - t.connect);
+                }
+            }
+        }
+        phases[PHASE_TTFB].record(t.starttransfer - t.pretransfer);
+        phases[PHASE_TOTAL].record(t.total);
+    }
+};
+
+class RepeatRunner {
+public:
+    static constexpr double kPercentiles[4] = {50.0, 90.0, 99.0, 99.9};
+
+    RepeatRunner(const RepeatOptions& options, const DiveOptions& dive_options)
+        : options_(options), dive_options_(dive_options) {
+        // Timing only: no body, events or TLS details are kept
+        dive_options_.keep_body = false;
+        dive_options_.on_body = nullptr;
+        dive_options_.debug_events = false;
+        dive_options_.verbose = false;
+        dive_options_.tls_info = false;
+        dive_options_.certinfo = false;
+    }
+
+    // Returns the number of failed runs
+    uint64_t run() {
+        // Cold runs leave resolution to curl on a fresh handle, so the DNS
+        // phase is a real lookup rather than a hit in the shared cache
+        DiveOptions cold_options = dive_options_;
+        cold_options.resolve = false;
+        DiveTransfer warm(options_.url, dive_options_);
+
+        // Interleaved, so a change on the server side during the run
+        // shows up in both kinds alike
+        for (long i = 0; i < options_.runs; i++) {
+            DiveTransfer cold(options_.url, cold_options);
+            cold.perform();
+            file(cold.result);
+
+            warm.reset_result();
+            warm.perform();
+            file(warm.result);
+        }
+        return failed_;
+    }
+
+    void print_report(std::ostream& out = std::cout) const {
+        out << "[Repeat] " << options_.url << ": " << cold_.runs << " cold, " << warm_.runs << " warm, " << failed_
+            << " failed\n";
+        print_stats("cold", cold_, out);
+        print_stats("warm", warm_, out);
+    }
+
+    bool export_json() const {
+        if (options_.export_path.empty()) return true;
+        std::ofstream file;
+        std::ostream* out = &std::cout;
+        if (options_.export_path != "-") {
+            file.open(options_.export_path);
+            if (!file) return false;
+            out = &file;
+        }
+        *out << "{\n";
+        *out << "  \"url\": \"" << json_escape(options_.url) << "\",\n";
+        *out << "  \"runs_per_kind\": " << options_.runs << ",\n";
+        *out << "  \"failed\": " << failed_ << ",\n";
+        *out << "  \"unit\": \"us\",\n";
+        write_stats_json("cold", cold_, *out);
+        *out << ",\n";
+        write_stats_json("warm", warm_, *out);
+        *out << "\n}\n";
+        return bool(*out);
+    }
+
+private:
+    void file(const DiveResult& r) {
+        if (!r.ok()) {
+            failed_++;
+            return;
+        }
+        bool fresh = r.new_connections > 0;
+        (fresh ? cold_ : warm_).record(r, fresh);
+    }
+
+    static std::string ms(int64_t us) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.2f", us / 1000.0);
+        return buf;
+    }
+
+    static void print_stats(const char* kind, const RepeatStats& stats, std::ostream& out) {
+        if (stats.runs == 0) return;
+        out << "[Repeat] " << std::left << std::setw(5) << kind << std::right << std::setw(13) << "runs";
+        for (double p : kPercentiles) out << std::setw(10) << ("p" + percentile_label(p));
+        out << std::setw(10) << "max" << "  (ms)\n";
+        for (int phase = 0; phase < PHASE_COUNT; phase++) {
+            const LatencyHistogram& h = stats.phases[phase];
+            if (h.count() == 0) continue;
+            out << "[Repeat]   " << std::left << std::setw(12) << repeat_phase_name(phase) << std::right
+                << std::setw(5) << h.count();
+            for (double p : kPercentiles) out << std::setw(10) << ms(h.percentile(p));
+            out << std::setw(10) << ms(h.max()) << "\n";
+        }
+    }
+
+    static std::string percentile_label(double p) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), p == std::floor(p) ? "%.0f" : "%.1f", p);
+        return buf;
+    }
+
+    static void write_stats_json(const char* kind, const RepeatStats& stats, std::ostream& out) {
+        out << "  \"" << kind << "\": {\n";
+        out << "    \"runs\": " << stats.runs;
+        for (int phase = 0; phase < PHASE_COUNT; phase++) {
+            const LatencyHistogram& h = stats.phases[phase];
+            out << ",\n    \"" << repeat_phase_name(phase) << "\": {\n";
+            out << "      \"count\": " << h.count() << ",\n";
+            out << "      \"min\": " << h.min() << ",\n";
+            for (double p : kPercentiles) out << "      \"p" << percentile_label(p) << "\": " << h.percentile(p) << ",\n";
+            out << "      \"max\": " << h.max() << "\n";
+            out << "    }";
+        }
+        out << "\n  }";
+    }
+
+    static std::string json_escape(const std::string& s) {
+        std::string out;
+        for (char c : s) {
+            if (c == '"' || c == '\\') out += '\\';
+            if (static_cast<unsigned char>(c) < 0x20) continue;
+            out += c;
+        }
+        return out;
+    }
+
+    RepeatOptions options_;
+    DiveOptions dive_options_;
+    RepeatStats cold_;
+    RepeatStats warm_;
+    uint64_t failed_ = 0;
+};
+
+// Run repeat mode and print the report. Returns the process exit status.
+inline int run_repeat(const RepeatOptions& options, const DiveOptions& dive_options) {
+    RepeatRunner runner(options, dive_options);
+    uint64_t failed = runner.run();
+    runner.print_report(options.export_path == "-" ? std::cerr : std::cout);
+    if (!runner.export_json()) {
+        std::cerr << "Failed to write " << options.export_path << "\n";
+        return 1;
+    }
+    return failed == uint64_t(options.runs) * 2 ? 1 : 0;
+}
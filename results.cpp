@@ -0,0 +1,309 @@
+// results.cpp
+// Query a results file written with --results, without loading it: the
+// file is mapped, blocks whose min/max rule the filters out are skipped,
+// and only the columns a query names are read.
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include "results_store.h"
+
+enum FilterOp { OP_EQ, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE, OP_CONTAINS };
+
+// "<column><op><value>"
+struct Filter {
+    ResultColumnId column;
+    FilterOp op;
+    int64_t number = 0;
+    std::string text;
+    std::vector<uint8_t> prefix;  // cert_fp
+};
+
+static void usage(const char* tool) {
+    std::cerr << "Usage: " << tool << " <file> [filter...] [--count | --list [columns] | --group-by <column> |"
+              << " --stats <column>] [--limit n]\n"
+              << "  filter: <column><op><value>, op one of = != < <= > >= ~ (substring, fingerprint prefix)\n"
+              << "  time takes unix ms or YYYY-MM-DD[THH:MM:SS] (UTC), tool a tool name\n"
+              << "  columns:";
+    for (int c = 0; c < RESULT_COLUMN_COUNT; c++) std::cerr << " " << result_column(ResultColumnId(c)).name;
+    std::cerr << "\n";
+}
+
+static bool parse_time(const std::string& s, int64_t& ms) {
+    std::tm tm{};
+    const char* end = strptime(s.c_str(), "%Y-%m-%d", &tm);
+    if (!end) return false;
+    if (*end == 'T' || *end == ' ') end = strptime(end + 1, "%H:%M:%S", &tm);
+    if (!end || *end) return false;
+    ms = int64_t(timegm(&tm)) * 1000;
+    return true;
+}
+
+static bool parse_filter(const std::string& arg, Filter& f) {
+    static const struct { const char* text; FilterOp op; } ops[] = {
+        {"!=", OP_NE}, {"<=", OP_LE}, {">=", OP_GE}, {"=", OP_EQ}, {"<", OP_LT}, {">", OP_GT}, {"~", OP_CONTAINS},
+    };
+    size_t at = arg.find_first_of("!<>=~");
+    if (at == std::string::npos || at == 0) return false;
+    f.column = result_column_id(std::string_view(arg).substr(0, at));
+    if (f.column == RESULT_COLUMN_COUNT) return false;
+    size_t len = 0;
+    for (const auto& op : ops) {
+        if (arg.compare(at, strlen(op.text), op.text) == 0) {
+            f.op = op.op;
+            len = strlen(op.text);
+            break;
+        }
+    }
+    if (!len) return false;
+    f.text = arg.substr(at + len);
+
+    const ResultColumn& col = result_column(f.column);
+    if (col.kind == RESULT_STRING) return f.op == OP_EQ || f.op == OP_NE || f.op == OP_CONTAINS;
+    if (col.kind == RESULT_FINGERPRINT) {
+        if (f.op != OP_EQ && f.op != OP_CONTAINS) return false;
+        std::string hex;
+        for (char c : f.text) {
+            if (c != ':') hex += c;
+        }
+        for (size_t i = 0; i + 2 <= hex.size(); i += 2) {
+            char* end = nullptr;
+            std::string byte = hex.substr(i, 2);
+            f.prefix.push_back(uint8_t(strtoul(byte.c_str(), &end, 16)));
+            if (*end) return false;
+        }
+        return !f.prefix.empty();
+    }
+    if (f.op == OP_CONTAINS) return false;
+    if (f.column == RESULT_TOOL) {
+        f.number = result_tool_id(f.text);
+        return f.number != 0;
+    }
+    if (f.column == RESULT_TIME && parse_time(f.text, f.number)) return true;
+    char* end = nullptr;
+    f.number = strtoll(f.text.c_str(), &end, 10);
+    return !f.text.empty() && !*end;
+}
+
+// Whether the block's min/max allow any row to match
+static bool zone_may_match(const ResultBlock& block, const Filter& f) {
+    if (result_column(f.column).kind != RESULT_INT) return true;
+    const ResultZone& z = block.zone(f.column);
+    switch (f.op) {
+        case OP_EQ: return f.number >= z.min && f.number <= z.max;
+        case OP_NE: return !(z.min == f.number && z.max == f.number);
+        case OP_LT: return z.min < f.number;
+        case OP_LE: return z.min <= f.number;
+        case OP_GT: return z.max > f.number;
+        case OP_GE: return z.max >= f.number;
+        default: return true;
+    }
+}
+
+static bool row_matches(const ResultBlock& block, uint32_t row, const Filter& f) {
+    const ResultColumn& col = result_column(f.column);
+    if (col.kind == RESULT_STRING) {
+        std::string_view s = block.string(f.column, row);
+        if (f.op == OP_CONTAINS) return s.find(f.text) != std::string_view::npos;
+        return (s == f.text) == (f.op == OP_EQ);
+    }
+    if (col.kind == RESULT_FINGERPRINT) {
+        const uint8_t* fp = block.fingerprint(f.column, row);
+        if (f.op == OP_EQ && f.prefix.size() != 32) return false;
+        return f.prefix.size() <= 32 && memcmp(fp, f.prefix.data(), f.prefix.size()) == 0;
+    }
+    int64_t v = block.value(f.column, row);
+    switch (f.op) {
+        case OP_EQ: return v == f.number;
+        case OP_NE: return v != f.number;
+        case OP_LT: return v < f.number;
+        case OP_LE: return v <= f.number;
+        case OP_GT: return v > f.number;
+        case OP_GE: return v >= f.number;
+        default: return false;
+    }
+}
+
+static std::string format_value(const ResultBlock& block, ResultColumnId c, uint32_t row) {
+    const ResultColumn& col = result_column(c);
+    if (col.kind == RESULT_STRING) return std::string(block.string(c, row));
+    if (col.kind == RESULT_FINGERPRINT) {
+        CertFingerprint fp;
+        memcpy(fp.data(), block.fingerprint(c, row), fp.size());
+        if (fp == CertFingerprint{}) return "-";
+        return cert_fingerprint_hex(fp);
+    }
+    int64_t v = block.value(c, row);
+    char buf[64];
+    switch (c) {
+        case RESULT_TOOL:
+            return result_tool_name(v);
+        case RESULT_TIME: {
+            std::time_t t = std::time_t(v / 1000);
+            std::tm tm{};
+            gmtime_r(&t, &tm);
+            strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
+            return std::string(buf) + "." + std::to_string(1000 + v % 1000).substr(1) + "Z";
+        }
+        case RESULT_BODY_HASH:
+            snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)v);
+            return buf;
+        case RESULT_CERT_NOT_AFTER:
+            return v ? cert_date(v) : "-";
+        default:
+            return std::to_string(v);
+    }
+}
+
+static bool parse_columns(const std::string& list, std::vector<ResultColumnId>& out) {
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos) comma = list.size();
+        ResultColumnId c = result_column_id(std::string_view(list).substr(start, comma - start));
+        if (c == RESULT_COLUMN_COUNT) return false;
+        out.push_back(c);
+        start = comma + 1;
+    }
+    return true;
+}
+
+static int64_t percentile(std::vector<int64_t>& values, double p) {
+    size_t k = std::min(values.size() - 1, size_t(p * double(values.size())));
+    std::nth_element(values.begin(), values.begin() + long(k), values.end());
+    return values[k];
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    enum { COUNT, LIST, GROUP_BY, STATS } action = COUNT;
+    std::vector<Filter> filters;
+    std::vector<ResultColumnId> columns = {RESULT_TIME, RESULT_TOOL, RESULT_STATUS, RESULT_TOTAL_US,
+                                           RESULT_BODY_BYTES, RESULT_URL};
+    ResultColumnId target = RESULT_COLUMN_COUNT;
+    uint64_t limit = 0;
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--count") {
+            action = COUNT;
+        } else if (arg == "--list") {
+            action = LIST;
+            if (has_value && argv[i + 1][0] != '-') {
+                columns.clear();
+                if (!parse_columns(argv[++i], columns)) {
+                    std::cerr << "Unknown column in " << argv[i] << "\n";
+                    return 1;
+                }
+            }
+        } else if ((arg == "--group-by" || arg == "--stats") && has_value) {
+            action = arg == "--stats" ? STATS : GROUP_BY;
+            target = result_column_id(argv[++i]);
+            if (target == RESULT_COLUMN_COUNT || (action == STATS && result_column(target).kind != RESULT_INT)) {
+                std::cerr << "Cannot " << arg.substr(2) << " " << argv[i] << "\n";
+                return 1;
+            }
+        } else if (arg == "--limit" && has_value) {
+            limit = std::strtoull(argv[++i], nullptr, 10);
+        } else {
+            Filter f;
+            if (!parse_filter(arg, f)) {
+                std::cerr << "Bad filter: " << arg << "\n";
+                usage(argv[0]);
+                return 1;
+            }
+            filters.push_back(f);
+        }
+    }
+
+    ResultsFile file;
+    if (!file.open(argv[1])) {
+        std::cerr << "Cannot read " << argv[1] << ": " << file.error() << "\n";
+        return 1;
+    }
+
+    if (action == LIST) {
+        for (size_t i = 0; i < columns.size(); i++) std::cout << (i ? "\t" : "") << result_column(columns[i]).name;
+        std::cout << "\n";
+    }
+
+    uint64_t matched = 0;
+    size_t skipped = 0;
+    std::map<std::string, uint64_t> groups;
+    std::vector<int64_t> values;
+    std::vector<uint32_t> rows;
+
+    for (size_t b = 0; b < file.block_count() && !(action == LIST && limit && matched >= limit); b++) {
+        ResultBlock block = file.block(b);
+        bool possible = true;
+        for (const Filter& f : filters) possible = possible && zone_may_match(block, f);
+        if (!possible) {
+            skipped++;
+            continue;
+        }
+
+        // Narrow the selection one filter (one column) at a time
+        rows.resize(block.rows());
+        for (uint32_t r = 0; r < block.rows(); r++) rows[r] = r;
+        for (const Filter& f : filters) {
+            rows.erase(std::remove_if(rows.begin(), rows.end(),
+                                      [&](uint32_t r) { return !row_matches(block, r, f); }),
+                       rows.end());
+        }
+
+        for (uint32_t r : rows) {
+            if (action == LIST && limit && matched >= limit) break;
+            matched++;
+            if (action == LIST) {
+                for (size_t i = 0; i < columns.size(); i++) {
+                    std::cout << (i ? "\t" : "") << format_value(block, columns[i], r);
+                }
+                std::cout << "\n";
+            } else if (action == GROUP_BY) {
+                groups[format_value(block, target, r)]++;
+            } else if (action == STATS) {
+                values.push_back(block.value(target, r));
+            }
+        }
+    }
+
+    if (action == COUNT) {
+        std::cout << "[Results] " << matched << " rows match\n";
+    } else if (action == GROUP_BY) {
+        std::vector<std::pair<std::string, uint64_t>> sorted(groups.begin(), groups.end());
+        std::stable_sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+        if (limit && sorted.size() > limit) sorted.resize(limit);
+        for (const auto& g : sorted) std::cout << g.second << "\t" << g.first << "\n";
+    } else if (action == STATS) {
+        const char* name = result_column(target).name;
+        if (values.empty()) {
+            std::cout << "[Stats] " << name << ": no rows\n";
+        } else {
+            long double sum = 0;
+            for (int64_t v : values) sum += v;
+            int64_t min = *std::min_element(values.begin(), values.end());
+            int64_t max = *std::max_element(values.begin(), values.end());
+            std::cout << "[Stats] " << name << ": n=" << values.size() << " min=" << min
+                      << " mean=" << int64_t(sum / values.size()) << " p50=" << percentile(values, 0.50)
+                      << " p90=" << percentile(values, 0.90) << " p99=" << percentile(values, 0.99) << " max=" << max
+                      << "\n";
+        }
+    }
+
+    std::cerr << "[Results] " << file.rows() << " rows in " << file.block_count() << " blocks (" << file.size()
+              << " bytes), " << skipped << " blocks skipped by the index, " << matched << " matched\n";
+    if (file.damaged_blocks()) {
+        std::cerr << "[Results] " << file.damaged_blocks() << " damaged block(s) skipped, " << file.skipped_bytes()
+                  << " bytes (cut short by a writer that stopped, or still being written); the blocks after them were read\n";
+    }
+    return 0;
+}
@@ -0,0 +1,526 @@
+// results_store.h
+// Append-only, column-oriented results file for large scans.
+//
+// Every probe becomes one fixed-schema row: tool, status, phase timings,
+// header, cookie and redirect counts, leaf certificate, body size and hash,
+// and a few strings (URL, IP, content type, server). Rows are buffered and
+// appended in blocks of up to kBlockRows. Inside a block each column is
+// stored contiguously, so a query that filters on status and aggregates
+// total_us only touches those two columns' pages of the memory-mapped file.
+//
+// File: "WDRSLTS1" and the column count, then blocks. A block starts with
+// its row count and size and, per column, the offset of its data and the
+// smallest and largest value in it. The chain of block headers is the
+// index: a query skips every block whose min/max rules its filters out.
+// String columns are u32 end offsets into a string heap after them.
+//
+// Appends are a single write() under flock(), so several tools can add to
+// the same file at once. A block ends with a trailer repeating a checksum
+// of its header. A block cut short by a crash is followed by whatever was
+// appended after it, so its trailer is wrong. The reader skips the block
+// and the bytes after it up to the next block that checks out. The blocks
+// after the damaged one stay readable, and the skipped bytes are reported.
+// Checking costs one page at each end of a block, not a read of its data.
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "cert_store.h"
+#include "dive.h"
+
+enum ResultColumnId : uint8_t {
+    RESULT_TIME,             // unix ms when the probe started
+    RESULT_TOOL,             // result_tool_name()
+    RESULT_STATUS,           // HTTP status of the last response
+    RESULT_CURL_CODE,        // CURLcode, 0 on success
+    RESULT_DNS_US,           // phase durations, as in the [Hop] lines
+    RESULT_CONNECT_US,
+    RESULT_TLS_US,
+    RESULT_TTFB_US,
+    RESULT_TOTAL_US,
+    RESULT_NEW_CONNECTIONS,
+    RESULT_HEADER_LINES,
+    RESULT_HEADER_BYTES,
+    RESULT_COOKIES_SET,      // Set-Cookie lines received
+    RESULT_COOKIES_SENT,
+    RESULT_REDIRECTS,
+    RESULT_BODY_BYTES,
+    RESULT_BODY_HASH,        // FNV-1a 64 of the body
+    RESULT_CERT_NOT_AFTER,   // leaf certificate expiry, unix seconds
+    RESULT_CERT_FP,          // leaf certificate SHA-256
+    RESULT_URL,
+    RESULT_IP,
+    RESULT_CONTENT_TYPE,
+    RESULT_SERVER,
+    RESULT_COLUMN_COUNT
+};
+
+enum ResultColumnKind : uint8_t { RESULT_INT, RESULT_FINGERPRINT, RESULT_STRING };
+
+struct ResultColumn {
+    const char* name;
+    ResultColumnKind kind;
+    uint8_t width;  // bytes per value for RESULT_INT
+};
+
+inline const ResultColumn& result_column(ResultColumnId id) {
+    static const ResultColumn columns[RESULT_COLUMN_COUNT] = {
+        {"time", RESULT_INT, 8},         {"tool", RESULT_INT, 1},
+        {"status", RESULT_INT, 2},       {"curl_code", RESULT_INT, 2},
+        {"dns_us", RESULT_INT, 4},       {"connect_us", RESULT_INT, 4},
+        {"tls_us", RESULT_INT, 4},       {"ttfb_us", RESULT_INT, 4},
+        {"total_us", RESULT_INT, 4},     {"new_connections", RESULT_INT, 2},
+        {"header_lines", RESULT_INT, 2}, {"header_bytes", RESULT_INT, 4},
+        {"cookies_set", RESULT_INT, 2},  {"cookies_sent", RESULT_INT, 2},
+        {"redirects", RESULT_INT, 2},    {"body_bytes", RESULT_INT, 8},
+        {"body_hash", RESULT_INT, 8},    {"cert_not_after", RESULT_INT, 8},
+        {"cert_fp", RESULT_FINGERPRINT, 32},
+        {"url", RESULT_STRING, 0},       {"ip", RESULT_STRING, 0},
+        {"content_type", RESULT_STRING, 0}, {"server", RESULT_STRING, 0},
+    };
+    return columns[id];
+}
+
+// RESULT_COLUMN_COUNT when there is no such column
+inline ResultColumnId result_column_id(std::string_view name) {
+    for (int id = 0; id < RESULT_COLUMN_COUNT; id++) {
+        if (name == result_column(ResultColumnId(id)).name) return ResultColumnId(id);
+    }
+    return RESULT_COLUMN_COUNT;
+}
+
+inline const char* result_tool_name(int64_t id) {
+    static const char* names[] = {"unknown", "header", "cookies", "redirect", "tls",
+                                  "html_body", "certchain", "dive", "crawl"};
+    return id >= 0 && id < int64_t(sizeof(names) / sizeof(names[0])) ? names[id] : "unknown";
+}
+
+inline int64_t result_tool_id(std::string_view name) {
+    for (int64_t id = 1; id < 16; id++) {
+        if (name == result_tool_name(id)) return id;
+    }
+    return 0;
+}
+
+struct ResultFileHeader {
+    char magic[8];
+    uint32_t columns;
+    uint32_t reserved;
+};
+
+struct ResultZone {
+    uint64_t offset;  // from the start of the block
+    int64_t min;
+    int64_t max;
+};
+
+struct ResultBlockHeader {
+    char magic[4];
+    uint32_t rows;
+    uint64_t bytes;  // whole block, header included
+    ResultZone zones[RESULT_COLUMN_COUNT];
+};
+
+static const char kResultFileMagic[8] = {'W', 'D', 'R', 'S', 'L', 'T', 'S', '1'};
+// Blocks with a trailer; BLK1 blocks (without one) are still read
+static const char kResultBlockMagic[4] = {'B', 'L', 'K', '2'};
+static const char kResultBlockMagicV1[4] = {'B', 'L', 'K', '1'};
+
+struct ResultBlockTrailer {
+    char magic[4];      // "BEND"
+    uint32_t checksum;  // result_block_checksum() of the header
+};
+
+static const char kResultTrailerMagic[4] = {'B', 'E', 'N', 'D'};
+
+// FNV-1a 32 of the block header, its byte count included
+inline uint32_t result_block_checksum(const ResultBlockHeader& header) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(&header);
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < sizeof(header); i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Buffers rows and appends them to the file a block at a time
+class ResultsWriter {
+public:
+    static constexpr uint32_t kBlockRows = 4096;
+
+    ResultsWriter(const std::string& path, const std::string& tool)
+        : path_(path), tool_(result_tool_id(tool)) {
+        fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd_ < 0) {
+            error_ = strerror(errno);
+            return;
+        }
+        // The first writer of an empty file writes its header
+        flock(fd_, LOCK_EX);
+        struct stat st;
+        ResultFileHeader header;
+        if (fstat(fd_, &st) == 0 && st.st_size == 0) {
+            memcpy(header.magic, kResultFileMagic, sizeof(header.magic));
+            header.columns = RESULT_COLUMN_COUNT;
+            header.reserved = 0;
+            if (write(fd_, &header, sizeof(header)) != ssize_t(sizeof(header))) error_ = strerror(errno);
+        } else if (pread(fd_, &header, sizeof(header), 0) != ssize_t(sizeof(header)) ||
+                   memcmp(header.magic, kResultFileMagic, sizeof(header.magic)) != 0 ||
+                   header.columns != RESULT_COLUMN_COUNT) {
+            error_ = "not a results file of this version";
+        }
+        flock(fd_, LOCK_UN);
+        if (!error_.empty()) {
+            close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    ~ResultsWriter() {
+        flush();
+        if (fd_ >= 0) close(fd_);
+    }
+
+    ResultsWriter(const ResultsWriter&) = delete;
+    ResultsWriter& operator=(const ResultsWriter&) = delete;
+
+    bool ok() const { return fd_ >= 0; }
+    const std::string& error() const { return error_; }
+    const std::string& path() const { return path_; }
+    uint64_t rows_written() const { return written_; }
+
+    // Safe to call from several threads
+    void append(const DiveResult& r) {
+        int64_t v[RESULT_COLUMN_COUNT] = {};
+        v[RESULT_TIME] = std::chrono::duration_cast<std::chrono::milliseconds>(r.started.time_since_epoch()).count();
+        v[RESULT_TOOL] = tool_;
+        v[RESULT_STATUS] = r.response_code;
+        v[RESULT_CURL_CODE] = r.code;
+
+        const DiveTimings& t = r.timings;
+        auto phase = [](curl_off_t end, curl_off_t start) { return end > start ? int64_t(end - start) : 0; };
+        v[RESULT_DNS_US] = t.namelookup;
+        v[RESULT_CONNECT_US] = phase(t.connect, t.namelookup);
+        v[RESULT_TLS_US] = t.appconnect > 0 ? phase(t.appconnect, t.connect) : 0;
+        v[RESULT_TTFB_US] = phase(t.starttransfer, t.pretransfer);
+        v[RESULT_TOTAL_US] = r.total_time_us;
+        v[RESULT_NEW_CONNECTIONS] = r.new_connections;
+        v[RESULT_HEADER_LINES] = int64_t(r.headers.size());
+        v[RESULT_HEADER_BYTES] = int64_t(r.headers.raw().size());
+        int64_t cookies = 0;
+        r.headers.each(HEADER_SET_COOKIE, [&](const HeaderLine&) { cookies++; });
+        v[RESULT_COOKIES_SET] = cookies;
+        v[RESULT_COOKIES_SENT] = int64_t(r.cookies_sent);
+        v[RESULT_REDIRECTS] = r.hops.empty() ? 0 : int64_t(r.hops.size()) - 1;
+        v[RESULT_BODY_BYTES] = r.download_bytes;
+        v[RESULT_BODY_HASH] = int64_t(r.body_hash);
+
+        CertFingerprint fp{};
+        if (r.tls.has_leaf) {
+            v[RESULT_CERT_NOT_AFTER] = r.tls.leaf.not_after;
+            cert_fingerprint_parse(r.tls.leaf.sha256, fp);
+        }
+
+        std::string_view strings[RESULT_COLUMN_COUNT];
+        strings[RESULT_URL] = r.url;
+        strings[RESULT_IP] = r.primary_ip;
+        strings[RESULT_CONTENT_TYPE] = r.headers.last(HEADER_CONTENT_TYPE);
+        strings[RESULT_SERVER] = r.headers.last(HEADER_SERVER);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (fd_ < 0) return;
+        for (int c = 0; c < RESULT_COLUMN_COUNT; c++) {
+            const ResultColumn& col = result_column(ResultColumnId(c));
+            if (col.kind == RESULT_INT) {
+                // Clamp into the column's width, keeping zone maps honest
+                int64_t value = v[c];
+                if (col.width < 8) {
+                    int64_t limit = (int64_t(1) << (8 * col.width - 1)) - 1;
+                    value = std::max(-limit - 1, std::min(limit, value));
+                }
+                ints_[c].push_back(value);
+            } else if (col.kind == RESULT_FINGERPRINT) {
+                fingerprints_.push_back(fp);
+            } else {
+                heaps_[c].append(strings[c].substr(0, 65535));
+                ends_[c].push_back(uint32_t(heaps_[c].size()));
+            }
+        }
+        if (++rows_ == kBlockRows) write_block();
+    }
+
+    // Append the rows buffered so far. Returns false on a write error.
+    bool flush() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (rows_ > 0) write_block();
+        return error_.empty();
+    }
+
+private:
+    static size_t align8(size_t n) { return (n + 7) & ~size_t(7); }
+
+    void write_block() {
+        std::vector<char> block(sizeof(ResultBlockHeader));
+        ResultBlockHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, kResultBlockMagic, sizeof(header.magic));
+        header.rows = rows_;
+
+        auto put = [&](const void* data, size_t size) {
+            size_t at = block.size();
+            block.resize(align8(at + size));
+            memcpy(block.data() + at, data, size);
+        };
+        for (int c = 0; c < RESULT_COLUMN_COUNT; c++) {
+            const ResultColumn& col = result_column(ResultColumnId(c));
+            ResultZone& zone = header.zones[c];
+            zone.offset = block.size();
+            if (col.kind == RESULT_INT) {
+                const std::vector<int64_t>& values = ints_[c];
+                zone.min = *std::min_element(values.begin(), values.end());
+                zone.max = *std::max_element(values.begin(), values.end());
+                std::vector<char> packed(values.size() * col.width);
+                // Little-endian: the low bytes of each value are the value
+                for (size_t i = 0; i < values.size(); i++) memcpy(&packed[i * col.width], &values[i], col.width);
+                put(packed.data(), packed.size());
+            } else if (col.kind == RESULT_FINGERPRINT) {
+                put(fingerprints_.data(), fingerprints_.size() * sizeof(CertFingerprint));
+            } else {
+                // The heap follows the offsets directly
+                std::string packed(reinterpret_cast<const char*>(ends_[c].data()), ends_[c].size() * sizeof(uint32_t));
+                packed += heaps_[c];
+                put(packed.data(), packed.size());
+            }
+        }
+        header.bytes = block.size() + sizeof(ResultBlockTrailer);
+        memcpy(block.data(), &header, sizeof(header));
+        ResultBlockTrailer trailer;
+        memcpy(trailer.magic, kResultTrailerMagic, sizeof(trailer.magic));
+        trailer.checksum = result_block_checksum(header);
+        put(&trailer, sizeof(trailer));
+
+        flock(fd_, LOCK_EX);
+        ssize_t n = write(fd_, block.data(), block.size());
+        flock(fd_, LOCK_UN);
+        if (n != ssize_t(block.size())) {
+            error_ = n < 0 ? strerror(errno) : "short write";
+        } else {
+            written_ += rows_;
+        }
+
+        rows_ = 0;
+        for (auto& column : ints_) column.clear();
+        for (auto& column : ends_) column.clear();
+        for (auto& heap : heaps_) heap.clear();
+        fingerprints_.clear();
+    }
+
+    std::string path_;
+    int64_t tool_;
+    int fd_ = -1;
+    std::string error_;
+    std::mutex mutex_;
+    uint32_t rows_ = 0;
+    uint64_t written_ = 0;
+    std::vector<int64_t> ints_[RESULT_COLUMN_COUNT];
+    std::vector<uint32_t> ends_[RESULT_COLUMN_COUNT];
+    std::string heaps_[RESULT_COLUMN_COUNT];
+    std::vector<CertFingerprint> fingerprints_;
+};
+
+// One block of a mapped results file
+class ResultBlock {
+public:
+    explicit ResultBlock(const char* base) : base_(base) { memcpy(&header_, base, sizeof(header_)); }
+
+    uint32_t rows() const { return header_.rows; }
+    const ResultZone& zone(ResultColumnId c) const { return header_.zones[c]; }
+
+    int64_t value(ResultColumnId c, uint32_t row) const {
+        uint8_t width = result_column(c).width;
+        const char* p = base_ + header_.zones[c].offset + size_t(row) * width;
+        switch (width) {
+            case 1: return int8_t(*p);
+            case 2: { int16_t v; memcpy(&v, p, 2); return v; }
+            case 4: { int32_t v; memcpy(&v, p, 4); return v; }
+            default: { int64_t v; memcpy(&v, p, 8); return v; }
+        }
+    }
+
+    const uint8_t* fingerprint(ResultColumnId c, uint32_t row) const {
+        return reinterpret_cast<const uint8_t*>(base_ + header_.zones[c].offset) + size_t(row) * 32;
+    }
+
+    std::string_view string(ResultColumnId c, uint32_t row) const {
+        const char* ends = base_ + header_.zones[c].offset;
+        uint32_t start = 0, end;
+        if (row > 0) memcpy(&start, ends + (row - 1) * sizeof(uint32_t), sizeof(uint32_t));
+        memcpy(&end, ends + size_t(row) * sizeof(uint32_t), sizeof(uint32_t));
+        const char* heap = ends + size_t(header_.rows) * sizeof(uint32_t);
+        return std::string_view(heap + start, end - start);
+    }
+
+private:
+    const char* base_;
+    ResultBlockHeader header_;
+};
+
+// Read-only view of a results file, mapped rather than read, so only the
+// columns a query touches are paged in
+class ResultsFile {
+public:
+    ResultsFile() = default;
+    ~ResultsFile() {
+        if (data_) munmap(const_cast<char*>(data_), size_);
+    }
+    ResultsFile(const ResultsFile&) = delete;
+    ResultsFile& operator=(const ResultsFile&) = delete;
+
+    bool open(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            error_ = strerror(errno);
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(ResultFileHeader)) {
+            close(fd);
+            error_ = "not a results file";
+            return false;
+        }
+        size_ = size_t(st.st_size);
+        void* map = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) {
+            error_ = strerror(errno);
+            return false;
+        }
+        data_ = static_cast<const char*>(map);
+
+        ResultFileHeader header;
+        memcpy(&header, data_, sizeof(header));
+        if (memcmp(header.magic, kResultFileMagic, sizeof(header.magic)) != 0 ||
+            header.columns != RESULT_COLUMN_COUNT) {
+            error_ = "not a results file of this version";
+            return false;
+        }
+
+        // Walk the block headers. A block that does not check out is
+        // skipped up to the next one that does; after damage only blocks
+        // with a trailer are trusted, since a BLK1 magic may be row data.
+        bool damaged = false;
+        for (size_t at = sizeof(header); at < size_;) {
+            uint64_t bytes = 0;
+            if (valid_block(at, !damaged, bytes)) {
+                blocks_.push_back(at);
+                rows_ += reinterpret_cast<const ResultBlockHeader*>(data_ + at)->rows;
+                at += bytes;
+                continue;
+            }
+            damaged = true;
+            size_t next = next_block(at + 1);
+            skipped_bytes_ += next - at;
+            damaged_blocks_++;
+            at = next;
+        }
+        return true;
+    }
+
+    const std::string& error() const { return error_; }
+    size_t size() const { return size_; }
+    size_t block_count() const { return blocks_.size(); }
+    uint64_t rows() const { return rows_; }
+    ResultBlock block(size_t i) const { return ResultBlock(data_ + blocks_[i]); }
+
+    // Damage found by open(): runs of bytes that were not a complete
+    // block (a writer that died mid-block, or a block still being written)
+    uint64_t damaged_blocks() const { return damaged_blocks_; }
+    uint64_t skipped_bytes() const { return skipped_bytes_; }
+
+private:
+    // A whole block at at: known magic, a size within the file and its
+    // zones, and for BLK2 a trailer at its end matching the header
+    bool valid_block(size_t at, bool accept_v1, uint64_t& bytes) const {
+        if (size_ - at < sizeof(ResultBlockHeader)) return false;
+        ResultBlockHeader block;
+        memcpy(&block, data_ + at, sizeof(block));
+        bool v2 = memcmp(block.magic, kResultBlockMagic, sizeof(block.magic)) == 0;
+        bool v1 = accept_v1 && memcmp(block.magic, kResultBlockMagicV1, sizeof(block.magic)) == 0;
+        size_t least = sizeof(block) + (v2 ? sizeof(ResultBlockTrailer) : 0);
+        if ((!v1 && !v2) || block.bytes < least || block.bytes > size_ - at) return false;
+        for (const ResultZone& zone : block.zones) {
+            if (zone.offset < sizeof(block) || zone.offset > block.bytes) return false;
+        }
+        if (v2) {
+            ResultBlockTrailer trailer;
+            memcpy(&trailer, data_ + at + block.bytes - sizeof(trailer), sizeof(trailer));
+            if (memcmp(trailer.magic, kResultTrailerMagic, sizeof(trailer.magic)) != 0 ||
+                trailer.checksum != result_block_checksum(block)) {
+                return false;
+            }
+        }
+        bytes = block.bytes;
+        return true;
+    }
+
+    // Start of the next block with a trailer that checks out, or the end
+    size_t next_block(size_t from) const {
+        while (from < size_) {
+            const void* hit = memmem(data_ + from, size_ - from, kResultBlockMagic, sizeof(kResultBlockMagic));
+            if (!hit) break;
+            size_t at = size_t(static_cast<const char*>(hit) - data_);
+            uint64_t bytes = 0;
+            if (valid_block(at, false, bytes)) return at;
+            from = at + 1;
+        }
+        return size_;
+    }
+
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    std::vector<size_t> blocks_;
+    uint64_t rows_ = 0;
+    uint64_t damaged_blocks_ = 0;
+    uint64_t skipped_bytes_ = 0;
+    std::string error_;
+};
+
+// "--results <file>": also append every probe to a results file. Leaves
+// out empty when not asked for; returns false (after saying why) when the
+// file cannot be used.
+inline bool open_results_arg(int argc, char* argv[], const char* tool, std::unique_ptr<ResultsWriter>& out) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--results") != 0) continue;
+        out.reset(new ResultsWriter(argv[i + 1], tool));
+        if (!out->ok()) {
+            std::cerr << "Cannot use results file " << argv[i + 1] << ": " << out->error() << "\n";
+            return false;
+        }
+        return true;
+    }
+    return true;
+}
+
+// "[Results] ..." on stderr, after writing the last block
+inline void close_results(std::unique_ptr<ResultsWriter>& results, std::ostream& out = std::cerr) {
+    if (!results) return;
+    bool ok = results->flush();
+    out << "[Results] " << results->rows_written() << " rows appended to " << results->path();
+    if (!ok) out << " (write failed: " << results->error() << ")";
+    out << "\n";
+    results.reset();
+}
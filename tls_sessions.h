@@ -0,0 +1,324 @@
+// tls_sessions.h
+// TLS session cache shared by every transfer of a tool, and kept on disk
+// between runs.
+//
+// In memory the cache is curl's own: a CURLSH sharing
+// CURL_LOCK_DATA_SSL_SESSION, so a second connection to a host in the same
+// process resumes the first one's session. curl 7.88 has no way to export
+// or import that cache, so persistence hooks into OpenSSL through
+// CURLOPT_SSL_CTX_FUNCTION instead:
+//   - the "new session" callback serialises every session (and TLS 1.3
+//     ticket) the server hands out, keyed by host and port, then passes it
+//     on to curl's own callback;
+//   - the info callback, at the start of a handshake that curl has no
+//     session for, offers the stored session from disk.
+// The file is written with save(), mode 0600 since it holds resumption
+// secrets. A long-running process (webdived) can also put curl's
+// connection pool and DNS cache in the same share with share_connections().
+//
+// Location: $WEBDIVE_TLS_CACHE, else $XDG_CACHE_HOME/webdive/tls.sessions,
+// else ~/.cache/webdive/tls.sessions. WEBDIVE_TLS_CACHE=off keeps the cache
+// in memory only.
+#pragma once
+
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <curl/curl.h>
+#include <openssl/ssl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct TlsSessionStats {
+    unsigned long stored = 0;   // sessions received from servers this run
+    unsigned long offered = 0;  // handshakes that were offered a session from disk
+};
+
+class TlsSessionCache {
+public:
+    static constexpr size_t kMaxEntries = 4096;
+
+    // Process-wide cache on the default file
+    static TlsSessionCache& shared() {
+        static TlsSessionCache cache(default_path());
+        return cache;
+    }
+
+    static std::string default_path() {
+        if (const char* env = getenv("WEBDIVE_TLS_CACHE")) return env;
+        std::string dir;
+        if (const char* xdg = getenv("XDG_CACHE_HOME")) {
+            dir = xdg;
+        } else if (const char* home = getenv("HOME")) {
+            dir = std::string(home) + "/.cache";
+        } else {
+            return "";
+        }
+        return dir + "/webdive/tls.sessions";
+    }
+
+    explicit TlsSessionCache(const std::string& path) : path_(path == "off" ? "" : path) {
+        share_ = curl_share_init();
+        curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, lock_callback);
+        curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, unlock_callback);
+        curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+        load();
+    }
+
+    ~TlsSessionCache() {
+        if (share_) curl_share_cleanup(share_);
+    }
+
+    TlsSessionCache(const TlsSessionCache&) = delete;
+    TlsSessionCache& operator=(const TlsSessionCache&) = delete;
+
+    // Share open connections and curl's DNS cache too, between every handle
+    // attached from now on. Call before the first attach().
+    void share_connections() {
+        curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+        curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    }
+
+    // Make an easy handle use the cache
+    void attach(CURL* curl) {
+        curl_easy_setopt(curl, CURLOPT_SHARE, share_);
+        curl_easy_setopt(curl, CURLOPT_SSL_CTX_FUNCTION, ssl_ctx_callback);
+        curl_easy_setopt(curl, CURLOPT_SSL_CTX_DATA, this);
+    }
+
+    // Write the sessions still valid to disk. Returns false on failure.
+    bool save() {
+        if (path_.empty()) return true;
+        std::lock_guard<std::mutex> lock(entries_mutex_);
+        if (!dirty_) return true;
+
+        size_t slash = path_.rfind('/');
+        if (slash != std::string::npos && slash > 0) {
+            std::string dir = path_.substr(0, slash);
+            for (size_t p = dir.find('/', 1); ; p = dir.find('/', p + 1)) {
+                mkdir(dir.substr(0, p).c_str(), 0700);
+                if (p == std::string::npos) break;
+            }
+        }
+
+        // Temporary file and rename, so a concurrent reader never sees half a file
+        std::string tmp = path_ + ".tmp." + std::to_string(getpid());
+        mode_t old_mask = umask(077);
+        FILE* f = fopen(tmp.c_str(), "wb");
+        umask(old_mask);
+        if (!f) return false;
+        fwrite(kMagic, sizeof(kMagic), 1, f);
+        int64_t now = time(nullptr);
+        for (const auto& entry : entries_) {
+            if (entry.second.expires <= now) continue;
+            write_field(f, entry.first);
+            write_field(f, entry.second.der);
+            fwrite(&entry.second.expires, sizeof(int64_t), 1, f);
+        }
+        bool ok = fclose(f) == 0 && rename(tmp.c_str(), path_.c_str()) == 0;
+        if (!ok) unlink(tmp.c_str());
+        dirty_ = !ok;
+        return ok;
+    }
+
+    bool persistent() const { return !path_.empty(); }
+    size_t size() {
+        std::lock_guard<std::mutex> lock(entries_mutex_);
+        return entries_.size();
+    }
+    TlsSessionStats stats() {
+        std::lock_guard<std::mutex> lock(entries_mutex_);
+        return stats_;
+    }
+
+private:
+    struct Entry {
+        std::string der;  // i2d_SSL_SESSION
+        int64_t expires;  // unix seconds
+    };
+
+    static constexpr char kMagic[8] = {'W', 'D', 'T', 'L', 'S', 'S', '1', 0};
+
+    // "host:port" of the connection curl is about to set up. curl makes
+    // a fresh SSL_CTX per connection, so the key is kept on the context.
+    static std::string connection_key(CURL* curl) {
+        char* url = nullptr;
+        if (curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &url) != CURLE_OK || !url) return "";
+        CURLU* u = curl_url();
+        char* host = nullptr;
+        char* port = nullptr;
+        std::string key;
+        if (curl_url_set(u, CURLUPART_URL, url, 0) == CURLUE_OK &&
+            curl_url_get(u, CURLUPART_HOST, &host, 0) == CURLUE_OK &&
+            curl_url_get(u, CURLUPART_PORT, &port, CURLU_DEFAULT_PORT) == CURLUE_OK) {
+            key = std::string(host) + ":" + port;
+            for (char& c : key) c = char(tolower(static_cast<unsigned char>(c)));
+        }
+        curl_free(host);
+        curl_free(port);
+        curl_url_cleanup(u);
+        return key;
+    }
+
+    static const std::string* context_key(const SSL* ssl) {
+        return static_cast<const std::string*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), key_index()));
+    }
+
+    static void write_field(FILE* f, const std::string& s) {
+        uint32_t n = uint32_t(s.size());
+        fwrite(&n, sizeof(n), 1, f);
+        fwrite(s.data(), 1, n, f);
+    }
+
+    static bool read_field(FILE* f, std::string& s) {
+        uint32_t n = 0;
+        if (fread(&n, sizeof(n), 1, f) != 1 || n > (1u << 20)) return false;
+        s.resize(n);
+        return n == 0 || fread(&s[0], 1, n, f) == n;
+    }
+
+    void load() {
+        if (path_.empty()) return;
+        FILE* f = fopen(path_.c_str(), "rb");
+        if (!f) return;
+        char magic[sizeof(kMagic)];
+        if (fread(magic, sizeof(magic), 1, f) == 1 && memcmp(magic, kMagic, sizeof(kMagic)) == 0) {
+            int64_t now = time(nullptr);
+            std::string key;
+            Entry entry;
+            while (entries_.size() < kMaxEntries && read_field(f, key) && read_field(f, entry.der) &&
+                   fread(&entry.expires, sizeof(int64_t), 1, f) == 1) {
+                if (entry.expires > now) entries_[key] = entry;
+            }
+        }
+        fclose(f);
+    }
+
+    static CURLcode ssl_ctx_callback(CURL* curl, void* ssl_ctx, void* userptr) {
+        SSL_CTX* ctx = static_cast<SSL_CTX*>(ssl_ctx);
+        std::string key = connection_key(curl);
+        if (key.empty()) return CURLE_OK;
+        SSL_CTX_set_ex_data(ctx, key_index(), new std::string(key));
+        // curl installs its own new-session callback before calling us;
+        // keep it so the in-memory cache still gets every session
+        SSL_CTX_set_ex_data(ctx, ctx_index(), userptr);
+        SSL_CTX_set_ex_data(ctx, chain_index(), reinterpret_cast<void*>(SSL_CTX_sess_get_new_cb(ctx)));
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL);
+        SSL_CTX_sess_set_new_cb(ctx, new_session_callback);
+        SSL_CTX_set_info_callback(ctx, info_callback);
+        return CURLE_OK;
+    }
+
+    static int ctx_index() {
+        static int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+        return index;
+    }
+
+    static int key_index() {
+        static int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, free_key);
+        return index;
+    }
+
+    static void free_key(void*, void* ptr, CRYPTO_EX_DATA*, int, long, void*) {
+        delete static_cast<std::string*>(ptr);
+    }
+
+    static int chain_index() {
+        static int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+        return index;
+    }
+
+    using NewSessionFn = int (*)(SSL*, SSL_SESSION*);
+
+    static int new_session_callback(SSL* ssl, SSL_SESSION* session) {
+        SSL_CTX* ctx = SSL_get_SSL_CTX(ssl);
+        auto* self = static_cast<TlsSessionCache*>(SSL_CTX_get_ex_data(ctx, ctx_index()));
+        if (self) self->remember(ssl, session);
+        auto chained = reinterpret_cast<NewSessionFn>(SSL_CTX_get_ex_data(ctx, chain_index()));
+        return chained ? chained(ssl, session) : 0;
+    }
+
+    // At the start of a handshake curl has no session for, offer the one
+    // from disk. The ClientHello is not built yet at this point.
+    static void info_callback(const SSL* const_ssl, int where, int) {
+        if (!(where & SSL_CB_HANDSHAKE_START)) return;
+        SSL* ssl = const_cast<SSL*>(const_ssl);
+        if (SSL_get_session(ssl)) return;
+        auto* self = static_cast<TlsSessionCache*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), ctx_index()));
+        if (self) self->offer(ssl);
+    }
+
+    void remember(SSL* ssl, SSL_SESSION* session) {
+        const std::string* key = context_key(ssl);
+        int len = i2d_SSL_SESSION(session, nullptr);
+        if (!key || !SSL_SESSION_is_resumable(session) || len <= 0) return;
+        Entry entry;
+        entry.der.resize(size_t(len));
+        unsigned char* p = reinterpret_cast<unsigned char*>(&entry.der[0]);
+        i2d_SSL_SESSION(session, &p);
+        entry.expires = int64_t(SSL_SESSION_get_time(session)) + SSL_SESSION_get_timeout(session);
+
+        std::lock_guard<std::mutex> lock(entries_mutex_);
+        if (entries_.size() >= kMaxEntries && !entries_.count(*key)) return;
+        entries_[*key] = std::move(entry);
+        stats_.stored++;
+        dirty_ = true;
+    }
+
+    void offer(SSL* ssl) {
+        const std::string* key = context_key(ssl);
+        if (!key) return;
+        std::string der;
+        {
+            std::lock_guard<std::mutex> lock(entries_mutex_);
+            auto it = entries_.find(*key);
+            if (it == entries_.end() || it->second.expires <= time(nullptr)) return;
+            der = it->second.der;
+        }
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(der.data());
+        SSL_SESSION* session = d2i_SSL_SESSION(nullptr, &p, long(der.size()));
+        if (!session) return;
+        if (SSL_set_session(ssl, session) == 1) {
+            std::lock_guard<std::mutex> lock(entries_mutex_);
+            stats_.offered++;
+        }
+        SSL_SESSION_free(session);
+    }
+
+    // One lock per kind of shared data: curl may take the session lock
+    // while it holds the connection lock
+    static void lock_callback(CURL*, curl_lock_data data, curl_lock_access, void* userptr) {
+        static_cast<TlsSessionCache*>(userptr)->share_mutex_[data].lock();
+    }
+
+    static void unlock_callback(CURL*, curl_lock_data data, void* userptr) {
+        static_cast<TlsSessionCache*>(userptr)->share_mutex_[data].unlock();
+    }
+
+    std::string path_;
+    CURLSH* share_ = nullptr;
+    std::mutex share_mutex_[CURL_LOCK_DATA_LAST];
+    std::mutex entries_mutex_;
+    std::map<std::string, Entry> entries_;
+    TlsSessionStats stats_;
+    bool dirty_ = false;
+};
+
+// "[TLS cache] ..." on stderr, after saving the cache
+inline void save_tls_session_cache(std::ostream& out = std::cerr) {
+    TlsSessionCache& cache = TlsSessionCache::shared();
+    TlsSessionStats s = cache.stats();
+    bool saved = cache.save();
+    out << "[TLS cache] " << cache.size() << " sessions, " << s.stored << " received, " << s.offered
+        << " offered from disk";
+    if (!saved) out << " (failed to save)";
+    out << "\n";
+}
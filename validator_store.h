@@ -0,0 +1,238 @@
+// validator_store.h
+// Per-URL validators for incremental re-scans.
+//
+// For every URL fetched, the store keeps the ETag and Last-Modified of the
+// response and the size and FNV-1a hash of its body. The next scan sends
+// them back as If-None-Match / If-Modified-Since: a 304 means the URL is
+// unchanged and its body is not downloaded again. A 200 whose body hashes
+// the same as last time (a server that ignores validators) also counts as
+// unchanged, so only bodies that really changed are processed again.
+//
+// File: "WDVALID1", then per entry the URL, ETag and Last-Modified
+// (length-prefixed), the body size and hash, and the last check as i64
+// unix seconds. Written to a temporary file and renamed.
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// What a re-scan found for one URL
+enum ValidatorChange : uint8_t {
+    VALIDATOR_NONE,          // no store, or the transfer failed
+    VALIDATOR_NEW,           // not seen before
+    VALIDATOR_NOT_MODIFIED,  // 304: the stored validators still match
+    VALIDATOR_SAME_CONTENT,  // full response, but the same body (or the same validators for HEAD)
+    VALIDATOR_MODIFIED,
+};
+
+inline const char* validator_change_name(ValidatorChange change) {
+    switch (change) {
+        case VALIDATOR_NEW: return "new";
+        case VALIDATOR_NOT_MODIFIED: return "unchanged (304 Not Modified)";
+        case VALIDATOR_SAME_CONTENT: return "unchanged (same content)";
+        case VALIDATOR_MODIFIED: return "changed";
+        default: return "unknown";
+    }
+}
+
+struct ValidatorStats {
+    unsigned long urls = 0;
+    unsigned long fresh = 0;  // new
+    unsigned long not_modified = 0;
+    unsigned long same_content = 0;
+    unsigned long modified = 0;
+    uint64_t bytes_downloaded = 0;
+    uint64_t bytes_saved = 0;  // bodies not downloaded thanks to a 304
+};
+
+class ValidatorStore {
+public:
+    static constexpr size_t kMaxEntries = 1 << 22;
+
+    struct Entry {
+        std::string etag;
+        std::string last_modified;
+        int64_t body_size = -1;  // -1: body never seen (HEAD requests)
+        uint64_t body_hash = 0;
+        int64_t checked = 0;
+    };
+
+    explicit ValidatorStore(const std::string& path) : path_(path) { load(); }
+
+    ValidatorStore(const ValidatorStore&) = delete;
+    ValidatorStore& operator=(const ValidatorStore&) = delete;
+
+    // Request headers for a conditional request to url; empty when nothing
+    // is stored for it
+    std::vector<std::string> conditional_headers(const std::string& url) {
+        std::vector<std::string> out;
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(url);
+        if (it == entries_.end()) return out;
+        if (!it->second.etag.empty()) out.push_back("If-None-Match: " + it->second.etag);
+        if (!it->second.last_modified.empty()) out.push_back("If-Modified-Since: " + it->second.last_modified);
+        return out;
+    }
+
+    // Record a finished response and classify it. body_hash/body_size are
+    // only meaningful when has_body is true. Returns the bytes a 304 saved
+    // through saved.
+    ValidatorChange record(const std::string& url, long status, std::string_view etag, std::string_view last_modified,
+                           bool has_body, int64_t body_size, uint64_t body_hash, uint64_t downloaded,
+                           uint64_t* saved = nullptr) {
+        if (status != 304 && (status < 200 || status > 299)) return VALIDATOR_NONE;
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.urls++;
+        stats_.bytes_downloaded += downloaded;
+        auto it = entries_.find(url);
+        bool known = it != entries_.end();
+        if (!known && entries_.size() >= kMaxEntries) return VALIDATOR_NEW;
+        Entry& entry = entries_[url];
+        entry.checked = int64_t(time(nullptr));
+        dirty_ = true;
+
+        ValidatorChange change;
+        if (status == 304) {
+            change = VALIDATOR_NOT_MODIFIED;
+            uint64_t bytes = has_body && entry.body_size > 0 ? uint64_t(entry.body_size) : 0;  // HEAD saves nothing
+            stats_.bytes_saved += bytes;
+            if (saved) *saved = bytes;
+            // A 304 may carry an updated ETag; the rest of the entry stands
+            if (!etag.empty()) entry.etag.assign(etag);
+            if (!last_modified.empty()) entry.last_modified.assign(last_modified);
+        } else {
+            if (!known) {
+                change = VALIDATOR_NEW;
+            } else if (has_body && entry.body_size >= 0) {
+                change = entry.body_hash == body_hash && entry.body_size == body_size ? VALIDATOR_SAME_CONTENT
+                                                                                      : VALIDATOR_MODIFIED;
+            } else {
+                bool same = (!etag.empty() && etag == entry.etag) ||
+                            (etag.empty() && !last_modified.empty() && last_modified == entry.last_modified);
+                change = same ? VALIDATOR_SAME_CONTENT : VALIDATOR_MODIFIED;
+            }
+            entry.etag.assign(etag);
+            entry.last_modified.assign(last_modified);
+            if (has_body) {
+                entry.body_size = body_size;
+                entry.body_hash = body_hash;
+            }
+        }
+
+        switch (change) {
+            case VALIDATOR_NEW: stats_.fresh++; break;
+            case VALIDATOR_NOT_MODIFIED: stats_.not_modified++; break;
+            case VALIDATOR_SAME_CONTENT: stats_.same_content++; break;
+            default: stats_.modified++; break;
+        }
+        return change;
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return entries_.size();
+    }
+
+    ValidatorStats stats() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+    // Write the entries to disk. Returns false on failure.
+    bool save() {
+        if (path_.empty()) return true;
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!dirty_) return true;
+
+        std::string tmp = path_ + ".tmp." + std::to_string(getpid());
+        FILE* f = fopen(tmp.c_str(), "wb");
+        if (!f) return false;
+        fwrite(kMagic, sizeof(kMagic), 1, f);
+        for (const auto& e : entries_) {
+            write_field(f, e.first);
+            write_field(f, e.second.etag);
+            write_field(f, e.second.last_modified);
+            fwrite(&e.second.body_size, sizeof(int64_t), 1, f);
+            fwrite(&e.second.body_hash, sizeof(uint64_t), 1, f);
+            fwrite(&e.second.checked, sizeof(int64_t), 1, f);
+        }
+        bool ok = fclose(f) == 0 && rename(tmp.c_str(), path_.c_str()) == 0;
+        if (!ok) unlink(tmp.c_str());
+        dirty_ = !ok;
+        return ok;
+    }
+
+private:
+    static constexpr char kMagic[8] = {'W', 'D', 'V', 'A', 'L', 'I', 'D', '1'};
+
+    static void write_field(FILE* f, const std::string& s) {
+        uint32_t n = uint32_t(s.size());
+        fwrite(&n, sizeof(n), 1, f);
+        fwrite(s.data(), 1, n, f);
+    }
+
+    static bool read_field(FILE* f, std::string& s) {
+        uint32_t n = 0;
+        if (fread(&n, sizeof(n), 1, f) != 1 || n > (1u << 16)) return false;
+        s.resize(n);
+        return n == 0 || fread(&s[0], 1, n, f) == n;
+    }
+
+    void load() {
+        if (path_.empty()) return;
+        FILE* f = fopen(path_.c_str(), "rb");
+        if (!f) return;
+        char magic[sizeof(kMagic)];
+        if (fread(magic, sizeof(magic), 1, f) == 1 && memcmp(magic, kMagic, sizeof(kMagic)) == 0) {
+            std::string url;
+            Entry entry;
+            while (entries_.size() < kMaxEntries && read_field(f, url) && read_field(f, entry.etag) &&
+                   read_field(f, entry.last_modified) && fread(&entry.body_size, sizeof(int64_t), 1, f) == 1 &&
+                   fread(&entry.body_hash, sizeof(uint64_t), 1, f) == 1 &&
+                   fread(&entry.checked, sizeof(int64_t), 1, f) == 1) {
+                entries_[url] = entry;
+            }
+        }
+        fclose(f);
+    }
+
+    std::string path_;
+    std::mutex mutex_;
+    std::unordered_map<std::string, Entry> entries_;
+    ValidatorStats stats_;
+    bool dirty_ = false;
+};
+
+// --incremental <file>: the store to send validators from and record into
+inline void open_validators_arg(int argc, char* argv[], std::unique_ptr<ValidatorStore>& out) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--incremental") == 0) out.reset(new ValidatorStore(argv[i + 1]));
+    }
+}
+
+// "[Incremental] ..." summary, after saving the store
+inline void save_validators(ValidatorStore& store, std::ostream& out = std::cerr) {
+    ValidatorStats s = store.stats();
+    bool saved = store.save();
+    unsigned long unchanged = s.not_modified + s.same_content;
+    uint64_t full = s.bytes_downloaded + s.bytes_saved;
+    out << "[Incremental] " << s.urls << " URLs: " << unchanged << " unchanged (" << s.not_modified << " 304, "
+        << s.same_content << " same content), " << s.modified << " changed, " << s.fresh << " new; "
+        << s.bytes_downloaded << " bytes downloaded, " << s.bytes_saved << " saved vs a full scan";
+    if (full > 0) out << " (" << std::fixed << std::setprecision(1) << 100.0 * double(s.bytes_saved) / double(full) << "%)";
+    out.unsetf(std::ios::fixed);
+    if (!saved) out << " (failed to save)";
+    out << "\n";
+}
@@ -0,0 +1,366 @@
+// webdived.cpp
+// Resident probe daemon. Keeps one process warm - libcurl and OpenSSL
+// initialised, open connections, the DNS cache and TLS sessions - and runs
+// the tools' single-URL probes for clients on a Unix socket (see
+// daemon_protocol.h). A second look at the same host reuses the open
+// connection instead of paying for DNS, TCP and TLS again.
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <poll.h>
+#include <sys/stat.h>
+#include <curl/curl.h>
+#include "dive.h"
+#include "daemon_protocol.h"
+
+std::atomic<bool> g_stop{false};
+
+void on_signal(int) { g_stop = true; }
+
+// Sends what is written to it as frames of one type, whenever the buffer
+// fills up and when flushed
+class FrameStreambuf : public std::streambuf {
+public:
+    FrameStreambuf(int fd, DaemonFrameType type) : fd_(fd), type_(type) {
+        setp(buffer_, buffer_ + sizeof(buffer_));
+    }
+
+    ~FrameStreambuf() override { sync(); }
+
+protected:
+    int_type overflow(int_type c) override {
+        if (sync() != 0) return traits_type::eof();
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync() override {
+        size_t size = size_t(pptr() - pbase());
+        if (size == 0) return 0;
+        setp(buffer_, buffer_ + sizeof(buffer_));
+        // A client that went away is not an error for the probe itself
+        if (!failed_ && !daemon_write_frame(fd_, type_, buffer_, size)) failed_ = true;
+        return 0;
+    }
+
+private:
+    int fd_;
+    DaemonFrameType type_;
+    bool failed_ = false;
+    char buffer_[64 * 1024];
+};
+
+// One request: where its output goes, and what the summary line reports
+struct Probe {
+    std::string url;
+    std::ostream& out;
+    std::ostream& err;
+    long new_connections = -1;  // -1 when the probe made no transfer
+};
+
+// Every probe goes through the shared cache, and with it the connection
+// pool and DNS cache
+static DiveOptions probe_options() {
+    DiveOptions options;
+    options.tls_sessions = &TlsSessionCache::shared();
+    return options;
+}
+
+static int probe_dns(Probe& p) {
+    DiveOptions options = probe_options();
+    DiveTransfer transfer(p.url, options);
+    print_dns(transfer.result, p.out);
+    return transfer.result.resolved ? 0 : 1;
+}
+
+static int probe_tls(Probe& p) {
+    DiveOptions options = probe_options();
+    options.follow_redirects = false;
+    options.keep_body = false;
+    options.debug_events = false;
+    options.certinfo = false;
+
+    p.out << "Connecting to: " << p.url << "\n";
+    DiveResult result = dive(p.url, options);
+    p.new_connections = result.new_connections;
+    if (!result.ok()) {
+        p.err << "curl_easy_perform() failed: " << result.error() << "\n";
+        return 1;
+    }
+    if (!result.tls.available) {
+        p.err << "Failed to get SSL session info.\n";
+        return 1;
+    }
+    print_tls(result, p.out);
+    print_tls_handshake(result, p.out);
+    return 0;
+}
+
+static int probe_header(Probe& p) {
+    DiveOptions options = probe_options();
+    options.nobody = true;
+    options.follow_redirects = false;
+    options.keep_body = false;
+    options.debug_events = false;
+    options.tls_info = false;
+    options.certinfo = false;
+
+    DiveResult result = dive(p.url, options);
+    p.new_connections = result.new_connections;
+    print_headers(result, p.out);
+    if (!result.ok()) p.out << "curl_easy_perform() failed: " << result.error() << "\n";
+    return 0;
+}
+
+static int probe_cookies(Probe& p) {
+    DiveOptions options = probe_options();
+    options.follow_redirects = false;
+    options.keep_body = false;
+    options.debug_events = false;
+    options.tls_info = false;
+    options.certinfo = false;
+
+    p.out << "Performing request to: " << p.url << "\n\n";
+    DiveResult result = dive(p.url, options);
+    p.new_connections = result.new_connections;
+    print_cookies(result, p.out);
+    if (!result.ok()) p.err << "\ncurl_easy_perform() failed: " << result.error() << "\n";
+    p.out << "\nRequest complete.\n";
+    return 0;
+}
+
+static int probe_body(Probe& p) {
+    DiveOptions options = probe_options();
+    options.follow_redirects = false;
+    options.debug_events = false;
+    options.tls_info = false;
+    options.certinfo = false;
+
+    DiveResult result = dive(p.url, options);
+    p.new_connections = result.new_connections;
+    if (!result.ok()) {
+        p.out << "curl_easy_perform() failed: " << result.error() << "\n";
+    } else {
+        print_body(result, p.out);
+    }
+    return 0;
+}
+
+static int probe_redirect(Probe& p) {
+    DiveOptions options = probe_options();
+    options.walk_redirects = true;
+    options.redirect_cache = &RedirectCache::shared();
+    options.keep_body = false;
+    options.debug_events = false;
+    options.tls_info = false;
+    options.certinfo = false;
+
+    p.out << "Performing request to: " << p.url << "\n";
+    DiveResult result = dive(p.url, options);
+    p.new_connections = result.new_connections;
+    print_redirects(result, p.out);
+    if (!result.ok()) p.err << "\ncurl_easy_perform() failed: " << result.error() << "\n";
+    p.out << "\nRequest complete.\n";
+    return 0;
+}
+
+// curl's events as pseudo packets. Capturing real segments is left to the
+// packets tool: a reused connection has no handshake to capture.
+static int probe_packets(Probe& p) {
+    DiveOptions options = probe_options();
+    options.keep_body = false;
+    options.tls_info = false;
+    options.certinfo = false;
+
+    p.out << "Performing HTTPS request to: " << p.url << "\n";
+    DiveTransfer transfer(p.url, options);
+    const DiveResult& result = transfer.result;
+    if (!result.resolved) {
+        p.err << "Failed to resolve host: " << result.host << "\n";
+        return 1;
+    }
+    p.out << "Resolved " << result.host << " to " << dive_connect_address(result) << "\n";
+    transfer.perform();
+    p.new_connections = result.new_connections;
+    print_packets(result, p.out);
+    if (!result.ok()) p.out << "curl_easy_perform() failed: " << result.error() << "\n";
+    p.out << "Request complete.\n";
+    return 0;
+}
+
+// Every view from one fetch, printed by print_dive exactly as dive prints it
+static int probe_dive(Probe& p) {
+    DiveOptions options = probe_options();
+    DiveResult result = dive(p.url, options);
+    p.new_connections = result.new_connections;
+    print_dive(result, options.happy_eyeballs.delay_ms, p.out);
+    return 0;
+}
+
+struct ProbeHandler {
+    const char* tool;
+    int (*run)(Probe&);
+};
+
+static const ProbeHandler kHandlers[] = {
+    {"dns", probe_dns},         {"tls", probe_tls},           {"header", probe_header},
+    {"cookies", probe_cookies}, {"html_body", probe_body},    {"redirect", probe_redirect},
+    {"packets", probe_packets}, {"dive", probe_dive},
+};
+
+// Clients being served; shutdown waits for them
+static std::mutex g_clients_mutex;
+static std::condition_variable g_clients_done;
+static int g_clients = 0;
+
+static bool read_request(int fd, std::string& line) {
+    char buf[1024];
+    while (line.size() < kDaemonMaxRequest) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        line.append(buf, size_t(n));
+        size_t newline = line.find('\n');
+        if (newline != std::string::npos) {
+            line.resize(newline);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void serve_client(int fd) {
+    std::string line, tool, url;
+    int status = 1;
+    {
+        FrameStreambuf out_buf(fd, DAEMON_FRAME_OUTPUT);
+        FrameStreambuf err_buf(fd, DAEMON_FRAME_ERROR);
+        std::ostream out(&out_buf);
+        std::ostream err(&err_buf);
+
+        const ProbeHandler* handler = nullptr;
+        if (read_request(fd, line) && daemon_parse_request(line, tool, url)) {
+            for (const ProbeHandler& h : kHandlers) {
+                if (tool == h.tool) handler = &h;
+            }
+        }
+
+        if (!handler) {
+            err << "[Daemon] bad request: " << line.substr(0, 200) << "\n";
+        } else {
+            Probe probe{url, out, err};
+            auto start = std::chrono::steady_clock::now();
+            status = handler->run(probe);
+            out.flush();
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            char summary[160];
+            snprintf(summary, sizeof(summary), "[Daemon] %s in %.2f ms%s\n", tool.c_str(), ms,
+                     probe.new_connections < 0  ? ""
+                     : probe.new_connections ? ", new connection"
+                                             : ", reused connection");
+            err << summary;
+        }
+        out.flush();
+        err.flush();
+    }
+
+    int32_t code = status;
+    daemon_write_frame(fd, DAEMON_FRAME_EXIT, &code, sizeof(code));
+    close(fd);
+
+    std::lock_guard<std::mutex> lock(g_clients_mutex);
+    if (--g_clients == 0) g_clients_done.notify_all();
+}
+
+// Bind the socket, replacing a stale one left by a daemon that died. Fails
+// when another daemon is still answering on it.
+static int listen_on(const std::string& path) {
+    sockaddr_un addr;
+    if (!daemon_socket_address(path, addr)) {
+        std::cerr << "Socket path too long: " << path << "\n";
+        return -1;
+    }
+    int probe = daemon_connect(path);
+    if (probe >= 0) {
+        close(probe);
+        std::cerr << "A daemon is already listening on " << path << "\n";
+        return -1;
+    }
+    unlink(path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    // Only this user may connect
+    mode_t old_mask = umask(077);
+    int bound = bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    umask(old_mask);
+    if (bound != 0 || listen(fd, 64) != 0) {
+        std::cerr << "Failed to listen on " << path << ": " << strerror(errno) << "\n";
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char* argv[]) {
+    std::string path = daemon_socket_path();
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--socket" && i + 1 < argc) {
+            path = argv[++i];
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--socket <path>]\n";
+            return 1;
+        }
+    }
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    // Before any handle is attached
+    TlsSessionCache::shared().share_connections();
+
+    int listen_fd = listen_on(path);
+    if (listen_fd < 0) return 1;
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+    std::cerr << "[Daemon] listening on " << path << "\n";
+
+    unsigned long served = 0;
+    while (!g_stop) {
+        pollfd pfd = {listen_fd, POLLIN, 0};
+        if (poll(&pfd, 1, 500) <= 0) continue;
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) continue;
+        {
+            std::lock_guard<std::mutex> lock(g_clients_mutex);
+            g_clients++;
+        }
+        served++;
+        std::thread(serve_client, fd).detach();
+    }
+
+    close(listen_fd);
+    unlink(path.c_str());
+    {
+        std::unique_lock<std::mutex> lock(g_clients_mutex);
+        g_clients_done.wait(lock, [] { return g_clients == 0; });
+    }
+
+    std::cerr << "[Daemon] " << served << " probes served\n";
+    print_dns_cache_stats();
+    save_tls_session_cache();
+    save_redirect_cache();
+    return 0;
+}